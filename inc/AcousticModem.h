@@ -0,0 +1,296 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef ACOUSTIC_MODEM_H
+#define ACOUSTIC_MODEM_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "CodalFiber.h"
+#include "DataStream.h"
+#include "ManagedBuffer.h"
+
+//
+// Number of symbols transmitted per second. Each symbol carries four bits.
+//
+#ifndef CONFIG_ACOUSTIC_MODEM_SYMBOL_RATE
+#define CONFIG_ACOUSTIC_MODEM_SYMBOL_RATE           100
+#endif
+
+//
+// Frequency of the lowest tone, and the spacing between each of the 16 tones, in Hz.
+// The spacing must be at least twice the symbol rate for the tones to remain distinguishable.
+//
+#ifndef CONFIG_ACOUSTIC_MODEM_BASE_FREQUENCY
+#define CONFIG_ACOUSTIC_MODEM_BASE_FREQUENCY        1600
+#endif
+
+#ifndef CONFIG_ACOUSTIC_MODEM_TONE_SPACING
+#define CONFIG_ACOUSTIC_MODEM_TONE_SPACING          200
+#endif
+
+//
+// Number of alternating symbols sent ahead of each frame, to allow the receiver to acquire symbol timing.
+//
+#ifndef CONFIG_ACOUSTIC_MODEM_PREAMBLE_SYMBOLS
+#define CONFIG_ACOUSTIC_MODEM_PREAMBLE_SYMBOLS      8
+#endif
+
+//
+// Maximum payload of a single frame, in bytes.
+//
+#ifndef CONFIG_ACOUSTIC_MODEM_MAX_PAYLOAD
+#define CONFIG_ACOUSTIC_MODEM_MAX_PAYLOAD           64
+#endif
+
+//
+// Number of received frames held until read by the application.
+//
+#ifndef CONFIG_ACOUSTIC_MODEM_RX_QUEUE_SIZE
+#define CONFIG_ACOUSTIC_MODEM_RX_QUEUE_SIZE         4
+#endif
+
+//
+// Default sample rates of the transmitter (the mixer output rate) and receiver (the micro:bit microphone).
+//
+#ifndef CONFIG_ACOUSTIC_MODEM_TX_SAMPLE_RATE
+#define CONFIG_ACOUSTIC_MODEM_TX_SAMPLE_RATE        44100
+#endif
+
+#ifndef CONFIG_ACOUSTIC_MODEM_RX_SAMPLE_RATE
+#define CONFIG_ACOUSTIC_MODEM_RX_SAMPLE_RATE        10989
+#endif
+
+#ifndef CONFIG_ACOUSTIC_MODEM_BUFFER_SIZE
+#define CONFIG_ACOUSTIC_MODEM_BUFFER_SIZE           512
+#endif
+
+#define ACOUSTIC_MODEM_TONES                        16
+#define ACOUSTIC_MODEM_SYNC_WORD                    0x7E19
+#define ACOUSTIC_MODEM_TIMING_PHASES                4
+
+#define DEVICE_ID_ACOUSTIC_MODEM                    3044
+
+#define ACOUSTIC_MODEM_EVT_TX_COMPLETE              1
+#define ACOUSTIC_MODEM_EVT_RX_FRAME                 2
+#define ACOUSTIC_MODEM_EVT_RX_ERROR                 3
+
+#define ACOUSTIC_MODEM_STATUS_TRANSMITTING          0x0001
+
+namespace codal
+{
+    /**
+     * Frame format. Each byte is sent as two symbols, most significant nibble first,
+     * where each symbol is one of 16 tones:
+     *
+     * +--------------------------------+
+     * |  Preamble (alternating tones   |
+     * |  0 and 15)                     |
+     * +--------------------------------+
+     * |  uint16_t sync word            |
+     * +--------------------------------+
+     * |  uint8_t length                |
+     * +--------------------------------+
+     * |  payload (length bytes)        |
+     * +--------------------------------+
+     * |  uint16_t CRC-16/CCITT of      |
+     * |  length and payload            |
+     * +--------------------------------+
+     */
+
+    /**
+     * Class definition for AcousticModemTransmitter.
+     *
+     * A DataSource generating phase continuous multi-tone FSK, intended to be added as a channel of the Mixer2
+     * used by MicroBitAudio, e.g. uBit.audio.mixer.addChannel(transmitter, CONFIG_ACOUSTIC_MODEM_TX_SAMPLE_RATE)
+     */
+    class AcousticModemTransmitter : public DataSource, public CodalComponent
+    {
+        private:
+        DataSink        *downStream;                // Our downstream component.
+        FiberLock       lock;                       // Blocks callers of send() while a frame is in progress.
+        ManagedBuffer   frame;                      // The frame being transmitted, from the sync word onward.
+        int             symbol;                     // Index of the symbol being transmitted.
+        int             symbolCount;                // Total number of symbols in the current transmission.
+        int             sampleRate;                 // The sample rate of our output.
+        int             symbolCountdown;            // Samples until the next symbol is due (Q8).
+        int             rampPosition;               // Position within the start or end of transmission envelope.
+        float           amplitude;                  // Peak amplitude of the output, in sample units.
+        float           c, s;                       // Oscillator state.
+        float           cr, sr;                     // Oscillator rotation for the current tone.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param sampleRate The sample rate to generate, in Hz.
+         * @param id The ID of this component, used for events.
+         */
+        AcousticModemTransmitter(int sampleRate = CONFIG_ACOUSTIC_MODEM_TX_SAMPLE_RATE, uint16_t id = DEVICE_ID_ACOUSTIC_MODEM);
+
+        /**
+         * Transmits the given data as a single frame.
+         * If a frame is already being transmitted, the calling fiber is blocked until it is complete.
+         *
+         * @param data The payload to send, of up to CONFIG_ACOUSTIC_MODEM_MAX_PAYLOAD bytes.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int send(ManagedBuffer data);
+
+        /**
+         * Determines if a frame is being transmitted.
+         * @return true if transmitting, false otherwise.
+         */
+        bool isTransmitting();
+
+        /**
+         * Defines the output level.
+         *
+         * @param volume The output level, in the range 0..1023.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setVolume(int volume);
+
+        /**
+         * Provide the next available ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Define a downstream component for data stream.
+         *
+         * @sink The component that data will be delivered to, when it is availiable
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        private:
+
+        /**
+         * Determines the tone of the given symbol of the current transmission.
+         */
+        int getTone(int index);
+    };
+
+    /**
+     * Class definition for AcousticModemReceiver.
+     *
+     * A DataSink demodulating frames sent by an AcousticModemTransmitter, typically from the microphone.
+     *
+     * Tone energies are measured by Goertzel filters over one symbol period. Four banks of filters run in parallel,
+     * staggered by a quarter of a symbol, so that the bank best aligned with the incoming symbols can be selected
+     * when the sync word is seen. Received frames are queued, and an ACOUSTIC_MODEM_EVT_RX_FRAME event raised.
+     */
+    class AcousticModemReceiver : public DataSink, public CodalComponent
+    {
+        private:
+        DataSource      &upstream;                                                          // Our upstream component.
+
+        float           coefficient[ACOUSTIC_MODEM_TONES];                                  // Goertzel coefficients, 2.cos(w).
+        float           s1[ACOUSTIC_MODEM_TIMING_PHASES][ACOUSTIC_MODEM_TONES];             // Goertzel state.
+        float           s2[ACOUSTIC_MODEM_TIMING_PHASES][ACOUSTIC_MODEM_TONES];             // Goertzel state.
+        int             remaining[ACOUSTIC_MODEM_TIMING_PHASES];                            // Samples remaining in each bank's current window.
+        int             countdown[ACOUSTIC_MODEM_TIMING_PHASES];                            // Samples until each bank starts its next window (Q8).
+        uint32_t        history[ACOUSTIC_MODEM_TIMING_PHASES];                              // The most recent symbols seen by each bank.
+        float           quality[ACOUSTIC_MODEM_TIMING_PHASES];                              // Recent symbol clarity of each bank.
+        int             windowLength;                                                       // Length of the Goertzel window, in samples.
+        int             symbolPeriod;                                                       // Length of a symbol, in samples (Q8).
+
+        int             state;                                                              // The state of the frame decoder.
+        int             bank;                                                               // The bank in use, once synchronised.
+        int             syncCountdown;                                                      // Number of banks left to compare, while synchronising.
+        int             nibbles;                                                            // Number of nibbles received in the current frame.
+        uint8_t         frame[CONFIG_ACOUSTIC_MODEM_MAX_PAYLOAD + 3];                       // The frame being received, from the length byte onward.
+
+        ManagedBuffer   queue[CONFIG_ACOUSTIC_MODEM_RX_QUEUE_SIZE];                         // Received frames.
+        int             queueHead;                                                          // Index of the oldest frame in the queue.
+        int             queueLength;                                                        // Number of frames in the queue.
+        uint32_t        errors;                                                             // Number of frames discarded due to a bad CRC or full queue.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The DataSource to receive audio from.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param id The ID of this component, used for events.
+         */
+        AcousticModemReceiver(DataSource &source, int sampleRate = CONFIG_ACOUSTIC_MODEM_RX_SAMPLE_RATE, uint16_t id = DEVICE_ID_ACOUSTIC_MODEM);
+
+        /**
+         * Destructor.
+         */
+        ~AcousticModemReceiver();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Retrieves the oldest frame received.
+         * @return the payload of the frame, or an empty buffer if none is available.
+         */
+        ManagedBuffer recv();
+
+        /**
+         * Determines the number of frames waiting to be read by recv().
+         * @return the number of frames available.
+         */
+        int available();
+
+        /**
+         * Determines the number of frames lost due to corruption or a full receive queue.
+         * @return the number of frames lost.
+         */
+        uint32_t getErrorCount();
+
+        private:
+
+        /**
+         * Processes the result of a completed Goertzel window.
+         * @param b The bank that completed.
+         */
+        void processWindow(int b);
+
+        /**
+         * Processes a symbol of a synchronised frame.
+         * @param nibble The symbol received.
+         */
+        void processSymbol(int nibble);
+
+        /**
+         * Abandons the current frame, and returns to searching for a sync word.
+         */
+        void reset();
+    };
+}
+
+#endif
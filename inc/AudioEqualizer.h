@@ -0,0 +1,177 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef AUDIO_EQUALIZER_H
+#define AUDIO_EQUALIZER_H
+
+#include "CodalConfig.h"
+#include "DataStream.h"
+#include "BiquadFilter.h"
+
+//
+// Maximum number of cascaded filter sections in an AudioEqualizer.
+//
+#ifndef CONFIG_AUDIO_EQUALIZER_SECTIONS
+#define CONFIG_AUDIO_EQUALIZER_SECTIONS             4
+#endif
+
+#ifndef CONFIG_AUDIO_EQUALIZER_DEFAULT_SAMPLE_RATE
+#define CONFIG_AUDIO_EQUALIZER_DEFAULT_SAMPLE_RATE  44100
+#endif
+
+#ifndef CONFIG_AUDIO_EQUALIZER_DEFAULT_RANGE
+#define CONFIG_AUDIO_EQUALIZER_DEFAULT_RANGE        1023
+#endif
+
+namespace codal
+{
+    enum class AudioFilterType
+    {
+        None = 0,                                   // Section is bypassed.
+        LowPass = 1,
+        HighPass = 2,
+        LowShelf = 3,
+        HighShelf = 4,
+        Peaking = 5
+    };
+
+    /**
+     * Class definition for AudioEqualizer.
+     *
+     * A DataStream stage applying a cascade of fixed point biquad filters to the audio passing through it,
+     * e.g. between the Mixer2 and NRF52PWM of MicroBitAudio, to provide a low cut for the on board speaker,
+     * an anti-alias filter ahead of the PWM, or tone control. Stages may also be chained.
+     *
+     * Sections are processed in Direct Form I, where the filter state holds only past input and output samples.
+     * Coefficients may therefore be updated while audio is playing without audible glitches. Updates are applied
+     * atomically, between buffers. Bypassed sections cost nothing, and buffers are passed through untouched if
+     * all sections are bypassed.
+     */
+    class AudioEqualizer : public DataSink, public DataSource
+    {
+        private:
+        DataSource          &upstream;                                  // Our upstream component.
+        DataSink            *downStream;                                // Our downstream component.
+        BiquadFilter        section[CONFIG_AUDIO_EQUALIZER_SECTIONS];   // Filter sections.
+        AudioFilterType     type[CONFIG_AUDIO_EQUALIZER_SECTIONS];      // Type of each filter section.
+        float               sampleRate;                                 // Sample rate of the stream, in Hz.
+        int                 sampleRange;                                // Number of quantization levels in the stream.
+        int                 shift;                                      // Scaling applied to samples while filtering, to retain precision.
+        uint32_t            orMask;                                     // Bits set on every output sample, and ignored on input.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The DataSource to receive audio from.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param sampleRange The number of quantization levels in the given source (i.e. its maximum value for unsigned data).
+         */
+        AudioEqualizer(DataSource &source, float sampleRate = CONFIG_AUDIO_EQUALIZER_DEFAULT_SAMPLE_RATE, int sampleRange = CONFIG_AUDIO_EQUALIZER_DEFAULT_RANGE);
+
+        /**
+         * Destructor.
+         */
+        ~AudioEqualizer();
+
+        /**
+         * Configures one of the filter sections of this equalizer.
+         *
+         * @param index The section to configure, in the range 0..CONFIG_AUDIO_EQUALIZER_SECTIONS-1.
+         * @param type The type of filter to apply, or AudioFilterType::None to bypass the section.
+         * @param frequency The cutoff, centre or shelf midpoint frequency of the filter, in Hz.
+         * @param q The quality factor of the filter. 0.7071 gives a maximally flat response for all but peaking filters.
+         * @param gain The gain of a shelving or peaking filter, in dB. Unused for other types.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setFilter(int index, AudioFilterType type, float frequency = 0.0f, float q = 0.7071f, float gain = 0.0f);
+
+        /**
+         * Bypasses all filter sections.
+         */
+        void clear();
+
+        /**
+         * Defines the sample rate of the stream. Existing filters must be reconfigured after a change in sample rate.
+         *
+         * @param sampleRate The sample rate of the stream, in Hz.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setSampleRate(float sampleRate);
+
+        /**
+         * Defines the range of the stream.
+         *
+         * @param sampleRange The number of quantization levels in the stream.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setSampleRange(int sampleRange);
+
+        /**
+         * Defines bits that are set on every output sample, and ignored in every input sample
+         * (e.g. the polarity bit used by NRF52PWM).
+         *
+         * @param mask The bits to set.
+         * @return DEVICE_OK on success.
+         */
+        int setOrMask(uint32_t mask);
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Provide the next available ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Define a downstream component for data stream.
+         *
+         * @sink The component that data will be delivered to, when it is availiable
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Disconnect the downstream component.
+         */
+        virtual void disconnect();
+
+        /**
+         * Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        /**
+         * Defines the data format of the buffers streamed out of this component.
+         * @param format the format to use.
+         */
+        virtual int setFormat(int format);
+    };
+}
+
+#endif
@@ -0,0 +1,199 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef CODAL_BIQUAD_FILTER_H
+#define CODAL_BIQUAD_FILTER_H
+
+#include "CodalConfig.h"
+
+//
+// Number of fractional bits used to represent filter coefficients.
+// Q29 provides a coefficient range of +/-4.0, which is sufficient for any stable second order section,
+// while retaining enough precision to place poles very close to the unit circle (e.g. sub 30Hz filters at 11kHz).
+//
+#define BIQUAD_COEFFICIENT_SHIFT        29
+#define BIQUAD_COEFFICIENT_ONE          (1 << BIQUAD_COEFFICIENT_SHIFT)
+
+namespace codal
+{
+    /**
+     * A single fixed point, second order IIR filter section (biquad), implemented in Direct Form I.
+     *
+     * Coefficients are designed in floating point, but all sample processing is performed in integer
+     * arithmetic using a 64 bit accumulator, such that a cascade of sections can run continuously on
+     * audio data without the cost of floating point operations per sample.
+     */
+    class BiquadFilter
+    {
+        public:
+        int32_t     b0, b1, b2;         // Feed forward coefficients (Q29)
+        int32_t     a1, a2;             // Feedback coefficients (Q29), normalised such that a0 == 1.0
+        int32_t     x1, x2;             // Previous two input samples.
+        int32_t     y1, y2;             // Previous two output samples.
+
+        /**
+         * Constructor.
+         * Creates a filter that passes all data unmodified.
+         */
+        BiquadFilter();
+
+        /**
+         * Clears the history of this filter, without modifying its coefficients.
+         */
+        void reset();
+
+        /**
+         * Defines the coefficients of this filter from the given transfer function:
+         *
+         *          b0 + b1.z^-1 + b2.z^-2
+         * H(z) =  ------------------------
+         *          a0 + a1.z^-1 + a2.z^-2
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the coefficients cannot be represented.
+         */
+        int setCoefficients(float b0, float b1, float b2, float a0, float a1, float a2);
+
+        /**
+         * Defines the coefficients of this filter from an analog (s-domain) second order prototype,
+         * using the bilinear transform:
+         *
+         *          b0.s^2 + b1.s + b2
+         * H(s) =  --------------------
+         *          a0.s^2 + a1.s + a2
+         *
+         * @param sampleRate The sample rate the filter will operate at, in Hz.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the coefficients cannot be represented.
+         */
+        int setAnalogCoefficients(float sampleRate, float b0, float b1, float b2, float a0, float a1, float a2);
+
+        /**
+         * Configures this filter as a second order low pass filter.
+         *
+         * @param sampleRate The sample rate the filter will operate at, in Hz.
+         * @param frequency The cutoff frequency, in Hz.
+         * @param q The quality factor of the filter (0.7071 gives a Butterworth response).
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setLowPass(float sampleRate, float frequency, float q);
+
+        /**
+         * Configures this filter as a second order high pass filter.
+         *
+         * @param sampleRate The sample rate the filter will operate at, in Hz.
+         * @param frequency The cutoff frequency, in Hz.
+         * @param q The quality factor of the filter (0.7071 gives a Butterworth response).
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setHighPass(float sampleRate, float frequency, float q);
+
+        /**
+         * Configures this filter as a peaking equalizer, boosting or cutting a band around the given frequency.
+         *
+         * @param sampleRate The sample rate the filter will operate at, in Hz.
+         * @param frequency The centre frequency, in Hz.
+         * @param q The quality factor of the filter (centre frequency / bandwidth).
+         * @param gain The gain at the centre frequency, in dB.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setPeaking(float sampleRate, float frequency, float q, float gain);
+
+        /**
+         * Configures this filter as a low shelf, boosting or cutting all frequencies below the given frequency.
+         *
+         * @param sampleRate The sample rate the filter will operate at, in Hz.
+         * @param frequency The shelf midpoint frequency, in Hz.
+         * @param q The quality factor of the filter (0.7071 gives the steepest slope without overshoot).
+         * @param gain The gain of the shelf, in dB.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setLowShelf(float sampleRate, float frequency, float q, float gain);
+
+        /**
+         * Configures this filter as a high shelf, boosting or cutting all frequencies above the given frequency.
+         *
+         * @param sampleRate The sample rate the filter will operate at, in Hz.
+         * @param frequency The shelf midpoint frequency, in Hz.
+         * @param q The quality factor of the filter (0.7071 gives the steepest slope without overshoot).
+         * @param gain The gain of the shelf, in dB.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setHighShelf(float sampleRate, float frequency, float q, float gain);
+
+        /**
+         * Configures this filter as a second order band pass filter, with a peak gain of 0dB.
+         *
+         * @param sampleRate The sample rate the filter will operate at, in Hz.
+         * @param frequency The centre frequency, in Hz.
+         * @param q The quality factor of the filter (centre frequency / bandwidth).
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setBandPass(float sampleRate, float frequency, float q);
+
+        /**
+         * Scales the feed forward coefficients of this filter, adjusting its overall gain.
+         *
+         * @param gain The linear gain to apply.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the result cannot be represented.
+         */
+        int scale(float gain);
+
+        /**
+         * Determines the magnitude of the response of this filter at the given frequency.
+         *
+         * @param sampleRate The sample rate the filter operates at, in Hz.
+         * @param frequency The frequency of interest, in Hz.
+         * @return the linear gain of the filter at the given frequency.
+         */
+        float getGain(float sampleRate, float frequency);
+
+        /**
+         * Filters a single sample.
+         *
+         * @param x The next input sample. Values should be limited to 24 bits to guarantee no overflow.
+         * @return The next output sample.
+         */
+        inline int32_t process(int32_t x)
+        {
+            int64_t acc = (int64_t) b0 * x + (int64_t) b1 * x1 + (int64_t) b2 * x2 - (int64_t) a1 * y1 - (int64_t) a2 * y2;
+            int32_t y = (int32_t) ((acc + (1 << (BIQUAD_COEFFICIENT_SHIFT - 1))) >> BIQUAD_COEFFICIENT_SHIFT);
+
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+
+            return y;
+        }
+
+        /**
+         * Filters a block of samples in place.
+         *
+         * @param data The samples to process.
+         * @param len The number of samples in the block.
+         */
+        void process(int32_t *data, int len);
+    };
+}
+
+#endif
@@ -25,10 +25,26 @@ DEALINGS IN THE SOFTWARE.
 #include "CodalCompat.h"
 
 #define FSCACHE_FLAG_PINNED				0x01
+#define FSCACHE_FLAG_DIRTY				0x02
+#define FSCACHE_FLAG_VALID				0x04
 
 #define CODAL_FS_CACHE_VALIDATE			1
 #define CODAL_FS_DEFAULT_CACHE_SZE		4
 
+// The number of entries in each set of the cache. A block may only be held in the set selected by its address,
+// so lookups and replacement examine only this many entries. If the cache size is not a multiple of this,
+// the cache is fully associative.
+#ifndef CODAL_FS_CACHE_WAYS
+#define CODAL_FS_CACHE_WAYS				2
+#endif
+
+// The maximum number of blocks read ahead, in the same operation, when a miss follows on from the previous one.
+// At most one block is read into each set, replacing its least recently used block, and only while that is no more
+// recent than the block replaced by the miss. Zero disables read ahead.
+#ifndef CODAL_FS_CACHE_READ_AHEAD
+#define CODAL_FS_CACHE_READ_AHEAD		1
+#endif
+
 namespace codal
 {
 	struct CacheEntry
@@ -36,6 +52,8 @@ namespace codal
 		uint32_t address;
 		uint16_t lastUsed;
 		uint16_t flags;
+		uint16_t dirtyStart;
+		uint16_t dirtyEnd;
 		uint8_t  *page;
 	};
 
@@ -44,31 +62,98 @@ namespace codal
 		private:
 			NVMController &flash;
 			CacheEntry* cache;
+			uint8_t *arena;
+			uint8_t *erased;
 			int blockSize;
 			int cacheSize;
+			int ways;
 			uint16_t operationCount;
+			uint32_t nextSequential;
+			bool writeBack;
+			bool ownsArena;
+
+			/**
+			 * Writes the modified part of the given cache entry back to FLASH, if it has one.
+			 * @param c the cache entry to write back.
+			 * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the data could not be written.
+			 */
+			int writeBackEntry(CacheEntry *c);
+
+			/**
+			 * Determines the first entry of the set that may hold the given block.
+			 * @param address the logical address of the block.
+			 */
+			CacheEntry *getSet(uint32_t address);
+
+			/**
+			 * Determines if the block at the given address is known to be erased.
+			 * @param address the logical address of the block.
+			 */
+			bool isErased(uint32_t address);
+
+			/**
+			 * Records whether or not the block at the given address is known to be erased.
+			 * @param address the logical address of the block.
+			 * @param state true if the block is erased, false otherwise.
+			 */
+			void setErased(uint32_t address, bool state);
 
 		public:
+			uint32_t hits;				// The number of block lookups satisfied by the cache.
+			uint32_t misses;			// The number of block lookups that were paged in from FLASH.
+			uint32_t evictions;			// The number of blocks replaced to make room for another.
+			uint32_t prefetches;		// The number of blocks read ahead of a sequential miss.
+			uint32_t bytesRead;			// The number of bytes read from FLASH.
+			uint32_t bytesWritten;		// The number of bytes written to FLASH.
+
 		  /**
 			* @param nvm non - volatile memory controller to use as backing store
 			* @param blockSize - the size of a logical block, in bytes (n.b. this may be smaller than the physical page size)
 			* @param size the maximum number of pages in the cache
+			* @param arena optional RAM to hold the cached blocks, of at least size * blockSize bytes (e.g. a statically allocated array).
+			* If NULL, this is allocated as a single block when the cache is first used.
 			*/
-			FSCache(NVMController &nvm, int blockSize, int size = CODAL_FS_DEFAULT_CACHE_SZE);
+			FSCache(NVMController &nvm, int blockSize, int size = CODAL_FS_DEFAULT_CACHE_SZE, uint8_t *arena = NULL);
+
+			/**
+			 * Determines when data written to the cache is written to FLASH.
+			 * In write through mode (the default), every write() is written to FLASH immediately.
+			 * In write back mode, writes only update the cache. Modified blocks are written to FLASH
+			 * in a single operation when they are evicted, or when flush() is called.
+			 *
+			 * @param enable true to use write back mode, false to use write through mode.
+			 */
+			void setWriteBack(bool enable);
+
+			/**
+			 * Writes any modified blocks held in the cache to FLASH.
+			 * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if any data could not be written.
+			 */
+			int flush();
 
 			/**
 			 * Clear all cache entries, and free any allocated RAM.
+			 * n.b. Any data not yet written back to FLASH is discarded. Use flush() beforehand to keep it.
 			 */
 			void clear();
 
 			/**
-			 * Erase a single page of FLASH memory at the given address
+			 * Resets the hit, miss, eviction, prefetch and byte counters to zero.
+			 */
+			void resetStatistics();
+
+			/**
+			 * Erase a single block at the given address in the cache, and record that it is erased.
+			 * The block can then be paged in without reading FLASH, until it is next written.
+			 * n.b. This should be called along with the erase of the block in FLASH.
 			 */
 			int erase(uint32_t address);
 
 			/**
 			 * Read the given area of memory into the buffer provided,
 			 * paging the data in from FLASH as needed.
+			 * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the area is out of range, or DEVICE_I2C_ERROR if no block
+			 * could be replaced to make room for the data.
 			 */
 			int read(uint32_t address, const void *data, int len);
 
@@ -76,9 +161,20 @@ namespace codal
 			* Write the given area of memory into the buffer provided,
 			* paging the data in from FLASH as needed.
 			* n.b. data doe NOT need to be word aligned.
+			* @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if the write needs an erase cycle, or DEVICE_I2C_ERROR if no block
+			* could be replaced to make room for the data.
 			*/
 			int write(uint32_t address, const void *data, int len);
 
+			/**
+			 * Updates the cache after data has been written directly to FLASH, bypassing the cache.
+			 * Any cached copies of the blocks written are brought up to date, and the blocks are no longer known to be erased.
+			 * @param address The logical address of the data written.
+			 * @param data the data written.
+			 * @param len amount of data written, in bytes.
+			 */
+			void update(uint32_t address, const void *data, int len);
+
 			/**
 			 * Pin the given page into cache space.
 			 */
@@ -98,11 +194,17 @@ namespace codal
 
 			/**
 			 * Page a given block into the cache, replacing the LRU block if necessary.
+			 * A block holding data not yet written to FLASH is kept if that data cannot be written, and another replaced instead.
 			 * @param address the logical address of the block to cache.
-			 * @return a pointer to the relevant cache entry.
+			 * @return a pointer to the relevant cache entry, or NULL if every block that could hold it is pinned or could not be written back.
 			 */
 			CacheEntry *cachePage(uint32_t address);
 
+			/**
+			 * Destructor. Writes any modified blocks to FLASH, and frees any allocated RAM.
+			 */
+			~FSCache();
+
 			void debug(bool verbose = true);
 			void debug(CacheEntry *c, bool verbose = true);
 	};
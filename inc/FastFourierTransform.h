@@ -0,0 +1,113 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef FAST_FOURIER_TRANSFORM_H
+#define FAST_FOURIER_TRANSFORM_H
+
+#include "CodalConfig.h"
+
+//
+// The largest transform supported, in points. Must be a power of two, no larger than 4096.
+// A single table of twiddle factors for this size is held in static RAM and shared by all transforms, costing
+// 4 bytes per point.
+//
+#ifndef CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE
+#define CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE      256
+#endif
+
+namespace codal
+{
+    /**
+     * Class definition for FastFourierTransform.
+     *
+     * A small, allocation free radix-2 FFT engine, shared by the audio and motion analysis components.
+     * Twiddle factors are computed once, into a static table sized by CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE
+     * that transforms of every smaller size index with a stride. Each transform then costs only the
+     * butterflies themselves, and its memory use is fixed at compile time.
+     *
+     * Data is held as separate real and imaginary float arrays, processed in place.
+     * The nRF52833 has a single precision FPU, so this is considerably faster and simpler than an equivalent
+     * fixed point implementation with the necessary per-stage scaling.
+     */
+    class FastFourierTransform
+    {
+        private:
+        int             size;               // Number of points in the transform. Always a power of two, or zero if invalid.
+        int             stride;             // Distance between successive twiddle factors of this size in the shared table.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param size The number of points in the transform. Must be a power of two, between 4 and CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE.
+         */
+        FastFourierTransform(int size);
+
+        /**
+         * Determines the number of points in this transform.
+         * @return the size of the transform.
+         */
+        int getSize()
+        {
+            return size;
+        }
+
+        /**
+         * Determines if this transform was successfully created.
+         * @return true if the given size was valid, false otherwise.
+         */
+        bool isValid()
+        {
+            return size != 0;
+        }
+
+        /**
+         * Applies a Hann window to the given block of samples, in place.
+         *
+         * @param data An array of getSize() samples.
+         */
+        void window(float *data);
+
+        /**
+         * Performs a forward transform of the given complex data, in place.
+         * The output is not normalised.
+         *
+         * @param re An array of getSize() real components.
+         * @param im An array of getSize() imaginary components.
+         */
+        void transform(float *re, float *im);
+
+        /**
+         * Performs a forward transform of the given real data, and computes the power spectrum.
+         * On return, re[k] holds |X(k)|^2 for k in [0, getSize()/2]. The content of im is undefined.
+         *
+         * @param re An array of getSize() real samples.
+         * @param im An array of getSize() floats, used as working memory.
+         */
+        void powerSpectrum(float *re, float *im);
+    };
+}
+
+#endif
@@ -0,0 +1,246 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MFCC_EXTRACTOR_H
+#define MFCC_EXTRACTOR_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "FastFourierTransform.h"
+
+//
+// Number of samples in each analysis frame. Must be a power of two.
+// At the microphone's sample rate, the default of 256 samples spans 23ms.
+//
+#ifndef CONFIG_MFCC_FFT_SIZE
+#define CONFIG_MFCC_FFT_SIZE                        256
+#endif
+
+#if (CONFIG_MFCC_FFT_SIZE > CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE)
+#error "CONFIG_MFCC_FFT_SIZE is larger than CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE"
+#endif
+
+//
+// Number of samples between successive feature vectors.
+//
+#ifndef CONFIG_MFCC_HOP_SIZE
+#define CONFIG_MFCC_HOP_SIZE                        128
+#endif
+
+//
+// Number of input samples held for analysis. Must be a power of two, and larger than the FFT size. Frames that arrive
+// while the fiber is busy wait here, until their samples are overwritten.
+//
+#ifndef CONFIG_MFCC_BUFFER_SIZE
+#define CONFIG_MFCC_BUFFER_SIZE                     1024
+#endif
+
+#if (CONFIG_MFCC_BUFFER_SIZE <= CONFIG_MFCC_FFT_SIZE)
+#error "CONFIG_MFCC_BUFFER_SIZE must be larger than CONFIG_MFCC_FFT_SIZE"
+#endif
+
+//
+// Sample rate of the micro:bit microphone (ADC sampling period of 91uS), used when no sample rate is given.
+//
+#ifndef CONFIG_MFCC_SAMPLE_RATE
+#define CONFIG_MFCC_SAMPLE_RATE                     10989
+#endif
+
+//
+// Number of triangular filters in the mel filterbank, and the range of frequencies they cover, in Hz.
+//
+#ifndef CONFIG_MFCC_MEL_FILTERS
+#define CONFIG_MFCC_MEL_FILTERS                     20
+#endif
+
+#ifndef CONFIG_MFCC_MIN_FREQUENCY
+#define CONFIG_MFCC_MIN_FREQUENCY                   20
+#endif
+
+#ifndef CONFIG_MFCC_MAX_FREQUENCY
+#define CONFIG_MFCC_MAX_FREQUENCY                   5000
+#endif
+
+//
+// Number of cepstral coefficients in each feature vector, including the zeroth.
+//
+#ifndef CONFIG_MFCC_COEFFICIENTS
+#define CONFIG_MFCC_COEFFICIENTS                    13
+#endif
+
+//
+// Number of recent feature vectors retained, for use as the input window of a classifier.
+//
+#ifndef CONFIG_MFCC_HISTORY
+#define CONFIG_MFCC_HISTORY                         32
+#endif
+
+//
+// Pre-emphasis filter coefficient, applied to each frame before analysis. Zero disables pre-emphasis.
+//
+#ifndef CONFIG_MFCC_PRE_EMPHASIS
+#define CONFIG_MFCC_PRE_EMPHASIS                    0.97f
+#endif
+
+//
+// Smallest mel filterbank energy before taking the logarithm, so that silence yields finite coefficients.
+//
+#ifndef CONFIG_MFCC_LOG_FLOOR
+#define CONFIG_MFCC_LOG_FLOOR                       1e-6f
+#endif
+
+#define DEVICE_ID_MFCC_EXTRACTOR                    3046
+
+#define MFCC_EXTRACTOR_EVT_FRAME                    1
+#define MFCC_EXTRACTOR_EVT_PENDING                  2
+
+#define MFCC_EXTRACTOR_STATUS_ACTIVE                0x01
+#define MFCC_EXTRACTOR_STATUS_FIBER                 0x02
+
+// Marks an FFT bin that lies outside the range of the filterbank.
+#define MFCC_EXTRACTOR_NO_FILTER                    0xFF
+
+namespace codal
+{
+    /**
+     * Class definition for MFCCExtractor.
+     *
+     * A DataSink that converts audio into mel frequency cepstral coefficients (MFCCs), the usual input features
+     * for keyword spotting and other small speech classifiers. A feature vector is produced for every
+     * CONFIG_MFCC_HOP_SIZE samples, so raw audio never needs to be stored or transmitted.
+     *
+     * Each frame is pre-emphasised, Hann windowed and transformed. Its power spectrum (normalised by the square
+     * of the frame length) is passed through a bank of triangular filters equally spaced on the HTK mel scale.
+     * The natural log of each filter's energy is then decorrelated with an orthonormal DCT-II. This is the same
+     * pipeline as common desktop feature extractors, so that models can be trained on a PC.
+     *
+     * All memory used, including the filterbank and DCT tables, is fixed at compile time.
+     *
+     * Samples are captured in the context of the upstream component, while the analysis is performed on a background
+     * fiber. Frames wait in the sample buffer until the fiber is free. If the fiber falls so far behind that the samples
+     * of a waiting frame are overwritten, that frame is dropped and counted.
+     */
+    class MFCCExtractor : public DataSink, public CodalComponent
+    {
+        private:
+        DataSource              &upstream;                                              // Our upstream component.
+        FastFourierTransform    fft;                                                    // The FFT engine.
+
+        int16_t                 samples[CONFIG_MFCC_BUFFER_SIZE];                       // The most recent input samples.
+        uint32_t                written;                                                // Number of samples received.
+        int                     countdown;                                              // Samples until the next frame is due.
+        int                     pending;                                                // Number of frames waiting to be analysed.
+        uint32_t                frameEnd;                                               // Value of written at the end of the newest waiting frame.
+        uint32_t                dropped;                                                // Number of frames dropped.
+        float                   re[CONFIG_MFCC_FFT_SIZE];                               // FFT working memory.
+        float                   im[CONFIG_MFCC_FFT_SIZE];                               // FFT working memory.
+
+        uint8_t                 filterIndex[CONFIG_MFCC_FFT_SIZE / 2 + 1];              // For each FFT bin, the filter whose rising edge it lies on.
+        float                   filterWeight[CONFIG_MFCC_FFT_SIZE / 2 + 1];             // For each FFT bin, its weight in that filter. The next lower filter receives the remainder.
+        float                   dct[CONFIG_MFCC_COEFFICIENTS][CONFIG_MFCC_MEL_FILTERS]; // Orthonormal DCT-II basis.
+
+        float                   features[CONFIG_MFCC_HISTORY][CONFIG_MFCC_COEFFICIENTS];// The most recent feature vectors.
+        int                     featureHead;                                            // Index of the next feature vector to be written.
+        uint32_t                frames;                                                 // Number of feature vectors computed.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The DataSource to receive audio from.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param id The ID of this component, used for events.
+         */
+        MFCCExtractor(DataSource &source, float sampleRate = CONFIG_MFCC_SAMPLE_RATE, uint16_t id = DEVICE_ID_MFCC_EXTRACTOR);
+
+        /**
+         * Destructor.
+         */
+        ~MFCCExtractor();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Begins computing feature vectors. A MFCC_EXTRACTOR_EVT_FRAME event is raised as each becomes available.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the FFT engine could not be created.
+         */
+        int start();
+
+        /**
+         * Stops computing feature vectors. Those already computed are retained.
+         * @return DEVICE_OK on success.
+         */
+        int stop();
+
+        /**
+         * Determines the number of feature vectors computed since this extractor was created.
+         * @return the number of frames processed.
+         */
+        uint32_t getFrameCount();
+
+        /**
+         * Copies the most recent feature vector.
+         *
+         * @param mfcc An array of CONFIG_MFCC_COEFFICIENTS floats to receive the coefficients.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if no frames have been computed.
+         */
+        int getFrame(float *mfcc);
+
+        /**
+         * Copies a window of the most recent feature vectors, oldest first, as a single array of
+         * frames * CONFIG_MFCC_COEFFICIENTS floats.
+         *
+         * @param dest The array to receive the coefficients.
+         * @param frames The number of feature vectors required, up to CONFIG_MFCC_HISTORY.
+         * @return the number of feature vectors copied, which may be fewer than requested shortly after start(),
+         * or DEVICE_INVALID_PARAMETER.
+         */
+        int getFeatures(float *dest, int frames);
+
+        /**
+         * Determines the number of frames dropped because the analysis could not keep up.
+         * @return the number of dropped frames.
+         */
+        uint32_t getDroppedCount();
+
+        private:
+
+        /**
+         * Computes the feature vector of the oldest waiting frame of samples.
+         */
+        void processFrame();
+
+        /**
+         * Background fiber, processing frames as they become ready.
+         */
+        static void frameFiber(void *param);
+    };
+}
+
+#endif
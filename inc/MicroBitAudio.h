@@ -29,6 +29,7 @@ DEALINGS IN THE SOFTWARE.
 #include "SoundEmojiSynthesizer.h"
 #include "SoundExpressions.h"
 #include "Mixer2.h"
+#include "AudioEqualizer.h"
 #include "SoundOutputPin.h"
 
 // Status Flags
@@ -44,6 +45,7 @@ namespace codal
         public:
         static MicroBitAudio    *instance;      // Primary instance of MicroBitAudio, on demand activated.
         Mixer2                  mixer;          // Multi channel audio mixer
+        AudioEqualizer          equalizer;      // Filter stage between the mixer output and the PWM
 
         private:
         bool speakerEnabled;                    // State of on board speaker
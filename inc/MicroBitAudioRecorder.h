@@ -0,0 +1,284 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_AUDIO_RECORDER_H
+#define MICROBIT_AUDIO_RECORDER_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "NVMController.h"
+#include "MicroBitFile.h"
+
+//
+// Size of each of the two RAM buffers used to stage data before it is written to storage, in bytes.
+// Must be a multiple of 4. Each buffer is written as a single, independently decodable block.
+//
+#ifndef CONFIG_AUDIO_RECORDER_BLOCK_SIZE
+#define CONFIG_AUDIO_RECORDER_BLOCK_SIZE            1024
+#endif
+
+//
+// Maximum number of upstream buffers held in RAM for pre-trigger capture.
+//
+#ifndef CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS
+#define CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS 8
+#endif
+
+//
+// Sample rate of the micro:bit microphone (ADC sampling period of 91uS), used when no sample rate is given.
+//
+#ifndef CONFIG_AUDIO_RECORDER_SAMPLE_RATE
+#define CONFIG_AUDIO_RECORDER_SAMPLE_RATE           10989
+#endif
+
+#define DEVICE_ID_AUDIO_RECORDER                    3042
+
+#define MICROBIT_AUDIO_RECORDER_EVT_DATA            1
+#define MICROBIT_AUDIO_RECORDER_EVT_FULL            2
+#define MICROBIT_AUDIO_RECORDER_EVT_STOPPED         3
+
+#define MICROBIT_AUDIO_RECORDER_STATUS_ARMED        0x0001
+#define MICROBIT_AUDIO_RECORDER_STATUS_RECORDING    0x0002
+#define MICROBIT_AUDIO_RECORDER_STATUS_STALLED      0x0004
+#define MICROBIT_AUDIO_RECORDER_STATUS_WRITER       0x0008
+#define MICROBIT_AUDIO_RECORDER_STATUS_FULL         0x0010
+#define MICROBIT_AUDIO_RECORDER_STATUS_REPLAY       0x0020
+
+#define MICROBIT_AUDIO_RECORDER_MAGIC               "UBAR"
+
+namespace codal
+{
+    /**
+     * Encoding used for recorded audio.
+     */
+    enum class AudioRecorderFormat
+    {
+        PCM16 = 1,                                  // Signed 16 bit little endian samples.
+        ADPCM = 2                                   // IMA ADPCM, 4 bits per sample.
+    };
+
+    /**
+     * Header written at the start of every recording.
+     * The length and dropped fields are left erased (0xFFFFFFFF) until the recording is stopped.
+     */
+    struct AudioRecordingHeader
+    {
+        char        magic[4];                       // MICROBIT_AUDIO_RECORDER_MAGIC
+        uint16_t    format;                         // AudioRecorderFormat of the data that follows.
+        uint16_t    blockSize;                      // Size of each block of audio data, in bytes.
+        uint32_t    sampleRate;                     // Sample rate of the recording, in Hz.
+        uint32_t    length;                         // Total length of the audio data that follows, in bytes.
+        uint32_t    dropped;                        // Number of upstream buffers lost because storage could not keep up.
+    };
+
+    /**
+     * Class definition for MicroBitAudioRecorder.
+     *
+     * A DataSink that streams audio into a MicroBitFileSystem file or a raw region of non-volatile memory.
+     *
+     * Incoming samples are encoded into one of two RAM blocks from the context of the upstream component.
+     * Completed blocks are written by a background fiber, such that page erase and write latency never stalls
+     * the audio source. If storage falls behind by more than a block, incoming buffers are discarded and counted.
+     * Pre-trigger audio retained by arm() is encoded by the same fiber when recording begins, writing out each block as
+     * it completes. Buffers arriving meanwhile are queued behind it in the (then empty) pre-trigger ring.
+     *
+     * In ADPCM format, every block starts with its own predictor state, so each can be decoded independently:
+     *
+     * +---------------------------+
+     * |  int16_t predictor        |
+     * |  uint8_t step index       |
+     * |  uint8_t reserved         |
+     * +---------------------------+
+     * |  4 bit samples, low       |
+     * |  nibble first             |
+     * +---------------------------+
+     */
+    class MicroBitAudioRecorder : public DataSink, public CodalComponent
+    {
+        private:
+        DataSource              &upstream;                                                  // Our upstream component.
+        NVMController           *nvm;                                                       // Raw storage to write to, if in use.
+        uint32_t                regionStart;                                                // Start address of the raw storage region.
+        uint32_t                regionEnd;                                                  // End address of the raw storage region.
+        uint32_t                address;                                                    // Next address to write within the raw storage region.
+        ManagedString           fileName;                                                   // Name of the file to write to, if in use.
+        MicroBitFile            *file;                                                      // The file currently being written.
+
+        AudioRecorderFormat     format;                                                     // The encoding in use.
+        int                     sampleRate;                                                 // The sample rate of the input stream.
+        uint8_t                 *block[2];                                                  // Double buffered blocks.
+        int                     length[2];                                                  // Number of bytes used in each block.
+        int                     filling;                                                    // Index of the block being filled.
+        int                     writing;                                                    // Index of the block being written, or -1 if idle.
+        uint32_t                bytesWritten;                                               // Number of audio bytes written in this recording.
+        uint32_t                dropped;                                                    // Number of upstream buffers dropped in this recording.
+
+        int16_t                 predictor;                                                  // ADPCM encoder state.
+        int                     stepIndex;                                                  // ADPCM encoder state.
+        bool                    highNibble;                                                 // True if the next ADPCM sample is stored in the high nibble.
+
+        ManagedBuffer           preTrigger[CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS];   // Ring of the most recent upstream buffers.
+        int                     preTriggerHead;                                             // Index of the oldest buffer in the ring.
+        int                     preTriggerCount;                                            // Number of buffers in the ring.
+        int                     preTriggerSamples;                                          // Number of samples of pre-trigger audio requested.
+        ManagedBuffer           replay[CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS];       // Pre-trigger audio yet to be encoded by the writer.
+        int                     replayCount;                                                // Number of buffers in replay.
+
+        public:
+
+        /**
+         * Constructor.
+         * Creates a recorder that writes to a raw region of non-volatile memory.
+         *
+         * @param source The DataSource to receive audio from.
+         * @param nvm The non-volatile memory controller to write to.
+         * @param start The logical address of the start of the region to use. Must be page aligned.
+         * @param length The size of the region, in bytes.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param id The ID of this component, used for events.
+         */
+        MicroBitAudioRecorder(DataSource &source, NVMController &nvm, uint32_t start, uint32_t length, int sampleRate = CONFIG_AUDIO_RECORDER_SAMPLE_RATE, uint16_t id = DEVICE_ID_AUDIO_RECORDER);
+
+        /**
+         * Constructor.
+         * Creates a recorder that writes to a file in the default MicroBitFileSystem.
+         *
+         * @param source The DataSource to receive audio from.
+         * @param fileName The name of the file to record into. Any existing file is replaced.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param id The ID of this component, used for events.
+         */
+        MicroBitAudioRecorder(DataSource &source, ManagedString fileName, int sampleRate = CONFIG_AUDIO_RECORDER_SAMPLE_RATE, uint16_t id = DEVICE_ID_AUDIO_RECORDER);
+
+        /**
+         * Destructor.
+         */
+        ~MicroBitAudioRecorder();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Defines the encoding used for subsequent recordings.
+         *
+         * @param format AudioRecorderFormat::PCM16 or AudioRecorderFormat::ADPCM.
+         * @return DEVICE_OK on success, or DEVICE_BUSY if a recording is in progress.
+         */
+        int setFormat(AudioRecorderFormat format);
+
+        /**
+         * Defines how much audio preceding a call to record() is captured, and begins retaining it.
+         *
+         * @param milliseconds The length of pre-trigger audio to retain. Limited by CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int arm(int milliseconds);
+
+        /**
+         * Begins a new recording, starting with any pre-trigger audio retained by arm().
+         *
+         * @return DEVICE_OK on success, DEVICE_BUSY if a recording is already in progress, or DEVICE_NO_RESOURCES.
+         */
+        int record();
+
+        /**
+         * Stops the current recording, writes any buffered audio to storage and finalises the recording header.
+         * Blocks the calling fiber until complete.
+         *
+         * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if no recording is in progress.
+         */
+        int stop();
+
+        /**
+         * Determines if a recording is in progress.
+         * @return true if recording, false otherwise.
+         */
+        bool isRecording();
+
+        /**
+         * Determines the number of upstream buffers dropped during the current (or last) recording,
+         * because storage could not keep up.
+         *
+         * @return the number of dropped buffers.
+         */
+        uint32_t getDroppedCount();
+
+        /**
+         * Determines the number of bytes of audio data written during the current (or last) recording.
+         * @return the number of bytes written.
+         */
+        uint32_t getLength();
+
+        private:
+
+        /**
+         * Common initialisation.
+         */
+        void init(int sampleRate, uint16_t id);
+
+        /**
+         * Encodes the given buffer into the current block, handing completed blocks to the writer.
+         * @return false if the data could not be accepted as storage is behind.
+         */
+        bool encode(ManagedBuffer &b);
+
+        /**
+         * Begins a new block, writing its ADPCM header if required.
+         */
+        void startBlock();
+
+        /**
+         * Hands a complete block to the writer fiber, if possible.
+         * @return false if the writer is still busy with the previous block.
+         */
+        bool completeBlock();
+
+        /**
+         * Writes the given data to storage.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the storage is full.
+         */
+        int store(const void *data, int len);
+
+        /**
+         * Encodes the pre-trigger audio retained by arm(), and any buffers queued behind it, then hands encoding over
+         * to pullRequest().
+         */
+        void replayPreTrigger();
+
+        /**
+         * Background writer fiber.
+         */
+        static void writerFiber(void *param);
+
+        /**
+         * Writes any completed blocks to storage.
+         */
+        void flushBlocks();
+    };
+}
+
+#endif
@@ -60,13 +60,8 @@ DEALINGS IN THE SOFTWARE.
  * N x Journal Pages:
  * +===========================+
  * |                           |
- * |     0x00 Init Region      |
- * |     (variable length)     |
- * |                           |
- * +---------------------------+
- * |                           |
- * |      Logfile length       |
- * |         (12 bytes)        |
+ * |      Journal entries      |
+ * |   (4 bytes, 32 bit LE)    |
  * |                           |
  * +---------------------------|
  * |                           |
@@ -74,6 +69,16 @@ DEALINGS IN THE SOFTWARE.
  * |     (variable length)     |
  * |                           |
  * +===========================+
+ *
+ * The journal pages form a ring of entries, each holding the offset from dataStart of the data page that held the end
+ * of the log when it was written. A new entry is appended each time the end of the log moves onto another data page,
+ * and the journal page after the one being written is always erased. The newest entry is therefore the last one on
+ * the only journal page in use that is followed by an erased page, and every journal page is erased once per
+ * N * PAGE_SIZE / 4 data pages written.
+ *
+ * The journal pages themselves stay at a fixed location. Each data page is erased once per M data pages written, so a
+ * journal page wears more slowly than a data page for any log of fewer than N * PAGE_SIZE / 4 data pages (16MB with four
+ * journal pages of 4KB). Moving the journal around the flash would therefore spread no wear that matters.
  * 
  * M x pages
  * +===========================+
@@ -87,11 +92,69 @@ DEALINGS IN THE SOFTWARE.
  * |                           |
  * +===========================+
  * 
+ * Log Data is a sequence of newline terminated CSV rows. Binary records (see logBinary()) may be interleaved
+ * with these rows, encoded as a single line of 7 bit text so that the file remains valid HTML:
+ *
+ * +-------------+-------------+-------------------------------+-------------+
+ * |  RS (0x1E)  |  Type char  |  Base64 encoded payload       |     '\n'    |
+ * +-------------+-------------+-------------------------------+-------------+
+ *
+ * In compressed and binary formats (see setFormat()), rows are stored as binary records rather than CSV text:
+ *
+ * '#' records hold the schema, and precede the first row that uses it. After the index of the first column described
+ * (one byte), for each column in turn:
+ * +-------------+-------------------------------+-------------+
+ * |  Type char  |  Column name                  |     0x00    |
+ * +-------------+-------------------------------+-------------+
+ * Type is 'b', 'h' or 'i' for an 8, 16 or 32 bit signed integer, 'f' for a 32 bit float or 's' for text. The 8 and 16
+ * bit types are only used in binary format.
+ *
+ * '%' records each hold a sequence of rows in compressed format, each in this form:
+ * +-------------------------------+-----------------------------------------------+
+ * |  Presence bitmap              |  Values of the columns present, in order      |
+ * |  (1 bit per column, LSB first)|                                               |
+ * +-------------------------------+-----------------------------------------------+
+ * Integers are stored as a zig-zag varint (7 bits per byte, least significant first) of the difference from the value of
+ * the column in the previous row of the record that holds it. Each record starts from zero. Floats are 4 bytes, little
+ * endian. Text is a length byte followed by its characters.
+ *
+ * '$' records each hold a sequence of rows in binary format, in the same form as '%' records except that every value is
+ * fixed width: integers are stored little endian, in the number of bytes given by the type of their column.
+ *
+ * In circular mode (see setCircular()), the log wraps around to the start of the data pages once it reaches logEnd,
+ * rather than becoming full. The page after the one being written is always erased, so the oldest data begins after
+ * the run of 0xFF bytes that follows the end of the newest data. "WRP" is written after logEnd (in place of "FUL")
+ * whenever the final page is erased, to indicate the log should be read out from that point. In compressed and binary
+ * formats, a schema record precedes the first row to start on each page, so that every page can be decoded on its own.
+ *
+ * '!' records index the log, so that rows can be located without reading it from the start (see MicroBitLogIterator).
+ * One is written at the first line boundary on each page, and ahead of each line of CSV headings:
+ * +-------------+-------------------------------+-------------------------------+
+ * |  Flags      |  Row number (32 bit)          |  Time (48 bit, milliseconds)  |
+ * +-------------+-------------------------------+-------------------------------+
+ * Row number is the number of rows logged before the next one, and time is that of the most recent row logged by endRow().
+ * Every line of CSV text other than headings counts as a row, as does each row held in a '%' or '$' record.
+ * Flags holds MICROBIT_LOG_INDEX_HEADINGS if the next line of text holds headings rather than a row.
+ * In compressed and binary formats, a schema record also precedes the first row to start on each page in all modes, not
+ * only in circular mode.
+ *
+ * '=' records define a named table (see MicroBitLogTable), each with its own columns. They precede the first row of the table,
+ * and the first to start on each page, and hold the schema of the table in the same form as '#' records:
+ * +-------------+-------------------------------+-------------+-------------------------------+
+ * |  Tag        |  Table name                   |     0x00    |  Schema, as in '#' records    |
+ * +-------------+-------------------------------+-------------+-------------------------------+
+ * '&' records each hold one row of a named table: its tag byte, followed by the row in the form held in '%' records, except
+ * that integers are stored as 4 bytes, little endian.
+ * Tags are assigned afresh each time the device starts, and reused as tables are destroyed, so readers should attribute
+ * each row to the table named by the most recent '=' record with the same tag. Rows of named tables are stored in this
+ * form in all formats, and are not counted as rows of the log itself.
+ * 
  */
 
 #ifndef MICROBIT_LOG_H
 #define MICROBIT_LOG_H
 
+#include "CodalComponent.h"
 #include "MicroBitUSBFlashManager.h"
 #include "FSCache.h"
 #include "NRF52Serial.h"
@@ -105,6 +168,21 @@ DEALINGS IN THE SOFTWARE.
 #define CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE    256
 #endif
 
+//
+// The number of blocks held in the RAM cache of the log.
+//
+#ifndef CONFIG_MICROBIT_LOG_CACHE_BLOCKS
+#define CONFIG_MICROBIT_LOG_CACHE_BLOCKS        4
+#endif
+
+//
+// Set to 1 to hold the cached blocks in an arena within MicroBitLog, sized at compile time, rather than allocating
+// them on first use. This reserves the RAM even if the log is never used.
+//
+#ifndef MICROBIT_LOG_STATIC_CACHE
+#define MICROBIT_LOG_STATIC_CACHE               0
+#endif
+
 #ifndef CONFIG_MICROBIT_LOG_FULL_ERASE_BY_DEFAULT
 #define CONFIG_MICROBIT_LOG_FULL_ERASE_BY_DEFAULT    false
 #endif
@@ -113,19 +191,75 @@ DEALINGS IN THE SOFTWARE.
 #define CONFIG_MICROBIT_LOG_INVALID_CHAR_VALUE  '_'
 #endif
 
-#define MICROBIT_LOG_VERSION                "UBIT_LOG_FS_V_001\n"           // MUST be 18 characters.
-#define MICROBIT_LOG_JOURNAL_ENTRY_SIZE     8
+//
+// Maximum size of the payload of a single binary record, in bytes.
+// Records are encoded on the stack, and occupy 4/3 of this size in storage.
+//
+#ifndef CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD
+#define CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD   192
+#endif
+
+//
+// Maximum length of the name of a named table (see MicroBitLogTable), in characters.
+//
+#ifndef CONFIG_MICROBIT_LOG_TABLE_NAME_LENGTH
+#define CONFIG_MICROBIT_LOG_TABLE_NAME_LENGTH   32
+#endif
+
+//
+// Maximum time (in milliseconds) that logged data is held in RAM before being committed to flash storage.
+// Zero disables write behind buffering, such that every row is written through to flash as it is logged, and
+// nothing is lost if power is removed. Applications that can accept that risk opt in with setFlushInterval().
+//
+#ifndef CONFIG_MICROBIT_LOG_FLUSH_INTERVAL
+#define CONFIG_MICROBIT_LOG_FLUSH_INTERVAL      0
+#endif
+
+//
+// Size of the RAM buffers used to accumulate and serialize each row, in bytes.
+// The values logged in a single row must fit within this space.
+//
+#ifndef CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE
+#define CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE     256
+#endif
+
+// Identifies the layout of the log. Firmware that finds any other version when mounting the log reformats it,
+// rather than misreading it. Version 002 holds the journal as binary entries, rather than ASCII hex.
+#define MICROBIT_LOG_VERSION                "UBIT_LOG_FS_V_002\n"           // MUST be 18 characters.
+#define MICROBIT_LOG_JOURNAL_ENTRY_SIZE     4
+#define MICROBIT_LOG_BINARY_RECORD_MARKER   0x1E                            // ASCII Record Separator.
+#define MICROBIT_LOG_RECORD_SCHEMA          '#'                             // Compressed and binary format column definitions.
+#define MICROBIT_LOG_RECORD_ROWS            '%'                             // Compressed format rows.
+#define MICROBIT_LOG_RECORD_BINARY_ROWS     '$'                             // Binary format rows.
+#define MICROBIT_LOG_RECORD_INDEX           '!'                             // Row index, at the first line boundary on each page.
+#define MICROBIT_LOG_RECORD_TABLE           '='                             // Named table definition.
+#define MICROBIT_LOG_RECORD_TABLE_ROW       '&'                             // Named table row.
+
+#define MICROBIT_LOG_INDEX_SIZE             11                              // Length of the payload of an index record.
+#define MICROBIT_LOG_INDEX_HEADINGS         0x01                            // Index flag: the next line of text holds CSV headings.
+
+#define MICROBIT_LOG_COLUMN_INT8            'b'
+#define MICROBIT_LOG_COLUMN_INT16           'h'
+#define MICROBIT_LOG_COLUMN_INTEGER         'i'
+#define MICROBIT_LOG_COLUMN_FLOAT           'f'
+#define MICROBIT_LOG_COLUMN_TEXT            's'
 
 #define MICROBIT_LOG_STATUS_INITIALIZED     0x0001
 #define MICROBIT_LOG_STATUS_ROW_STARTED     0x0002
 #define MICROBIT_LOG_STATUS_FULL            0x0004
 #define MICROBIT_LOG_STATUS_SERIAL_MIRROR   0x0008
+#define MICROBIT_LOG_STATUS_FLUSH_FIBER     0x0010
+#define MICROBIT_LOG_STATUS_CIRCULAR        0x0020
+#define MICROBIT_LOG_STATUS_INDEXED         0x0040
+#define MICROBIT_LOG_STATUS_LINE_OPEN       0x0080
 
 
 #define MICROBIT_LOG_EVT_LOG_FULL           1
 
 namespace codal
 {
+    class MicroBitLogTable;
+
     struct MicroBitLogMetaData
     {
         char        version[18];             // MICROBIT_LOG_VERSION
@@ -137,7 +271,41 @@ namespace codal
     {
         public:
         ManagedString key;
-        ManagedString value;
+        uint32_t hash;                       // Hash of the key, used to index the column.
+        uint16_t value;                      // Offset of the value of this column within the value buffer.
+        uint16_t length;                     // Length of the value of this column, or zero if no value has been logged in this row.
+        char type;                           // MICROBIT_LOG_COLUMN_* type in compressed and binary formats, or zero if not yet known.
+        uint32_t previous;                   // The last integer value stored in this column, in compressed format.
+
+        ColumnEntry()
+        {
+            hash = 0;
+            value = 0;
+            length = 0;
+            type = 0;
+            previous = 0;
+        }
+    };
+
+    /**
+     * A handle to a column of a MicroBitLog, as returned by MicroBitLog::addColumn().
+     * Handles remain valid until the log is cleared.
+     */
+    struct LogColumn
+    {
+        int16_t id;
+
+        LogColumn()
+        {
+            id = -1;
+        }
+    };
+
+    enum class LogFormat
+    {
+        CSV = 0,
+        Compressed = 1,
+        Binary = 2
     };
 
     
@@ -151,64 +319,68 @@ namespace codal
         Days = 864000
     };
 
-    struct JournalEntry
-    {
-        char        length[MICROBIT_LOG_JOURNAL_ENTRY_SIZE];
-        char        null;
-
-        JournalEntry()
-        {
-            memcpy(length, "00000000", MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
-            null = 0;
-        }
-
-        void clear()
-        {
-            memset(length, 0, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
-        }
-
-        bool containsOnly(uint8_t value)
-        {
-            for (int i=0; i<MICROBIT_LOG_JOURNAL_ENTRY_SIZE;i++)
-                if (length[i] != value)
-                    return false;
-
-            return true;
-        }
-    };
-
     /**
      * Class definition for MicroBitLog. A simple text only, append only, single file log file system.
      * Also contains a key/value pair abstraction to enable dynamic creation of CSV based logfiles.
      */
-    class MicroBitLog 
+    class MicroBitLog : public CodalComponent
     {
         private:
-        MicroBitUSBFlashManager         &flash;             // Non-volatile memory contorller to use for storage.
+        NVMController                   &flash;             // Non-volatile memory contorller to use for storage.
+        MicroBitUSBFlashManager         *drive;             // The USB drive presenting the storage as a file, if any.
         NRF52Serial                     &serial;            // Reference to serial port used for data mirroring.
-        FSCache                         cache;              // Write through RAM cache.
-        uint32_t                        status;             // Status flags.
+#if CONFIG_ENABLED(MICROBIT_LOG_STATIC_CACHE)
+        uint8_t                         cacheArena[CONFIG_MICROBIT_LOG_CACHE_BLOCKS * CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE];
+#endif
+        FSCache                         cache;              // RAM cache. Write back while write behind buffering is enabled.
         FiberLock                       mutex;              // Mutual exclusion primitive to serialise APi calls.
+        FiberLock                       rowLock;            // Held by the fiber building the current row, from beginRow() to endRow().
+        Fiber                           *rowOwner;          // The fiber building the current row, or NULL.
 
         uint32_t                        startAddress;       // Logical address of the start of the Log file system.
         uint32_t                        journalPages;       // Number of physical pages allocated to journalling.
         uint32_t                        journalStart;       // logical address of the start of the journal section.
         uint32_t                        journalHead;        // Logical address of the last valid journal entry.
         uint32_t                        dataStart;          // Logical address of the start of the Data section.
-        uint32_t                        dataEnd;            // Logical address of the end of valid data.
+        uint32_t                        dataEnd;            // Logical address of the end of valid data, including any held in writeBuffer.
+        uint32_t                        flushedEnd;         // Logical address of the end of the data committed to flash.
+        uint32_t                        bufferAddress;      // Logical address of the page held in writeBuffer.
+        uint8_t                         *writeBuffer;       // RAM copy of the data page being filled, or NULL if writing through.
+        uint32_t                        flushInterval;      // Maximum time data is held in writeBuffer, in milliseconds.
         uint32_t                        logEnd;             // Logical address of the end of the file system space.
         uint32_t                        headingStart;       // Logical address of the start of the column header data. Zero if no data is present.
         uint32_t                        headingLength;      // The length (in bytes) of the column header data.
         uint32_t                        headingCount;       // Total number of headings in the current log.
         bool                            headingsChanged;    // Flag to indicate if a row has been added that contains new columns.
+        bool                            schemaChanged;      // Flag to indicate if the column types or headings have changed since the last binary row.
+        uint32_t                        schemaPage;         // The page on which the last schema record started.
+        LogFormat                       format;             // The format in which rows are stored.
 
         struct ColumnEntry*             rowData;            // Collection of key/value pairs. Used to accumulate each data row.
+        uint16_t                        *columnMap;         // The index in rowData of each column, indexed by the id of its LogColumn handle.
+        uint16_t                        *headingIndex;      // Open addressed hash table of column ids (plus one), keyed on the hash of their heading.
+        uint32_t                        headingIndexSize;   // The number of slots in headingIndex. Always a power of two.
+        LogColumn                       timeStampColumn;    // The column holding the timestamp, if any.
+        char                            *valueBuffer;       // The values of the current row, each NULL terminated, in the order they were logged.
+        uint32_t                        valueLength;        // The number of bytes used in valueBuffer.
+        char                            *rowBuffer;         // Buffer used to serialize each row.
+        uint8_t                         *packBuffer;        // Rows encoded in compressed or binary format, not yet written to the log.
+        uint32_t                        packLength;         // The number of bytes used in packBuffer.
+        uint32_t                        packRows;           // The number of rows held in packBuffer.
+        CODAL_TIMESTAMP                 packTime;           // The time of the first row held in packBuffer.
+        uint32_t                        rowCount;           // The number of rows logged, once MICROBIT_LOG_STATUS_INDEXED is set.
+        uint32_t                        indexPage;          // The page on which the last index record ended.
+        CODAL_TIMESTAMP                 rowTime;            // The time of the most recent row logged by endRow().
+        MicroBitLogTable                *tables;            // The named tables in use, so that their tags are not reused.
         struct MicroBitLogMetaData      metaData;           // Snapshot of the metadata held in flash storage.
         TimeStampFormat                 timeStampFormat;    // The format of timestamp to log on each row.
         ManagedString                   timeStampHeading;   // The title of the timestamp column, including units.
 
         const static uint8_t            header[2048];       // static header to prepend to FS in physical storage.
 
+        friend class MicroBitLogIterator;
+        friend class MicroBitLogTable;
+
         public:
 
         /**
@@ -216,6 +388,17 @@ namespace codal
          */
         MicroBitLog(MicroBitUSBFlashManager &flash, NRF52Serial &serial, int journalPages = CONFIG_MICROBIT_LOG_JOURNAL_PAGES);
 
+        /**
+         * Constructor, for storage other than the MICROBIT drive itself, such as an NVMMonitor wrapping it,
+         * or an in-memory NVMController in a host build.
+         *
+         * @param flash The non-volatile memory to log to.
+         * @param serial The serial port used for data mirroring.
+         * @param journalPages The number of pages to use for the journal.
+         * @param drive The USB drive presenting the storage as a file, or NULL. Its file name and size are updated when the log is cleared.
+         */
+        MicroBitLog(NVMController &flash, NRF52Serial &serial, int journalPages = CONFIG_MICROBIT_LOG_JOURNAL_PAGES, MicroBitUSBFlashManager *drive = NULL);
+
         /**
          * Destructor.
          */
@@ -262,6 +445,55 @@ namespace codal
          */
         void setTimeStamp(TimeStampFormat format);
          
+        /**
+         * Determines how rows are stored. CSV stores each row as text. Compressed stores rows as packed records of
+         * typed values, with integers stored as the difference from the previous row in as few bytes as possible. Binary
+         * stores rows as packed records of fixed width values, with each integer column as narrow as the values logged in it
+         * allow. Rows in either are converted back to CSV only when the log is viewed online (by dl.js), read out with
+         * decode.js in resources/logfs, or read on the device with MicroBitLogIterator. The offline view, and its Download
+         * and Copy buttons, leave them out, so use these formats only where the data will be read by one of those.
+         *
+         * In compressed format, each column takes the type of the first value logged in it: a 32 bit integer,
+         * a 32 bit float or text. In binary format, integer columns are 8, 16 or 32 bits wide, and are widened as larger
+         * values are logged. Numeric values are stored by value, so formatting such as trailing zeroes is not kept.
+         *
+         * While write behind buffering is enabled (see setFlushInterval()), rows are packed together in RAM and written
+         * when the log is flushed, which is where both formats save most. Compressed format suits slowly changing values
+         * such as sensor readings, and binary format values that change a lot from row to row but have a small range.
+         * Without buffering, each row is written as a record of its own.
+         *
+         * @param format The format to use for subsequent rows.
+         */
+        void setFormat(LogFormat format);
+
+        /**
+         * Determines how long logged data may be held in RAM before it is committed to flash storage.
+         * Rows are accumulated into whole pages and written in a single transfer, which is much faster than
+         * writing each row as it is logged. Updates to the journal and headings are held in the cache and written
+         * together in the same way. Any buffered data is also committed when the device enters deep sleep
+         * or is powered off. Data held in RAM is lost if power is removed unexpectedly, so buffering is disabled by
+         * default (see CONFIG_MICROBIT_LOG_FLUSH_INTERVAL).
+         *
+         * @param interval The maximum time to hold data in RAM, in milliseconds. Zero writes every row straight to flash.
+         */
+        void setFlushInterval(uint32_t interval);
+
+        /**
+         * Determines what happens when the log fills. By default, logging stops and the log is marked as full.
+         * In circular mode, the oldest page of data is instead erased to make room for new rows, such that the
+         * log always holds the most recent data. The log is still read out in the order it was written.
+         *
+         * @param circular true to reuse the oldest pages when the log fills, false to stop logging.
+         */
+        void setCircular(bool circular);
+
+        /**
+         * Commits any data held in RAM to flash storage.
+         *
+         * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the data could not be written.
+         */
+        int flush();
+
         /**
          * Defines if data logging should also be streamed over the serial port.
          *
@@ -272,11 +504,23 @@ namespace codal
 
         /**
          * Creates a new row in the log, ready to be populated by logData()
+         * Rows are built by one fiber at a time. If another fiber has a row open, this blocks until that row is ended,
+         * so every fiber that logs must end each row it begins. logData() begins a row implicitly if the calling fiber
+         * has none open. Must not be called from interrupt context (see MicroBitLogQueue).
          * 
          * @return DEVICE_OK on success.
          */
         int beginRow();
 
+        /**
+         * Adds a column to the log, if it is not already present.
+         * The handle returned can then be used to log data without looking the column up by name on each row.
+         *
+         * @param key the name of the column.
+         * @return a handle to the column.
+         */
+        LogColumn addColumn(const char *key);
+
         /**
          * Populates the current row with the given key/value pair.
          * @param key the name of the key column) to set.
@@ -295,12 +539,69 @@ namespace codal
          */
         int logData(ManagedString key, ManagedString value);
 
+        /**
+         * Populates the current row with the given key/value pair.
+         * @param key the name of the key column) to set.
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(const char *key, int value);
+
+        /**
+         * Populates the current row with the given key/value pair.
+         * The value is recorded to 7 significant figures.
+         *
+         * @param key the name of the key column) to set.
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(const char *key, float value);
+
+        /**
+         * Populates the given column of the current row.
+         * @param column the column to set, as returned by addColumn().
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(LogColumn column, const char *value);
+
+        /**
+         * Populates the given column of the current row.
+         * @param column the column to set, as returned by addColumn().
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(LogColumn column, int value);
+
+        /**
+         * Populates the given column of the current row.
+         * The value is recorded to 7 significant figures.
+         *
+         * @param column the column to set, as returned by addColumn().
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(LogColumn column, float value);
+
         /**
          * Complete a row in the log, and pushes to persistent storage.
          * @return DEVICE_OK on success.
          */
         int endRow();
 
+        /**
+         * Complete a row in the log, and pushes to persistent storage.
+         * @param time The time to record in the timestamp column (if enabled), in milliseconds.
+         * @return DEVICE_OK on success, DEVICE_INVALID_STATE if the calling fiber has no row open, DEVICE_NO_RESOURCES if
+         * the log is full, or DEVICE_I2C_ERROR if the row could not be written.
+         */
+        int endRow(CODAL_TIMESTAMP time);
+
         /**
          * Inject the given row into the log as text, ignoring key/value pairs.
          * @param s the string to inject.
@@ -313,6 +614,32 @@ namespace codal
          */
         int logString(ManagedString s);
 
+        /**
+         * Inject a packed binary record into the log, alongside any CSV rows.
+         * Binary records are ignored by the CSV view, and can be decoded by the online view or host tools
+         * (see resources/logfs). This provides a compact and fast means to log bulk data such as spectra.
+         *
+         * @param type An alphanumeric character identifying the type of the record.
+         * @param data The payload of the record.
+         * @param length The length of the payload, in bytes. Maximum CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD.
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int logBinary(char type, const void *data, int length);
+
+        /**
+         * Determines the number of rows logged since the log was last cleared, including any that have since been
+         * overwritten in circular mode.
+         *
+         * @return the number of rows logged.
+         */
+        uint32_t getRowCount();
+
+        /**
+         * Commits any buffered data to flash storage before deep sleep or power off.
+         */
+        virtual int deepSleepCallback(deepSleepCallbackReason reason, deepSleepCallbackData *data) override;
+
     private:
 
         /**
@@ -320,15 +647,204 @@ namespace codal
          */
         void init();
 
+        /**
+         * Scans forward from the given address for the first byte that does, or does not, hold the given value.
+         *
+         * @param address the address to start from.
+         * @param end the address at which to stop.
+         * @param value the value to compare against.
+         * @param match true to find the first byte holding the given value, false to find the first byte holding any other value.
+         * @return the address of the byte found, or end if there is none.
+         */
+        uint32_t scan(uint32_t address, uint32_t end, uint8_t value, bool match);
+
+        /**
+         * Encodes a binary record and writes it into the log.
+         *
+         * @param type The type of the record.
+         * @param data The payload of the record.
+         * @param length The length of the payload, in bytes. Maximum CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int writeRecord(char type, const void *data, int length, uint32_t rows = 0);
+
+        /**
+         * Writes the given data to the end of the log, preceded by an index record if it starts the first line on a new page.
+         *
+         * @param s The data to write.
+         * @param rows The number of rows completed by the data.
+         * @param headings true if the data is a line of CSV headings.
+         *
+         * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if the log is full, or DEVICE_I2C_ERROR if buffered data could not
+         * be committed to make way for it. The log is left unchanged in the latter case.
+         */
+        int writeData(const char *s, uint32_t rows, bool headings = false);
+
+        /**
+         * Writes the given data to the end of the log, erasing pages ahead of it and wrapping around in circular mode.
+         *
+         * @param data The data to write.
+         * @param length The number of bytes to write.
+         * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if the log is full, or DEVICE_I2C_ERROR if the data held in
+         * writeBuffer could not be committed to make way for the next page.
+         */
+        int appendData(const char *data, uint32_t length);
+
+        /**
+         * Determines the number of rows already in the log, and whether the last line is complete.
+         * Must be called before any data is written after the log is mounted.
+         */
+        void restoreIndex();
+
+        /**
+         * Ends the row being built, allowing other fibers to begin theirs.
+         */
+        void releaseRow();
+
+        /**
+         * Writes the current row as a binary record, preceded by a schema record if necessary.
+         *
+         * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if the log is full, or DEVICE_INVALID_PARAMETER
+         * if the row is too large to be stored as a single record.
+         */
+        int writeBinaryRow();
+
+        /**
+         * Widens the type of any column whose value in the current row no longer fits: integers to wider integers or floats,
+         * and anything else to text.
+         *
+         * @param columns The columns of the row.
+         * @param count The number of columns.
+         * @param values The buffer holding the value of each column, as text.
+         * @param narrow true to give integer columns the narrowest type that holds their values, false to make them 32 bit.
+         * @param update false to only determine whether any type would change, leaving the columns untouched.
+         * @return true if the type of any column has changed (or would change).
+         */
+        bool widenTypes(ColumnEntry *columns, uint32_t count, const char *values, bool narrow, bool update = true);
+
+        /**
+         * Writes schema records describing the current columns.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int writeSchema();
+
+        /**
+         * Writes schema records describing the given columns.
+         *
+         * @param columns The columns to describe.
+         * @param count The number of columns.
+         * @param tag The table tag to precede each record with, or NULL to describe the columns of the log itself.
+         * @param tagLength The length of the tag, in bytes.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int writeSchema(ColumnEntry *columns, uint32_t count, const uint8_t *tag = NULL, int tagLength = 0);
+
+        /**
+         * Encodes the values of the current row, preceded by a bitmap of the columns present.
+         *
+         * @param record The buffer to encode into, CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD bytes in length.
+         * @param delta true to encode integers relative to the previous row, false to start a new record.
+         * @return the length of the encoded row, or -1 if it does not fit in the buffer.
+         */
+        int encodeRow(uint8_t *record, bool delta);
+
+        /**
+         * Encodes the values of the given columns, preceded by a bitmap of the columns present.
+         *
+         * @param record The buffer to encode into.
+         * @param size The length of the buffer, in bytes.
+         * @param columns The columns of the row.
+         * @param count The number of columns.
+         * @param values The buffer holding the value of each column, as text.
+         * @param packed true to encode integers in compressed format.
+         * @param delta true to encode integers relative to the previous row, false to start a new record.
+         * @return the length of the encoded row, or -1 if it does not fit in the buffer.
+         */
+        int encodeRow(uint8_t *record, int size, ColumnEntry *columns, uint32_t count, const char *values, bool packed, bool delta);
+
+        /**
+         * Writes any rows held in packBuffer into the log, as a single record.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int writePackedRows();
+
+        /**
+         * Copies data into writeBuffer, at the current end of the log. The data must not span a page boundary.
+         * If the data starts a new page, the page previously held in writeBuffer is committed first.
+         *
+         * @param data The data to buffer.
+         * @param length The number of bytes to buffer.
+         * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the previous page could not be committed. writeBuffer is
+         * left holding that page in this case, so that it can be retried.
+         */
+        int bufferData(const char *data, int length);
+
+        /**
+         * Writes any data held in writeBuffer to flash storage in a single operation, and then updates the journal.
+         *
+         * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the data could not be written.
+         */
+        int flushBuffer();
+
+        /**
+         * Writes a new entry into the journal if the end of the data committed to flash has moved onto another page.
+         * Entries rotate around the journal pages, which stay at a fixed location (see the journal format above).
+         *
+         * @param oldDataEnd The previous end of the committed data.
+         * @param newDataEnd The new end of the committed data.
+         */
+        void updateJournal(uint32_t oldDataEnd, uint32_t newDataEnd);
+
+        /**
+         * Erases the given page of flash storage, along with any copy of it held in the cache.
+         *
+         * @param page The address of the page to erase.
+         */
+        void erasePage(uint32_t page);
+
+        /**
+         * Periodically commits buffered data to flash storage, while write behind buffering is enabled.
+         */
+        static void flushFiber(void *param);
+
         /**
          * Add the given heading to the list of headings in use. If the heading already exists,
          * this method has no effect.
          * 
          * @param key the heading to add
-         * @param value the initial value to add, or ManagedString::EmptyString
          * @param head true to add the given field at the front of the list, false to add at the end.
+         * @return the id of the column with the given heading.
+         */
+        int addHeading(ManagedString key, bool head = false);
+
+        /**
+         * Determines the column with the given heading.
+         *
+         * @param key the heading to find. Any invalid LogFS symbols are treated as they are by cleanBuffer().
+         * @return the id of the column, or -1 if the heading is not in use.
+         */
+        int findHeading(const char *key);
+
+        /**
+         * Adds the given column id to headingIndex, growing the index if necessary.
+         *
+         * @param id the id of the column to add.
+         */
+        void indexHeading(int id);
+
+        /**
+         * Stores the given value in the current row, removing any invalid LogFS symbols.
+         *
+         * @param column the index of the column to set.
+         * @param value the value to store.
+         * @param length the length of the value, in bytes.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
          */
-        void addHeading(ManagedString key, ManagedString value, bool head = false);
+        int setValue(int column, const char *value, int length);
 
         /**
          * Clean the given buffer of invalid LogFS symbols ("-->" and optionally ",\t\n")
@@ -340,6 +856,320 @@ namespace codal
          */
         ManagedString cleanBuffer(const char *s, int len, bool removeSeparators = true);
     };
+
+    /**
+     * A named table within a MicroBitLog, with its own columns and rows.
+     *
+     * Records of different kinds, logged at different rates, can be kept in separate tables rather than interleaved
+     * into one wide and sparse set of columns. Rows are stored as tagged binary records in all formats (see MicroBitLog.h),
+     * so are not shown by the offline view, and are exported as a separate CSV file for each table.
+     * Rows are timestamped in the same way as those of the log itself.
+     */
+    class MicroBitLogTable
+    {
+        private:
+        MicroBitLog             &log;               // The log to write to.
+        ManagedString           name;               // The name of this table.
+        uint8_t                 tag;                // The tag identifying the records of this table, or zero if none was free.
+        MicroBitLogTable        *next;              // The next table in use with the same log.
+        ColumnEntry             *columns;           // The columns of this table, and their values in the current row.
+        uint32_t                columnCount;        // The number of columns.
+        char                    *valueBuffer;       // The values of the current row, as text.
+        uint32_t                valueLength;        // The number of bytes used in valueBuffer.
+        uint32_t                schemaAddress;      // The logical address at which the definition of this table was last written.
+        bool                    schemaChanged;      // true if the columns or their types have changed since the definition was last written.
+        bool                    rowStarted;         // true if a row has been started.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param log The log to write to.
+         * @param name The name of the table. Invalid LogFS symbols are replaced, and the name is truncated to
+         * CONFIG_MICROBIT_LOG_TABLE_NAME_LENGTH characters.
+         *
+         * @note Each table in use is given a distinct tag, and the tag of a table is reused once it is destroyed. At most
+         * 255 tables may be in use with the same log at once. The rows of any more are refused by endRow().
+         */
+        MicroBitLogTable(MicroBitLog &log, const char *name);
+
+        /**
+         * Destructor.
+         */
+        ~MicroBitLogTable();
+
+        /**
+         * Creates a new row in this table, ready to be populated by logData().
+         * @return DEVICE_OK on success.
+         */
+        int beginRow();
+
+        /**
+         * Adds a column to this table, if it is not already present.
+         *
+         * @param key the name of the column.
+         * @return a handle to the column, valid only for this table.
+         */
+        LogColumn addColumn(const char *key);
+
+        /**
+         * Populates the current row with the given key/value pair.
+         * @param key the name of the key column) to set.
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(const char *key, const char *value);
+
+        /**
+         * Populates the current row with the given key/value pair.
+         * @param key the name of the key column) to set.
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(ManagedString key, ManagedString value);
+
+        /**
+         * Populates the current row with the given key/value pair.
+         * @param key the name of the key column) to set.
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(const char *key, int value);
+
+        /**
+         * Populates the current row with the given key/value pair.
+         * The value is recorded to 7 significant figures.
+         * @param key the name of the key column) to set.
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(const char *key, float value);
+
+        /**
+         * Populates the given column of the current row.
+         * @param column the column to set, as returned by addColumn().
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(LogColumn column, const char *value);
+
+        /**
+         * Populates the given column of the current row.
+         * @param column the column to set, as returned by addColumn().
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(LogColumn column, int value);
+
+        /**
+         * Populates the given column of the current row.
+         * The value is recorded to 7 significant figures.
+         * @param column the column to set, as returned by addColumn().
+         * @param value the value to insert
+         *
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int logData(LogColumn column, float value);
+
+        /**
+         * Completes the current row, and writes it to the log.
+         * @return DEVICE_OK on success, DEVICE_INVALID_STATE if no row has been started, DEVICE_NO_RESOURCES if the log is full
+         * or too many tables are in use, or DEVICE_INVALID_PARAMETER if the row is too large to be stored as a single record.
+         */
+        int endRow();
+
+        /**
+         * Completes the current row, and writes it to the log.
+         * @param time The time to record in the timestamp column (if enabled), in milliseconds.
+         * @return DEVICE_OK on success, DEVICE_INVALID_STATE if no row has been started, DEVICE_NO_RESOURCES if the log is full
+         * or too many tables are in use, or DEVICE_INVALID_PARAMETER if the row is too large to be stored as a single record.
+         */
+        int endRow(CODAL_TIMESTAMP time);
+
+        private:
+
+        /**
+         * Stores the given value in the current row, removing any invalid LogFS symbols.
+         *
+         * @param column the index of the column to set.
+         * @param value the value to store.
+         * @param length the length of the value, in bytes.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+         */
+        int setValue(int column, const char *value, int length);
+
+        /**
+         * Writes the definition of this table: its tag, name and schema.
+         *
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+         */
+        int writeSchema();
+    };
+
+    /**
+     * Reads rows back from a MicroBitLog, in the order they were logged, as CSV text.
+     *
+     * Rows are numbered from zero, from when the log was last cleared. The index records held on each page of the log
+     * are binary searched to seek to a given row or time, so the cost of a seek grows only with the logarithm of the
+     * size of the log, plus the reading of at most a page or so of rows.
+     *
+     * Rows may be read while more are logged. In circular mode, rows may be overwritten while they are being read.
+     */
+    class MicroBitLogIterator
+    {
+        private:
+        MicroBitLog             &log;                                           // The log to read from.
+        uint32_t                address;                                        // Logical address of the next byte to read.
+        uint32_t                row;                                            // The number of the next row.
+        CODAL_TIMESTAMP         time;                                           // The time of the last row read, in milliseconds.
+        bool                    headings;                                       // true if the next line of text holds headings.
+        uint8_t                 *types;                                         // The type of each column, from the last schema record read.
+        uint32_t                *previous;                                      // The value of each integer column in the previous compressed row.
+        uint32_t                columns;                                        // The number of columns described by the last schema.
+        bool                    packed;                                         // true if the record being read holds compressed rows, false if binary.
+        uint8_t                 record[CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD];  // The payload of the binary record being read.
+        int                     recordLength;                                   // The length of the payload held in record.
+        int                     recordOffset;                                   // The offset of the next row in record.
+        uint8_t                 chunk[32];                                      // Read buffer.
+        uint32_t                chunkAddress;                                   // Logical address of the data held in chunk.
+        uint32_t                chunkLength;                                    // The number of bytes held in chunk.
+
+        friend class MicroBitLog;
+
+        public:
+
+        /**
+         * Constructor.
+         * The iterator is initially positioned at the oldest row held in the log.
+         *
+         * @param log The log to read from.
+         */
+        MicroBitLogIterator(MicroBitLog &log);
+
+        /**
+         * Destructor.
+         */
+        ~MicroBitLogIterator();
+
+        /**
+         * Positions the iterator at the given row.
+         *
+         * @param row The number of the row to read next.
+         * @return DEVICE_OK on success, or DEVICE_NO_DATA if the row is not held in the log (in which case the iterator
+         * is positioned at the nearest row that is).
+         */
+        int seekRow(uint32_t row);
+
+        /**
+         * Positions the iterator at the first row with a timestamp at or after the given time.
+         * Rows are assumed to be logged in time order, as they are within each power cycle.
+         *
+         * @param time The time to seek to, in milliseconds.
+         * @return DEVICE_OK on success, DEVICE_NO_DATA if there is no such row, or DEVICE_NOT_SUPPORTED if the log is not timestamped.
+         */
+        int seekTime(CODAL_TIMESTAMP time);
+
+        /**
+         * Reads the next row, as a line of CSV text without the trailing newline.
+         * Rows held in compressed or binary format are converted to CSV text, with one value for each column of their schema.
+         *
+         * @param buffer The buffer to read into, or NULL to skip the row. The text is NULL terminated, and truncated if necessary.
+         * @param length The length of the buffer, in bytes.
+         * @return the length of the text placed in the buffer, or DEVICE_NO_DATA if there are no more rows.
+         */
+        int next(char *buffer = NULL, int length = 0);
+
+        /**
+         * Determines the number of the row that will be read next.
+         * @return the row number.
+         */
+        uint32_t getRow();
+
+        /**
+         * Determines the time held in the timestamp column of the last row read.
+         * @return the time of the row in milliseconds, or zero if it has none.
+         */
+        CODAL_TIMESTAMP getTime();
+
+        private:
+
+        /**
+         * Determines the address of the given page of data, counting from the page holding the oldest data.
+         *
+         * @param page The index of the page.
+         * @return the logical address of the start of the page.
+         */
+        uint32_t pageAddress(int page);
+
+        /**
+         * Determines the number of pages that may hold data.
+         * @return the number of pages.
+         */
+        int pageCount();
+
+        /**
+         * Finds the first index record to start on the given page, and positions the iterator at it.
+         *
+         * @param page The logical address of the page.
+         * @param row Set to the row number held in the index record.
+         * @param time Set to the time held in the index record.
+         * @return true if an index record was found.
+         */
+        bool findIndex(uint32_t page, uint32_t &row, CODAL_TIMESTAMP &time);
+
+        /**
+         * Positions the iterator at the last index record preceding the given row or time, or at the oldest data if there is none.
+         *
+         * @param target The row to locate.
+         * @param t The time to locate, in milliseconds.
+         * @param byTime true to locate the given time, false to locate the given row.
+         */
+        void locate(uint32_t target, CODAL_TIMESTAMP t, bool byTime);
+
+        /**
+         * Positions the iterator at the given row, without first committing any buffered data.
+         *
+         * @param target The number of the row to read next.
+         * @return DEVICE_OK on success, or DEVICE_NO_DATA if the row is not held in the log.
+         */
+        int skipTo(uint32_t target);
+
+        /**
+         * Reads the next byte of data, wrapping around the end of the log in circular mode.
+         * @return the byte read, or -1 if the end of the data has been reached.
+         */
+        int readByte();
+
+        /**
+         * Reads the remainder of a binary record, decoding its payload into record.
+         * @return DEVICE_OK on success, or DEVICE_NO_DATA if the record is incomplete.
+         */
+        int readRecord();
+
+        /**
+         * Converts the next row held in record into CSV text.
+         *
+         * @param buffer The buffer to write into, or NULL.
+         * @param length The length of the buffer, in bytes.
+         * @return the length of the text placed in the buffer.
+         */
+        int decodeRow(char *buffer, int length);
+
+        /**
+         * Parses the given value of the timestamp column, and records it as the time of the current row.
+         *
+         * @param s The value, as logged.
+         * @param length The length of the value.
+         */
+        void setTime(const char *s, int length);
+    };
 }
 
 #endif
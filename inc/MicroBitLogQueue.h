@@ -0,0 +1,244 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef MICROBIT_LOG_QUEUE_H
+#define MICROBIT_LOG_QUEUE_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "ErrorNo.h"
+#include "MicroBitLog.h"
+
+//
+// Number of records the queue can hold. Must be a power of two.
+//
+#ifndef CONFIG_MICROBIT_LOG_QUEUE_SIZE
+#define CONFIG_MICROBIT_LOG_QUEUE_SIZE              32
+#endif
+
+//
+// Maximum number of values held in each queued record.
+//
+#ifndef CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES
+#define CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES     4
+#endif
+
+//
+// Period at which the background fiber drains the queue into the log, in milliseconds.
+//
+#ifndef CONFIG_MICROBIT_LOG_QUEUE_DRAIN_PERIOD
+#define CONFIG_MICROBIT_LOG_QUEUE_DRAIN_PERIOD      50
+#endif
+
+#if (CONFIG_MICROBIT_LOG_QUEUE_SIZE & (CONFIG_MICROBIT_LOG_QUEUE_SIZE - 1))
+#error "CONFIG_MICROBIT_LOG_QUEUE_SIZE must be a power of two"
+#endif
+
+#define DEVICE_ID_LOG_QUEUE                         3047
+
+#define MICROBIT_LOG_QUEUE_STATUS_ACTIVE            0x0001
+#define MICROBIT_LOG_QUEUE_STATUS_FIBER             0x0002
+
+#define MICROBIT_LOG_QUEUE_VALUE_INT                1
+#define MICROBIT_LOG_QUEUE_VALUE_FLOAT              2
+
+namespace codal
+{
+    /**
+     * A fixed size row of values, ready to be placed onto a MicroBitLogQueue.
+     * Records can be built in any context, including interrupt handlers.
+     */
+    struct MicroBitLogRecord
+    {
+        CODAL_TIMESTAMP     time;                                                   // Time the record was queued, in milliseconds.
+        uint8_t             count;                                                  // Number of values held.
+        uint8_t             type[CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES];          // The type of each value.
+        LogColumn           column[CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES];        // The column of each value.
+        union
+        {
+            int             i;
+            float           f;
+        }                   value[CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES];         // The values.
+
+        MicroBitLogRecord()
+        {
+            count = 0;
+        }
+
+        /**
+         * Adds a value to this record.
+         * @param c the column to set, as returned by MicroBitLog::addColumn().
+         * @param v the value to insert.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the record is full.
+         */
+        int add(LogColumn c, int v)
+        {
+            if (count >= CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES)
+                return DEVICE_NO_RESOURCES;
+
+            type[count] = MICROBIT_LOG_QUEUE_VALUE_INT;
+            column[count] = c;
+            value[count++].i = v;
+
+            return DEVICE_OK;
+        }
+
+        /**
+         * Adds a value to this record.
+         * @param c the column to set, as returned by MicroBitLog::addColumn().
+         * @param v the value to insert.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the record is full.
+         */
+        int add(LogColumn c, float v)
+        {
+            if (count >= CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES)
+                return DEVICE_NO_RESOURCES;
+
+            type[count] = MICROBIT_LOG_QUEUE_VALUE_FLOAT;
+            column[count] = c;
+            value[count++].f = v;
+
+            return DEVICE_OK;
+        }
+    };
+
+    /**
+     * Class definition for MicroBitLogQueue.
+     *
+     * Decouples producers of log data from the flash storage path. Records are copied into a fixed size ring
+     * buffer by push(), which may be called from any context, including interrupt handlers. A background fiber
+     * periodically drains all pending records into the log as rows, each stamped with the time it was queued.
+     *
+     * push() never blocks, allocates or touches flash: it masks interrupts only for the duration of a
+     * single fixed size record copy, so its latency is bounded and independent of the state of the log.
+     * If the queue is full, the record is dropped and counted.
+     *
+     * Columns must be created with MicroBitLog::addColumn() before records referring to them are queued,
+     * as adding columns is not interrupt safe.
+     *
+     * Other fibers may log rows directly at the same time. MicroBitLog lets one fiber build a row at a time,
+     * so queued records are never merged into a row another fiber has begun but not yet ended.
+     */
+    class MicroBitLogQueue : public CodalComponent
+    {
+        private:
+        MicroBitLog             &log;                                               // The log to write to.
+        MicroBitLogRecord       queue[CONFIG_MICROBIT_LOG_QUEUE_SIZE];              // The ring buffer of pending records.
+        volatile uint32_t       head;                                               // Number of records ever queued.
+        volatile uint32_t       tail;                                               // Number of records ever removed.
+        volatile uint32_t       dropped;                                            // Number of records dropped because the queue was full.
+        volatile uint32_t       peak;                                               // Largest number of records pending at once.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param log The log to write records into.
+         * @param id The ID of this component.
+         */
+        MicroBitLogQueue(MicroBitLog &log, uint16_t id = DEVICE_ID_LOG_QUEUE);
+
+        /**
+         * Destructor.
+         */
+        ~MicroBitLogQueue();
+
+        /**
+         * Places a copy of the given record onto the queue, stamped with the current time.
+         * Safe to call from any context, including interrupt handlers.
+         *
+         * @param record The record to queue.
+         * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the record is empty, or DEVICE_NO_RESOURCES if the queue is full.
+         */
+        int push(const MicroBitLogRecord &record);
+
+        /**
+         * Queues a row holding a single value.
+         * Safe to call from any context, including interrupt handlers.
+         *
+         * @param column the column to set, as returned by MicroBitLog::addColumn().
+         * @param value the value to insert.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the queue is full.
+         */
+        int push(LogColumn column, int value);
+
+        /**
+         * Queues a row holding a single value.
+         * Safe to call from any context, including interrupt handlers.
+         *
+         * @param column the column to set, as returned by MicroBitLog::addColumn().
+         * @param value the value to insert.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the queue is full.
+         */
+        int push(LogColumn column, float value);
+
+        /**
+         * Writes all pending records into the log. Must be called from fiber context.
+         * Each record is written as a row of its own, waiting for any row another fiber is building to be ended first.
+         * @return the number of records written.
+         */
+        int drain();
+
+        /**
+         * Begins draining the queue into the log from a background fiber.
+         * @return DEVICE_OK on success.
+         */
+        int start();
+
+        /**
+         * Stops the background fiber, once any pending records have been written.
+         * @return DEVICE_OK on success.
+         */
+        int stop();
+
+        /**
+         * Determines the number of records waiting to be written to the log.
+         * @return the number of pending records.
+         */
+        int getPendingCount();
+
+        /**
+         * Determines the largest number of records that have been pending at once.
+         * @return the peak number of pending records.
+         */
+        int getPeakCount();
+
+        /**
+         * Determines the number of records dropped because the queue was full.
+         * @return the number of dropped records.
+         */
+        uint32_t getDroppedCount();
+
+        private:
+
+        /**
+         * Background fiber, periodically draining the queue.
+         */
+        static void drainFiber(void *param);
+    };
+}
+
+#endif
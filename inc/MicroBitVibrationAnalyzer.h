@@ -0,0 +1,203 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MICROBIT_VIBRATION_ANALYZER_H
+#define MICROBIT_VIBRATION_ANALYZER_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "MicroBitI2C.h"
+#include "FastFourierTransform.h"
+
+//
+// Number of samples per axis in each analysed block. Must be a power of two.
+//
+#ifndef CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE
+#define CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE        256
+#endif
+
+#if (CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE > CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE)
+#error "CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE is larger than CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE"
+#endif
+
+//
+// Measurement range used while capturing, in g.
+//
+#ifndef CONFIG_VIBRATION_ANALYZER_RANGE
+#define CONFIG_VIBRATION_ANALYZER_RANGE             4
+#endif
+
+//
+// Time between reads of the sensor's FIFO, in milliseconds. The 32 entry FIFO of both supported parts
+// holds 23ms of samples at the LSM303's 1344Hz, and 40ms at the FXOS8700's 800Hz.
+//
+#ifndef CONFIG_VIBRATION_ANALYZER_POLL_PERIOD
+#define CONFIG_VIBRATION_ANALYZER_POLL_PERIOD       8
+#endif
+
+//
+// Number of dominant frequencies reported for each block.
+//
+#ifndef CONFIG_VIBRATION_ANALYZER_PEAKS
+#define CONFIG_VIBRATION_ANALYZER_PEAKS             3
+#endif
+
+//
+// Number of equal width frequency bands between 0Hz and half the sample rate, for which energies are reported.
+//
+#ifndef CONFIG_VIBRATION_ANALYZER_BANDS
+#define CONFIG_VIBRATION_ANALYZER_BANDS             8
+#endif
+
+#define DEVICE_ID_VIBRATION_ANALYZER                3045
+
+#define VIBRATION_ANALYZER_EVT_DATA_READY           1
+
+#define VIBRATION_ANALYZER_STATUS_ACTIVE            0x01
+#define VIBRATION_ANALYZER_STATUS_FIBER             0x02
+
+namespace codal
+{
+    /**
+     * Class definition for MicroBitVibrationAnalyzer.
+     *
+     * Captures blocks of accelerometer samples at the highest rate the detected motion sensor supports, and
+     * analyses their spectrum to report the dominant vibration frequencies and the energy in each frequency band.
+     *
+     * Rather than reading one sample at a time through the accelerometer driver, the sensor's hardware FIFO is
+     * enabled and drained with a single burst read every few milliseconds, so that no samples are lost.
+     * While capturing, the accelerometer driver does not receive new samples. Its configuration is restored by stop().
+     */
+    class MicroBitVibrationAnalyzer : public CodalComponent
+    {
+        private:
+        MicroBitI2C             &i2c;                                                   // The bus the motion sensor is attached to.
+        FastFourierTransform    fft;                                                    // The FFT engine.
+
+        uint16_t                address;                                                // I2C address of the detected sensor, or zero.
+        int                     sampleRate;                                             // Sample rate while capturing, in Hz.
+        int16_t                 block[3][CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE];         // Captured samples for each axis.
+        int                     blockLength;                                            // Number of samples in the current block.
+        float                   re[CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE];               // FFT working memory.
+        float                   im[CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE];               // FFT working memory.
+        float                   spectrum[CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE / 2];     // Power spectrum, summed over all axes.
+
+        float                   peakFrequency[CONFIG_VIBRATION_ANALYZER_PEAKS];         // Dominant frequencies of the last block, in Hz.
+        float                   peakAmplitude[CONFIG_VIBRATION_ANALYZER_PEAKS];         // Amplitudes of the dominant frequencies, in milli-g.
+        float                   bandEnergy[CONFIG_VIBRATION_ANALYZER_BANDS];            // Mean square acceleration in each band, in milli-g squared.
+        uint32_t                overruns;                                               // Number of times the sensor's FIFO overflowed.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param i2c The bus the motion sensor is attached to.
+         * @param id The ID of this component, used for events.
+         */
+        MicroBitVibrationAnalyzer(MicroBitI2C &i2c, uint16_t id = DEVICE_ID_VIBRATION_ANALYZER);
+
+        /**
+         * Destructor.
+         */
+        ~MicroBitVibrationAnalyzer();
+
+        /**
+         * Configures the motion sensor for high rate capture, and begins analysing blocks of samples.
+         * A VIBRATION_ANALYZER_EVT_DATA_READY event is raised as the results for each block become available.
+         *
+         * @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if no supported sensor is present, or DEVICE_I2C_ERROR.
+         */
+        int start();
+
+        /**
+         * Stops capturing, and restores the previous configuration of the accelerometer.
+         * @return DEVICE_OK on success, or DEVICE_I2C_ERROR.
+         */
+        int stop();
+
+        /**
+         * Determines the rate at which samples are captured.
+         * @return the sample rate in Hz, or zero if no supported sensor is present.
+         */
+        int getSampleRate();
+
+        /**
+         * Determines one of the dominant frequencies of the last block analysed.
+         *
+         * @param index The rank of the frequency, from zero (the strongest) to CONFIG_VIBRATION_ANALYZER_PEAKS - 1.
+         * @return the frequency in Hz, or zero if there is no such peak.
+         */
+        float getPeakFrequency(int index = 0);
+
+        /**
+         * Determines the amplitude of one of the dominant frequencies of the last block analysed.
+         *
+         * @param index The rank of the frequency, from zero (the strongest) to CONFIG_VIBRATION_ANALYZER_PEAKS - 1.
+         * @return the amplitude of the vibration at that frequency, in milli-g.
+         */
+        float getPeakAmplitude(int index = 0);
+
+        /**
+         * Determines the energy in one frequency band of the last block analysed.
+         * Band n spans frequencies from n to n+1 times the sample rate / (2 * CONFIG_VIBRATION_ANALYZER_BANDS).
+         *
+         * @param band The band, from 0 to CONFIG_VIBRATION_ANALYZER_BANDS - 1.
+         * @return the mean square acceleration in that band, in milli-g squared.
+         */
+        float getBandEnergy(int band);
+
+        /**
+         * Determines the overall level of vibration in the last block analysed, excluding gravity and other constant forces.
+         * @return the RMS acceleration, in milli-g.
+         */
+        float getRMS();
+
+        /**
+         * Determines the number of times the sensor's FIFO overflowed before it could be read, each of which loses samples.
+         * @return the number of overruns since start() was called.
+         */
+        uint32_t getOverrunCount();
+
+        private:
+
+        /**
+         * Reads all the samples waiting in the sensor's FIFO.
+         * @return DEVICE_OK on success, or DEVICE_I2C_ERROR.
+         */
+        int drain();
+
+        /**
+         * Computes the spectrum of the current block, and updates the reported results.
+         */
+        void analyse();
+
+        /**
+         * Background fiber, reading the sensor while capture is active.
+         */
+        static void captureFiber(void *param);
+    };
+}
+
+#endif
@@ -0,0 +1,140 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#ifndef NVM_MONITOR_H
+#define NVM_MONITOR_H
+
+#include "CodalConfig.h"
+#include "NVMController.h"
+#include "ErrorNo.h"
+
+namespace codal
+{
+    /**
+     * Class definition for NVMMonitor.
+     *
+     * An NVMController that passes every operation through to another, counting the operations and bytes transferred
+     * and the number of times each page is erased. Place one between a component and its storage (e.g. MicroBitLog or
+     * FSCache) to measure the flash transactions it performs, and the wear it causes.
+     * As it depends only on NVMController, it can equally wrap an in-memory NVMController in a host build.
+     */
+    class NVMMonitor : public NVMController
+    {
+        private:
+        NVMController           &nvm;               // The controller to pass operations through to.
+        uint32_t                *wear;              // The number of times each page has been erased.
+        uint32_t                pageCount;          // The number of pages held in wear.
+
+        public:
+        uint32_t                reads;              // The number of read operations.
+        uint32_t                writes;             // The number of write operations.
+        uint32_t                erases;             // The number of erase operations.
+        uint32_t                bytesRead;          // The number of bytes read.
+        uint32_t                bytesWritten;       // The number of bytes written.
+
+        /**
+         * Constructor.
+         *
+         * @param nvm The controller to pass operations through to.
+         */
+        NVMMonitor(NVMController &nvm);
+
+        /**
+         * Destructor.
+         */
+        ~NVMMonitor();
+
+        /**
+         * Resets the operation and byte counters to zero. The wear held for each page is unaffected.
+         */
+        void reset();
+
+        /**
+         * Determines the number of times the given page has been erased through this monitor.
+         *
+         * @param page The index of the page, counting from the start of the flash.
+         * @return the number of erases.
+         */
+        uint32_t getWear(uint32_t page);
+
+        /**
+         * Determines the lowest and highest number of times any page in the given range has been erased through this monitor.
+         *
+         * @param start The address of the start of the range.
+         * @param end The address of the end of the range.
+         * @param min Set to the lowest number of erases.
+         * @param max Set to the highest number of erases.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the range holds no pages.
+         */
+        int getWearRange(uint32_t start, uint32_t end, uint32_t &min, uint32_t &max);
+
+        /**
+         * Reads a block of memory from non-volatile memory into RAM.
+         *
+         * @param dest The address in RAM in which to store the result of the read operation.
+         * @param source The logical address in non-voltile memory to read from.
+         * @param size The number 32-bit words to read.
+         */
+        virtual int read(uint32_t* dest, uint32_t source, uint32_t size) override;
+
+        /**
+         * Writes data to non-volatile memory.
+         *
+         * @param dest The logical address in non-voltile memory to write to.
+         * @param source The address in RAM of the data to write.
+         * @param size The number 32-bit words to write.
+         */
+        virtual int write(uint32_t dest, uint32_t* source, uint32_t size) override;
+
+        /**
+         * Erases the given page in non-volatile memory.
+         *
+         * @param page The address of the page to erase.
+         */
+        virtual int erase(uint32_t page) override;
+
+        /**
+         * Returns the logical address of the start of non-volatile memory.
+         */
+        virtual uint32_t getFlashStart() override;
+
+        /**
+         * Returns the logical address of the end of non-volatile memory.
+         */
+        virtual uint32_t getFlashEnd() override;
+
+        /**
+         * Returns the size of a page of non-volatile memory, in bytes.
+         */
+        virtual uint32_t getPageSize() override;
+
+        /**
+         * Returns the size of non-volatile memory, in bytes.
+         */
+        virtual uint32_t getFlashSize() override;
+    };
+}
+
+#endif
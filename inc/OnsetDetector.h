@@ -0,0 +1,249 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef ONSET_DETECTOR_H
+#define ONSET_DETECTOR_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "FastFourierTransform.h"
+
+//
+// Number of samples in each analysis frame. Must be a power of two.
+//
+#ifndef CONFIG_ONSET_DETECTOR_FFT_SIZE
+#define CONFIG_ONSET_DETECTOR_FFT_SIZE              256
+#endif
+
+#if (CONFIG_ONSET_DETECTOR_FFT_SIZE > CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE)
+#error "CONFIG_ONSET_DETECTOR_FFT_SIZE is larger than CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE"
+#endif
+
+//
+// Number of samples between successive analysis frames.
+//
+#ifndef CONFIG_ONSET_DETECTOR_HOP_SIZE
+#define CONFIG_ONSET_DETECTOR_HOP_SIZE              128
+#endif
+
+//
+// Number of input samples held for analysis. Must be a power of two, and larger than the FFT size. Frames that arrive
+// while the fiber is busy wait here, until their samples are overwritten.
+//
+#ifndef CONFIG_ONSET_DETECTOR_BUFFER_SIZE
+#define CONFIG_ONSET_DETECTOR_BUFFER_SIZE           1024
+#endif
+
+#if (CONFIG_ONSET_DETECTOR_BUFFER_SIZE <= CONFIG_ONSET_DETECTOR_FFT_SIZE)
+#error "CONFIG_ONSET_DETECTOR_BUFFER_SIZE must be larger than CONFIG_ONSET_DETECTOR_FFT_SIZE"
+#endif
+
+//
+// Sample rate of the micro:bit microphone (ADC sampling period of 91uS), used when no sample rate is given.
+//
+#ifndef CONFIG_ONSET_DETECTOR_SAMPLE_RATE
+#define CONFIG_ONSET_DETECTOR_SAMPLE_RATE           10989
+#endif
+
+//
+// Default onset threshold, as a multiple of the recent mean spectral flux.
+//
+#ifndef CONFIG_ONSET_DETECTOR_SENSITIVITY
+#define CONFIG_ONSET_DETECTOR_SENSITIVITY           2.0f
+#endif
+
+//
+// Amplitude (in sample units) below which spectral components are compressed towards zero,
+// so that changes in background noise do not register as onsets.
+//
+#ifndef CONFIG_ONSET_DETECTOR_NOISE_FLOOR
+#define CONFIG_ONSET_DETECTOR_NOISE_FLOOR           16.0f
+#endif
+
+//
+// Minimum time between onsets, in milliseconds.
+//
+#ifndef CONFIG_ONSET_DETECTOR_MIN_INTERVAL
+#define CONFIG_ONSET_DETECTOR_MIN_INTERVAL          60
+#endif
+
+//
+// Number of frames of onset strength history used for tempo estimation (about 3 seconds by default).
+//
+#ifndef CONFIG_ONSET_DETECTOR_TEMPO_HISTORY
+#define CONFIG_ONSET_DETECTOR_TEMPO_HISTORY         256
+#endif
+
+//
+// Range of tempos that can be detected, in beats per minute.
+//
+#ifndef CONFIG_ONSET_DETECTOR_MIN_TEMPO
+#define CONFIG_ONSET_DETECTOR_MIN_TEMPO             60
+#endif
+
+#ifndef CONFIG_ONSET_DETECTOR_MAX_TEMPO
+#define CONFIG_ONSET_DETECTOR_MAX_TEMPO             200
+#endif
+
+//
+// Beats are no longer generated if no onset has been detected for this long, in milliseconds.
+//
+#ifndef CONFIG_ONSET_DETECTOR_BEAT_TIMEOUT
+#define CONFIG_ONSET_DETECTOR_BEAT_TIMEOUT          3000
+#endif
+
+#ifndef DEVICE_ID_MICROPHONE
+#define DEVICE_ID_MICROPHONE                        3001
+#endif
+
+// Used only to wake the analysis fiber, so that listeners on the microphone do not receive an event for every frame.
+#define DEVICE_ID_ONSET_DETECTOR                    3048
+
+// Chosen to coexist with the LevelDetectorSPL events also raised on DEVICE_ID_MICROPHONE.
+#define ONSET_DETECTOR_EVT_ONSET                    16
+#define ONSET_DETECTOR_EVT_BEAT                     17
+
+// Raised on DEVICE_ID_ONSET_DETECTOR.
+#define ONSET_DETECTOR_EVT_FRAME                    1
+
+#define ONSET_DETECTOR_STATUS_ACTIVE                0x0001
+#define ONSET_DETECTOR_STATUS_FIBER                 0x0002
+
+namespace codal
+{
+    /**
+     * Class definition for OnsetDetector.
+     *
+     * A DataSink that detects note onsets and estimates the tempo of the audio it receives.
+     *
+     * Onsets are detected as peaks in the spectral flux (the sum of increases in log magnitude across all frequency
+     * bins between frames), above an adaptive threshold. Tempo is estimated from the autocorrelation of the recent
+     * flux history, weighted towards 120 BPM to resolve octave ambiguity. Beats are then predicted from the tempo, with
+     * their phase pulled towards the detected onsets.
+     *
+     * Events are raised with timestamps interpolated to the estimated position of each onset or beat within the
+     * audio stream, rather than the time at which the containing buffer was processed.
+     *
+     * Samples are captured in the context of the upstream component, while the analysis is performed on a background
+     * fiber. Frames wait in the sample buffer until the fiber is free. If the fiber falls so far behind that the samples
+     * of a waiting frame are overwritten, that frame is dropped and counted.
+     */
+    class OnsetDetector : public DataSink, public CodalComponent
+    {
+        private:
+        DataSource              &upstream;                                              // Our upstream component.
+        FastFourierTransform    fft;                                                    // The FFT engine.
+
+        float                   sampleRate;                                             // The sample rate of the input stream.
+        int16_t                 samples[CONFIG_ONSET_DETECTOR_BUFFER_SIZE];             // The most recent input samples.
+        uint32_t                written;                                                // Number of samples received.
+        int                     countdown;                                              // Samples until the next frame is due.
+        int                     pending;                                                // Number of frames waiting to be analysed.
+        uint32_t                frameEnd;                                               // Value of written at the end of the newest waiting frame.
+        CODAL_TIMESTAMP         frameTime;                                              // Time of the middle of the newest waiting frame, in microseconds.
+        uint32_t                dropped;                                                // Number of frames dropped.
+        float                   re[CONFIG_ONSET_DETECTOR_FFT_SIZE];                     // FFT working memory.
+        float                   im[CONFIG_ONSET_DETECTOR_FFT_SIZE];                     // FFT working memory.
+        float                   magnitude[CONFIG_ONSET_DETECTOR_FFT_SIZE / 2];          // Log magnitude spectrum of the previous frame.
+
+        float                   flux[3];                                                // Spectral flux of the three most recent frames.
+        CODAL_TIMESTAMP         fluxTime;                                               // Time of the middle of these frames, in microseconds.
+        float                   meanFlux;                                               // Recent average spectral flux.
+        float                   sensitivity;                                            // Onset threshold, relative to meanFlux.
+        CODAL_TIMESTAMP         lastOnset;                                              // Time of the last onset, in microseconds.
+
+        float                   history[CONFIG_ONSET_DETECTOR_TEMPO_HISTORY];           // Recent spectral flux, for tempo estimation.
+        int                     historyHead;                                            // Index of the oldest entry in the history.
+        int                     frames;                                                 // Number of frames processed since the last tempo estimate.
+        float                   period;                                                 // Beat period in microseconds, or zero if unknown.
+        CODAL_TIMESTAMP         nextBeat;                                               // Predicted time of the next beat, in microseconds.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The DataSource to receive audio from.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param id The ID of this component, used for events. Defaults to that of the microphone.
+         */
+        OnsetDetector(DataSource &source, float sampleRate = CONFIG_ONSET_DETECTOR_SAMPLE_RATE, uint16_t id = DEVICE_ID_MICROPHONE);
+
+        /**
+         * Destructor.
+         */
+        ~OnsetDetector();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Defines how readily onsets are detected.
+         *
+         * @param sensitivity The onset threshold, as a multiple of the recent mean spectral flux. Lower values detect more onsets.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setSensitivity(float sensitivity);
+
+        /**
+         * Determines the current tempo estimate.
+         * @return the tempo in beats per minute, or zero if no steady beat has been detected.
+         */
+        float getTempo();
+
+        /**
+         * Determines the time of the most recent onset.
+         * @return the time of the last onset, in microseconds, or zero if none has been detected.
+         */
+        CODAL_TIMESTAMP getLastOnsetTime();
+
+        /**
+         * Determines the number of frames dropped because the analysis could not keep up.
+         * @return the number of dropped frames.
+         */
+        uint32_t getDroppedCount();
+
+        private:
+
+        /**
+         * Analyses the oldest waiting frame of samples.
+         */
+        void processFrame();
+
+        /**
+         * Background fiber, processing frames as they become ready.
+         */
+        static void frameFiber(void *param);
+
+        /**
+         * Updates the tempo estimate from the flux history.
+         */
+        void estimateTempo();
+    };
+}
+
+#endif
@@ -0,0 +1,210 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SOUND_ACTIVITY_DETECTOR_H
+#define SOUND_ACTIVITY_DETECTOR_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+
+//
+// Sample rate of the micro:bit microphone (ADC sampling period of 91uS), used when no sample rate is given.
+//
+#ifndef CONFIG_SOUND_ACTIVITY_SAMPLE_RATE
+#define CONFIG_SOUND_ACTIVITY_SAMPLE_RATE           10989.0f
+#endif
+
+//
+// Number of buffers retained while inactive, and replayed downstream when activity is detected.
+//
+#ifndef CONFIG_SOUND_ACTIVITY_PREROLL_BUFFERS
+#define CONFIG_SOUND_ACTIVITY_PREROLL_BUFFERS       4
+#endif
+
+//
+// Period of time for which the detector remains active after activity was last detected, in milliseconds.
+//
+#ifndef CONFIG_SOUND_ACTIVITY_HANGOVER
+#define CONFIG_SOUND_ACTIVITY_HANGOVER              300
+#endif
+
+//
+// Ratio of block energy to background noise energy that indicates activity.
+//
+#ifndef CONFIG_SOUND_ACTIVITY_THRESHOLD
+#define CONFIG_SOUND_ACTIVITY_THRESHOLD             4.0f
+#endif
+
+//
+// Minimum RMS level of a block (in sample units) that can be considered active, regardless of the noise floor.
+//
+#ifndef CONFIG_SOUND_ACTIVITY_MINIMUM_LEVEL
+#define CONFIG_SOUND_ACTIVITY_MINIMUM_LEVEL         64
+#endif
+
+//
+// Range of zero crossing rates (crossings per second) characteristic of voiced sound.
+// Blocks within this range are considered active at half the normal energy threshold.
+//
+#ifndef CONFIG_SOUND_ACTIVITY_ZCR_LOW
+#define CONFIG_SOUND_ACTIVITY_ZCR_LOW               100
+#endif
+
+#ifndef CONFIG_SOUND_ACTIVITY_ZCR_HIGH
+#define CONFIG_SOUND_ACTIVITY_ZCR_HIGH              3000
+#endif
+
+#define DEVICE_ID_SOUND_ACTIVITY_DETECTOR           3041
+
+#define SOUND_ACTIVITY_EVT_ACTIVE                   1
+#define SOUND_ACTIVITY_EVT_INACTIVE                 2
+
+#define SOUND_ACTIVITY_STATUS_ACTIVE                0x0001
+#define SOUND_ACTIVITY_STATUS_CONNECTED             0x0002
+
+namespace codal
+{
+    /**
+     * Class definition for SoundActivityDetector.
+     *
+     * A lightweight, energy and zero crossing rate based activity detector intended to sit at the head of
+     * an audio pipeline. While no activity is detected, buffers are withheld from the downstream component,
+     * such that more expensive processing (FFTs, recorders, etc) consumes no CPU. The most recent buffers
+     * are retained in a short pre-roll ring and are delivered ahead of live data when activity begins,
+     * so that the onset of a sound is not lost.
+     */
+    class SoundActivityDetector : public DataSink, public DataSource, public CodalComponent
+    {
+        private:
+        DataSource      &upstream;                                              // Our upstream component.
+        DataSink        *downStream;                                            // Our downstream component.
+        ManagedBuffer   queue[CONFIG_SOUND_ACTIVITY_PREROLL_BUFFERS + 1];       // Ring of buffers awaiting delivery or held as pre-roll.
+        int             head;                                                   // Index of the oldest buffer in the queue.
+        int             count;                                                  // Number of buffers in the queue.
+        int             notified;                                               // Number of queued buffers announced to our downstream component.
+        uint32_t        dropped;                                                // Number of buffers discarded while active, due to a slow consumer.
+
+        float           sampleRate;                                             // Sample rate of the input stream.
+        uint32_t        noiseFloor;                                             // Adaptive estimate of the background mean square level.
+        uint32_t        threshold;                                              // Activity threshold, as a multiple of the noise floor (Q8).
+        uint32_t        minimumLevel;                                           // Minimum mean square level considered active.
+        uint32_t        hangover;                                               // Hangover period, in samples.
+        uint32_t        quietSamples;                                           // Number of samples since activity was last detected.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The DataSource to receive audio from. Samples are expected to be signed, with any DC offset removed.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param id The ID of this component, used for events.
+         */
+        SoundActivityDetector(DataSource &source, float sampleRate = CONFIG_SOUND_ACTIVITY_SAMPLE_RATE, uint16_t id = DEVICE_ID_SOUND_ACTIVITY_DETECTOR);
+
+        /**
+         * Destructor.
+         */
+        ~SoundActivityDetector();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Provide the next available ManagedBuffer to our downstream caller, if available.
+         */
+        virtual ManagedBuffer pull();
+
+        /**
+         * Define a downstream component for data stream.
+         *
+         * @sink The component that data will be delivered to, when it is availiable
+         */
+        virtual void connect(DataSink &sink);
+
+        /**
+         * Disconnect our downstream component.
+         */
+        virtual void disconnect();
+
+        /**
+         * Determine the data format of the buffers streamed out of this component.
+         */
+        virtual int getFormat();
+
+        /**
+         * Determines if activity is currently detected.
+         * @return true if buffers are currently being delivered downstream, false otherwise.
+         */
+        bool isActive();
+
+        /**
+         * Defines the sensitivity of the detector.
+         *
+         * @param ratio The ratio of signal energy to background noise energy that indicates activity (e.g. 4.0 = 6dB).
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setThreshold(float ratio);
+
+        /**
+         * Defines the minimum level of sound considered as activity, regardless of the background noise level.
+         *
+         * @param level The minimum RMS level, in sample units.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setMinimumLevel(int level);
+
+        /**
+         * Defines how long the detector remains active after activity was last detected.
+         *
+         * @param milliseconds The hangover period.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setHangover(int milliseconds);
+
+        /**
+         * Determines the number of buffers discarded while active because our downstream component did not keep up.
+         * @return the number of buffers dropped.
+         */
+        uint32_t getDroppedCount();
+
+        private:
+
+        /**
+         * Analyses the given buffer, updating the activity state of this detector.
+         * @return true if the buffer contains activity, false otherwise.
+         */
+        bool analyse(ManagedBuffer &b);
+
+        /**
+         * Announces any unannounced buffers to our downstream component.
+         */
+        void release();
+    };
+}
+
+#endif
@@ -0,0 +1,254 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SOUND_LEVEL_METER_H
+#define SOUND_LEVEL_METER_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "BiquadFilter.h"
+
+//
+// Sample rate of the micro:bit microphone (ADC sampling period of 91uS), used when no sample rate is given.
+//
+#ifndef CONFIG_SOUND_LEVEL_METER_SAMPLE_RATE
+#define CONFIG_SOUND_LEVEL_METER_SAMPLE_RATE        10989.0f
+#endif
+
+//
+// Default integration period used to calculate Leq values, in milliseconds.
+//
+#ifndef CONFIG_SOUND_LEVEL_METER_DEFAULT_WINDOW
+#define CONFIG_SOUND_LEVEL_METER_DEFAULT_WINDOW     1000
+#endif
+
+//
+// Sound pressure level (dB SPL) corresponding to a full scale RMS input. Should be calibrated per device type.
+//
+#ifndef CONFIG_SOUND_LEVEL_METER_CALIBRATION
+#define CONFIG_SOUND_LEVEL_METER_CALIBRATION        120.0f
+#endif
+
+//
+// Lowest centre frequency of any band in the filter bank, in Hz.
+//
+#ifndef CONFIG_SOUND_LEVEL_METER_MIN_FREQUENCY
+#define CONFIG_SOUND_LEVEL_METER_MIN_FREQUENCY      25.0f
+#endif
+
+//
+// Number of cascaded biquad sections used for each band pass filter. Higher values give steeper band edges.
+//
+#ifndef CONFIG_SOUND_LEVEL_METER_BAND_SECTIONS
+#define CONFIG_SOUND_LEVEL_METER_BAND_SECTIONS      2
+#endif
+
+//
+// Maximum number of times the input is decimated by two to process low frequency bands at a reduced sample rate.
+//
+#ifndef CONFIG_SOUND_LEVEL_METER_DECIMATION_LEVELS
+#define CONFIG_SOUND_LEVEL_METER_DECIMATION_LEVELS  6
+#endif
+
+//
+// Number of samples processed in a single pass of the filter bank. Defines the size of the working buffer.
+//
+#ifndef CONFIG_SOUND_LEVEL_METER_CHUNK_SIZE
+#define CONFIG_SOUND_LEVEL_METER_CHUNK_SIZE         64
+#endif
+
+#define DEVICE_ID_SOUND_LEVEL_METER                 3040
+
+#define SOUND_LEVEL_METER_EVT_UPDATE                1
+
+#define SOUND_LEVEL_METER_STATUS_ACTIVE             0x0001
+
+namespace codal
+{
+    /**
+     * Defines the resolution of the filter bank.
+     */
+    enum class SoundLevelMeterBands
+    {
+        None = 0,
+        Octave = 1,
+        ThirdOctave = 3
+    };
+
+    /**
+     * A single band of the filter bank, and its energy integrator.
+     */
+    struct SoundLevelMeterBand
+    {
+        float           frequency;                                          // Nominal centre frequency of this band, in Hz.
+        int             level;                                              // Decimation level this band is processed at.
+        BiquadFilter    filter[CONFIG_SOUND_LEVEL_METER_BAND_SECTIONS];     // Band pass filter cascade.
+        uint64_t        energy;                                             // Sum of squared samples in the current window.
+        uint32_t        samples;                                            // Number of samples in the current window.
+        float           leq;                                                // Most recently published Leq for this band.
+    };
+
+    /**
+     * Class definition for SoundLevelMeter.
+     *
+     * A DataSink that calculates A-weighted, unweighted and 1/1 or 1/3 octave band equivalent continuous sound
+     * levels (Leq) from an audio stream, publishing new values at the end of each integration window.
+     *
+     * All filtering is performed in fixed point. Low frequency bands are processed at a successively decimated
+     * sample rate, such that the cost of the filter bank is roughly twice that of its highest octave.
+     *
+     * The A-weighting filter is fitted to the curve defined in IEC 61672 at the sample rate given. At the sample rate
+     * of the micro:bit microphone it lies within 0.15dB of that curve at every third octave frequency from 10Hz to
+     * 4kHz, and within 0.65dB up to 0.45 of the sample rate at any rate up to 44.1kHz.
+     */
+    class SoundLevelMeter : public DataSink, public CodalComponent
+    {
+        private:
+        DataSource              &upstream;                                                      // Our upstream component.
+        float                   sampleRate;                                                     // Sample rate of the input stream.
+        SoundLevelMeterBand     *bands;                                                         // The bands of the filter bank, ordered by descending frequency.
+        int                     bandCount;                                                      // Number of bands in the filter bank.
+        int                     levels;                                                         // Number of decimation levels in use.
+        BiquadFilter            decimator[CONFIG_SOUND_LEVEL_METER_DECIMATION_LEVELS][2];       // Anti-alias filters applied before each decimation.
+        bool                    phase[CONFIG_SOUND_LEVEL_METER_DECIMATION_LEVELS];              // Alternating sample selector for each decimator.
+        BiquadFilter            aWeighting[3];                                                  // A-weighting filter cascade.
+        uint64_t                energyA;                                                        // A-weighted sum of squares in the current window.
+        uint64_t                energyZ;                                                        // Unweighted sum of squares in the current window.
+        uint32_t                samples;                                                        // Number of input samples in the current window.
+        uint32_t                windowSamples;                                                  // Number of input samples per integration window.
+        float                   calibration;                                                    // dB SPL of a full scale RMS signal.
+        float                   leqA;                                                           // Most recently published A-weighted Leq.
+        float                   leqZ;                                                           // Most recently published unweighted Leq.
+        int32_t                 chunk[CONFIG_SOUND_LEVEL_METER_CHUNK_SIZE];                     // Working buffer.
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The DataSource to receive audio from. Samples are expected to be signed, with any DC offset removed.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param bands The resolution of the filter bank to use.
+         * @param id The ID of this component, used for events.
+         * @param connectImmediately If true, this component will begin receiving data immediately.
+         */
+        SoundLevelMeter(DataSource &source, float sampleRate = CONFIG_SOUND_LEVEL_METER_SAMPLE_RATE, SoundLevelMeterBands bands = SoundLevelMeterBands::Octave, uint16_t id = DEVICE_ID_SOUND_LEVEL_METER, bool connectImmediately = true);
+
+        /**
+         * Destructor.
+         */
+        ~SoundLevelMeter();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Defines the resolution of the filter bank. Any partially integrated data is discarded.
+         *
+         * @param bands SoundLevelMeterBands::None, SoundLevelMeterBands::Octave or SoundLevelMeterBands::ThirdOctave.
+         * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the filter bank could not be allocated.
+         */
+        int setBands(SoundLevelMeterBands bands);
+
+        /**
+         * Defines the integration period over which Leq values are calculated. Any partially integrated data is discarded.
+         *
+         * @param milliseconds The length of the window, in milliseconds.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setWindow(int milliseconds);
+
+        /**
+         * Defines the sound pressure level that corresponds to a full scale RMS input signal.
+         *
+         * @param spl The calibration level, in dB SPL.
+         */
+        void setCalibration(float spl);
+
+        /**
+         * Determines the most recent A-weighted equivalent continuous sound level.
+         * @return The LAeq over the last complete window, in dB.
+         */
+        float getLeqA();
+
+        /**
+         * Determines the most recent unweighted equivalent continuous sound level.
+         * @return The LZeq over the last complete window, in dB.
+         */
+        float getLeqZ();
+
+        /**
+         * Determines the number of bands in the filter bank.
+         * @return the number of bands available.
+         */
+        int getBandCount();
+
+        /**
+         * Determines the nominal centre frequency of the given band.
+         *
+         * @param band The index of the band, where band 0 is the highest frequency band.
+         * @return the centre frequency of the band in Hz, or zero if the band does not exist.
+         */
+        float getBandFrequency(int band);
+
+        /**
+         * Determines the most recent equivalent continuous sound level of the given band.
+         *
+         * @param band The index of the band, where band 0 is the highest frequency band.
+         * @return The Leq of the band over the last complete window, in dB, or zero if the band does not exist.
+         */
+        float getBandLeq(int band);
+
+        private:
+
+        /**
+         * Positions the high frequency pole of the A-weighting filter to best fit the curve defined in IEC 61672.
+         *
+         * @return The position of the double real pole in the z-plane.
+         */
+        float fitAWeighting();
+
+        /**
+         * Passes a block of samples through the weighting filters and filter bank.
+         *
+         * @param len the number of samples held in the working buffer.
+         */
+        void process(int len);
+
+        /**
+         * Calculates and publishes the Leq values for the current window, and resets the integrators.
+         */
+        void publish();
+
+        /**
+         * Converts a mean square value into a calibrated sound level.
+         */
+        float toDecibels(uint64_t energy, uint32_t samples);
+    };
+}
+
+#endif
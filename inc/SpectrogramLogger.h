@@ -0,0 +1,181 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SPECTROGRAM_LOGGER_H
+#define SPECTROGRAM_LOGGER_H
+
+#include "CodalConfig.h"
+#include "CodalComponent.h"
+#include "DataStream.h"
+#include "FastFourierTransform.h"
+#include "MicroBitLog.h"
+
+//
+// Number of samples in each spectral frame. Must be a power of two.
+// Each frame records FFT_SIZE/2 frequency bins.
+//
+#ifndef CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE
+#define CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE          128
+#endif
+
+#if (CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE > CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE)
+#error "CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE is larger than CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE"
+#endif
+
+//
+// Default number of frames logged per second.
+//
+#ifndef CONFIG_SPECTROGRAM_LOGGER_FRAME_RATE
+#define CONFIG_SPECTROGRAM_LOGGER_FRAME_RATE        10
+#endif
+
+//
+// Sample rate of the micro:bit microphone (ADC sampling period of 91uS), used when no sample rate is given.
+//
+#ifndef CONFIG_SPECTROGRAM_LOGGER_SAMPLE_RATE
+#define CONFIG_SPECTROGRAM_LOGGER_SAMPLE_RATE       10989
+#endif
+
+#define SPECTROGRAM_LOGGER_RECORD_HEADER_SIZE       8
+
+#if (SPECTROGRAM_LOGGER_RECORD_HEADER_SIZE + CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE / 2 > CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD)
+#error "CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE is too large for CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD"
+#endif
+
+#define DEVICE_ID_SPECTROGRAM_LOGGER                3043
+
+#define SPECTROGRAM_LOGGER_EVT_FRAME                1
+
+#define SPECTROGRAM_LOGGER_STATUS_ACTIVE            0x0001
+#define SPECTROGRAM_LOGGER_STATUS_FIBER             0x0002
+#define SPECTROGRAM_LOGGER_STATUS_FRAME_READY       0x0004
+
+#define SPECTROGRAM_LOGGER_RECORD_TYPE              'S'
+
+namespace codal
+{
+    /**
+     * Class definition for SpectrogramLogger.
+     *
+     * A DataSink that periodically computes the spectrum of its input, and writes each frame
+     * into a MicroBitLog as a packed binary record (see MicroBitLog::logBinary()):
+     *
+     * +-------------------------------+
+     * |  uint32_t time (ms)           |
+     * |  uint16_t sample rate (Hz)    |
+     * |  uint16_t FFT size            |
+     * +-------------------------------+
+     * |  uint8_t level of each bin,   |
+     * |  in units of 0.5 dB           |
+     * +-------------------------------+
+     *
+     * Levels are the amplitude of each bin, relative to a sinusoid of amplitude one sample unit.
+     *
+     * Samples are captured in the context of the upstream component, while the FFT and storage writes are
+     * performed on a background fiber. If the fiber is still busy with the previous frame when the next is
+     * due, the new frame is dropped and counted.
+     */
+    class SpectrogramLogger : public DataSink, public CodalComponent
+    {
+        private:
+        DataSource              &upstream;                                          // Our upstream component.
+        MicroBitLog             &log;                                               // The log to write to.
+        FastFourierTransform    fft;                                                // The FFT engine.
+
+        int                     sampleRate;                                         // The sample rate of the input stream.
+        int                     hop;                                                // Number of samples between the start of each frame.
+        int                     countdown;                                          // Number of samples until the next frame is due.
+        int16_t                 history[CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE];        // The most recent input samples.
+        int                     historyHead;                                        // Index of the oldest sample in the history.
+        uint32_t                frameTime;                                          // Time at which the pending frame was captured, in milliseconds.
+        uint32_t                dropped;                                            // Number of frames dropped.
+
+        float                   re[CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE];             // FFT working memory.
+        float                   im[CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE];             // FFT working memory.
+        uint8_t                 record[SPECTROGRAM_LOGGER_RECORD_HEADER_SIZE + CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE / 2];
+
+        public:
+
+        /**
+         * Constructor.
+         *
+         * @param source The DataSource to receive audio from.
+         * @param log The log to write spectra into.
+         * @param sampleRate The sample rate of the given source, in Hz.
+         * @param id The ID of this component, used for events.
+         */
+        SpectrogramLogger(DataSource &source, MicroBitLog &log, int sampleRate = CONFIG_SPECTROGRAM_LOGGER_SAMPLE_RATE, uint16_t id = DEVICE_ID_SPECTROGRAM_LOGGER);
+
+        /**
+         * Destructor.
+         */
+        ~SpectrogramLogger();
+
+        /**
+         * Callback provided when data is ready.
+         */
+        virtual int pullRequest();
+
+        /**
+         * Begins logging spectral frames.
+         * @return DEVICE_OK on success.
+         */
+        int start();
+
+        /**
+         * Stops logging spectral frames.
+         * Waits for any frame being written to complete.
+         * @return DEVICE_OK on success.
+         */
+        int stop();
+
+        /**
+         * Defines the number of frames logged per second.
+         *
+         * @param framesPerSecond The frame rate, between 1 and the sample rate.
+         * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+         */
+        int setFrameRate(int framesPerSecond);
+
+        /**
+         * Determines the number of frames dropped because the log could not keep up.
+         * @return the number of dropped frames.
+         */
+        uint32_t getDroppedCount();
+
+        private:
+
+        /**
+         * Computes the spectrum of the pending frame, and writes it to the log.
+         */
+        void processFrame();
+
+        /**
+         * Background fiber, processing frames as they become ready.
+         */
+        static void frameFiber(void *param);
+    };
+}
+
+#endif
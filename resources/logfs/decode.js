@@ -0,0 +1,47 @@
+/**
+ * Host tool to extract data from a MY_DATA.HTM file saved from a micro:bit.
+ *
+ * Usage: node decode.js MY_DATA.HTM [output prefix]
+ *
+ * Writes the CSV data to <prefix>.csv, any spectrogram frames to <prefix>.spectrogram.csv, and the rows of each
+ * named table to <prefix>.<table name>.csv.
+ */
+const fs = require("fs");
+const path = require("path");
+const logfs = require("./dl.js");
+
+if (process.argv.length < 3) {
+  console.error("Usage: node decode.js MY_DATA.HTM [output prefix]");
+  process.exit(1);
+}
+
+const input = process.argv[2];
+const prefix =
+  process.argv[3] || path.join(path.dirname(input), path.parse(input).name);
+
+// Read as latin1 so that each byte maps to one character, with offsets matching the flash layout.
+const file = fs.readFileSync(input, { encoding: "latin1" });
+const log = logfs.decode(file.substr(2048));
+
+if (!log) {
+  console.error(`${input} does not contain a micro:bit data log`);
+  process.exit(1);
+}
+
+if (log.full) {
+  console.log("Log is full");
+}
+
+fs.writeFileSync(prefix + ".csv", log.csv);
+console.log(`Wrote ${prefix}.csv`);
+
+const spectrogram = logfs.spectrogramToCsv(log.records);
+if (spectrogram) {
+  fs.writeFileSync(prefix + ".spectrogram.csv", spectrogram);
+  console.log(`Wrote ${prefix}.spectrogram.csv`);
+}
+
+Object.keys(log.tables).forEach(function (name) {
+  fs.writeFileSync(`${prefix}.${name}.csv`, log.tables[name]);
+  console.log(`Wrote ${prefix}.${name}.csv`);
+});
@@ -1,8 +1,368 @@
 /**
- * Data logging support file for "online" mode.
+ * Data logging support file for "online" mode, published as https://microbit.org/dl/2/dl.js.
  * This content is managed in https://github.com/lancaster-university/codal-microbit-v2/
  */
 (function () {
+  /**
+   * Decodes the file system content that follows the HTML header.
+   * See MicroBitLog.h/cpp for the format.
+   *
+   * @param raw the text following the "<!--FS_START" delimiter.
+   * @returns {csv, records, tables, full, binary, wrapped}, where records is a list of {type, data} binary records, tables
+   * maps the name of each named table to its rows as CSV, binary indicates that rows stored in compressed format have been
+   * converted into the csv, and wrapped indicates that a circular log has been reordered, or undefined if no log is present.
+   */
+  function decode(raw) {
+    if (!/^UBIT_LOG_FS_V_002/.test(raw)) {
+      return undefined;
+    }
+    let dataStart = parseInt(raw.substr(29, 10), 16) - 2048;
+    let logEnd = parseInt(raw.substr(18, 10), 16);
+    let dataEnd = findByte(raw, dataStart, true);
+    let data = raw.substring(dataStart, dataEnd);
+    let csv = "";
+    let headings = "";
+    let wrapped = raw.substr(logEnd - 2048 + 1, 3) === "WRP";
+    if (wrapped) {
+      // A circular log. The oldest data follows the erased space after the newest, and runs up to logEnd.
+      let older = raw.substring(findByte(raw, dataEnd, false), logEnd - 2048);
+      // The oldest page may begin part way through a row, unless it starts with a binary record.
+      if (older && older.charCodeAt(0) != 0x1e) {
+        older = older.substr(older.indexOf("\n") + 1);
+      }
+      data = older + data;
+      // The row holding the headings may have been erased, so start with those held in the metadata page.
+      let start = 40;
+      while (raw.charCodeAt(start) == 0) {
+        start++;
+      }
+      headings = raw.substring(start, findByte(raw, start, true)).split("\n")[0];
+      if (headings && data.split("\n", 1)[0] !== headings) {
+        csv = headings + "\n";
+      }
+    }
+    let records = [];
+    let schema = [];
+    // Named tables, by tag and by name.
+    let tags = {};
+    let tables = {};
+    let headingsPending = false;
+    let binary = false;
+    data
+      .split("\n")
+      .forEach(function (line) {
+        let type = line.charCodeAt(0) == 0x1e ? line[1] : undefined;
+        let data = type ? decodeBase64(line.substr(2)) : undefined;
+        // Index records are only used to seek within the log on the device.
+        if (type === "!") {
+          return;
+        }
+        if (type === "=") {
+          // A named table definition: its tag and name, then its schema in the same form as a '#' record.
+          let end = data.indexOf(0, 1);
+          let name = decodeText(data.subarray(1, end));
+          let definition = data.subarray(end + 1);
+          let table = tags[data[0]];
+          tags[data[0]] = {
+            name: name,
+            schema: (definition[0] === 0 || !table || table.name !== name
+              ? []
+              : table.schema
+            ).concat(decodeSchema(definition)),
+          };
+          return;
+        }
+        if (type === "&") {
+          let table = tags[data[0]];
+          if (!table || !table.schema.length) {
+            return;
+          }
+          let out = tables[table.name] || (tables[table.name] = { csv: "" });
+          let names = table.schema
+            .map(function (c) {
+              return c.name;
+            })
+            .join(",");
+          if (names !== out.headings) {
+            out.csv += names + "\n";
+            out.headings = names;
+          }
+          decodeRows(data.subarray(1), table.schema, false, true).forEach(function (row) {
+            out.csv += row.join(",") + "\n";
+          });
+          return;
+        }
+        if (type === "#") {
+          // A schema may span several records, so write out its headings ahead of the next row.
+          schema = (data[0] === 0 ? [] : schema).concat(decodeSchema(data));
+          headingsPending = true;
+          return;
+        }
+        if (type && type !== "%" && type !== "$") {
+          records.push({ type: type, data: data });
+          return;
+        }
+        // Skip empty lines, and rows whose schema has been erased from a circular log.
+        if (!line || (type && !schema.length)) {
+          return;
+        }
+        if (headingsPending) {
+          let names = schema
+            .map(function (c) {
+              return c.name;
+            })
+            .join(",");
+          // Schemas are repeated in circular logs, but the headings only need to be written when they change.
+          if (names !== headings) {
+            csv += names + "\n";
+            headings = names;
+          }
+          headingsPending = false;
+        }
+        if (type) {
+          decodeRows(data, schema, type === "%", false).forEach(function (row) {
+            csv += row.join(",") + "\n";
+          });
+          binary = true;
+        } else {
+          csv += line + "\n";
+        }
+      });
+    return {
+      csv: csv,
+      records: records,
+      tables: Object.keys(tables).reduce(function (acc, name) {
+        acc[name] = tables[name].csv;
+        return acc;
+      }, {}),
+      full: raw.substr(logEnd - 2048 + 1, 3) === "FUL",
+      binary: binary,
+      wrapped: wrapped,
+    };
+  }
+
+  /**
+   * Finds the first byte at or after the given offset that is (or is not) unused storage.
+   * Unused storage reads as 0xFF, which browsers present as U+FFFD.
+   */
+  function findByte(raw, offset, unused) {
+    while (offset < raw.length) {
+      let c = raw.charCodeAt(offset);
+      if ((c == 0xfffd || c == 0xff) == unused) {
+        break;
+      }
+      offset++;
+    }
+    return offset;
+  }
+
+  function decodeText(bytes) {
+    if (typeof TextDecoder !== "undefined") {
+      return new TextDecoder().decode(bytes);
+    }
+    return String.fromCharCode.apply(null, bytes);
+  }
+
+  /**
+   * Decodes a schema ('#') record into a list of {type, name} columns.
+   */
+  function decodeSchema(data) {
+    let columns = [];
+    let i = 1;
+    while (i < data.length) {
+      let end = data.indexOf(0, i + 1);
+      if (end < 0) {
+        end = data.length;
+      }
+      columns.push({
+        type: String.fromCharCode(data[i]),
+        name: decodeText(data.subarray(i + 1, end)),
+      });
+      i = end + 1;
+    }
+    return columns;
+  }
+
+  /**
+   * Decodes a compressed ('%') or binary ('$') rows record, or the row of a table ('&') record, into a list of rows,
+   * each a list of values, one per column of the given schema. In compressed records, integers are zig-zag varints
+   * holding the difference from the value of the column in the previous row of the record. Elsewhere they are 1, 2 or
+   * 4 bytes, as given by the type of their column.
+   */
+  function decodeRows(data, schema, compressed, single) {
+    let view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+    let offset = 0;
+    let previous = schema.map(function () {
+      return 0;
+    });
+    let rows = [];
+    while (offset < data.length) {
+      let bitmap = offset;
+      offset += Math.ceil(schema.length / 8);
+      rows.push(
+        schema.map(function (column, i) {
+          if (!(data[bitmap + (i >> 3)] & (1 << (i & 7)))) {
+            return "";
+          }
+          if (column.type === "s") {
+            let length = data[offset];
+            offset += length + 1;
+            return decodeText(data.subarray(offset - length, offset));
+          }
+          let width = { b: 1, h: 2, i: 4 }[column.type];
+          if (compressed && width) {
+            let z = 0;
+            let scale = 1;
+            let b;
+            do {
+              b = data[offset++];
+              z += (b & 0x7f) * scale;
+              scale *= 128;
+            } while (b & 0x80);
+            previous[i] = (previous[i] + (z % 2 ? -(z + 1) / 2 : z / 2)) | 0;
+            return previous[i];
+          }
+          if (width === 1) {
+            return view.getInt8(offset++);
+          }
+          if (width === 2) {
+            offset += 2;
+            return view.getInt16(offset - 2, true);
+          }
+          offset += 4;
+          if (column.type === "f") {
+            return parseFloat(view.getFloat32(offset - 4, true).toPrecision(7));
+          }
+          return view.getInt32(offset - 4, true);
+        })
+      );
+      if (single) {
+        break;
+      }
+    }
+    return rows;
+  }
+
+  function decodeBase64(s) {
+    let table =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    let out = [];
+    for (let i = 0; i < s.length; i += 4) {
+      let v = 0;
+      for (let j = 0; j < 4; j++) {
+        v = (v << 6) | Math.max(0, table.indexOf(s[i + j]));
+      }
+      out.push((v >> 16) & 0xff);
+      if (s[i + 2] != "=") out.push((v >> 8) & 0xff);
+      if (s[i + 3] != "=") out.push(v & 0xff);
+    }
+    return new Uint8Array(out);
+  }
+
+  /**
+   * Decodes a spectrogram frame ('S' record) written by SpectrogramLogger.
+   *
+   * @returns {time, sampleRate, fftSize, levels}, where time is in milliseconds and levels are
+   * the amplitude of each frequency bin in dB.
+   */
+  function decodeSpectrum(data) {
+    let view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+    let levels = [];
+    for (let i = 8; i < data.length; i++) {
+      levels.push(data[i] / 2);
+    }
+    return {
+      time: view.getUint32(0, true),
+      sampleRate: view.getUint16(4, true),
+      fftSize: view.getUint16(6, true),
+      levels: levels,
+    };
+  }
+
+  /**
+   * Converts the spectrogram frames within the given records to CSV, one row per frame.
+   */
+  function spectrogramToCsv(records) {
+    let frames = records
+      .filter(function (r) {
+        return r.type === "S";
+      })
+      .map(function (r) {
+        return decodeSpectrum(r.data);
+      });
+    if (frames.length === 0) {
+      return "";
+    }
+    let f = frames[0];
+    let heading = ["Time (milliseconds)"].concat(
+      f.levels.map(function (_, k) {
+        return Math.round((k * f.sampleRate) / f.fftSize) + " Hz (dB)";
+      })
+    );
+    return (
+      [heading]
+        .concat(
+          frames.map(function (s) {
+            return [s.time].concat(s.levels);
+          })
+        )
+        .map(function (row) {
+          return row.join(",");
+        })
+        .join("\n") + "\n"
+    );
+  }
+
+  /**
+   * Renders the spectrogram frames within the given records onto a canvas, time running left to right.
+   */
+  function renderSpectrogram(records) {
+    let frames = records
+      .filter(function (r) {
+        return r.type === "S";
+      })
+      .map(function (r) {
+        return decodeSpectrum(r.data);
+      });
+    if (frames.length === 0) {
+      return undefined;
+    }
+    let bins = frames[0].levels.length;
+    let canvas = document.createElement("canvas");
+    canvas.width = frames.length;
+    canvas.height = bins;
+    canvas.style.width = "100%";
+    canvas.style.height = "256px";
+    canvas.style.imageRendering = "pixelated";
+    let context = canvas.getContext("2d");
+    let image = context.createImageData(frames.length, bins);
+    frames.forEach(function (frame, x) {
+      frame.levels.forEach(function (level, k) {
+        // Low frequencies at the bottom. Map 0..96 dB onto a dark blue to yellow ramp.
+        let i = ((bins - 1 - k) * frames.length + x) * 4;
+        let v = Math.min(1, level / 96);
+        image.data[i] = 255 * v;
+        image.data[i + 1] = 255 * v * v;
+        image.data[i + 2] = 128 * (1 - v);
+        image.data[i + 3] = 255;
+      });
+    });
+    context.putImageData(image, 0, 0);
+    return canvas;
+  }
+
+  let logfs = {
+    decode: decode,
+    decodeSpectrum: decodeSpectrum,
+    spectrogramToCsv: spectrogramToCsv,
+  };
+
+  // Allow host tools to share the decoder.
+  if (typeof module !== "undefined") {
+    module.exports = logfs;
+    return;
+  }
+
   let isParentPage = !location.href.split("?")[1];
   if (isParentPage) {
     const base = Object.keys(window.dl).reduce(function (acc, curr) {
@@ -42,6 +402,87 @@
         wrapper.appendChild(info);
 
         base.load();
+
+        // Separate any binary records from the CSV data, and present them.
+        let log = decode(
+          document.documentElement.outerHTML.split("FS_START")[2]
+        );
+        if (log && (log.binary || log.wrapped)) {
+          // The offline view only marks where rows stored in compressed format are, and only shows the newest part of a
+          // circular log.
+          // So redraw the table from the decoded data.
+          csv = log.csv;
+          let table = wrapper.querySelector("table");
+          table.innerHTML = "";
+          csv.split("\n").forEach(function (line) {
+            let row = table.insertRow();
+            line.split(",").forEach(function (value) {
+              row.insertCell().innerText = value;
+            });
+          });
+        }
+        if (log && log.records.length) {
+          csv = log.csv;
+          let spectrogram = renderSpectrogram(log.records);
+          if (spectrogram) {
+            let title = document.createElement("h2");
+            title.innerText = "Spectrogram";
+            wrapper.insertBefore(title, wrapper.querySelector("table"));
+            wrapper.insertBefore(spectrogram, wrapper.querySelector("table"));
+
+            let button = document.createElement("button");
+            button.innerText = "Download spectrogram";
+            button.onclick = function () {
+              let a = document.createElement("a");
+              a.download = "spectrogram.csv";
+              a.href = URL.createObjectURL(
+                new Blob([spectrogramToCsv(log.records)], {
+                  type: "text/plain",
+                })
+              );
+              a.click();
+              a.remove();
+            };
+            wrapper.querySelector(".bb").appendChild(button);
+          }
+        }
+        // Show each named table after the log itself, with its own download.
+        if (log) {
+          Object.keys(log.tables).forEach(function (name) {
+            let title = document.createElement("h2");
+            title.innerText = name;
+            wrapper.appendChild(title);
+
+            let table = document.createElement("table");
+            log.tables[name]
+              .split("\n")
+              .filter(function (line) {
+                return line;
+              })
+              .forEach(function (line) {
+                let row = table.insertRow();
+                line.split(",").forEach(function (value) {
+                  row.insertCell().innerText = value;
+                });
+              });
+            wrapper.appendChild(table);
+
+            let button = document.createElement("button");
+            button.innerText = "Download " + name;
+            button.onclick = function () {
+              let a = document.createElement("a");
+              a.download = name + ".csv";
+              a.href = URL.createObjectURL(
+                new Blob([log.tables[name]], {
+                  type: "text/plain",
+                })
+              );
+              a.click();
+              a.remove();
+            };
+            wrapper.querySelector(".bb").appendChild(button);
+          });
+        }
       },
     };
     Object.keys(overrides).forEach(function (k) {
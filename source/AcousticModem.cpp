@@ -0,0 +1,519 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AcousticModem.h"
+#include "MicroBitAudio.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "CodalCompat.h"
+#include "codal_target_hal.h"
+#include "DSPMath.h"
+#include <string.h>
+
+#define ACOUSTIC_MODEM_STATE_SEARCHING      0
+#define ACOUSTIC_MODEM_STATE_SYNCHRONISING  1
+#define ACOUSTIC_MODEM_STATE_RECEIVING      2
+
+// The last symbols of the preamble followed by the sync word, as seen by the receiver.
+#define ACOUSTIC_MODEM_SYNC_PATTERN         (0x0F0F0000 | ACOUSTIC_MODEM_SYNC_WORD)
+
+using namespace codal;
+
+/**
+ * Computes the CRC-16/CCITT of the given data.
+ */
+static uint16_t crc16(const uint8_t *data, int length)
+{
+    uint16_t crc = 0xFFFF;
+
+    for (int i = 0; i < length; i++)
+    {
+        crc ^= data[i] << 8;
+        for (int b = 0; b < 8; b++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+/**
+ * Determines the frequency of the given tone, in Hz.
+ */
+static float toneFrequency(int tone)
+{
+    return CONFIG_ACOUSTIC_MODEM_BASE_FREQUENCY + tone * CONFIG_ACOUSTIC_MODEM_TONE_SPACING;
+}
+
+/**
+ * Constructor.
+ *
+ * @param sampleRate The sample rate to generate, in Hz.
+ * @param id The ID of this component, used for events.
+ */
+AcousticModemTransmitter::AcousticModemTransmitter(int sampleRate, uint16_t id)
+{
+    this->id = id;
+    this->status = 0;
+    this->downStream = NULL;
+    this->sampleRate = sampleRate;
+    this->symbol = 0;
+    this->symbolCount = 0;
+    this->symbolCountdown = 0;
+    this->rampPosition = 0;
+    this->c = 1.0f;
+    this->s = 0.0f;
+    this->cr = 1.0f;
+    this->sr = 0.0f;
+
+    setVolume(512);
+}
+
+/**
+ * Transmits the given data as a single frame.
+ * If a frame is already being transmitted, the calling fiber is blocked until it is complete.
+ *
+ * @param data The payload to send, of up to CONFIG_ACOUSTIC_MODEM_MAX_PAYLOAD bytes.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AcousticModemTransmitter::send(ManagedBuffer data)
+{
+    int length = data.length();
+
+    if (length <= 0 || length > CONFIG_ACOUSTIC_MODEM_MAX_PAYLOAD)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Enable audio pipeline if needed.
+    MicroBitAudio::requestActivation();
+
+    // If a transmission is already in progress, block until it is complete.
+    lock.wait();
+
+    ManagedBuffer f(length + 5);
+    f[0] = ACOUSTIC_MODEM_SYNC_WORD >> 8;
+    f[1] = ACOUSTIC_MODEM_SYNC_WORD & 0xFF;
+    f[2] = length;
+    memcpy(&f[3], &data[0], length);
+
+    uint16_t crc = crc16(&f[2], length + 1);
+    f[length + 3] = crc >> 8;
+    f[length + 4] = crc & 0xFF;
+
+    frame = f;
+    symbol = 0;
+    symbolCount = CONFIG_ACOUSTIC_MODEM_PREAMBLE_SYMBOLS + 2 * f.length();
+    symbolCountdown = 0;
+    rampPosition = 0;
+    c = 1.0f;
+    s = 0.0f;
+
+    status |= ACOUSTIC_MODEM_STATUS_TRANSMITTING;
+
+    // Generation will start the next time a pull() operation is called from downstream.
+    if (downStream)
+        downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if a frame is being transmitted.
+ * @return true if transmitting, false otherwise.
+ */
+bool AcousticModemTransmitter::isTransmitting()
+{
+    return status & ACOUSTIC_MODEM_STATUS_TRANSMITTING;
+}
+
+/**
+ * Defines the output level.
+ *
+ * @param volume The output level, in the range 0..1023.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AcousticModemTransmitter::setVolume(int volume)
+{
+    if (volume < 0 || volume > 1023)
+        return DEVICE_INVALID_PARAMETER;
+
+    amplitude = volume * 0.5f;
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the tone of the given symbol of the current transmission.
+ */
+int AcousticModemTransmitter::getTone(int index)
+{
+    if (index < CONFIG_ACOUSTIC_MODEM_PREAMBLE_SYMBOLS)
+        return (index & 1) ? ACOUSTIC_MODEM_TONES - 1 : 0;
+
+    index -= CONFIG_ACOUSTIC_MODEM_PREAMBLE_SYMBOLS;
+    uint8_t b = frame[index / 2];
+
+    return (index & 1) ? b & 0x0F : b >> 4;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer AcousticModemTransmitter::pull()
+{
+    if (!(status & ACOUSTIC_MODEM_STATUS_TRANSMITTING))
+        return ManagedBuffer();
+
+    ManagedBuffer buffer(CONFIG_ACOUSTIC_MODEM_BUFFER_SIZE);
+    uint16_t *sample = (uint16_t *) &buffer[0];
+    uint16_t *end = (uint16_t *) (&buffer[0] + buffer.length());
+
+    int samplesPerSymbol = (sampleRate << 8) / CONFIG_ACOUSTIC_MODEM_SYMBOL_RATE;
+    int rampLength = sampleRate / 500;
+    bool done = false;
+
+    while (sample < end)
+    {
+        if (symbolCountdown <= 0)
+        {
+            if (symbol == symbolCount)
+            {
+                done = true;
+                break;
+            }
+
+            // Move the oscillator onto the next tone. The phase is continuous, so no clicks are introduced.
+            float w = 2.0f * (float) M_PI * toneFrequency(getTone(symbol)) / sampleRate;
+            cr = cosf(w);
+            sr = sinf(w);
+            symbol++;
+            symbolCountdown += samplesPerSymbol;
+
+            // Correct any drift in the oscillator amplitude.
+            float g = 1.5f - 0.5f * (c * c + s * s);
+            c *= g;
+            s *= g;
+        }
+
+        symbolCountdown -= 256;
+
+        // Apply a short ramp at each end of the transmission.
+        float gain = amplitude;
+        if (rampPosition < rampLength)
+            gain = gain * rampPosition++ / rampLength;
+
+        if (symbol == symbolCount && symbolCountdown < (rampLength << 8))
+            gain = gain * max(symbolCountdown, 0) / (rampLength << 8);
+
+        float n = c * cr - s * sr;
+        s = c * sr + s * cr;
+        c = n;
+
+        *sample++ = (uint16_t) (512.0f + gain * s);
+    }
+
+    // Pad the output buffer with silence if necessary.
+    while (sample < end)
+        *sample++ = 512;
+
+    if (done)
+    {
+        frame = ManagedBuffer();
+        status &= ~ACOUSTIC_MODEM_STATUS_TRANSMITTING;
+        Event(id, ACOUSTIC_MODEM_EVT_TX_COMPLETE);
+        lock.notify();
+    }
+    else if (downStream)
+    {
+        downStream->pullRequest();
+    }
+
+    return buffer;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void AcousticModemTransmitter::connect(DataSink &sink)
+{
+    this->downStream = &sink;
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int AcousticModemTransmitter::getFormat()
+{
+    return DATASTREAM_FORMAT_16BIT_UNSIGNED;
+}
+
+/**
+ * Constructor.
+ *
+ * @param source The DataSource to receive audio from.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param id The ID of this component, used for events.
+ */
+AcousticModemReceiver::AcousticModemReceiver(DataSource &source, int sampleRate, uint16_t id) : upstream(source)
+{
+    this->id = id;
+    this->status = 0;
+    this->queueHead = 0;
+    this->queueLength = 0;
+    this->errors = 0;
+
+    for (int k = 0; k < ACOUSTIC_MODEM_TONES; k++)
+        coefficient[k] = 2.0f * cosf(2.0f * (float) M_PI * toneFrequency(k) / sampleRate);
+
+    // Windows are slightly shorter than a symbol, so each bank is free before its next window is due.
+    symbolPeriod = (sampleRate << 8) / CONFIG_ACOUSTIC_MODEM_SYMBOL_RATE;
+    windowLength = symbolPeriod >> 8;
+
+    for (int b = 0; b < ACOUSTIC_MODEM_TIMING_PHASES; b++)
+    {
+        countdown[b] = 256 + b * symbolPeriod / ACOUSTIC_MODEM_TIMING_PHASES;
+        remaining[b] = 0;
+        quality[b] = 0.0f;
+    }
+
+    reset();
+
+    upstream.connect(*this);
+}
+
+/**
+ * Abandons the current frame, and returns to searching for a sync word.
+ */
+void AcousticModemReceiver::reset()
+{
+    state = ACOUSTIC_MODEM_STATE_SEARCHING;
+    bank = 0;
+    nibbles = 0;
+
+    for (int b = 0; b < ACOUSTIC_MODEM_TIMING_PHASES; b++)
+        history[b] = 0;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int AcousticModemReceiver::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    int format = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    if (format == DATASTREAM_FORMAT_UNKNOWN)
+        return DEVICE_OK;
+
+    uint8_t *data = &b[0];
+    uint8_t *end = data + b.length();
+
+    while (data < end)
+    {
+        float v = StreamNormalizer::readSample[format](data);
+        data += bytesPerSample;
+
+        for (int p = 0; p < ACOUSTIC_MODEM_TIMING_PHASES; p++)
+        {
+            countdown[p] -= 256;
+            if (countdown[p] <= 0)
+            {
+                countdown[p] += symbolPeriod;
+                remaining[p] = windowLength;
+
+                for (int k = 0; k < ACOUSTIC_MODEM_TONES; k++)
+                {
+                    s1[p][k] = 0.0f;
+                    s2[p][k] = 0.0f;
+                }
+            }
+
+            if (remaining[p] == 0)
+                continue;
+
+            float *a = s1[p];
+            float *z = s2[p];
+
+            for (int k = 0; k < ACOUSTIC_MODEM_TONES; k++)
+            {
+                float s0 = v + coefficient[k] * a[k] - z[k];
+                z[k] = a[k];
+                a[k] = s0;
+            }
+
+            if (--remaining[p] == 0)
+                processWindow(p);
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Processes the result of a completed Goertzel window.
+ * @param b The bank that completed.
+ */
+void AcousticModemReceiver::processWindow(int b)
+{
+    int symbol = 0;
+    float peak = 0.0f;
+    float total = 1e-6f;
+
+    for (int k = 0; k < ACOUSTIC_MODEM_TONES; k++)
+    {
+        float energy = s1[b][k] * s1[b][k] + s2[b][k] * s2[b][k] - coefficient[k] * s1[b][k] * s2[b][k];
+        total += energy;
+
+        if (energy > peak)
+        {
+            peak = energy;
+            symbol = k;
+        }
+    }
+
+    history[b] = (history[b] << 4) | symbol;
+    quality[b] = quality[b] * 0.75f + peak / total;
+
+    bool sync = history[b] == ACOUSTIC_MODEM_SYNC_PATTERN;
+
+    switch (state)
+    {
+        case ACOUSTIC_MODEM_STATE_SEARCHING:
+            // The earliest bank to see the sync word may be straddling symbols. Compare it with the banks that follow.
+            if (sync)
+            {
+                state = ACOUSTIC_MODEM_STATE_SYNCHRONISING;
+                bank = b;
+                syncCountdown = ACOUSTIC_MODEM_TIMING_PHASES - 1;
+            }
+            break;
+
+        case ACOUSTIC_MODEM_STATE_SYNCHRONISING:
+            if (sync && quality[b] > quality[bank])
+                bank = b;
+
+            if (--syncCountdown == 0)
+                state = ACOUSTIC_MODEM_STATE_RECEIVING;
+            break;
+
+        case ACOUSTIC_MODEM_STATE_RECEIVING:
+            if (b == bank)
+                processSymbol(symbol);
+            break;
+    }
+}
+
+/**
+ * Processes a symbol of a synchronised frame.
+ * @param nibble The symbol received.
+ */
+void AcousticModemReceiver::processSymbol(int nibble)
+{
+    int i = nibbles / 2;
+
+    if (nibbles & 1)
+        frame[i] |= nibble;
+    else
+        frame[i] = nibble << 4;
+
+    nibbles++;
+
+    int length = frame[0];
+
+    // Discard frames with an invalid length.
+    if (nibbles == 2 && (length == 0 || length > CONFIG_ACOUSTIC_MODEM_MAX_PAYLOAD))
+    {
+        errors++;
+        reset();
+        Event(id, ACOUSTIC_MODEM_EVT_RX_ERROR);
+        return;
+    }
+
+    if (nibbles < 2 || nibbles < 2 * (length + 3))
+        return;
+
+    // We have a complete frame. Validate and queue it.
+    if (crc16(frame, length + 1) == ((frame[length + 1] << 8) | frame[length + 2]) && queueLength < CONFIG_ACOUSTIC_MODEM_RX_QUEUE_SIZE)
+    {
+        queue[(queueHead + queueLength) % CONFIG_ACOUSTIC_MODEM_RX_QUEUE_SIZE] = ManagedBuffer(&frame[1], length);
+        queueLength++;
+        reset();
+        Event(id, ACOUSTIC_MODEM_EVT_RX_FRAME);
+    }
+    else
+    {
+        errors++;
+        reset();
+        Event(id, ACOUSTIC_MODEM_EVT_RX_ERROR);
+    }
+}
+
+/**
+ * Retrieves the oldest frame received.
+ * @return the payload of the frame, or an empty buffer if none is available.
+ */
+ManagedBuffer AcousticModemReceiver::recv()
+{
+    ManagedBuffer b;
+
+    target_disable_irq();
+    if (queueLength)
+    {
+        b = queue[queueHead];
+        queue[queueHead] = ManagedBuffer();
+        queueHead = (queueHead + 1) % CONFIG_ACOUSTIC_MODEM_RX_QUEUE_SIZE;
+        queueLength--;
+    }
+    target_enable_irq();
+
+    return b;
+}
+
+/**
+ * Determines the number of frames waiting to be read by recv().
+ * @return the number of frames available.
+ */
+int AcousticModemReceiver::available()
+{
+    return queueLength;
+}
+
+/**
+ * Determines the number of frames lost due to corruption or a full receive queue.
+ * @return the number of frames lost.
+ */
+uint32_t AcousticModemReceiver::getErrorCount()
+{
+    return errors;
+}
+
+/**
+ * Destructor.
+ */
+AcousticModemReceiver::~AcousticModemReceiver()
+{
+    upstream.disconnect();
+}
@@ -0,0 +1,290 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "AudioEqualizer.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param source The DataSource to receive audio from.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param sampleRange The number of quantization levels in the given source (i.e. its maximum value for unsigned data).
+ */
+AudioEqualizer::AudioEqualizer(DataSource &source, float sampleRate, int sampleRange) : upstream(source)
+{
+    this->downStream = NULL;
+    this->sampleRate = sampleRate;
+    this->orMask = 0;
+
+    for (int i = 0; i < CONFIG_AUDIO_EQUALIZER_SECTIONS; i++)
+        type[i] = AudioFilterType::None;
+
+    setSampleRange(sampleRange);
+
+    upstream.connect(*this);
+}
+
+/**
+ * Configures one of the filter sections of this equalizer.
+ *
+ * @param index The section to configure, in the range 0..CONFIG_AUDIO_EQUALIZER_SECTIONS-1.
+ * @param type The type of filter to apply, or AudioFilterType::None to bypass the section.
+ * @param frequency The cutoff, centre or shelf midpoint frequency of the filter, in Hz.
+ * @param q The quality factor of the filter. 0.7071 gives a maximally flat response for all but peaking filters.
+ * @param gain The gain of a shelving or peaking filter, in dB. Unused for other types.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AudioEqualizer::setFilter(int index, AudioFilterType type, float frequency, float q, float gain)
+{
+    if (index < 0 || index >= CONFIG_AUDIO_EQUALIZER_SECTIONS)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Design the new filter away from the live section, so an invalid request leaves the audio untouched.
+    BiquadFilter f;
+    int result = DEVICE_OK;
+
+    switch (type)
+    {
+        case AudioFilterType::None:
+            break;
+
+        case AudioFilterType::LowPass:
+            result = f.setLowPass(sampleRate, frequency, q);
+            break;
+
+        case AudioFilterType::HighPass:
+            result = f.setHighPass(sampleRate, frequency, q);
+            break;
+
+        case AudioFilterType::LowShelf:
+            result = f.setLowShelf(sampleRate, frequency, q, gain);
+            break;
+
+        case AudioFilterType::HighShelf:
+            result = f.setHighShelf(sampleRate, frequency, q, gain);
+            break;
+
+        case AudioFilterType::Peaking:
+            result = f.setPeaking(sampleRate, frequency, q, gain);
+            break;
+
+        default:
+            result = DEVICE_INVALID_PARAMETER;
+    }
+
+    if (result != DEVICE_OK)
+        return result;
+
+    // Swap in the new coefficients between buffers. The section retains its history, so the output remains continuous.
+    target_disable_irq();
+
+    if (this->type[index] == AudioFilterType::None)
+        section[index].reset();
+
+    section[index].b0 = f.b0;
+    section[index].b1 = f.b1;
+    section[index].b2 = f.b2;
+    section[index].a1 = f.a1;
+    section[index].a2 = f.a2;
+    this->type[index] = type;
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Bypasses all filter sections.
+ */
+void AudioEqualizer::clear()
+{
+    for (int i = 0; i < CONFIG_AUDIO_EQUALIZER_SECTIONS; i++)
+        type[i] = AudioFilterType::None;
+}
+
+/**
+ * Defines the sample rate of the stream. Existing filters must be reconfigured after a change in sample rate.
+ *
+ * @param sampleRate The sample rate of the stream, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AudioEqualizer::setSampleRate(float sampleRate)
+{
+    if (sampleRate <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->sampleRate = sampleRate;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the range of the stream.
+ *
+ * @param sampleRange The number of quantization levels in the stream.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int AudioEqualizer::setSampleRange(int sampleRange)
+{
+    if (sampleRange <= 1 || sampleRange > 65536)
+        return DEVICE_INVALID_PARAMETER;
+
+    // Scale samples to around 20 bits while filtering. This retains precision in low frequency sections,
+    // while leaving 12dB of headroom for boosts within the 24 bits supported by BiquadFilter.
+    int s = 0;
+    while (((sampleRange / 2) << (s + 1)) <= (1 << 20))
+        s++;
+
+    target_disable_irq();
+    this->sampleRange = sampleRange;
+    this->shift = s;
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines bits that are set on every output sample, and ignored in every input sample
+ * (e.g. the polarity bit used by NRF52PWM).
+ *
+ * @param mask The bits to set.
+ * @return DEVICE_OK on success.
+ */
+int AudioEqualizer::setOrMask(uint32_t mask)
+{
+    orMask = mask;
+    return DEVICE_OK;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int AudioEqualizer::pullRequest()
+{
+    if (downStream)
+        return downStream->pullRequest();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer AudioEqualizer::pull()
+{
+    ManagedBuffer b = upstream.pull();
+
+    int format = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    if (format == DATASTREAM_FORMAT_UNKNOWN)
+        return b;
+
+    int active[CONFIG_AUDIO_EQUALIZER_SECTIONS];
+    int sections = 0;
+
+    for (int i = 0; i < CONFIG_AUDIO_EQUALIZER_SECTIONS; i++)
+        if (type[i] != AudioFilterType::None)
+            active[sections++] = i;
+
+    if (sections == 0)
+        return b;
+
+    int offset = (format == DATASTREAM_FORMAT_16BIT_UNSIGNED || format == DATASTREAM_FORMAT_8BIT_UNSIGNED) ? sampleRange / 2 : 0;
+    int lo = -sampleRange / 2;
+    int hi = sampleRange - sampleRange / 2;
+    int round = shift ? 1 << (shift - 1) : 0;
+
+    uint8_t *data = &b[0];
+    uint8_t *end = data + b.length();
+
+    while (data < end)
+    {
+        int32_t v = ((StreamNormalizer::readSample[format](data) & ~orMask) - offset) * (1 << shift);
+
+        for (int i = 0; i < sections; i++)
+            v = section[active[i]].process(v);
+
+        v = (v + round) >> shift;
+
+        if (v < lo)
+            v = lo;
+
+        if (v > hi)
+            v = hi;
+
+        StreamNormalizer::writeSample[format](data, (v + offset) | orMask);
+        data += bytesPerSample;
+    }
+
+    return b;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void AudioEqualizer::connect(DataSink &sink)
+{
+    downStream = &sink;
+}
+
+/**
+ * Disconnect the downstream component.
+ */
+void AudioEqualizer::disconnect()
+{
+    downStream = NULL;
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int AudioEqualizer::getFormat()
+{
+    return upstream.getFormat();
+}
+
+/**
+ * Defines the data format of the buffers streamed out of this component.
+ * @param format the format to use.
+ */
+int AudioEqualizer::setFormat(int format)
+{
+    return upstream.setFormat(format);
+}
+
+/**
+ * Destructor.
+ */
+AudioEqualizer::~AudioEqualizer()
+{
+    upstream.disconnect();
+}
@@ -0,0 +1,288 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "BiquadFilter.h"
+#include "ErrorNo.h"
+#include "DSPMath.h"
+
+using namespace codal;
+
+/**
+ * Converts the given floating point coefficient into Q29 fixed point.
+ *
+ * @param in The value to convert.
+ * @param out The location to store the result.
+ * @return true on success, false if the value lies outside the representable range.
+ */
+static bool toFixed(float in, int32_t &out)
+{
+    if (in >= 4.0f || in < -4.0f || isnan(in))
+        return false;
+
+    out = (int32_t) lroundf(in * (float) BIQUAD_COEFFICIENT_ONE);
+    return true;
+}
+
+/**
+ * Constructor.
+ * Creates a filter that passes all data unmodified.
+ */
+BiquadFilter::BiquadFilter()
+{
+    b0 = BIQUAD_COEFFICIENT_ONE;
+    b1 = b2 = a1 = a2 = 0;
+    reset();
+}
+
+/**
+ * Clears the history of this filter, without modifying its coefficients.
+ */
+void BiquadFilter::reset()
+{
+    x1 = x2 = y1 = y2 = 0;
+}
+
+/**
+ * Defines the coefficients of this filter from the given transfer function.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the coefficients cannot be represented.
+ */
+int BiquadFilter::setCoefficients(float b0, float b1, float b2, float a0, float a1, float a2)
+{
+    int32_t c[5];
+
+    if (a0 == 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (!toFixed(b0 / a0, c[0]) || !toFixed(b1 / a0, c[1]) || !toFixed(b2 / a0, c[2]) || !toFixed(a1 / a0, c[3]) || !toFixed(a2 / a0, c[4]))
+        return DEVICE_INVALID_PARAMETER;
+
+    this->b0 = c[0];
+    this->b1 = c[1];
+    this->b2 = c[2];
+    this->a1 = c[3];
+    this->a2 = c[4];
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the coefficients of this filter from an analog (s-domain) second order prototype,
+ * using the bilinear transform.
+ *
+ * @param sampleRate The sample rate the filter will operate at, in Hz.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the coefficients cannot be represented.
+ */
+int BiquadFilter::setAnalogCoefficients(float sampleRate, float b0, float b1, float b2, float a0, float a1, float a2)
+{
+    float k = 2.0f * sampleRate;
+    float k2 = k * k;
+
+    return setCoefficients(b0*k2 + b1*k + b2, 2.0f * (b2 - b0*k2), b0*k2 - b1*k + b2,
+                           a0*k2 + a1*k + a2, 2.0f * (a2 - a0*k2), a0*k2 - a1*k + a2);
+}
+
+/**
+ * Configures this filter as a second order low pass filter.
+ *
+ * @param sampleRate The sample rate the filter will operate at, in Hz.
+ * @param frequency The cutoff frequency, in Hz.
+ * @param q The quality factor of the filter (0.7071 gives a Butterworth response).
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int BiquadFilter::setLowPass(float sampleRate, float frequency, float q)
+{
+    if (frequency <= 0.0f || frequency >= sampleRate / 2 || q <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    float w0 = 2.0f * (float)M_PI * frequency / sampleRate;
+    float c = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+
+    return setCoefficients((1.0f - c) / 2.0f, 1.0f - c, (1.0f - c) / 2.0f, 1.0f + alpha, -2.0f * c, 1.0f - alpha);
+}
+
+/**
+ * Configures this filter as a second order high pass filter.
+ *
+ * @param sampleRate The sample rate the filter will operate at, in Hz.
+ * @param frequency The cutoff frequency, in Hz.
+ * @param q The quality factor of the filter (0.7071 gives a Butterworth response).
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int BiquadFilter::setHighPass(float sampleRate, float frequency, float q)
+{
+    if (frequency <= 0.0f || frequency >= sampleRate / 2 || q <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    float w0 = 2.0f * (float)M_PI * frequency / sampleRate;
+    float c = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+
+    return setCoefficients((1.0f + c) / 2.0f, -(1.0f + c), (1.0f + c) / 2.0f, 1.0f + alpha, -2.0f * c, 1.0f - alpha);
+}
+
+/**
+ * Configures this filter as a peaking equalizer, boosting or cutting a band around the given frequency.
+ *
+ * @param sampleRate The sample rate the filter will operate at, in Hz.
+ * @param frequency The centre frequency, in Hz.
+ * @param q The quality factor of the filter (centre frequency / bandwidth).
+ * @param gain The gain at the centre frequency, in dB.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int BiquadFilter::setPeaking(float sampleRate, float frequency, float q, float gain)
+{
+    if (frequency <= 0.0f || frequency >= sampleRate / 2 || q <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    float a = powf(10.0f, gain / 40.0f);
+    float w0 = 2.0f * (float)M_PI * frequency / sampleRate;
+    float c = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+
+    return setCoefficients(1.0f + alpha * a, -2.0f * c, 1.0f - alpha * a, 1.0f + alpha / a, -2.0f * c, 1.0f - alpha / a);
+}
+
+/**
+ * Configures this filter as a low shelf, boosting or cutting all frequencies below the given frequency.
+ *
+ * @param sampleRate The sample rate the filter will operate at, in Hz.
+ * @param frequency The shelf midpoint frequency, in Hz.
+ * @param q The quality factor of the filter (0.7071 gives the steepest slope without overshoot).
+ * @param gain The gain of the shelf, in dB.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int BiquadFilter::setLowShelf(float sampleRate, float frequency, float q, float gain)
+{
+    if (frequency <= 0.0f || frequency >= sampleRate / 2 || q <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    float a = powf(10.0f, gain / 40.0f);
+    float w0 = 2.0f * (float)M_PI * frequency / sampleRate;
+    float c = cosf(w0);
+    float k = 2.0f * sqrtf(a) * sinf(w0) / (2.0f * q);
+
+    return setCoefficients(a * ((a + 1.0f) - (a - 1.0f) * c + k), 2.0f * a * ((a - 1.0f) - (a + 1.0f) * c), a * ((a + 1.0f) - (a - 1.0f) * c - k),
+                           (a + 1.0f) + (a - 1.0f) * c + k, -2.0f * ((a - 1.0f) + (a + 1.0f) * c), (a + 1.0f) + (a - 1.0f) * c - k);
+}
+
+/**
+ * Configures this filter as a high shelf, boosting or cutting all frequencies above the given frequency.
+ *
+ * @param sampleRate The sample rate the filter will operate at, in Hz.
+ * @param frequency The shelf midpoint frequency, in Hz.
+ * @param q The quality factor of the filter (0.7071 gives the steepest slope without overshoot).
+ * @param gain The gain of the shelf, in dB.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int BiquadFilter::setHighShelf(float sampleRate, float frequency, float q, float gain)
+{
+    if (frequency <= 0.0f || frequency >= sampleRate / 2 || q <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    float a = powf(10.0f, gain / 40.0f);
+    float w0 = 2.0f * (float)M_PI * frequency / sampleRate;
+    float c = cosf(w0);
+    float k = 2.0f * sqrtf(a) * sinf(w0) / (2.0f * q);
+
+    return setCoefficients(a * ((a + 1.0f) + (a - 1.0f) * c + k), -2.0f * a * ((a - 1.0f) + (a + 1.0f) * c), a * ((a + 1.0f) + (a - 1.0f) * c - k),
+                           (a + 1.0f) - (a - 1.0f) * c + k, 2.0f * ((a - 1.0f) - (a + 1.0f) * c), (a + 1.0f) - (a - 1.0f) * c - k);
+}
+
+/**
+ * Configures this filter as a second order band pass filter, with a peak gain of 0dB.
+ *
+ * @param sampleRate The sample rate the filter will operate at, in Hz.
+ * @param frequency The centre frequency, in Hz.
+ * @param q The quality factor of the filter (centre frequency / bandwidth).
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int BiquadFilter::setBandPass(float sampleRate, float frequency, float q)
+{
+    if (frequency <= 0.0f || frequency >= sampleRate / 2 || q <= 0.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    float w0 = 2.0f * (float)M_PI * frequency / sampleRate;
+    float alpha = sinf(w0) / (2.0f * q);
+
+    return setCoefficients(alpha, 0.0f, -alpha, 1.0f + alpha, -2.0f * cosf(w0), 1.0f - alpha);
+}
+
+/**
+ * Scales the feed forward coefficients of this filter, adjusting its overall gain.
+ *
+ * @param gain The linear gain to apply.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the result cannot be represented.
+ */
+int BiquadFilter::scale(float gain)
+{
+    int32_t c[3];
+
+    if (!toFixed(gain * b0 / BIQUAD_COEFFICIENT_ONE, c[0]) || !toFixed(gain * b1 / BIQUAD_COEFFICIENT_ONE, c[1]) || !toFixed(gain * b2 / BIQUAD_COEFFICIENT_ONE, c[2]))
+        return DEVICE_INVALID_PARAMETER;
+
+    b0 = c[0];
+    b1 = c[1];
+    b2 = c[2];
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the magnitude of the response of this filter at the given frequency.
+ *
+ * @param sampleRate The sample rate the filter operates at, in Hz.
+ * @param frequency The frequency of interest, in Hz.
+ * @return the linear gain of the filter at the given frequency.
+ */
+float BiquadFilter::getGain(float sampleRate, float frequency)
+{
+    const float one = (float) BIQUAD_COEFFICIENT_ONE;
+    float w = 2.0f * (float)M_PI * frequency / sampleRate;
+    float c1 = cosf(w), s1 = sinf(w);
+    float c2 = cosf(2.0f * w), s2 = sinf(2.0f * w);
+
+    float nr = (b0 + b1 * c1 + b2 * c2) / one;
+    float ni = -(b1 * s1 + b2 * s2) / one;
+    float dr = 1.0f + (a1 * c1 + a2 * c2) / one;
+    float di = -(a1 * s1 + a2 * s2) / one;
+
+    return sqrtf((nr*nr + ni*ni) / (dr*dr + di*di));
+}
+
+/**
+ * Filters a block of samples in place.
+ *
+ * @param data The samples to process.
+ * @param len The number of samples in the block.
+ */
+void BiquadFilter::process(int32_t *data, int len)
+{
+    while (len--)
+    {
+        *data = process(*data);
+        data++;
+    }
+}
@@ -22,21 +22,138 @@ DEALINGS IN THE SOFTWARE.
 
 using namespace codal;
 
+/**
+ * Determines if the given data can be programmed over the current contents of FLASH without an erase cycle,
+ * i.e. that it does not require any bit to change from 0 to 1. Compares a word at a time where possible.
+ *
+ * @param current the current contents of FLASH.
+ * @param data the data to write.
+ * @param length the number of bytes to compare.
+ * @return true if the data can be written, false otherwise.
+ */
+static bool canProgram(const uint8_t *current, const uint8_t *data, uint32_t length)
+{
+	uint32_t i = 0;
+
+	for (; i + 4 <= length; i += 4)
+	{
+		uint32_t w1, w2;
+
+		memcpy(&w1, current + i, 4);
+		memcpy(&w2, data + i, 4);
+
+		if ((w1 ^ w2) & w2)
+			return false;
+	}
+
+	for (; i < length; i++)
+	{
+		if ((current[i] ^ data[i]) & data[i])
+			return false;
+	}
+
+	return true;
+}
+
 /**
  * Create a new instanece of a FileSystem Write Through Cache
  *
  * @param nvm non-volatile memory controller to use as backing store
  * @param blockSize - the size of a logical block, in bytes (n.b. this may be smaller than the physical page size)
  * @param size the maximum number of pages in the cache
+ * @param arena optional RAM to hold the cached blocks, of at least size * blockSize bytes (e.g. a statically allocated array).
+ * If NULL, this is allocated as a single block when the cache is first used.
  */
-FSCache::FSCache(NVMController &nvm, int blockSize, int size) : flash(nvm), blockSize(blockSize), cacheSize(size)
+FSCache::FSCache(NVMController &nvm, int blockSize, int size, uint8_t *arena) : flash(nvm), arena(arena), blockSize(blockSize), cacheSize(size)
 {
-	// Initialise space to hold our cached pages.
+	// Initialise space to hold our cache entries.
 	cache = (CacheEntry *) malloc(sizeof(CacheEntry)*size);
 	memset(cache, 0, sizeof(CacheEntry)*size);
 
+	// Divide the cache into sets, falling back to a single, fully associative set if the size doesn't allow it.
+	ways = (size % CODAL_FS_CACHE_WAYS == 0) ? CODAL_FS_CACHE_WAYS : size;
+
 	// Reset operation counter (used for least-recently-used cache replacement policy)
 	operationCount = 0;
+
+	// Start as a write through cache, with no knowledge of which blocks are erased.
+	erased = NULL;
+	writeBack = false;
+	nextSequential = 0xFFFFFFFF;
+	ownsArena = (arena == NULL);
+
+	resetStatistics();
+}
+
+/**
+* Resets the hit, miss, eviction, prefetch and byte counters to zero.
+*/
+void FSCache::resetStatistics()
+{
+	hits = 0;
+	misses = 0;
+	evictions = 0;
+	prefetches = 0;
+	bytesRead = 0;
+	bytesWritten = 0;
+}
+
+/**
+* Determines when data written to the cache is written to FLASH.
+* In write through mode (the default), every write() is written to FLASH immediately.
+* In write back mode, writes only update the cache. Modified blocks are written to FLASH
+* in a single operation when they are evicted, or when flush() is called.
+*
+* @param enable true to use write back mode, false to use write through mode.
+*/
+void FSCache::setWriteBack(bool enable)
+{
+	// Leave nothing behind in the cache if we're returning to write through mode.
+	if (!enable)
+		flush();
+
+	writeBack = enable;
+}
+
+/**
+* Writes any modified blocks held in the cache to FLASH.
+* @return DEVICE_OK on success, or DEVICE_I2C_ERROR if any data could not be written.
+*/
+int FSCache::flush()
+{
+	int result = DEVICE_OK;
+
+	for (int i = 0; i < cacheSize; i++)
+	{
+		if (writeBackEntry(&cache[i]) != DEVICE_OK)
+			result = DEVICE_I2C_ERROR;
+	}
+
+	return result;
+}
+
+/**
+* Writes the modified part of the given cache entry back to FLASH, if it has one.
+* @param c the cache entry to write back.
+* @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the data could not be written.
+*/
+int FSCache::writeBackEntry(CacheEntry *c)
+{
+	if (!(c->flags & FSCACHE_FLAG_DIRTY))
+		return DEVICE_OK;
+
+	// Write back only the words that have changed, so that unmodified areas are not programmed again.
+	uint32_t alignedStart = c->dirtyStart & 0xFFFFFFFC;
+	uint32_t alignedEnd = (c->dirtyEnd + 3) & 0xFFFFFFFC;
+
+	if (flash.write(c->address + alignedStart, (uint32_t *)(c->page + alignedStart), (alignedEnd - alignedStart)/4) != DEVICE_OK)
+		return DEVICE_I2C_ERROR;
+
+	bytesWritten += alignedEnd - alignedStart;
+
+	c->flags &= ~FSCACHE_FLAG_DIRTY;
+
+	return DEVICE_OK;
 }
 
 /**
@@ -44,31 +161,92 @@ FSCache::FSCache(NVMController &nvm, int blockSize, int size) : flash(nvm), bloc
 */
 void FSCache::clear()
 {
-	for (int i = 0; i < cacheSize; i++)
+	if (ownsArena)
 	{
-		if (cache[i].page != NULL)
-			free(cache[i].page);
+		free(arena);
+		arena = NULL;
 	}
 
+	free(erased);
+	erased = NULL;
+
 	// reset all state.
 	memset(cache, 0, sizeof(CacheEntry)*cacheSize);
 
 	// Reset operation counter (used for least-recently-used cache replacement policy)
 	operationCount = 0;
+	nextSequential = 0xFFFFFFFF;
+}
 
+/**
+* Destructor. Writes any modified blocks to FLASH, and frees any allocated RAM.
+*/
+FSCache::~FSCache()
+{
+	flush();
+	clear();
+	free(cache);
+}
+
+/**
+* Determines if the block at the given address is known to be erased.
+* @param address the logical address of the block.
+*/
+bool FSCache::isErased(uint32_t address)
+{
+	uint32_t block = (address - flash.getFlashStart()) / blockSize;
+
+	if (erased == NULL || address < flash.getFlashStart() || address >= flash.getFlashEnd())
+		return false;
+
+	return erased[block / 8] & (1 << (block % 8));
+}
+
+/**
+* Records whether or not the block at the given address is known to be erased.
+* @param address the logical address of the block.
+* @param state true if the block is erased, false otherwise.
+*/
+void FSCache::setErased(uint32_t address, bool state)
+{
+	uint32_t block = (address - flash.getFlashStart()) / blockSize;
+
+	if (address < flash.getFlashStart() || address >= flash.getFlashEnd())
+		return;
+
+	// Allocate the map of erased blocks the first time we learn of one.
+	if (erased == NULL)
+	{
+		if (!state)
+			return;
+
+		int length = ((flash.getFlashEnd() - flash.getFlashStart()) / blockSize + 7) / 8;
+		erased = (uint8_t *) malloc(length);
+		memset(erased, 0, length);
+	}
+
+	if (state)
+		erased[block / 8] |= 1 << (block % 8);
+	else
+		erased[block / 8] &= ~(1 << (block % 8));
 }
 
 /**
 * Erase a single block at the given address in CACHE memory only, (assuming it is loaded into cache)
+* The block is then known to be erased, such that it can be paged in without reading FLASH until it is written.
+* n.b. This should be called along with the erase of the block in FLASH.
 */
 int FSCache::erase(uint32_t address)
 {
 	CacheEntry *c = getCacheEntry(address);
 
+	setErased(address, true);
+
 	// Erase the page in our cache (if it is present)
 	if (c != NULL)
 	{
 		memset(c->page, 0xFF, blockSize);
+		c->flags &= ~FSCACHE_FLAG_DIRTY;
 		c->lastUsed = ++operationCount;
 	}
 
@@ -78,6 +256,8 @@ int FSCache::erase(uint32_t address)
 /**
 * Read the given area of memory into the buffer provided,
 * paging the data in from FLASH as needed.
+* @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the area is out of range, or DEVICE_I2C_ERROR if no block
+* could be replaced to make room for the data.
 */
 int FSCache::read(uint32_t address, const void *data, int len)
 {
@@ -96,6 +276,9 @@ int FSCache::read(uint32_t address, const void *data, int len)
 		uint32_t l = min(len - bytesCopied, blockSize - offset);
 		CacheEntry *c = cachePage(block);
 
+		if (c == NULL)
+			return DEVICE_I2C_ERROR;
+
 		memcpy((uint8_t *)data + bytesCopied, c->page + offset, l);
 		bytesCopied += l;
 	}
@@ -105,11 +288,12 @@ int FSCache::read(uint32_t address, const void *data, int len)
 
 /**
 * Write the given area of memory into the buffer provided, paging the data in from FLASH as needed.
-* Also performs a write-through cache operation directly back if possible. 
+* Also performs a write-through cache operation directly back if possible, unless write back mode is enabled.
 * @param address The logical address of the non-volatile storage to write to. DOES NOT need to be word aligned.
 * @param data the data to write.
 * @param len amount of data to write, in bytes.
-* @return DEVICE_OK on success, or DEVICE_NOT_SUPPORTED if the attempted operation is not possible without an ERASE operation.
+* @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if the attempted operation is not possible without an ERASE operation,
+* or DEVICE_I2C_ERROR if no block could be replaced to make room for the data.
 */
 int FSCache::write(uint32_t address, const void *data, int len)
 {
@@ -129,18 +313,15 @@ int FSCache::write(uint32_t address, const void *data, int len)
 		uint32_t l = min(len - bytesCopied, blockSize - offset);
 		CacheEntry *c = cachePage(block);
 
+		if (c == NULL)
+			return DEVICE_I2C_ERROR;
+
 		// Validate that a write operation can be performed without needing an erase cycle.
-		for (uint32_t i = 0; i < l; i++)
+		if (!canProgram(c->page + offset, (uint8_t *)data + bytesCopied, l))
 		{
-			uint8_t b1 = c->page[offset + i];
-			uint8_t b2 = ((uint8_t *)data)[bytesCopied + i];
-
-			if ((b1 ^ b2) & b2)
-			{
-				DMESG("FS_CACHE: ILLEGAL WRITE OPERAITON ATTEMPTED [ADDRESS: %p] [LENGTH: %d]\n", address, len);
-				debug(c);
-				return DEVICE_NOT_SUPPORTED;
-			}
+			DMESG("FS_CACHE: ILLEGAL WRITE OPERAITON ATTEMPTED [ADDRESS: %p] [LENGTH: %d]\n", address, len);
+			debug(c);
+			return DEVICE_NOT_SUPPORTED;
 		}
 
 		bytesCopied += l;
@@ -158,6 +339,9 @@ int FSCache::write(uint32_t address, const void *data, int len)
 		uint32_t l = min(len - bytesCopied, blockSize - offset);
 		CacheEntry *c = cachePage(block);
 
+		if (c == NULL)
+			return DEVICE_I2C_ERROR;
+
 		uint32_t alignedStart = a & 0xFFFFFFFC;
 		uint32_t alignedEnd = (a + l) & 0xFFFFFFFC;
 		if ((a + l) & 0x03)
@@ -165,9 +349,29 @@ int FSCache::write(uint32_t address, const void *data, int len)
 
 		// update cache.
 		memcpy(c->page + offset, (uint8_t *)data + bytesCopied, l);
+		setErased(block, false);
 
-		// Write through (maintaining 32-bit aligned operations)
-		flash.write(alignedStart, (uint32_t *)(c->page + (alignedStart % blockSize)), (alignedEnd - alignedStart)/4);
+		if (writeBack)
+		{
+			// Record the area that has changed. It is written to FLASH when the block is flushed or evicted.
+			if (!(c->flags & FSCACHE_FLAG_DIRTY))
+			{
+				c->dirtyStart = offset;
+				c->dirtyEnd = offset + l;
+				c->flags |= FSCACHE_FLAG_DIRTY;
+			}
+			else
+			{
+				c->dirtyStart = min(c->dirtyStart, offset);
+				c->dirtyEnd = max(c->dirtyEnd, offset + l);
+			}
+		}
+		else
+		{
+			// Write through (maintaining 32-bit aligned operations)
+			flash.write(alignedStart, (uint32_t *)(c->page + (alignedStart % blockSize)), (alignedEnd - alignedStart)/4);
+			bytesWritten += alignedEnd - alignedStart;
+		}
 
 		// Move to next page
 		bytesCopied += l;
@@ -176,6 +380,33 @@ int FSCache::write(uint32_t address, const void *data, int len)
 	return DEVICE_OK;
 }
 
+/**
+* Updates the cache after data has been written directly to FLASH, bypassing the cache.
+* Any cached copies of the blocks written are brought up to date, and the blocks are no longer known to be erased.
+* @param address The logical address of the data written.
+* @param data the data written.
+* @param len amount of data written, in bytes.
+*/
+void FSCache::update(uint32_t address, const void *data, int len)
+{
+	int bytesCopied = 0;
+
+	while (bytesCopied < len)
+	{
+		uint32_t a = address + bytesCopied;
+		uint32_t block = (a / blockSize) *blockSize;
+		uint32_t offset = a % blockSize;
+		uint32_t l = min(len - bytesCopied, blockSize - offset);
+		CacheEntry *c = getCacheEntry(block);
+
+		if (c)
+			memcpy(c->page + offset, (uint8_t *)data + bytesCopied, l);
+
+		setErased(block, false);
+		bytesCopied += l;
+	}
+}
+
 /**
 * Pin the given page into cache space.
 */
@@ -206,8 +437,20 @@ int FSCache::unpin(uint32_t address)
 }
 
 /**
-* Page a given block into the cache, replacing the LRU block if necessary.
+* Determines the first entry of the set that may hold the given block.
+* @param address the logical address of the block.
+*/
+CacheEntry *FSCache::getSet(uint32_t address)
+{
+	return &cache[((address / blockSize) % (cacheSize / ways)) * ways];
+}
+
+/**
+* Page a given block into the cache, replacing the LRU block in its set if necessary.
+* In write back mode, a block is only replaced once any data it holds has been written to FLASH. If that fails,
+* the block is kept, and the least recently used block that holds no such data is replaced instead.
 * @param address the logical address of the block to cache.
+* @return a pointer to the relevant cache entry, or NULL if every block in the set is pinned or could not be written back.
 */
 CacheEntry* FSCache::cachePage(uint32_t address)
 {
@@ -216,33 +459,146 @@ CacheEntry* FSCache::cachePage(uint32_t address)
 	// Ensure the page is not already in the cache. If so, then nothing to do...
 	lru = getCacheEntry(address);
 	if (lru)
+	{
+		hits++;
 		return lru;
+	}
 
-	// Determine the LRU block to replace, or prefereably unused block.
-	lru = &cache[0];
-	for (int i = 0; i < cacheSize; i++)
+	misses++;
+
+	// Allocate space for all of the cached blocks at once, on first use.
+	if (arena == NULL)
+		arena = (uint8_t *) malloc(blockSize * cacheSize);
+
+	// Determine the LRU block in this set to replace, or prefereably unused block.
+	CacheEntry *set = getSet(address);
+	bool cleanOnly = false;
+
+	while (true)
+	{
+		lru = NULL;
+
+		for (int i = 0; i < ways; i++)
+		{
+			// Simply return the first empty block we find
+			if (!(set[i].flags & FSCACHE_FLAG_VALID))
+			{
+				lru = &set[i];
+				break;
+			}
+
+			// Alternatively, record the least recently used block
+			if ((set[i].flags & FSCACHE_FLAG_PINNED) || (cleanOnly && (set[i].flags & FSCACHE_FLAG_DIRTY)))
+				continue;
+
+			if (lru == NULL || operationCount - set[i].lastUsed > operationCount - lru->lastUsed)
+				lru = &set[i];
+		}
+
+		if (lru == NULL)
+			return NULL;
+
+		// Never discard data that has not reached FLASH. Keep the block, and look for one that holds none.
+		if (writeBackEntry(lru) == DEVICE_OK)
+			break;
+
+		cleanOnly = true;
+	}
+
+	// If this miss continues a sequential run, also read the blocks that follow it, one into each of the following sets.
+	// Each replaces the least recently used block of its set, unless that was used more recently than the block this
+	// miss replaces: data in active use is never displaced by data that may not be.
+	CacheEntry *victims[CODAL_FS_CACHE_READ_AHEAD + 1] = {};
+	uint16_t age = operationCount - lru->lastUsed;
+	bool replacing = lru->flags & FSCACHE_FLAG_VALID;
+	int sets = cacheSize / ways;
+	int first = (lru - cache) / ways;
+	int count = 1;
+
+	victims[0] = lru;
+
+	if (address == nextSequential && !isErased(address))
 	{
-		// Simply return the first empty block we find
-		if (cache[i].page == NULL)
+		while (count <= CODAL_FS_CACHE_READ_AHEAD && first + count < sets && address + (count+1) * blockSize < flash.getFlashEnd())
 		{
-			lru = &cache[i];
+			CacheEntry *set = &cache[(first + count) * ways];
+			CacheEntry *victim = NULL;
+			uint32_t a = address + count * blockSize;
+			bool cached = false;
+
+			for (int i = 0; i < ways; i++)
+			{
+				if (!(set[i].flags & FSCACHE_FLAG_VALID))
+				{
+					if (victim == NULL || (victim->flags & FSCACHE_FLAG_VALID))
+						victim = &set[i];
+				}
+				else if (set[i].address == a)
+				{
+					cached = true;
+				}
+				else if (!(set[i].flags & FSCACHE_FLAG_PINNED) && (victim == NULL || ((victim->flags & FSCACHE_FLAG_VALID) && operationCount - set[i].lastUsed > operationCount - victim->lastUsed)))
+				{
+					victim = &set[i];
+				}
+			}
+
+			// Stop at any block that is already cached, known to be erased, or that would displace more recent data.
+			if (cached || victim == NULL || isErased(a))
+				break;
+
+			if ((victim->flags & FSCACHE_FLAG_VALID) && (!replacing || (uint16_t)(operationCount - victim->lastUsed) < age))
+				break;
+
+			victims[count++] = victim;
+		}
+	}
+
+	// We now have the best blocks to replace. In write back mode, they may hold data not yet written to FLASH.
+	// Read ahead no further than the first that cannot be written back. Once written, all old values are soft state.
+	for (int i = 1; i < count; i++)
+	{
+		if (writeBackEntry(victims[i]) != DEVICE_OK)
+		{
+			count = i;
 			break;
 		}
+	}
+
+	// Each entry has a fixed page in the arena, such that the same way of consecutive sets is contiguous.
+	for (int i = 0; i < count; i++)
+	{
+		CacheEntry *c = victims[i];
+
+		if (c->flags & FSCACHE_FLAG_VALID)
+			evictions++;
+
+		c->address = address + i * blockSize;
+		c->flags = FSCACHE_FLAG_VALID;
+		c->lastUsed = i ? operationCount : ++operationCount;
+		c->page = arena + (((c - cache) % ways) * sets + (c - cache) / ways) * blockSize;
+	}
 
-		// Alternatively, record the least recently used block
-		if (!(cache[i].flags & FSCACHE_FLAG_PINNED) && (operationCount - cache[i].lastUsed > operationCount - lru->lastUsed))
-			lru = &cache[i];
+	// There's no need to read a block we know to be erased.
+	if (isErased(address))
+	{
+		memset(lru->page, 0xFF, blockSize);
 	}
+	else
+	{
+		// Read each run of blocks whose pages are contiguous in a single operation.
+		for (int i = 0, run; i < count; i += run)
+		{
+			for (run = 1; i + run < count && victims[i + run]->page == victims[i]->page + run * blockSize; run++);
+
+			flash.read((uint32_t *)victims[i]->page, address + i * blockSize, run * blockSize / 4);
+		}
 
-	// We now have the best block to replace. Update metadata and load in the block from storage.
-	// We are a write through cache, so all old values are soft state.
-	lru->address = address;
-	lru->flags = 0;
-	lru->lastUsed = ++operationCount;
-	if (lru->page == NULL)
-		lru->page = (uint8_t *) malloc(blockSize);
+		bytesRead += count * blockSize;
+		prefetches += count - 1;
+	}
 
-	flash.read((uint32_t *)lru->page, address, blockSize / 4);
+	nextSequential = address + count * blockSize;
 
 	return lru;
 }
@@ -254,12 +610,14 @@ CacheEntry* FSCache::cachePage(uint32_t address)
 */
 CacheEntry *FSCache::getCacheEntry(uint32_t address)
 {
-	for (int i = 0; i < cacheSize; i++)
+	CacheEntry *set = getSet(address);
+
+	for (int i = 0; i < ways; i++)
 	{
-		if (cache[i].address == address && cache[i].page)
+		if (set[i].address == address && (set[i].flags & FSCACHE_FLAG_VALID))
 		{
-			cache[i].lastUsed = ++operationCount;
-			return &cache[i];
+			set[i].lastUsed = ++operationCount;
+			return &set[i];
 		}
 	}
 
@@ -268,19 +626,22 @@ CacheEntry *FSCache::getCacheEntry(uint32_t address)
 
 void FSCache::debug(bool verbose)
 {
+	DMESG("FSCache: [hits: %d] [misses: %d] [evictions: %d] [prefetches: %d] [bytesRead: %d] [bytesWritten: %d]\n", hits, misses, evictions, prefetches, bytesRead, bytesWritten);
+
 	for (int i = 0; i < cacheSize; i++)
 		debug(&cache[i], verbose);
 }
 
 void FSCache::debug(CacheEntry *c, bool verbose)
 {
-	DMESG("CacheEntry: [address: %p] [lastUsed: %d] [flags: %X]\n", c->address, c->lastUsed, c->flags);
+	DMESG("CacheEntry: [address: %p] [lastUsed: %d] [flags: %X] [dirty: %d-%d]\n", c->address, c->lastUsed, c->flags, c->dirtyStart, c->dirtyEnd);
 
-	if (verbose)
+	if (verbose && (c->flags & FSCACHE_FLAG_VALID))
 	{
 		int i = 0;
 		int lineLength = 32;
 		uint8_t *p = (uint8_t *)c->page;
+
 		uint8_t *end = p + blockSize;
 
 		while (p < end)
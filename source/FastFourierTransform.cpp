@@ -0,0 +1,165 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "FastFourierTransform.h"
+#include "DSPMath.h"
+
+using namespace codal;
+
+#if (CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE < 4 || CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE > 4096 || (CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE & (CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE - 1)))
+#error "CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE must be a power of two, between 4 and 4096"
+#endif
+
+// cos(2.pi.k/N) and sin(2.pi.k/N) for k in [0, N/2), where N is CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE.
+static float cosTable[CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE / 2];
+static float sinTable[CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE / 2];
+static bool tablesReady = false;
+
+/**
+ * Constructor.
+ *
+ * @param size The number of points in the transform. Must be a power of two, between 4 and CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE.
+ */
+FastFourierTransform::FastFourierTransform(int size)
+{
+    this->size = 0;
+    this->stride = 0;
+
+    if (size < 4 || size > CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE || (size & (size - 1)))
+        return;
+
+    if (!tablesReady)
+    {
+        for (int k = 0; k < CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE / 2; k++)
+        {
+            cosTable[k] = cosf(2.0f * (float) M_PI * k / CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE);
+            sinTable[k] = sinf(2.0f * (float) M_PI * k / CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE);
+        }
+
+        tablesReady = true;
+    }
+
+    this->size = size;
+    this->stride = CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE / size;
+}
+
+/**
+ * Applies a Hann window to the given block of samples, in place.
+ *
+ * @param data An array of getSize() samples.
+ */
+void FastFourierTransform::window(float *data)
+{
+    if (!isValid())
+        return;
+
+    // The window is symmetric, and 0.5 - 0.5.cos(2.pi.k/size), so shares the twiddle table. Its peak, at size/2, is one.
+    data[0] = 0.0f;
+
+    for (int k = 1; k < size / 2; k++)
+    {
+        float w = 0.5f - 0.5f * cosTable[k * stride];
+
+        data[k] *= w;
+        data[size - k] *= w;
+    }
+}
+
+/**
+ * Performs a forward transform of the given complex data, in place.
+ * The output is not normalised.
+ *
+ * @param re An array of getSize() real components.
+ * @param im An array of getSize() imaginary components.
+ */
+void FastFourierTransform::transform(float *re, float *im)
+{
+    if (!isValid())
+        return;
+
+    // Reorder the input into bit reversed order.
+    for (int i = 1, j = 0; i < size; i++)
+    {
+        int bit = size >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+        {
+            float t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    // Iterative radix-2 decimation in time butterflies.
+    for (int len = 2, step = CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE / 2; len <= size; len <<= 1, step >>= 1)
+    {
+        int half = len >> 1;
+
+        for (int i = 0; i < size; i += len)
+        {
+            for (int k = 0; k < half; k++)
+            {
+                float wr = cosTable[k * step];
+                float wi = -sinTable[k * step];
+
+                int a = i + k;
+                int b = a + half;
+
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+/**
+ * Performs a forward transform of the given real data, and computes the power spectrum.
+ * On return, re[k] holds |X(k)|^2 for k in [0, getSize()/2]. The content of im is undefined.
+ *
+ * @param re An array of getSize() real samples.
+ * @param im An array of getSize() floats, used as working memory.
+ */
+void FastFourierTransform::powerSpectrum(float *re, float *im)
+{
+    for (int k = 0; k < size; k++)
+        im[k] = 0.0f;
+
+    transform(re, im);
+
+    for (int k = 0; k <= size / 2; k++)
+        re[k] = re[k] * re[k] + im[k] * im[k];
+}
+
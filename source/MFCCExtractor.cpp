@@ -0,0 +1,356 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MFCCExtractor.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "CodalCompat.h"
+#include "CodalFiber.h"
+#include "codal_target_hal.h"
+#include "DSPMath.h"
+
+using namespace codal;
+
+/**
+ * Converts a frequency in Hz to the HTK mel scale.
+ */
+static float hzToMel(float hz)
+{
+    return 2595.0f * log10f(1.0f + hz / 700.0f);
+}
+
+/**
+ * Converts a point on the HTK mel scale to a frequency in Hz.
+ */
+static float melToHz(float mel)
+{
+    return 700.0f * (powf(10.0f, mel / 2595.0f) - 1.0f);
+}
+
+/**
+ * Constructor.
+ *
+ * @param source The DataSource to receive audio from.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param id The ID of this component, used for events.
+ */
+MFCCExtractor::MFCCExtractor(DataSource &source, float sampleRate, uint16_t id) : upstream(source), fft(CONFIG_MFCC_FFT_SIZE)
+{
+    const int filters = CONFIG_MFCC_MEL_FILTERS;
+
+    this->id = id;
+    this->status = 0;
+    this->written = 0;
+    this->countdown = CONFIG_MFCC_HOP_SIZE;
+    this->pending = 0;
+    this->frameEnd = 0;
+    this->dropped = 0;
+    this->featureHead = 0;
+    this->frames = 0;
+
+    memset(samples, 0, sizeof(samples));
+    memset(features, 0, sizeof(features));
+
+    // The filter edges are equally spaced on the mel scale. Within each pair of adjacent edges, a bin lies on the
+    // rising slope of one filter and the falling slope of the one below it, with weights linear in frequency.
+    float melMin = hzToMel(CONFIG_MFCC_MIN_FREQUENCY);
+    float melMax = hzToMel(min(CONFIG_MFCC_MAX_FREQUENCY, (int) (sampleRate / 2)));
+    float melStep = (melMax - melMin) / (filters + 1);
+
+    for (int k = 0; k <= CONFIG_MFCC_FFT_SIZE / 2; k++)
+    {
+        float hz = k * sampleRate / CONFIG_MFCC_FFT_SIZE;
+        float position = (hzToMel(hz) - melMin) / melStep;
+
+        if (position < 0.0f || position >= filters + 1)
+        {
+            filterIndex[k] = MFCC_EXTRACTOR_NO_FILTER;
+            filterWeight[k] = 0.0f;
+            continue;
+        }
+
+        int edge = (int) position;
+        float lower = melToHz(melMin + edge * melStep);
+        float upper = melToHz(melMin + (edge + 1) * melStep);
+
+        filterIndex[k] = edge;
+        filterWeight[k] = (hz - lower) / (upper - lower);
+    }
+
+    for (int i = 0; i < CONFIG_MFCC_COEFFICIENTS; i++)
+    {
+        float scale = sqrtf((i == 0 ? 1.0f : 2.0f) / filters);
+
+        for (int m = 0; m < filters; m++)
+            dct[i][m] = scale * cosf((float) M_PI * i * (m + 0.5f) / filters);
+    }
+
+    upstream.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+MFCCExtractor::~MFCCExtractor()
+{
+    stop();
+    upstream.disconnect();
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int MFCCExtractor::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    int format = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    if (!(status & MFCC_EXTRACTOR_STATUS_ACTIVE) || format == DATASTREAM_FORMAT_UNKNOWN)
+        return DEVICE_OK;
+
+    uint8_t *data = &b[0];
+    uint8_t *end = data + b.length();
+
+    while (data < end)
+    {
+        samples[written & (CONFIG_MFCC_BUFFER_SIZE - 1)] = max(min(StreamNormalizer::readSample[format](data), 32767), -32768);
+        written++;
+        data += bytesPerSample;
+
+        // Drop the oldest waiting frame once its first sample has been overwritten.
+        if (pending && written - (frameEnd - (pending - 1) * CONFIG_MFCC_HOP_SIZE - CONFIG_MFCC_FFT_SIZE) > CONFIG_MFCC_BUFFER_SIZE)
+        {
+            pending--;
+            dropped++;
+        }
+
+        if (--countdown > 0)
+            continue;
+
+        countdown = CONFIG_MFCC_HOP_SIZE;
+
+        // Hand the frame to the fiber. Frames are a fixed hop apart, so only the newest needs to be recorded.
+        frameEnd = written;
+        pending++;
+
+        Event(id, MFCC_EXTRACTOR_EVT_PENDING);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Computes the feature vector of the oldest waiting frame of samples.
+ */
+void MFCCExtractor::processFrame()
+{
+    const int n = CONFIG_MFCC_FFT_SIZE;
+    const float normalise = 1.0f / ((float) n * n);
+
+    float energy[CONFIG_MFCC_MEL_FILTERS];
+    float *mfcc = features[featureHead];
+
+    // Take a copy of the frame, so that capture can carry on over the buffer while we analyse it.
+    target_disable_irq();
+
+    uint32_t start = frameEnd - (pending - 1) * CONFIG_MFCC_HOP_SIZE - n;
+
+    for (int i = 0; i < n; i++)
+        re[i] = samples[(start + i) & (CONFIG_MFCC_BUFFER_SIZE - 1)];
+
+    pending--;
+
+    target_enable_irq();
+
+    // Pre-emphasis, scaling samples to the range [-1, 1).
+    float previous = re[0] / 32768.0f;
+
+    for (int i = 0; i < n; i++)
+    {
+        float s = re[i] / 32768.0f;
+        re[i] = s - CONFIG_MFCC_PRE_EMPHASIS * previous;
+        previous = s;
+    }
+
+    fft.window(re);
+    fft.powerSpectrum(re, im);
+
+    memset(energy, 0, sizeof(energy));
+
+    for (int k = 0; k <= n / 2; k++)
+    {
+        int edge = filterIndex[k];
+
+        if (edge == MFCC_EXTRACTOR_NO_FILTER)
+            continue;
+
+        float p = re[k] * normalise;
+
+        if (edge < CONFIG_MFCC_MEL_FILTERS)
+            energy[edge] += p * filterWeight[k];
+
+        if (edge > 0)
+            energy[edge - 1] += p * (1.0f - filterWeight[k]);
+    }
+
+    for (int m = 0; m < CONFIG_MFCC_MEL_FILTERS; m++)
+        energy[m] = logf(energy[m] > CONFIG_MFCC_LOG_FLOOR ? energy[m] : CONFIG_MFCC_LOG_FLOOR);
+
+    for (int i = 0; i < CONFIG_MFCC_COEFFICIENTS; i++)
+    {
+        float c = 0.0f;
+
+        for (int m = 0; m < CONFIG_MFCC_MEL_FILTERS; m++)
+            c += dct[i][m] * energy[m];
+
+        mfcc[i] = c;
+    }
+
+    featureHead = (featureHead + 1) % CONFIG_MFCC_HISTORY;
+    frames++;
+
+    Event(id, MFCC_EXTRACTOR_EVT_FRAME);
+}
+
+/**
+ * Begins computing feature vectors. A MFCC_EXTRACTOR_EVT_FRAME event is raised as each becomes available.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the FFT engine could not be created.
+ */
+int MFCCExtractor::start()
+{
+    if (!fft.isValid())
+        return DEVICE_NO_RESOURCES;
+
+    if (status & MFCC_EXTRACTOR_STATUS_ACTIVE)
+        return DEVICE_OK;
+
+    pending = 0;
+    countdown = CONFIG_MFCC_HOP_SIZE;
+    status |= MFCC_EXTRACTOR_STATUS_ACTIVE;
+
+    if (!(status & MFCC_EXTRACTOR_STATUS_FIBER))
+    {
+        status |= MFCC_EXTRACTOR_STATUS_FIBER;
+        create_fiber(frameFiber, this);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops computing feature vectors. Those already computed are retained.
+ * @return DEVICE_OK on success.
+ */
+int MFCCExtractor::stop()
+{
+    status &= ~MFCC_EXTRACTOR_STATUS_ACTIVE;
+
+    // Wake the fiber, and wait for it to exit, as it may still be processing a frame.
+    while (status & MFCC_EXTRACTOR_STATUS_FIBER)
+    {
+        Event(id, MFCC_EXTRACTOR_EVT_PENDING);
+        fiber_sleep(10);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Background fiber, processing frames as they become ready.
+ */
+void MFCCExtractor::frameFiber(void *param)
+{
+    MFCCExtractor *x = (MFCCExtractor *) param;
+
+    while (x->status & MFCC_EXTRACTOR_STATUS_ACTIVE)
+    {
+        if (x->pending)
+            x->processFrame();
+        else
+            fiber_wait_for_event(x->id, MFCC_EXTRACTOR_EVT_PENDING);
+    }
+
+    x->status &= ~MFCC_EXTRACTOR_STATUS_FIBER;
+}
+
+/**
+ * Determines the number of feature vectors computed since this extractor was created.
+ * @return the number of frames processed.
+ */
+uint32_t MFCCExtractor::getFrameCount()
+{
+    return frames;
+}
+
+/**
+ * Copies the most recent feature vector.
+ *
+ * @param mfcc An array of CONFIG_MFCC_COEFFICIENTS floats to receive the coefficients.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if no frames have been computed.
+ */
+int MFCCExtractor::getFrame(float *mfcc)
+{
+    return getFeatures(mfcc, 1) == 1 ? DEVICE_OK : DEVICE_INVALID_STATE;
+}
+
+/**
+ * Copies a window of the most recent feature vectors, oldest first, as a single array of
+ * frames * CONFIG_MFCC_COEFFICIENTS floats.
+ *
+ * @param dest The array to receive the coefficients.
+ * @param frames The number of feature vectors required, up to CONFIG_MFCC_HISTORY.
+ * @return the number of feature vectors copied, which may be fewer than requested shortly after start(),
+ * or DEVICE_INVALID_PARAMETER.
+ */
+int MFCCExtractor::getFeatures(float *dest, int frames)
+{
+    if (dest == NULL || frames < 0 || frames > CONFIG_MFCC_HISTORY)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (this->frames < (uint32_t) frames)
+        frames = this->frames;
+
+    // Frames are computed on a fiber, which does not yield part way through one, so the snapshot is consistent.
+    int index = (featureHead - frames + CONFIG_MFCC_HISTORY) % CONFIG_MFCC_HISTORY;
+
+    for (int i = 0; i < frames; i++)
+    {
+        memcpy(dest + i * CONFIG_MFCC_COEFFICIENTS, features[index], sizeof(features[index]));
+        index = (index + 1) % CONFIG_MFCC_HISTORY;
+    }
+
+    return frames;
+}
+
+/**
+ * Determines the number of frames dropped because the analysis could not keep up.
+ * @return the number of dropped frames.
+ */
+uint32_t MFCCExtractor::getDroppedCount()
+{
+    return dropped;
+}
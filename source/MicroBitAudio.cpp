@@ -39,6 +39,7 @@ MicroBitAudio* MicroBitAudio::instance = NULL;
   * Default Constructor.
   */
 MicroBitAudio::MicroBitAudio(NRF52Pin &pin, NRF52Pin &speaker):
+    equalizer(mixer),
     speakerEnabled(true),
     pinEnabled(true),
     pin(&pin), 
@@ -64,13 +65,17 @@ int MicroBitAudio::enable()
     if (pwm == NULL)
     {
 
-        pwm = new NRF52PWM(NRF_PWM1, mixer, 44100);
+        pwm = new NRF52PWM(NRF_PWM1, equalizer, 44100);
         pwm->setDecoderMode(PWM_DECODER_LOAD_Common);
 
         mixer.setSampleRate(44100);
         mixer.setSampleRange(pwm->getSampleRange());
         mixer.setOrMask(0x8000);
 
+        equalizer.setSampleRate(44100);
+        equalizer.setSampleRange(pwm->getSampleRange());
+        equalizer.setOrMask(0x8000);
+
         setSpeakerEnabled(speakerEnabled);
         setPinEnabled(pinEnabled);
 
@@ -0,0 +1,647 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitAudioRecorder.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "CodalFiber.h"
+#include "codal_target_hal.h"
+#include "CodalCompat.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace codal;
+
+//
+// IMA ADPCM quantizer step sizes and step index adjustments.
+//
+static const int16_t adpcmStepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767
+};
+
+static const int8_t adpcmIndexTable[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/**
+ * Constructor.
+ * Creates a recorder that writes to a raw region of non-volatile memory.
+ *
+ * @param source The DataSource to receive audio from.
+ * @param nvm The non-volatile memory controller to write to.
+ * @param start The logical address of the start of the region to use. Must be page aligned.
+ * @param length The size of the region, in bytes.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param id The ID of this component, used for events.
+ */
+MicroBitAudioRecorder::MicroBitAudioRecorder(DataSource &source, NVMController &nvm, uint32_t start, uint32_t length, int sampleRate, uint16_t id) : upstream(source)
+{
+    init(sampleRate, id);
+
+    this->nvm = &nvm;
+    this->regionStart = start;
+    this->regionEnd = start + length;
+}
+
+/**
+ * Constructor.
+ * Creates a recorder that writes to a file in the default MicroBitFileSystem.
+ *
+ * @param source The DataSource to receive audio from.
+ * @param fileName The name of the file to record into. Any existing file is replaced.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param id The ID of this component, used for events.
+ */
+MicroBitAudioRecorder::MicroBitAudioRecorder(DataSource &source, ManagedString fileName, int sampleRate, uint16_t id) : upstream(source)
+{
+    init(sampleRate, id);
+
+    this->fileName = fileName;
+}
+
+/**
+ * Common initialisation.
+ */
+void MicroBitAudioRecorder::init(int sampleRate, uint16_t id)
+{
+    this->id = id;
+    this->status = 0;
+    this->nvm = NULL;
+    this->regionStart = 0;
+    this->regionEnd = 0;
+    this->address = 0;
+    this->file = NULL;
+    this->format = AudioRecorderFormat::PCM16;
+    this->sampleRate = sampleRate;
+    this->block[0] = NULL;
+    this->block[1] = NULL;
+    this->length[0] = 0;
+    this->length[1] = 0;
+    this->filling = 0;
+    this->writing = -1;
+    this->bytesWritten = 0;
+    this->dropped = 0;
+    this->predictor = 0;
+    this->stepIndex = 0;
+    this->highNibble = false;
+    this->preTriggerHead = 0;
+    this->preTriggerCount = 0;
+    this->preTriggerSamples = 0;
+    this->replayCount = 0;
+
+    upstream.connect(*this);
+}
+
+/**
+ * Defines the encoding used for subsequent recordings.
+ *
+ * @param format AudioRecorderFormat::PCM16 or AudioRecorderFormat::ADPCM.
+ * @return DEVICE_OK on success, or DEVICE_BUSY if a recording is in progress.
+ */
+int MicroBitAudioRecorder::setFormat(AudioRecorderFormat format)
+{
+    if (status & (MICROBIT_AUDIO_RECORDER_STATUS_RECORDING | MICROBIT_AUDIO_RECORDER_STATUS_WRITER))
+        return DEVICE_BUSY;
+
+    this->format = format;
+    return DEVICE_OK;
+}
+
+/**
+ * Defines how much audio preceding a call to record() is captured, and begins retaining it.
+ *
+ * @param milliseconds The length of pre-trigger audio to retain. Limited by CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int MicroBitAudioRecorder::arm(int milliseconds)
+{
+    if (milliseconds < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    target_disable_irq();
+    preTriggerSamples = (int) ((int64_t) sampleRate * milliseconds / 1000);
+    status |= MICROBIT_AUDIO_RECORDER_STATUS_ARMED;
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int MicroBitAudioRecorder::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    if (b.length() == 0)
+        return DEVICE_OK;
+
+    if (status & MICROBIT_AUDIO_RECORDER_STATUS_RECORDING)
+    {
+        // While the writer is still encoding the pre-trigger audio, queue this buffer behind it.
+        if (status & MICROBIT_AUDIO_RECORDER_STATUS_REPLAY)
+        {
+            if (preTriggerCount < CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS)
+            {
+                preTrigger[(preTriggerHead + preTriggerCount) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS] = b;
+                preTriggerCount++;
+            }
+            else
+            {
+                dropped++;
+            }
+        }
+        else if (!encode(b))
+        {
+            dropped++;
+        }
+
+        // Keep nudging the writer while it has work, so a missed wakeup can never stall the pipeline.
+        if (writing >= 0)
+            Event(id, MICROBIT_AUDIO_RECORDER_EVT_DATA);
+    }
+    else if (status & MICROBIT_AUDIO_RECORDER_STATUS_ARMED)
+    {
+        int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(upstream.getFormat());
+
+        if (preTriggerCount == CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS)
+        {
+            preTrigger[preTriggerHead] = ManagedBuffer();
+            preTriggerHead = (preTriggerHead + 1) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS;
+            preTriggerCount--;
+        }
+
+        preTrigger[(preTriggerHead + preTriggerCount) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS] = b;
+        preTriggerCount++;
+
+        // Age out buffers that are no longer needed to provide the requested amount of pre-trigger audio.
+        int samples = 0;
+        for (int i = 1; i < preTriggerCount; i++)
+            samples += preTrigger[(preTriggerHead + i) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS].length() / bytesPerSample;
+
+        while (preTriggerCount > 1 && samples >= preTriggerSamples)
+        {
+            preTrigger[preTriggerHead] = ManagedBuffer();
+            preTriggerHead = (preTriggerHead + 1) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS;
+            preTriggerCount--;
+            samples -= preTrigger[preTriggerHead].length() / bytesPerSample;
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Begins a new block, writing its ADPCM header if required.
+ */
+void MicroBitAudioRecorder::startBlock()
+{
+    uint8_t *p = block[filling];
+
+    length[filling] = 0;
+    highNibble = false;
+
+    if (format == AudioRecorderFormat::ADPCM)
+    {
+        p[0] = predictor & 0xFF;
+        p[1] = (predictor >> 8) & 0xFF;
+        p[2] = stepIndex;
+        p[3] = 0;
+        length[filling] = 4;
+    }
+}
+
+/**
+ * Hands a complete block to the writer fiber, if possible.
+ * @return false if the writer is still busy with the previous block.
+ */
+bool MicroBitAudioRecorder::completeBlock()
+{
+    if (writing >= 0)
+    {
+        status |= MICROBIT_AUDIO_RECORDER_STATUS_STALLED;
+        return false;
+    }
+
+    writing = filling;
+    filling = filling ^ 1;
+    startBlock();
+
+    return true;
+}
+
+/**
+ * Encodes the given buffer into the current block, handing completed blocks to the writer.
+ * @return false if the data could not be accepted as storage is behind.
+ */
+bool MicroBitAudioRecorder::encode(ManagedBuffer &b)
+{
+    int inputFormat = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(inputFormat);
+
+    if (inputFormat == DATASTREAM_FORMAT_UNKNOWN || (status & MICROBIT_AUDIO_RECORDER_STATUS_STALLED))
+        return false;
+
+    uint8_t *data = &b[0];
+    uint8_t *end = data + b.length();
+
+    while (data < end)
+    {
+        int v = StreamNormalizer::readSample[inputFormat](data);
+        data += bytesPerSample;
+
+        v = max(min(v, 32767), -32768);
+        uint8_t *out = block[filling];
+
+        if (format == AudioRecorderFormat::PCM16)
+        {
+            out[length[filling]++] = v & 0xFF;
+            out[length[filling]++] = (v >> 8) & 0xFF;
+        }
+        else
+        {
+            int step = adpcmStepTable[stepIndex];
+            int diff = v - predictor;
+            int delta = step >> 3;
+            int nibble = 0;
+
+            if (diff < 0)
+            {
+                nibble = 8;
+                diff = -diff;
+            }
+
+            for (int bit = 4; bit; bit >>= 1)
+            {
+                if (diff >= step)
+                {
+                    nibble |= bit;
+                    diff -= step;
+                    delta += step;
+                }
+                step >>= 1;
+            }
+
+            predictor = (int16_t) max(min(predictor + ((nibble & 8) ? -delta : delta), 32767), -32768);
+            stepIndex = max(min(stepIndex + adpcmIndexTable[nibble], 88), 0);
+
+            if (highNibble)
+                out[length[filling] - 1] |= nibble << 4;
+            else
+                out[length[filling]++] = nibble;
+
+            highNibble = !highNibble;
+
+            if (highNibble)
+                continue;
+        }
+
+        if (length[filling] == CONFIG_AUDIO_RECORDER_BLOCK_SIZE && !completeBlock())
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Writes the given data to storage.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the storage is full.
+ */
+int MicroBitAudioRecorder::store(const void *data, int len)
+{
+    if (file)
+        return file->write((const char *) data, len) == len ? DEVICE_OK : DEVICE_NO_RESOURCES;
+
+    // Raw storage is written in whole words.
+    len = (len + 3) & ~3;
+
+    if (address + len > regionEnd)
+        return DEVICE_NO_RESOURCES;
+
+    uint8_t *p = (uint8_t *) data;
+    uint32_t pageSize = nvm->getPageSize();
+
+    while (len > 0)
+    {
+        if (address % pageSize == 0)
+            nvm->erase(address);
+
+        int l = min(len, (int) (pageSize - (address % pageSize)));
+        nvm->write(address, (uint32_t *) p, l / 4);
+
+        address += l;
+        p += l;
+        len -= l;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes any completed blocks to storage.
+ */
+void MicroBitAudioRecorder::flushBlocks()
+{
+    while (writing >= 0)
+    {
+        if (!(status & MICROBIT_AUDIO_RECORDER_STATUS_FULL))
+        {
+            if (store(block[writing], length[writing]) == DEVICE_OK)
+            {
+                bytesWritten += length[writing];
+            }
+            else
+            {
+                status |= MICROBIT_AUDIO_RECORDER_STATUS_FULL;
+                status &= ~MICROBIT_AUDIO_RECORDER_STATUS_RECORDING;
+                Event(id, MICROBIT_AUDIO_RECORDER_EVT_FULL);
+            }
+        }
+
+        // If the encoder filled the other block while we were busy, take it now.
+        target_disable_irq();
+        if (status & MICROBIT_AUDIO_RECORDER_STATUS_STALLED)
+        {
+            status &= ~MICROBIT_AUDIO_RECORDER_STATUS_STALLED;
+            int next = filling;
+            filling = writing;
+            writing = next;
+            startBlock();
+        }
+        else
+        {
+            writing = -1;
+        }
+        target_enable_irq();
+    }
+}
+
+/**
+ * Encodes the pre-trigger audio retained by arm(), and any buffers queued behind it, then hands encoding over
+ * to pullRequest().
+ */
+void MicroBitAudioRecorder::replayPreTrigger()
+{
+    for (int i = 0; i < replayCount; i++)
+    {
+        // Write out any completed block first, so that the block being filled can always be handed over.
+        flushBlocks();
+
+        if (!encode(replay[i]))
+            dropped++;
+
+        replay[i] = ManagedBuffer();
+    }
+
+    replayCount = 0;
+
+    // Then encode the buffers that arrived meanwhile, until pullRequest() can take over from an empty ring.
+    while (true)
+    {
+        flushBlocks();
+
+        // Interrupts are masked only to take the oldest buffer from the ring, not while it is encoded.
+        target_disable_irq();
+        if (preTriggerCount == 0)
+        {
+            status &= ~MICROBIT_AUDIO_RECORDER_STATUS_REPLAY;
+            target_enable_irq();
+            return;
+        }
+
+        ManagedBuffer b = preTrigger[preTriggerHead];
+        preTrigger[preTriggerHead] = ManagedBuffer();
+        preTriggerHead = (preTriggerHead + 1) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS;
+        preTriggerCount--;
+        target_enable_irq();
+
+        if (!encode(b))
+            dropped++;
+    }
+}
+
+/**
+ * Background writer fiber.
+ */
+void MicroBitAudioRecorder::writerFiber(void *param)
+{
+    MicroBitAudioRecorder *r = (MicroBitAudioRecorder *) param;
+
+    r->replayPreTrigger();
+
+    while (true)
+    {
+        r->flushBlocks();
+
+        if (!(r->status & MICROBIT_AUDIO_RECORDER_STATUS_RECORDING))
+            break;
+
+        fiber_wait_for_event(r->id, MICROBIT_AUDIO_RECORDER_EVT_DATA);
+    }
+
+    r->status &= ~MICROBIT_AUDIO_RECORDER_STATUS_WRITER;
+}
+
+/**
+ * Begins a new recording, starting with any pre-trigger audio retained by arm().
+ *
+ * @return DEVICE_OK on success, DEVICE_BUSY if a recording is already in progress, or DEVICE_NO_RESOURCES.
+ */
+int MicroBitAudioRecorder::record()
+{
+    if (status & (MICROBIT_AUDIO_RECORDER_STATUS_RECORDING | MICROBIT_AUDIO_RECORDER_STATUS_WRITER | MICROBIT_AUDIO_RECORDER_STATUS_FULL))
+        return DEVICE_BUSY;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (block[i] == NULL)
+            block[i] = (uint8_t *) malloc(CONFIG_AUDIO_RECORDER_BLOCK_SIZE);
+
+        if (block[i] == NULL)
+            return DEVICE_NO_RESOURCES;
+    }
+
+    if (nvm == NULL)
+    {
+        file = new MicroBitFile(fileName);
+        file->remove();
+        delete file;
+
+        file = new MicroBitFile(fileName);
+        if (!file->isValid())
+        {
+            delete file;
+            file = NULL;
+            return DEVICE_NO_RESOURCES;
+        }
+    }
+
+    address = regionStart;
+    bytesWritten = 0;
+    dropped = 0;
+    predictor = 0;
+    stepIndex = 0;
+    filling = 0;
+    writing = -1;
+
+    // Write the header, leaving the length fields erased so they can be completed when the recording stops.
+    AudioRecordingHeader h;
+    memcpy(h.magic, MICROBIT_AUDIO_RECORDER_MAGIC, 4);
+    h.format = (uint16_t) format;
+    h.blockSize = CONFIG_AUDIO_RECORDER_BLOCK_SIZE;
+    h.sampleRate = sampleRate;
+    h.length = 0xFFFFFFFF;
+    h.dropped = 0xFFFFFFFF;
+
+    if (store(&h, sizeof(h)) != DEVICE_OK)
+        return DEVICE_NO_RESOURCES;
+
+    startBlock();
+    status |= MICROBIT_AUDIO_RECORDER_STATUS_WRITER;
+
+    // Hand the pre-trigger audio to the writer to encode, leaving the ring empty to queue the buffers that follow it,
+    // and switch to live capture.
+    target_disable_irq();
+    for (int i = 0; i < preTriggerCount; i++)
+    {
+        replay[i] = preTrigger[(preTriggerHead + i) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS];
+        preTrigger[(preTriggerHead + i) % CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS] = ManagedBuffer();
+    }
+
+    replayCount = preTriggerCount;
+    preTriggerHead = 0;
+    preTriggerCount = 0;
+
+    status &= ~MICROBIT_AUDIO_RECORDER_STATUS_ARMED;
+    status |= MICROBIT_AUDIO_RECORDER_STATUS_RECORDING;
+
+    if (replayCount)
+        status |= MICROBIT_AUDIO_RECORDER_STATUS_REPLAY;
+    target_enable_irq();
+
+    create_fiber(writerFiber, this);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops the current recording, writes any buffered audio to storage and finalises the recording header.
+ * Blocks the calling fiber until complete.
+ *
+ * @return DEVICE_OK on success, or DEVICE_INVALID_STATE if no recording is in progress.
+ */
+int MicroBitAudioRecorder::stop()
+{
+    if (!(status & (MICROBIT_AUDIO_RECORDER_STATUS_RECORDING | MICROBIT_AUDIO_RECORDER_STATUS_FULL)))
+        return DEVICE_INVALID_STATE;
+
+    target_disable_irq();
+    status &= ~MICROBIT_AUDIO_RECORDER_STATUS_RECORDING;
+    target_enable_irq();
+
+    // Wait for the writer to drain any completed blocks.
+    while (status & MICROBIT_AUDIO_RECORDER_STATUS_WRITER)
+    {
+        Event(id, MICROBIT_AUDIO_RECORDER_EVT_DATA);
+        fiber_sleep(10);
+    }
+
+    // Write out the last, partially filled block (padded to a whole word with erased bytes).
+    int l = length[filling];
+    if (!(status & MICROBIT_AUDIO_RECORDER_STATUS_FULL) && l > (format == AudioRecorderFormat::ADPCM ? 4 : 0))
+    {
+        memset(block[filling] + l, 0xFF, ((l + 3) & ~3) - l);
+
+        if (store(block[filling], l) == DEVICE_OK)
+            bytesWritten += l;
+    }
+
+    // Complete the header.
+    uint32_t trailer[2] = { bytesWritten, dropped };
+
+    if (file)
+    {
+        file->setPosition(offsetof(AudioRecordingHeader, length));
+        file->write((const char *) trailer, sizeof(trailer));
+        file->close();
+        delete file;
+        file = NULL;
+    }
+    else
+    {
+        nvm->write(regionStart + offsetof(AudioRecordingHeader, length), trailer, 2);
+    }
+
+    status &= ~MICROBIT_AUDIO_RECORDER_STATUS_FULL;
+    Event(id, MICROBIT_AUDIO_RECORDER_EVT_STOPPED);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines if a recording is in progress.
+ * @return true if recording, false otherwise.
+ */
+bool MicroBitAudioRecorder::isRecording()
+{
+    return status & MICROBIT_AUDIO_RECORDER_STATUS_RECORDING;
+}
+
+/**
+ * Determines the number of upstream buffers dropped during the current (or last) recording,
+ * because storage could not keep up.
+ *
+ * @return the number of dropped buffers.
+ */
+uint32_t MicroBitAudioRecorder::getDroppedCount()
+{
+    return dropped;
+}
+
+/**
+ * Determines the number of bytes of audio data written during the current (or last) recording.
+ * @return the number of bytes written.
+ */
+uint32_t MicroBitAudioRecorder::getLength()
+{
+    return bytesWritten;
+}
+
+/**
+ * Destructor.
+ */
+MicroBitAudioRecorder::~MicroBitAudioRecorder()
+{
+    if (status & (MICROBIT_AUDIO_RECORDER_STATUS_RECORDING | MICROBIT_AUDIO_RECORDER_STATUS_FULL))
+        stop();
+
+    upstream.disconnect();
+
+    free(block[0]);
+    free(block[1]);
+}
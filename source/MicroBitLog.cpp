@@ -25,17 +25,13 @@ DEALINGS IN THE SOFTWARE.
 #include "MicroBitLog.h"
 #include "CodalDmesg.h"
 #include <new>
+#include <ctype.h>
+#include <stdlib.h>
+#include <math.h>
 
 using namespace codal;
 
-static ManagedString padString(ManagedString s, int digits)
-{
-    ManagedString zero = "0";
-    while(s.length() != digits)
-        s = zero + s;
-
-    return s;
-}
+static const char base64Table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 static void writeNum(char *buf, uint32_t n)
 {
@@ -50,23 +46,297 @@ static void writeNum(char *buf, uint32_t n)
     buf[i] = 0;
 }
 
+/**
+ * Writes the given value as a NULL terminated decimal string, zero padded to at least the given number of digits.
+ * @return the number of characters written.
+ */
+static int writeDecimal(char *buf, uint64_t n, int digits = 1)
+{
+    char reversed[20];
+    int l = 0;
+
+    do
+    {
+        reversed[l++] = '0' + n % 10;
+        n = n / 10;
+    } while (n || l < digits);
+
+    for (int i=0; i<l; i++)
+        buf[i] = reversed[l-i-1];
+
+    buf[l] = 0;
+    return l;
+}
+
+/**
+ * Writes the given value as a NULL terminated decimal string.
+ * @return the number of characters written.
+ */
+static int writeInteger(char *buf, int n)
+{
+    if (n >= 0)
+        return writeDecimal(buf, n);
+
+    buf[0] = '-';
+    return 1 + writeDecimal(buf+1, 0 - (int64_t)n);
+}
+
+/**
+ * Writes the given value as a NULL terminated decimal string, to 7 significant figures (the precision of a float).
+ * Very large and very small values are written in exponent form, e.g. "1.5e-07".
+ * @return the number of characters written.
+ */
+static int writeFloat(char *buf, float value)
+{
+    char *p = buf;
+    int exponent = 0;
+
+    if (isnan(value))
+    {
+        strcpy(p, "nan");
+        return 3;
+    }
+
+    if (value < 0)
+    {
+        *p++ = '-';
+        value = -value;
+    }
+
+    if (isinf(value))
+    {
+        strcpy(p, "inf");
+        return p - buf + 3;
+    }
+
+    if (value >= 1e9f || (value != 0.0f && value < 1e-4f))
+    {
+        exponent = (int) floorf(log10f(value));
+        value = (float) (value / pow(10.0, exponent));
+    }
+
+    // Scale to a fixed point value holding 7 significant figures.
+    int decimals = value == 0.0f ? 0 : 6 - (int) floorf(log10f(value));
+    decimals = decimals < 0 ? 0 : decimals;
+
+    uint64_t scale = 1;
+    for (int i=0; i<decimals; i++)
+        scale *= 10;
+
+    uint64_t fixed = (uint64_t) ((double) value * scale + 0.5);
+
+    // Rounding may carry into another digit (e.g. 9.9999999e20).
+    if (exponent && fixed >= 10 * scale)
+    {
+        fixed = fixed / 10;
+        exponent++;
+    }
+
+    p += writeDecimal(p, fixed / scale);
+
+    if (fixed % scale)
+    {
+        *p++ = '.';
+        p += writeDecimal(p, fixed % scale, decimals);
+
+        while (p[-1] == '0')
+            p--;
+    }
+
+    if (exponent)
+    {
+        *p++ = 'e';
+        *p++ = exponent < 0 ? '-' : '+';
+        p += writeDecimal(p, exponent < 0 ? -exponent : exponent, 2);
+    }
+
+    *p = 0;
+    return p - buf;
+}
+
+/**
+ * Writes the given time as a NULL terminated string in the given units, with two decimal places for anything other than milliseconds.
+ * @return the number of characters written.
+ */
+static int writeTimeStamp(char *buf, CODAL_TIMESTAMP time, TimeStampFormat format)
+{
+    // handle 32 bit overflow and fractional components of timestamp
+    CODAL_TIMESTAMP t = time / (CODAL_TIMESTAMP)format;
+    int billions = t / (CODAL_TIMESTAMP) 1000000000;
+    int units = t % (CODAL_TIMESTAMP) 1000000000;
+    int fraction = 0;
+
+    if ((int)format > 1)
+    {
+        fraction = units % 100;
+        units = units / 100;
+        billions = billions / 100;
+    }
+
+    int l = 0;
+
+    if (billions)
+    {
+        l = writeDecimal(buf, billions);
+        l += writeDecimal(buf+l, units, 9);
+    }
+    else
+    {
+        l = writeDecimal(buf, units);
+    }
+
+    // Add two decimal places for anything other than milliseconds.
+    if ((int)format > 1)
+    {
+        buf[l++] = '.';
+        l += writeDecimal(buf+l, fraction, 2);
+    }
+
+    return l;
+}
+
+/**
+ * Encodes a binary record as a NULL terminated line of text (see MicroBitLog.h).
+ * @return the number of characters written, excluding the terminator.
+ */
+static int encodeRecord(char *buf, char type, const uint8_t *data, int length)
+{
+    char *out = buf;
+
+    *out++ = MICROBIT_LOG_BINARY_RECORD_MARKER;
+    *out++ = type;
+
+    // Base64 encode the payload. The result contains no CSV separators, or characters that would break the HTML view.
+    for (int i = 0; i < length; i += 3)
+    {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < length)
+            v |= data[i+1] << 8;
+        if (i + 2 < length)
+            v |= data[i+2];
+
+        *out++ = base64Table[(v >> 18) & 0x3F];
+        *out++ = base64Table[(v >> 12) & 0x3F];
+        *out++ = i + 1 < length ? base64Table[(v >> 6) & 0x3F] : '=';
+        *out++ = i + 2 < length ? base64Table[v & 0x3F] : '=';
+    }
+
+    *out++ = '\n';
+    *out = 0;
+
+    return out - buf;
+}
+
+/**
+ * Determines the value of the given base64 character.
+ * @return the value, or -1 if the character is not part of the base64 alphabet.
+ */
+static int base64Value(int c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+
+    return -1;
+}
+
+/**
+ * Determines the character that cleanBuffer() would place at the given index of a string.
+ */
+static char cleanChar(const char *s, int i, int len, bool removeSeparators)
+{
+    for (int j = i-2; j <= i; j++)
+        if (j >= 0 && j+2 < len && s[j] == '-' && s[j+1] == '-' && s[j+2] == '>')
+            return CONFIG_MICROBIT_LOG_INVALID_CHAR_VALUE;
+
+    if (s[i] == '\t' || (removeSeparators && (s[i] == ',' || s[i] == '\n')))
+        return CONFIG_MICROBIT_LOG_INVALID_CHAR_VALUE;
+
+    return s[i];
+}
+
+/**
+ * Calculates a hash (FNV-1a) of the given heading, as it will be stored once cleaned.
+ */
+static uint32_t hashHeading(const char *key, int len)
+{
+    uint32_t hash = 2166136261;
+
+    for (int i=0; i<len; i++)
+    {
+        hash ^= (uint8_t) cleanChar(key, i, len, true);
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
 /**
  * Constructor.
  */
-MicroBitLog::MicroBitLog(MicroBitUSBFlashManager &flash, NRF52Serial &serial, int journalPages) : flash(flash), serial(serial), cache(flash, CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE, 4)
+MicroBitLog::MicroBitLog(MicroBitUSBFlashManager &flash, NRF52Serial &serial, int journalPages) : MicroBitLog((NVMController &) flash, serial, journalPages, &flash)
+{
+}
+
+/**
+ * Constructor, for storage other than the MICROBIT drive itself, such as an NVMMonitor wrapping it,
+ * or an in-memory NVMController in a host build.
+ *
+ * @param flash The non-volatile memory to log to.
+ * @param serial The serial port used for data mirroring.
+ * @param journalPages The number of pages to use for the journal.
+ * @param drive The USB drive presenting the storage as a file, or NULL. Its file name and size are updated when the log is cleared.
+ */
+MicroBitLog::MicroBitLog(NVMController &flash, NRF52Serial &serial, int journalPages, MicroBitUSBFlashManager *drive) : CodalComponent(MICROBIT_ID_LOG, 0), flash(flash), serial(serial),
+#if CONFIG_ENABLED(MICROBIT_LOG_STATIC_CACHE)
+    cache(flash, CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE, CONFIG_MICROBIT_LOG_CACHE_BLOCKS, cacheArena)
+#else
+    cache(flash, CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE, CONFIG_MICROBIT_LOG_CACHE_BLOCKS)
+#endif
 {
+    this->drive = drive;
     this->journalPages = journalPages;
-    this->status = 0;
     this->journalHead = 0;
     this->startAddress = 0;
     this->journalStart = 0;
     this->dataStart = 0;
+    this->dataEnd = 0;
+    this->flushedEnd = 0;
+    this->bufferAddress = 0;
+    this->writeBuffer = NULL;
+    this->rowOwner = NULL;
+    this->flushInterval = CONFIG_MICROBIT_LOG_FLUSH_INTERVAL;
+    this->cache.setWriteBack(flushInterval != 0);
     this->headingStart = 0;
     this->headingLength = 0;
     this->headingCount = 0;
     this->logEnd = 0;
     this->headingsChanged = false;
+    this->schemaChanged = true;
+    this->schemaPage = 0;
+    this->format = LogFormat::CSV;
     this->rowData = NULL;
+    this->columnMap = NULL;
+    this->headingIndex = NULL;
+    this->headingIndexSize = 0;
+    this->valueBuffer = NULL;
+    this->valueLength = 0;
+    this->rowBuffer = NULL;
+    this->packBuffer = NULL;
+    this->packLength = 0;
+    this->packRows = 0;
+    this->packTime = 0;
+    this->rowCount = 0;
+    this->indexPage = 0xFFFFFFFF;
+    this->rowTime = 0;
+    this->tables = NULL;
     this->timeStampFormat = TimeStampFormat::None;
 }
 
@@ -82,65 +352,78 @@ void MicroBitLog::init()
     if (isPresent())
     {
         // We have a valid file system.
-        JournalEntry j;
-        journalPages = (dataStart - startAddress) / flash.getPageSize() - 1;
-        journalHead = journalStart;
+        uint32_t pageSize = flash.getPageSize();
+        uint32_t head, first, next;
+        journalPages = (dataStart - startAddress) / pageSize - 1;
+        journalHead = dataStart - MICROBIT_LOG_JOURNAL_ENTRY_SIZE;
         dataEnd = dataStart;
 
-        // Load the last entry in the journal.
-        uint32_t journalEntryAddress = journalHead;
-        bool valid = false;
+        // Load the last entry in the journal. The journal page after the one holding it is always erased, so we need only
+        // probe the first entry of each page to find the one in use, and can then binary search within that page.
+        // If there is no such page (e.g. the journal could not be written), scan from the start of the data.
+        flash.read(&head, journalStart, 1);
+        first = head;
 
-        while(journalEntryAddress < dataStart)
+        for (uint32_t i = 0; i < journalPages; i++)
         {
-            cache.read(journalEntryAddress, j.length, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+            uint32_t page = journalStart + i * pageSize;
 
-            // If we have a valid reading follwed by an unused entry, we're done.
-            if (j.containsOnly(0xFF) && valid)
-                break;
+            if (i + 1 < journalPages)
+                flash.read(&next, page + pageSize, 1);
+            else
+                next = journalPages > 1 ? head : 0xFFFFFFFF;
 
-            // Parse valid entries. We continue processing to the last valid entry, just in case.
-            if (!j.containsOnly(0x00))
+            if (first != 0xFFFFFFFF && next == 0xFFFFFFFF)
             {
-                journalHead = journalEntryAddress;
-                dataEnd = dataStart + strtoul(j.length, NULL, 16);
-                valid = true;
-            }
+                uint32_t lo = page;
+                uint32_t hi = page + pageSize;
+                uint32_t entry = first;
 
-            journalEntryAddress += MICROBIT_LOG_JOURNAL_ENTRY_SIZE;
-        }
+                while (hi - lo > MICROBIT_LOG_JOURNAL_ENTRY_SIZE)
+                {
+                    uint32_t mid = lo + ((hi - lo) / (2 * MICROBIT_LOG_JOURNAL_ENTRY_SIZE)) * MICROBIT_LOG_JOURNAL_ENTRY_SIZE;
+                    uint32_t e;
+                    flash.read(&e, mid, 1);
+
+                    if (e == 0xFFFFFFFF)
+                    {
+                        hi = mid;
+                    }
+                    else
+                    {
+                        lo = mid;
+                        entry = e;
+                    }
+                }
+
+                if (entry < logEnd - dataStart)
+                {
+                    journalHead = lo;
+                    dataEnd = dataStart + entry;
+                }
 
-        // Walk the page indicated by dataEnd, and increment until an unused byte (0xFF) is found.
-        uint8_t d = 0;
-        while(dataEnd < logEnd)
-        {
-            cache.read(dataEnd, &d, 1);
-            if (d == 0xFF)
                 break;
+            }
 
-            dataEnd++;
+            first = next;
         }
 
+        // Scan forward from the position indicated by the journal until an unused byte (0xFF) is found.
+        dataEnd = scan(dataEnd, logEnd, 0xFF, true);
+
+        // In circular mode, the data may have wrapped around since the journal was last updated.
+        if (dataEnd == logEnd && (status & MICROBIT_LOG_STATUS_CIRCULAR))
+            dataEnd = scan(dataStart, logEnd, 0xFF, true);
+
+        // Everything found in flash is already durable.
+        flushedEnd = dataEnd;
+        bufferAddress = 0;
+
         // Determine if we have any column headers defined
         // If so, parse them.
-        uint32_t start = startAddress + sizeof(MicroBitLogMetaData);
-        char c;
-        
-        // Skip any leading zeroes (erased old data)
-        cache.read(start, &c, 1);
-        while(c == 0)
-        {
-            start++;
-            cache.read(start, &c, 1);
-        }
-
-        // Read read until we see a 0xFF character (unused memory)
-        uint32_t end = start;
-        while(c != 0xff)
-        {
-            end++;
-            cache.read(end, &c, 1);
-        }
+        // Skip any leading zeroes (erased old data), then read until we see a 0xFF character (unused memory)
+        uint32_t start = scan(startAddress + sizeof(MicroBitLogMetaData), journalStart, 0x00, false);
+        uint32_t end = scan(start, journalStart, 0xFF, true);
 
         headingLength = (int)(end-start);
 
@@ -153,30 +436,26 @@ void MicroBitLog::init()
             char *headers = (char *) malloc(headingLength);
             cache.read(start, headers, headingLength);
 
-            // Count the number of comma separated headers.
+            // Add each of the comma separated headers in turn.
             // Also terminate each entry as a string as we go.
-            for (uint32_t i=0; i<headingLength; i++)
+            int i = 0;
+            for (uint32_t h=0; h<headingLength; h++)
             {
-                if (headers[i] == ',' || headers[i] == '\n')
+                if (headers[h] == ',' || headers[h] == '\n')
                 {
-                    headers[i] = 0;
-                    headingCount++;
+                    headers[h] = 0;
+                    addHeading(ManagedString(&headers[i]));
+                    i = h + 1;
                 }
             }
 
-            // Allocate a RAM buffer to hold key/value pairs matching those defined
-            rowData = (ColumnEntry *) malloc(sizeof(ColumnEntry) * headingCount);
+            free(headers);
 
-            // Populate each entry.
-            int i=0;
-            for (uint32_t h=0; h<headingCount; h++)
-            {
-                new (&rowData[h]) ColumnEntry;
-                rowData[h].key = ManagedString(&headers[i]);
-                i = i + rowData[h].key.length() + 1;
-            }
+            // These headings are already held in persistent storage.
+            headingsChanged = false;
 
-            free(headers);
+            // Column types are not persisted, so a new schema will be needed before any binary rows.
+            schemaChanged = true;
         }
 
         // We may be full here, but this is still a valid state.
@@ -189,6 +468,35 @@ void MicroBitLog::init()
 }
 
 
+/**
+ * Scans forward from the given address for the first byte that does, or does not, hold the given value.
+ * Data is read through the cache a chunk at a time, so the cost is bounded by the number of blocks spanned.
+ *
+ * @param address the address to start from.
+ * @param end the address at which to stop.
+ * @param value the value to compare against.
+ * @param match true to find the first byte holding the given value, false to find the first byte holding any other value.
+ * @return the address of the byte found, or end if there is none.
+ */
+uint32_t MicroBitLog::scan(uint32_t address, uint32_t end, uint8_t value, bool match)
+{
+    uint8_t chunk[32];
+
+    while (address < end)
+    {
+        int length = min(sizeof(chunk), end - address);
+        cache.read(address, chunk, length);
+
+        for (int i=0; i<length; i++)
+            if ((chunk[i] == value) == match)
+                return address + i;
+
+        address += length;
+    }
+
+    return end;
+}
+
 /**
  * Reset all data stored in persistent storage.
  */
@@ -203,11 +511,21 @@ void MicroBitLog::clear(bool fullErase)
     journalHead = journalStart;
     dataStart = journalStart + journalPages*flash.getPageSize();
     dataEnd = dataStart;
+    flushedEnd = dataStart;
+    bufferAddress = 0;
     logEnd = flash.getFlashEnd() - flash.getPageSize() - sizeof(uint32_t);
-    status &= MICROBIT_LOG_STATUS_SERIAL_MIRROR;
+
+    // Any row being built is discarded.
+    if (status & MICROBIT_LOG_STATUS_ROW_STARTED)
+        releaseRow();
+
+    status &= (MICROBIT_LOG_STATUS_SERIAL_MIRROR | MICROBIT_LOG_STATUS_FLUSH_FIBER | MICROBIT_LOG_STATUS_CIRCULAR);
     
     // Remove any cached state around column headings
     headingsChanged = false;
+    schemaChanged = true;
+    packLength = 0;
+    packRows = 0;
     headingStart = 0;
     headingCount = 0;
     headingLength = 0;
@@ -215,9 +533,16 @@ void MicroBitLog::clear(bool fullErase)
     if (rowData)
     {
         free(rowData);
+        free(columnMap);
+        free(headingIndex);
         rowData = NULL;
+        columnMap = NULL;
+        headingIndex = NULL;
+        headingIndexSize = 0;
     }
 
+    timeStampColumn = LogColumn();
+
     // Erase block associated with the FULL indicator. We don't perform a pag eerase here to reduce flash wear.
     uint32_t zero = 0x00000000;
     flash.write(logEnd, &zero, 1);
@@ -225,11 +550,12 @@ void MicroBitLog::clear(bool fullErase)
     // Erase all pages associated with the header, all meta data and the first page of data storage.
     cache.clear();
     for (uint32_t p = flash.getFlashStart(); p <= (fullErase ? logEnd : dataStart); p += flash.getPageSize())
-        flash.erase(p);
+        erasePage(p);
 
     // Serialise and write header (if we have one)
     // n.b. we use flash.write() here to avoid unecessary preheating of the cache.
     flash.write(flash.getFlashStart(), (uint32_t *)header, sizeof(header)/4);
+    cache.update(flash.getFlashStart(), header, sizeof(header));
 
     // Generate and write FS metadata
     memcpy(metaData.version, MICROBIT_LOG_VERSION, 18);
@@ -242,17 +568,23 @@ void MicroBitLog::clear(bool fullErase)
     cache.write(startAddress, &metaData, sizeof(metaData));
 
     // Record that the log is empty
-    JournalEntry je;
-    cache.write(journalHead, &je, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+    uint32_t entry = 0;
+    cache.write(journalHead, &entry, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+
+    // Ensure the new file system is in FLASH before the drive is remounted.
+    cache.flush();
 
     // Update physical file size and visibility information.
-    MicroBitUSBFlashConfig config;
-    config.fileName = "MY_DATA.HTM";
-    config.fileSize = flash.getFlashEnd() - flash.getFlashStart() - flash.getPageSize();
-    config.visible = true;
-    
-    flash.setConfiguration(config, true);
-    flash.remount();
+    if (drive)
+    {
+        MicroBitUSBFlashConfig config;
+        config.fileName = "MY_DATA.HTM";
+        config.fileSize = flash.getFlashEnd() - flash.getFlashStart() - flash.getPageSize();
+        config.visible = true;
+
+        drive->setConfiguration(config, true);
+        drive->remount();
+    }
 
     status |= MICROBIT_LOG_STATUS_INITIALIZED;
 
@@ -306,7 +638,41 @@ void MicroBitLog::setTimeStamp(TimeStampFormat format)
 
     // Attempt to add the column, if it does not already exist.
     // Add at the front, unless data has already been written.
-    addHeading(timeStampHeading, ManagedString::EmptyString, dataStart == dataEnd);
+    timeStampColumn.id = addHeading(timeStampHeading, dataStart == dataEnd);
+}
+
+/**
+ * Determines how rows are stored. CSV stores each row as text. Compressed stores rows as packed records of
+ * typed values, with integers stored as the difference from the previous row in as few bytes as possible. Binary
+ * stores rows as packed records of fixed width values, with each integer column as narrow as the values logged in it
+ * allow. Rows in either are converted back to CSV only when the log is viewed online (by dl.js), read out with
+ * decode.js in resources/logfs, or read on the device with MicroBitLogIterator. The offline view, and its Download
+ * and Copy buttons, leave them out, so use these formats only where the data will be read by one of those.
+ *
+ * In compressed format, each column takes the type of the first value logged in it: a 32 bit integer,
+ * a 32 bit float or text. In binary format, integer columns are 8, 16 or 32 bits wide, and are widened as larger
+ * values are logged. Numeric values are stored by value, so formatting such as trailing zeroes is not kept.
+ *
+ * While write behind buffering is enabled (see setFlushInterval()), rows are packed together in RAM and written
+ * when the log is flushed, which is where both formats save most. Compressed format suits slowly changing values
+ * such as sensor readings, and binary format values that change a lot from row to row but have a small range.
+ * Without buffering, each row is written as a record of its own.
+ *
+ * @param format The format to use for subsequent rows.
+ */
+void MicroBitLog::setFormat(LogFormat format)
+{
+    if (format != this->format)
+    {
+        writePackedRows();
+        schemaChanged = true;
+
+        // Each format types its columns differently, so let them be typed afresh.
+        for (uint32_t i=0; i<headingCount; i++)
+            rowData[i].type = 0;
+    }
+
+    this->format = format;
 }
 
 /**
@@ -322,8 +688,84 @@ void MicroBitLog::setSerialMirroring(bool enable)
         status &= ~MICROBIT_LOG_STATUS_SERIAL_MIRROR;
 }
 
+/**
+ * Determines how long logged data may be held in RAM before it is committed to flash storage.
+ * Rows are accumulated into whole pages and written in a single transfer, which is much faster than
+ * writing each row as it is logged. Updates to the journal and headings are held in the cache and written
+ * together in the same way. Any buffered data is also committed when the device enters deep sleep
+ * or is powered off. Data held in RAM is lost if power is removed unexpectedly, so buffering is disabled by
+ * default (see CONFIG_MICROBIT_LOG_FLUSH_INTERVAL).
+ *
+ * @param interval The maximum time to hold data in RAM, in milliseconds. Zero writes every row straight to flash.
+ */
+void MicroBitLog::setFlushInterval(uint32_t interval)
+{
+    if (interval == 0)
+        writePackedRows();
+
+    mutex.wait();
+
+    flushInterval = interval;
+
+    // If buffering is no longer required, commit what we have and release the buffer.
+    if (interval == 0 && writeBuffer)
+    {
+        flushBuffer();
+        free(writeBuffer);
+        writeBuffer = NULL;
+        bufferAddress = 0;
+    }
+
+    // While buffering, also hold updates to the metadata and journal in the cache until the next flush.
+    cache.setWriteBack(interval != 0);
+
+    mutex.notify();
+}
+
+/**
+ * Determines what happens when the log fills. By default, logging stops and the log is marked as full.
+ * In circular mode, the oldest page of data is instead erased to make room for new rows, such that the
+ * log always holds the most recent data. The log is still read out in the order it was written.
+ *
+ * @param circular true to reuse the oldest pages when the log fills, false to stop logging.
+ */
+void MicroBitLog::setCircular(bool circular)
+{
+    if (circular)
+        status |= MICROBIT_LOG_STATUS_CIRCULAR;
+    else
+        status &= ~MICROBIT_LOG_STATUS_CIRCULAR;
+}
+
+/**
+ * Commits any data held in RAM to flash storage.
+ *
+ * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the data could not be written.
+ */
+int MicroBitLog::flush()
+{
+    // Write out any packed rows, so that they are committed along with everything else.
+    writePackedRows();
+
+    // Fast path if there's nothing to do.
+    if (flushedEnd == dataEnd && !flushInterval)
+        return DEVICE_OK;
+
+    mutex.wait();
+    int result = flushBuffer();
+
+    // Write back any metadata and journal updates held in the cache.
+    if (result == DEVICE_OK)
+        result = cache.flush();
+
+    mutex.notify();
+
+    return result;
+}
+
 /**
  * Creates a new row in the log, ready to be populated by logData()
+ * Rows are built by one fiber at a time. If another fiber has a row open, this blocks until that row is ended.
  * 
  * @return DEVICE_OK on success.
  */
@@ -332,12 +774,25 @@ int MicroBitLog::beginRow()
     init();
 
     // If beginRow is called during an open transaction, implicity perform an endRow before proceeding.
-    if (status & MICROBIT_LOG_STATUS_ROW_STARTED)
+    if ((status & MICROBIT_LOG_STATUS_ROW_STARTED) && rowOwner == currentFiber)
         endRow();
 
+    // A row is built over several calls, any of which may yield, so hold other fibers off until it is ended.
+    rowLock.wait();
+    rowOwner = currentFiber;
+
+    // Allocate buffers to hold the row, if this is the first.
+    if (valueBuffer == NULL)
+    {
+        valueBuffer = (char *) malloc(CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE);
+        rowBuffer = (char *) malloc(CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE + 2);
+    }
+
     // Reset all values, ready to populate with a new row.
     for (uint32_t i=0; i<headingCount; i++)
-        rowData[i].value = ManagedString();
+        rowData[i].length = 0;
+
+    valueLength = 0;
 
     // indicate that we've started a new row.
     status |= MICROBIT_LOG_STATUS_ROW_STARTED;
@@ -354,7 +809,7 @@ int MicroBitLog::beginRow()
  */
 int MicroBitLog::logData(const char *key, const char *value)
 {
-    return logData(ManagedString(key), ManagedString(value));
+    return logData(addColumn(key), value);
 }
 
 /**
@@ -365,52 +820,236 @@ int MicroBitLog::logData(const char *key, const char *value)
  * @return DEVICE_OK on success.
  */
 int MicroBitLog::logData(ManagedString key, ManagedString value)
+{
+    return logData(addColumn(key.toCharArray()), value.toCharArray());
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLog::logData(const char *key, int value)
+{
+    return logData(addColumn(key), value);
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * The value is recorded to 7 significant figures.
+ *
+ * @param key the name of the key column) to set.
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLog::logData(const char *key, float value)
+{
+    return logData(addColumn(key), value);
+}
+
+/**
+ * Populates the given column of the current row.
+ * @param column the column to set, as returned by addColumn().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLog::logData(LogColumn column, const char *value)
 {
     // Perform lazy instatiation if necessary.
     init();
 
+    if (column.id < 0 || (uint32_t)column.id >= headingCount)
+        return DEVICE_INVALID_PARAMETER;
+
     // If logData is called before explicitly beginning a row, do so implicitly.
-    if (!(status & MICROBIT_LOG_STATUS_ROW_STARTED))
+    if (!(status & MICROBIT_LOG_STATUS_ROW_STARTED) || rowOwner != currentFiber)
         beginRow();
 
-    ManagedString k = cleanBuffer(key.toCharArray(), key.length());
-    ManagedString v = cleanBuffer(value.toCharArray(), value.length());
-
-    if (k.length())
-        key = k;
-
-    if (v.length())
-        value = v;
-
-    // Add the given key/value pair into our cumulative row data. 
-    bool added = false;
-    for (uint32_t i=0; i<headingCount; i++)
-    {
-        if(rowData[i].key == key)
-        {
-            rowData[i].value = value;
-            added = true;
-            break;
-        }
-    }
+    // Add the given value into our cumulative row data.
+    return setValue(columnMap[column.id], value, strlen(value));
+}
 
-    // If the requested heading is not available, add it.
-    if (!added)
-        addHeading(key, value);
+/**
+ * Populates the given column of the current row.
+ * @param column the column to set, as returned by addColumn().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLog::logData(LogColumn column, int value)
+{
+    char s[12];
+    writeInteger(s, value);
 
-    return DEVICE_OK;
+    return logData(column, s);
 }
 
 /**
- * Complete a row in the log, and pushes to persistent storage.
- * @return DEVICE_OK on success.
+ * Populates the given column of the current row.
+ * The value is recorded to 7 significant figures.
+ *
+ * @param column the column to set, as returned by addColumn().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
  */
-int MicroBitLog::endRow()
+int MicroBitLog::logData(LogColumn column, float value)
 {
-    if (!(status & MICROBIT_LOG_STATUS_ROW_STARTED))
-        return DEVICE_INVALID_STATE;
+    char s[20];
+    writeFloat(s, value);
 
-    init();
+    return logData(column, s);
+}
+
+/**
+ * Adds a column to the log, if it is not already present.
+ * The handle returned can then be used to log data without looking the column up by name on each row.
+ *
+ * @param key the name of the column.
+ * @return a handle to the column.
+ */
+LogColumn MicroBitLog::addColumn(const char *key)
+{
+    LogColumn column;
+
+    // Perform lazy instatiation if necessary.
+    init();
+
+    column.id = findHeading(key);
+
+    // If the requested heading is not available, add it.
+    if (column.id < 0)
+    {
+        ManagedString k = cleanBuffer(key, strlen(key));
+        column.id = addHeading(k.length() ? k : ManagedString(key));
+    }
+
+    return column;
+}
+
+/**
+ * Determines the column with the given heading.
+ *
+ * @param key the heading to find. Any invalid LogFS symbols are treated as they are by cleanBuffer().
+ * @return the id of the column, or -1 if the heading is not in use.
+ */
+int MicroBitLog::findHeading(const char *key)
+{
+    int len = strlen(key);
+    uint32_t hash = hashHeading(key, len);
+
+    if (headingIndex == NULL)
+        return -1;
+
+    for (uint32_t i = hash & (headingIndexSize - 1); headingIndex[i]; i = (i + 1) & (headingIndexSize - 1))
+    {
+        int id = headingIndex[i] - 1;
+        ColumnEntry &c = rowData[columnMap[id]];
+        const char *k = c.key.toCharArray();
+        int j = 0;
+
+        if (c.hash != hash || c.key.length() != len)
+            continue;
+
+        while (j < len && k[j] == cleanChar(key, j, len, true))
+            j++;
+
+        if (j == len)
+            return id;
+    }
+
+    return -1;
+}
+
+/**
+ * Adds the given column id to headingIndex, growing the index if necessary.
+ *
+ * @param id the id of the column to add.
+ */
+void MicroBitLog::indexHeading(int id)
+{
+    // Keep the index no more than half full, so that lookups remain short. Rebuild it whenever it grows.
+    if (2 * headingCount > headingIndexSize)
+    {
+        free(headingIndex);
+        headingIndexSize = headingIndexSize ? 2 * headingIndexSize : 16;
+        headingIndex = (uint16_t *) malloc(sizeof(uint16_t) * headingIndexSize);
+        memset(headingIndex, 0, sizeof(uint16_t) * headingIndexSize);
+
+        for (int i = 0; i < id; i++)
+            indexHeading(i);
+    }
+
+    uint32_t i = rowData[columnMap[id]].hash & (headingIndexSize - 1);
+
+    while (headingIndex[i])
+        i = (i + 1) & (headingIndexSize - 1);
+
+    headingIndex[i] = id + 1;
+}
+
+/**
+ * Stores the given value in the current row, removing any invalid LogFS symbols.
+ *
+ * @param column the index of the column to set.
+ * @param value the value to store.
+ * @param length the length of the value, in bytes.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLog::setValue(int column, const char *value, int length)
+{
+    ColumnEntry &c = rowData[column];
+
+    // Reuse the space held by any previous value in this column if we can. Otherwise, add the value to the end of the row.
+    if (length > c.length)
+    {
+        if (valueLength + length + 1 > CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE)
+            return DEVICE_NO_RESOURCES;
+
+        c.value = valueLength;
+        valueLength += length + 1;
+    }
+
+    if (length)
+    {
+        for (int i=0; i<length; i++)
+            valueBuffer[c.value + i] = cleanChar(value, i, length, true);
+
+        valueBuffer[c.value + length] = 0;
+    }
+
+    c.length = length;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Complete a row in the log, and pushes to persistent storage.
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLog::endRow()
+{
+    return endRow(system_timer_current_time());
+}
+
+/**
+ * Complete a row in the log, and pushes to persistent storage.
+ * @param time The time to record in the timestamp column (if enabled), in milliseconds.
+ * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if the log is full, or DEVICE_I2C_ERROR if the row could not be written.
+ */
+int MicroBitLog::endRow(CODAL_TIMESTAMP time)
+{
+    if (!(status & MICROBIT_LOG_STATUS_ROW_STARTED) || rowOwner != currentFiber)
+        return DEVICE_INVALID_STATE;
+
+    init();
+
+    // Recorded in the index, so that readers can seek by time.
+    rowTime = time;
 
     // Special case the condition where no values are present.
     // We suppress injecting a pointless timestamp in these cases.
@@ -418,7 +1057,7 @@ int MicroBitLog::endRow()
 
     for (uint32_t i=0; i<headingCount; i++)
     {
-        if(rowData[i].value != ManagedString::EmptyString)
+        if(rowData[i].length)
         {
             validData = true;
             break;
@@ -428,44 +1067,17 @@ int MicroBitLog::endRow()
     // Insert timestamp field if requested.
     if (validData && timeStampFormat != TimeStampFormat::None)
     {
-        // handle 32 bit overflow and fractional components of timestamp
-        CODAL_TIMESTAMP t = system_timer_current_time() / (CODAL_TIMESTAMP)timeStampFormat;
-        int billions = t / (CODAL_TIMESTAMP) 1000000000;
-        int units = t % (CODAL_TIMESTAMP) 1000000000;
-        int fraction = 0;
-
-        if ((int)timeStampFormat > 1)
-        {
-            fraction = units % 100;
-            units = units / 100;
-            billions = billions / 100;
-        }
-
-        ManagedString u(units);
-        ManagedString f(fraction);
-        ManagedString s;
-        f = padString(f, 2);
-
-        if (billions)
-        {
-            s = s + billions;
-            u = padString(u, 9);
-        }
-
-        s = s + u;
-
-        // Add two decimal places for anything other than milliseconds.
-        if ((int)timeStampFormat > 1)
-            s = s + "." + f;
+        char s[24];
+        writeTimeStamp(s, time, timeStampFormat);
 
-        logData(timeStampHeading, s);
+        logData(timeStampColumn, s);
     }
 
     // If new columns have been added since the last row, update persistent storage accordingly.
-    ManagedString sep = ",";
-
     if (headingsChanged)
     {
+        ManagedString sep = ",";
+
         // If this is the first time we have logged any headings, place them just after the metadata block
         if (headingStart == 0)
             headingStart = startAddress + sizeof(MicroBitLogMetaData);
@@ -485,37 +1097,67 @@ int MicroBitLog::endRow()
         cache.write(headingStart, &zero[0], headingLength);
         headingStart += headingLength;
         cache.write(headingStart, h.toCharArray(), h.length());
+        headingLength = h.length();
 
-        logString(h);
+        // In compressed format, the headings are written as part of the next schema record.
+        if (format == LogFormat::CSV)
+            writeData(h.toCharArray(), 0, true);
+        else
+            schemaChanged = true;
 
         headingsChanged = false;
     }
 
-    // Serialize data to CSV
-    ManagedString row;
-    bool empty = true;
+    // Rows too large to be held in a single binary record are stored as CSV text, under the same headings.
+    if (format != LogFormat::CSV && writeBinaryRow() != DEVICE_INVALID_PARAMETER)
+    {
+        releaseRow();
+        return (status & MICROBIT_LOG_STATUS_FULL) ? DEVICE_NO_RESOURCES : DEVICE_OK;
+    }
+
+    // Serialize data to CSV, directly into the row buffer. Rows too wide for the buffer are written in several pieces.
+    int result = DEVICE_OK;
 
-    for (uint32_t i=0; i<headingCount;i++)
+    if (validData)
     {
-        row = row + rowData[i].value;
-         
-        if (rowData[i].value.length())
-            empty = false;
+        int length = 0;
 
-        if (i + 1 != headingCount)
-            row = row + sep;
-    }
-    row = row + "\n";
+        for (uint32_t i=0; i<headingCount && result == DEVICE_OK;i++)
+        {
+            if (length + rowData[i].length > CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE)
+            {
+                rowBuffer[length] = 0;
+                result = writeData(rowBuffer, 0);
+                length = 0;
+            }
+
+            memcpy(&rowBuffer[length], &valueBuffer[rowData[i].value], rowData[i].length);
+            length += rowData[i].length;
+            rowBuffer[length++] = (i + 1 != headingCount) ? ',' : '\n';
+        }
 
-    if (!empty)
-        logString(row);
+        rowBuffer[length] = 0;
 
-    status &= ~MICROBIT_LOG_STATUS_ROW_STARTED;
+        if (result == DEVICE_OK)
+            result = writeData(rowBuffer, 1);
+    }
+
+    releaseRow();
 
     if (status & MICROBIT_LOG_STATUS_FULL)
         return DEVICE_NO_RESOURCES;
 
-    return DEVICE_OK;
+    return result == DEVICE_I2C_ERROR ? DEVICE_I2C_ERROR : DEVICE_OK;
+}
+
+/**
+ * Ends the row being built, allowing other fibers to begin theirs.
+ */
+void MicroBitLog::releaseRow()
+{
+    status &= ~MICROBIT_LOG_STATUS_ROW_STARTED;
+    rowOwner = NULL;
+    rowLock.notify();
 }
 
 /**
@@ -556,20 +1198,64 @@ ManagedString MicroBitLog::cleanBuffer(const char *s, int len, bool removeSepara
  * @param s the string to inject.
  */
 int MicroBitLog::logString(const char *s)
+{
+    uint32_t rows = 0;
+
+    for (const char *p = s; *p; p++)
+        if (*p == '\n')
+            rows++;
+
+    return writeData(s, rows);
+}
+
+/**
+ * Writes the given data to the end of the log, preceded by an index record if it starts the first line on a new page.
+ *
+ * @param s The data to write.
+ * @param rows The number of rows completed by the data.
+ * @param headings true if the data is a line of CSV headings.
+ *
+ * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if the log is full, or DEVICE_I2C_ERROR if buffered data could not
+ * be committed to make way for it. The log is left unchanged in the latter case.
+ */
+int MicroBitLog::writeData(const char *s, uint32_t rows, bool headings)
 {
     mutex.wait();
     
     init();
 
+    // Pick up the row count from the index on the first write after the log is mounted.
+    if (!(status & MICROBIT_LOG_STATUS_INDEXED))
+        restoreIndex();
+
     uint32_t oldDataEnd = dataEnd;
+    uint32_t oldIndexPage = indexPage;
+    uint16_t oldStatus = status;
     uint32_t l = strlen(s);
     const char *data = s;
+    char index[4 + 4 * ((MICROBIT_LOG_INDEX_SIZE + 2) / 3)];
+    uint32_t indexLength = 0;
+
+    // Index the first line to start on each page, and any line of CSV headings (which readers must not count as a row).
+    if (headings || (!(status & MICROBIT_LOG_STATUS_LINE_OPEN) && dataEnd / flash.getPageSize() != indexPage))
+    {
+        uint8_t entry[MICROBIT_LOG_INDEX_SIZE];
+
+        entry[0] = headings ? MICROBIT_LOG_INDEX_HEADINGS : 0;
+        for (int i = 0; i < 4; i++)
+            entry[1 + i] = (rowCount >> (8 * i)) & 0xFF;
+        for (int i = 0; i < 6; i++)
+            entry[5 + i] = (rowTime >> (8 * i)) & 0xFF;
 
-    // If we can't write a whole line of data, then treat the log as full.
-    if (l > logEnd - dataEnd)
+        indexLength = encodeRecord(index, MICROBIT_LOG_RECORD_INDEX, entry, MICROBIT_LOG_INDEX_SIZE);
+    }
+
+    // If we can't write a whole line of data, then treat the log as full. In circular mode, we simply wrap around.
+    if (!(status & MICROBIT_LOG_STATUS_CIRCULAR) && l + indexLength > logEnd - dataEnd)
     {
         if (!(status & MICROBIT_LOG_STATUS_FULL))
         {
+            flushBuffer();
             cache.write(logEnd+1, "FUL", 3);
             status |= MICROBIT_LOG_STATUS_FULL;
         }
@@ -586,76 +1272,252 @@ int MicroBitLog::logString(const char *s)
     if (status & MICROBIT_LOG_STATUS_SERIAL_MIRROR && l > 0)
         serial.send((uint8_t *)data, l);
 
+    // Allocate a write behind buffer on first use, if enabled.
+    if (flushInterval && writeBuffer == NULL)
+        writeBuffer = (uint8_t *) malloc(flash.getPageSize());
+
+    int result = DEVICE_OK;
+
+    if (indexLength)
+    {
+        result = appendData(index, indexLength);
+        indexPage = dataEnd / flash.getPageSize();
+    }
+
+    // Index records are only placed between lines, so note whether this data leaves one open.
+    if (l > 0)
+    {
+        if (data[l-1] == '\n')
+            status &= ~MICROBIT_LOG_STATUS_LINE_OPEN;
+        else
+            status |= MICROBIT_LOG_STATUS_LINE_OPEN;
+    }
+
+    if (result == DEVICE_OK)
+        result = appendData(data, l);
+
+    // The page held in writeBuffer could not be committed to make way for the next one. A line never spans more than
+    // two pages, so none of this data has reached flash yet. Discard what was buffered of it, and leave the log as it was.
+    if (result == DEVICE_I2C_ERROR)
+    {
+        uint32_t offset = oldDataEnd - bufferAddress;
+
+        if (offset < flash.getPageSize())
+            memset(writeBuffer + offset, 0xFF, flash.getPageSize() - offset);
+
+        dataEnd = oldDataEnd;
+        indexPage = oldIndexPage;
+        status = (status & ~MICROBIT_LOG_STATUS_LINE_OPEN) | (oldStatus & MICROBIT_LOG_STATUS_LINE_OPEN);
+
+        mutex.notify();
+        return DEVICE_I2C_ERROR;
+    }
+
+    if (result == DEVICE_OK)
+        rowCount += rows;
+
+    if (writeBuffer)
+    {
+        // Commit a completed page straight away. If this row started on the previous page, commit the rest of it too,
+        // so that a row is never left half written. Anything else is committed by the flush fiber.
+        if (dataEnd % flash.getPageSize() == 0 || dataEnd / flash.getPageSize() != oldDataEnd / flash.getPageSize())
+            flushBuffer();
+
+        if (!(status & MICROBIT_LOG_STATUS_FLUSH_FIBER))
+        {
+            status |= MICROBIT_LOG_STATUS_FLUSH_FIBER;
+            create_fiber(flushFiber, this);
+        }
+    }
+    else
+    {
+        updateJournal(oldDataEnd, dataEnd);
+        flushedEnd = dataEnd;
+    }
+
+    mutex.notify();
+
+    // Return NO_RESOURCES if we ran out of FLASH space.
+    if (result == DEVICE_OK)
+        return DEVICE_OK;
+
+    Event(MICROBIT_ID_LOG, MICROBIT_LOG_EVT_LOG_FULL);
+    return DEVICE_NO_RESOURCES;
+}
+
+/**
+ * Writes the given data to the end of the log, erasing pages ahead of it and wrapping around in circular mode.
+ *
+ * @param data The data to write.
+ * @param l The number of bytes to write.
+ * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if the log is full, or DEVICE_I2C_ERROR if the data held in
+ * writeBuffer could not be committed to make way for the next page.
+ */
+int MicroBitLog::appendData(const char *data, uint32_t l)
+{
     while (l > 0)
     {
         uint32_t spaceOnPage = flash.getPageSize() - (dataEnd % flash.getPageSize());
+
+        // In circular mode, the last page ends at logEnd.
+        if (status & MICROBIT_LOG_STATUS_CIRCULAR)
+            spaceOnPage = min(spaceOnPage, logEnd - dataEnd);
+
         //DMESG("SPACE_ON_PAGE: %d", spaceOnPage);
         int lengthToWrite = min(l, spaceOnPage);
 
         // If we're going to fill (or overspill) the current page, erase the next one ready for use.
-        if (spaceOnPage <= l && dataEnd+spaceOnPage < logEnd)
+        if (spaceOnPage <= l)
         {
-            uint32_t nextPage = ((dataEnd / flash.getPageSize()) + 1) * flash.getPageSize();
+            uint32_t nextPage = dataEnd + spaceOnPage;
+
+            if (nextPage >= logEnd && (status & MICROBIT_LOG_STATUS_CIRCULAR))
+                nextPage = dataStart;
 
-            //DMESG("   ERASING PAGE %p", nextPage);
-            flash.erase(nextPage);
+            if (nextPage < logEnd)
+            {
+                //DMESG("   ERASING PAGE %p", nextPage);
+                erasePage(nextPage);
+
+                // Erasing the last page also erases the indicator after logEnd. Record that the log should be read as a ring.
+                if ((status & MICROBIT_LOG_STATUS_CIRCULAR) && nextPage == (logEnd / flash.getPageSize()) * flash.getPageSize())
+                    cache.write(logEnd+1, "WRP", 3);
+            }
         }
 
-        // Perform a write through cache update
+        // Buffer the data, or perform a write through cache update
         //DMESG("   WRITING [ADDRESS: %p] [LENGTH: %d] ", dataEnd, lengthToWrite);
-        cache.write(dataEnd, data, lengthToWrite);
+        if (writeBuffer)
+        {
+            if (bufferData(data, lengthToWrite) != DEVICE_OK)
+                return DEVICE_I2C_ERROR;
+        }
+        else
+        {
+            cache.write(dataEnd, data, lengthToWrite);
+        }
 
         // move on pointers
         dataEnd += lengthToWrite;
         data += lengthToWrite;
         l -= lengthToWrite;
+
+        // Wrap around to the start of the data pages, once any buffered data up to logEnd has been committed.
+        if (dataEnd == logEnd && (status & MICROBIT_LOG_STATUS_CIRCULAR))
+        {
+            if (flushBuffer() != DEVICE_OK)
+                return DEVICE_I2C_ERROR;
+
+            dataEnd = dataStart;
+            flushedEnd = dataStart;
+            status &= ~MICROBIT_LOG_STATUS_FULL;
+        }
     }
 
-    // Write a new entry into the log journal if we crossed a cache block boundary
-    if ((dataEnd / CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE) != (oldDataEnd / CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE))
+    return l ? DEVICE_NO_RESOURCES : DEVICE_OK;
+}
+
+/**
+ * Copies data into writeBuffer, at the current end of the log. The data must not span a page boundary.
+ * If the data starts a new page, the page previously held in writeBuffer is committed first.
+ *
+ * @param data The data to buffer.
+ * @param length The number of bytes to buffer.
+ * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the previous page could not be committed. writeBuffer is
+ * left holding that page in this case, so that it can be retried.
+ */
+int MicroBitLog::bufferData(const char *data, int length)
+{
+    uint32_t page = (dataEnd / flash.getPageSize()) * flash.getPageSize();
+
+    if (page != bufferAddress)
     {
-        uint32_t oldJournalHead = journalHead;
-        oldDataEnd = dataEnd;
+        if (flushBuffer() != DEVICE_OK)
+            return DEVICE_I2C_ERROR;
+
+        // Flash is written in whole words. If we're resuming part way through a word, load the bytes already there.
+        bufferAddress = page;
+        memset(writeBuffer, 0xFF, flash.getPageSize());
+        cache.read(dataEnd & 0xFFFFFFFC, writeBuffer + ((dataEnd - page) & 0xFFFFFFFC), dataEnd & 0x03);
+    }
+
+    memcpy(writeBuffer + (dataEnd - page), data, length);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes any data held in writeBuffer to flash storage in a single operation, and then updates the journal.
+ *
+ * @return DEVICE_OK on success, or DEVICE_I2C_ERROR if the data could not be written.
+ */
+int MicroBitLog::flushBuffer()
+{
+    if (writeBuffer == NULL || flushedEnd == dataEnd)
+        return DEVICE_OK;
+
+    uint32_t start = flushedEnd & 0xFFFFFFFC;
+    uint32_t end = (dataEnd + 3) & 0xFFFFFFFC;
+
+    // Leave the data buffered (and the journal untouched) if it could not be written. We'll try again next time.
+    if (flash.write(start, (uint32_t *)(writeBuffer + (start - bufferAddress)), (end - start) / 4) != DEVICE_OK)
+        return DEVICE_I2C_ERROR;
+
+    // Bring any cached copies of the blocks we've written up to date.
+    cache.update(start, writeBuffer + (start - bufferAddress), end - start);
+
+    // The data is now durable, so record it in the journal.
+    updateJournal(flushedEnd, dataEnd);
+    flushedEnd = dataEnd;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes a new entry into the journal if the end of the data committed to flash has moved onto another page.
+ * Entries rotate around the journal pages, which stay at a fixed location (see the journal format in MicroBitLog.h).
+ *
+ * @param oldDataEnd The previous end of the committed data.
+ * @param newDataEnd The new end of the committed data.
+ */
+void MicroBitLog::updateJournal(uint32_t oldDataEnd, uint32_t newDataEnd)
+{
+    uint32_t pageSize = flash.getPageSize();
 
+    if ((newDataEnd - dataStart) / pageSize != (oldDataEnd - dataStart) / pageSize)
+    {
         // Record that we've moved on the journal log by one entry
         journalHead += MICROBIT_LOG_JOURNAL_ENTRY_SIZE;
 
-        // If we've moved onto another page, ensure it is erased.
-        if (journalHead % flash.getPageSize() == 0)
+        // If we've moved onto another page, cycling around after the last one, keep the page after it erased.
+        if (journalHead % pageSize == 0)
         {
-            //DMESG("JOURNAL PAGE BOUNDARY: %p", journalHead);
-            // If we've rolled over the last page, cycle around.
             if (journalHead == dataStart)
-            {
-                //DMESG("JOURNAL WRAPAROUND");
                 journalHead = journalStart;
-            }
 
-            //DMESG("ERASING JOURNAL PAGE: %p", journalHead);
-            cache.erase(journalHead);
-            flash.erase(journalHead);
+            uint32_t next = journalHead + pageSize == dataStart ? journalStart : journalHead + pageSize;
+
+            // This page was erased ahead of time, so erase the one after it. With a single journal page, that is this page.
+            erasePage(next);
         }
 
         // Write journal entry
-        JournalEntry je;
-        writeNum(je.length, ((dataEnd-dataStart) / CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE) * CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE);
-        cache.write(journalHead, &je, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
-
-        // Invalidate the old one
-        JournalEntry empty;
-        empty.clear();
-        //DMESG("   INVALIDATING: %p", oldJournalHead);
-        cache.write(oldJournalHead, &empty, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
+        uint32_t entry = ((newDataEnd - dataStart) / pageSize) * pageSize;
+        cache.write(journalHead, &entry, MICROBIT_LOG_JOURNAL_ENTRY_SIZE);
     }
+}
 
-    mutex.notify();
-
-    // Return NO_RESOURCES if we ran out of FLASH space.
-    if (l == 0)
-        return DEVICE_OK;
+/**
+ * Erases the given page of flash storage, along with any copy of it held in the cache.
+ *
+ * @param page The address of the page to erase.
+ */
+void MicroBitLog::erasePage(uint32_t page)
+{
+    for (uint32_t block = page; block < page + flash.getPageSize(); block += CONFIG_MICROBIT_LOG_CACHE_BLOCK_SIZE)
+        cache.erase(block);
 
-    Event(MICROBIT_ID_LOG, MICROBIT_LOG_EVT_LOG_FULL);
-    return DEVICE_NO_RESOURCES;
+    flash.erase(page);
 }
 
 /**
@@ -669,51 +1531,534 @@ int MicroBitLog::logString(ManagedString s)
 }
 
 /**
- * Add the given heading to the list of headings in use. If the heading already exists,
- * this method has no effect.
- * 
- * @param key the heading to add
- * @param value the initial value to add, or ManagedString::EmptyString
- * @param head true to add the given field at the front of the list, false to add at the end.
+ * Inject a packed binary record into the log, alongside any CSV rows.
+ * Binary records are ignored by the CSV view, and can be decoded by the online view or host tools
+ * (see resources/logfs). This provides a compact and fast means to log bulk data such as spectra.
+ *
+ * @param type An alphanumeric character identifying the type of the record.
+ * @param data The payload of the record.
+ * @param length The length of the payload, in bytes. Maximum CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD.
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER or DEVICE_NO_RESOURCES if the log is full.
  */
-void MicroBitLog::addHeading(ManagedString key, ManagedString value, bool head)
+int MicroBitLog::logBinary(char type, const void *data, int length)
 {
-    for (uint32_t i=0; i<headingCount; i++)
-        if (rowData[i].key == key)
-            return;
-
-    ColumnEntry* newRowData = (ColumnEntry *) malloc(sizeof(ColumnEntry) * (headingCount+1));
-    int columnShift = head ? 1 : 0;
-    int newColumn = head ? 0 : headingCount;
-
-    for (uint32_t i=0; i<headingCount; i++)
-    {
-        new (&newRowData[i+columnShift]) ColumnEntry;
-        newRowData[i+columnShift].key = rowData[i].key;
-        newRowData[i+columnShift].value = rowData[i].value;
-        rowData[i].key = ManagedString::EmptyString;
-        rowData[i].value = ManagedString::EmptyString;
-    }   
-    
-    if (rowData)
-        free(rowData);
+    if (!isalnum(type) || length < 0 || length > CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD)
+        return DEVICE_INVALID_PARAMETER;
 
-    new (&newRowData[newColumn]) ColumnEntry;
-    newRowData[newColumn].key = key;
-    newRowData[newColumn].value = value;
-    headingCount++;
+    // Keep records in the order they were logged.
+    writePackedRows();
 
-    rowData = newRowData;
-    headingsChanged = true;
+    return writeRecord(type, data, length);
 }
 
 /**
- * Marks an existing Log as invalid. The log will be cleared with the default settings the next time
- * a user attempts to use it. If no valid log is present, this method has no effect.
+ * Encodes a binary record and writes it into the log.
+ *
+ * @param type The type of the record.
+ * @param data The payload of the record.
+ * @param length The length of the payload, in bytes. Maximum CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD.
+ * @param rows The number of rows held in the record.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
  */
-void MicroBitLog::invalidate()
+int MicroBitLog::writeRecord(char type, const void *data, int length, uint32_t rows)
 {
-    if (isPresent())
+    char record[4 + 4 * ((CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD + 2) / 3)];
+
+    encodeRecord(record, type, (const uint8_t *) data, length);
+
+    return writeData(record, rows);
+}
+
+/**
+ * Determines the binary column type best suited to the given value.
+ * Only plain decimal numbers are stored numerically, and only if they can be held exactly. Other values,
+ * such as zero padded identifiers or hexadecimal strings, are stored as text so that they read out unchanged.
+ *
+ * @param s The value, as logged.
+ * @return the MICROBIT_LOG_COLUMN_* type of the value, or zero if the value is empty.
+ */
+static char valueType(const char *s)
+{
+    const char *p = s;
+    int digits = 0;
+    bool point = false;
+    bool exponent = false;
+
+    if (*p == 0)
+        return 0;
+
+    if (*p == '-')
+        p++;
+
+    if (p[0] == '0' && isdigit(p[1]))
+        return MICROBIT_LOG_COLUMN_TEXT;
+
+    for (; *p; p++)
+    {
+        if (isdigit(*p))
+        {
+            if (!exponent)
+                digits++;
+        }
+        else if (*p == '.' && !point && !exponent)
+        {
+            point = true;
+        }
+        else if ((*p == 'e' || *p == 'E') && digits && !exponent && isdigit(p[p[1] == '-' || p[1] == '+' ? 2 : 1]))
+        {
+            exponent = true;
+            if (p[1] == '-' || p[1] == '+')
+                p++;
+        }
+        else
+        {
+            return MICROBIT_LOG_COLUMN_TEXT;
+        }
+    }
+
+    if (digits == 0)
+        return MICROBIT_LOG_COLUMN_TEXT;
+
+    if (!point && !exponent)
+    {
+        long long v = strtoll(s, NULL, 10);
+        return (digits <= 10 && v >= INT32_MIN && v <= INT32_MAX) ? MICROBIT_LOG_COLUMN_INTEGER : MICROBIT_LOG_COLUMN_TEXT;
+    }
+
+    // A float holds just over 7 significant digits.
+    return digits <= 7 ? MICROBIT_LOG_COLUMN_FLOAT : MICROBIT_LOG_COLUMN_TEXT;
+}
+
+/**
+ * Determines the number of bytes in which a value of the given type is stored in binary format.
+ *
+ * @param type The MICROBIT_LOG_COLUMN_* type.
+ * @return 1, 2 or 4 for an integer type, or zero for any other type.
+ */
+static int integerWidth(char type)
+{
+    if (type == MICROBIT_LOG_COLUMN_INT8)
+        return 1;
+
+    if (type == MICROBIT_LOG_COLUMN_INT16)
+        return 2;
+
+    return type == MICROBIT_LOG_COLUMN_INTEGER ? 4 : 0;
+}
+
+/**
+ * Determines the narrowest integer type that holds the given value.
+ *
+ * @param s The value, which must be an integer.
+ * @return the MICROBIT_LOG_COLUMN_* type of the value.
+ */
+static char integerType(const char *s)
+{
+    long v = strtol(s, NULL, 10);
+
+    if (v >= INT8_MIN && v <= INT8_MAX)
+        return MICROBIT_LOG_COLUMN_INT8;
+
+    if (v >= INT16_MIN && v <= INT16_MAX)
+        return MICROBIT_LOG_COLUMN_INT16;
+
+    return MICROBIT_LOG_COLUMN_INTEGER;
+}
+
+/**
+ * Widens the type of any column whose value in the current row no longer fits: integers to wider integers or floats,
+ * and anything else to text.
+ *
+ * @param columns The columns of the row.
+ * @param count The number of columns.
+ * @param values The buffer holding the value of each column, as text.
+ * @param narrow true to give integer columns the narrowest type that holds their values, false to make them 32 bit.
+ * @param update false to only determine whether any type would change, leaving the columns untouched.
+ * @return true if the type of any column has changed (or would change).
+ */
+bool MicroBitLog::widenTypes(ColumnEntry *columns, uint32_t count, const char *values, bool narrow, bool update)
+{
+    bool changed = false;
+
+    for (uint32_t i=0; i<count; i++)
+    {
+        const char *value = &values[columns[i].value];
+        char type = columns[i].length ? valueType(value) : 0;
+        char current = columns[i].type;
+        char widened;
+
+        if (narrow && type == MICROBIT_LOG_COLUMN_INTEGER)
+            type = integerType(value);
+
+        if (type == 0 || type == current)
+            continue;
+
+        if (current == 0)
+            widened = type;
+        else if (integerWidth(current) && integerWidth(type))
+            widened = integerWidth(type) > integerWidth(current) ? type : current;
+        else if (current != MICROBIT_LOG_COLUMN_TEXT && type != MICROBIT_LOG_COLUMN_TEXT)
+            widened = MICROBIT_LOG_COLUMN_FLOAT;
+        else
+            widened = MICROBIT_LOG_COLUMN_TEXT;
+
+        if (widened != current)
+            changed = true;
+
+        if (update)
+            columns[i].type = widened;
+    }
+
+    return changed;
+}
+
+/**
+ * Adds the current row to those held in packBuffer, preceded by a schema record if necessary.
+ *
+ * @return DEVICE_OK on success, DEVICE_NO_RESOURCES if the log is full, or DEVICE_INVALID_PARAMETER
+ * if the row is too large to be stored as a single record.
+ */
+int MicroBitLog::writeBinaryRow()
+{
+    uint8_t record[CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD];
+    bool empty = true;
+    int length;
+    int result;
+
+    if (headingCount > 255 || (int)(headingCount + 7) / 8 > CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD)
+    {
+        writePackedRows();
+        return DEVICE_INVALID_PARAMETER;
+    }
+
+    // Rows already packed were encoded with the current types. Write them out before any type is widened, so that a
+    // schema written ahead of them (as they start a new page) describes them correctly.
+    if (packLength && widenTypes(rowData, headingCount, valueBuffer, format == LogFormat::Binary, false))
+        writePackedRows();
+
+    if (widenTypes(rowData, headingCount, valueBuffer, format == LogFormat::Binary))
+        schemaChanged = true;
+
+    for (uint32_t i=0; i<headingCount && empty; i++)
+        if (rowData[i].length)
+            empty = false;
+
+    if (empty)
+        return DEVICE_OK;
+
+    // Any rows already packed were encoded with the previous schema, so must be written ahead of the new one.
+    if (schemaChanged)
+    {
+        writePackedRows();
+        result = writeSchema();
+
+        if (result != DEVICE_OK)
+            return result;
+
+        schemaChanged = false;
+    }
+
+    length = encodeRow(record, packLength != 0);
+
+    if (length < 0)
+    {
+        writePackedRows();
+        return DEVICE_INVALID_PARAMETER;
+    }
+
+    // Start a new record if this row will not fit in the current one. The first row of each record holds absolute values.
+    if (packLength + length > CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD)
+    {
+        result = writePackedRows();
+        length = encodeRow(record, false);
+
+        if (result != DEVICE_OK)
+            return result;
+    }
+
+    if (packBuffer == NULL)
+        packBuffer = (uint8_t *) malloc(CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD);
+
+    if (packLength == 0)
+        packTime = rowTime;
+
+    memcpy(packBuffer + packLength, record, length);
+    packLength += length;
+    packRows++;
+
+    // Rows are only held back while write behind buffering is enabled.
+    if (flushInterval == 0)
+        return writePackedRows();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes schema records describing the current columns.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLog::writeSchema()
+{
+    schemaPage = dataEnd / flash.getPageSize();
+
+    return writeSchema(rowData, headingCount);
+}
+
+/**
+ * Writes schema records describing the given columns.
+ * Each schema record begins with the index of the first column it describes, so that wide schemas may span several records.
+ *
+ * @param columns The columns to describe.
+ * @param count The number of columns.
+ * @param tag The table tag to precede each record with, or NULL to describe the columns of the log itself.
+ * @param tagLength The length of the tag, in bytes.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLog::writeSchema(ColumnEntry *columns, uint32_t count, const uint8_t *tag, int tagLength)
+{
+    uint8_t record[CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD];
+    uint32_t column = 0;
+    int result = DEVICE_OK;
+
+    if (tagLength)
+        memcpy(record, tag, tagLength);
+
+    while (column < count && result == DEVICE_OK)
+    {
+        int length = tagLength + 1;
+        record[tagLength] = column;
+
+        while (column < count)
+        {
+            int l = min(columns[column].key.length(), CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD - tagLength - 3);
+
+            if (length + l + 2 > CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD)
+                break;
+
+            record[length++] = columns[column].type ? columns[column].type : MICROBIT_LOG_COLUMN_TEXT;
+            memcpy(&record[length], columns[column].key.toCharArray(), l);
+            length += l;
+            record[length++] = 0;
+            column++;
+        }
+
+        result = writeRecord(tag ? MICROBIT_LOG_RECORD_TABLE : MICROBIT_LOG_RECORD_SCHEMA, record, length);
+    }
+
+    return result;
+}
+
+/**
+ * Encodes the values of the current row, preceded by a bitmap of the columns present.
+ *
+ * @param record The buffer to encode into, CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD bytes in length.
+ * @param delta true to encode integers relative to the previous row, false to start a new record.
+ * @return the length of the encoded row, or -1 if it does not fit in the buffer.
+ */
+int MicroBitLog::encodeRow(uint8_t *record, bool delta)
+{
+    return encodeRow(record, CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD, rowData, headingCount, valueBuffer, format == LogFormat::Compressed, delta);
+}
+
+/**
+ * Encodes the values of the given columns, preceded by a bitmap of the columns present.
+ * In compressed format, integers are stored as the zig-zag varint encoded difference from the value of the column
+ * in the previous row of the record (in which it was present). Otherwise they are stored little endian, in the width
+ * of their type, and floats as 4 bytes. Text is stored as a length byte followed by its characters.
+ *
+ * @param record The buffer to encode into.
+ * @param size The length of the buffer, in bytes.
+ * @param columns The columns of the row.
+ * @param count The number of columns.
+ * @param values The buffer holding the value of each column, as text.
+ * @param packed true to encode integers in compressed format.
+ * @param delta true to encode integers relative to the previous row, false to start a new record.
+ * @return the length of the encoded row, or -1 if it does not fit in the buffer.
+ */
+int MicroBitLog::encodeRow(uint8_t *record, int size, ColumnEntry *columns, uint32_t count, const char *values, bool packed, bool delta)
+{
+    int bitmapLength = (count + 7) / 8;
+    int length = bitmapLength;
+
+    memset(record, 0, bitmapLength);
+
+    // Each record starts afresh, so that it can be decoded on its own.
+    if (packed && !delta)
+        for (uint32_t i=0; i<count; i++)
+            columns[i].previous = 0;
+
+    for (uint32_t i=0; i<count; i++)
+    {
+        const char *value = &values[columns[i].value];
+        int l = columns[i].length;
+
+        if (l == 0)
+            continue;
+
+        if (columns[i].type == MICROBIT_LOG_COLUMN_TEXT)
+        {
+            l = min(l, 255);
+            if (length + l + 1 > size)
+                return -1;
+
+            record[length++] = l;
+            memcpy(&record[length], value, l);
+            length += l;
+        }
+        else if (packed && integerWidth(columns[i].type))
+        {
+            if (length + 5 > size)
+                return -1;
+
+            uint32_t v = (uint32_t) strtol(value, NULL, 10);
+            int32_t d = (int32_t) (v - columns[i].previous);
+            uint32_t z = ((uint32_t) d << 1) ^ (uint32_t) (d >> 31);
+
+            while (z >= 0x80)
+            {
+                record[length++] = (z & 0x7F) | 0x80;
+                z >>= 7;
+            }
+
+            record[length++] = z;
+            columns[i].previous = v;
+        }
+        else
+        {
+            int width = integerWidth(columns[i].type);
+            uint32_t v;
+
+            if (width)
+            {
+                v = (uint32_t) strtol(value, NULL, 10);
+            }
+            else
+            {
+                float f = strtof(value, NULL);
+                memcpy(&v, &f, sizeof(v));
+                width = 4;
+            }
+
+            if (length + width > size)
+                return -1;
+
+            for (int b = 0; b < width; b++)
+                record[length++] = (v >> (8 * b)) & 0xFF;
+        }
+
+        record[i / 8] |= 1 << (i % 8);
+    }
+
+    return length;
+}
+
+/**
+ * Writes any rows held in packBuffer into the log, as a single record.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLog::writePackedRows()
+{
+    uint8_t rows[CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD];
+    int length = packLength;
+    uint32_t count = packRows;
+    CODAL_TIMESTAMP time = rowTime;
+    int result;
+
+    if (length == 0)
+        return DEVICE_OK;
+
+    // Take a copy, so that further rows can be packed while this record is written.
+    memcpy(rows, packBuffer, length);
+    packLength = 0;
+    packRows = 0;
+
+    // Index the record by the time of the first row it holds.
+    rowTime = packTime;
+
+    // Each page needs a schema ahead of the first record to start on it.
+    if (dataEnd / flash.getPageSize() != schemaPage)
+        writeSchema();
+
+    result = writeRecord(format == LogFormat::Binary ? MICROBIT_LOG_RECORD_BINARY_ROWS : MICROBIT_LOG_RECORD_ROWS, rows, length, count);
+    rowTime = time;
+
+    return result;
+}
+
+/**
+ * Add the given heading to the list of headings in use. If the heading already exists,
+ * this method has no effect.
+ * 
+ * @param key the heading to add
+ * @param head true to add the given field at the front of the list, false to add at the end.
+ * @return the id of the column with the given heading.
+ */
+int MicroBitLog::addHeading(ManagedString key, bool head)
+{
+    int id = findHeading(key.toCharArray());
+
+    if (id >= 0)
+        return id;
+
+    // Likewise, rows already packed must be written out while the schema still describes them.
+    if (packLength)
+        writePackedRows();
+
+    ColumnEntry* newRowData = (ColumnEntry *) malloc(sizeof(ColumnEntry) * (headingCount+1));
+    uint16_t* newColumnMap = (uint16_t *) malloc(sizeof(uint16_t) * (headingCount+1));
+    int columnShift = head ? 1 : 0;
+    int newColumn = head ? 0 : headingCount;
+
+    for (uint32_t i=0; i<headingCount; i++)
+    {
+        new (&newRowData[i+columnShift]) ColumnEntry;
+        newRowData[i+columnShift].key = rowData[i].key;
+        newRowData[i+columnShift].hash = rowData[i].hash;
+        newRowData[i+columnShift].value = rowData[i].value;
+        newRowData[i+columnShift].length = rowData[i].length;
+        newRowData[i+columnShift].type = rowData[i].type;
+        newRowData[i+columnShift].previous = rowData[i].previous;
+        rowData[i].key = ManagedString::EmptyString;
+
+        // Handles stay the same, but the columns they refer to may have moved along.
+        newColumnMap[i] = columnMap[i] + columnShift;
+    }   
+    
+    if (rowData)
+    {
+        free(rowData);
+        free(columnMap);
+    }
+
+    new (&newRowData[newColumn]) ColumnEntry;
+    newRowData[newColumn].key = key;
+    newRowData[newColumn].hash = hashHeading(key.toCharArray(), key.length());
+    newColumnMap[headingCount] = newColumn;
+
+    id = headingCount;
+    headingCount++;
+
+    rowData = newRowData;
+    columnMap = newColumnMap;
+    headingsChanged = true;
+
+    indexHeading(id);
+
+    return id;
+}
+
+/**
+ * Marks an existing Log as invalid. The log will be cleared with the default settings the next time
+ * a user attempts to use it. If no valid log is present, this method has no effect.
+ */
+void MicroBitLog::invalidate()
+{
+    if (isPresent())
     {
 
 #if (CONFIG_MICROBIT_LOG_FULL_ERASE_BY_DEFAULT)
@@ -725,9 +2070,15 @@ void MicroBitLog::invalidate()
         // Erase the LogFS metadata and trailing FULL indicator.
         flash.write(startAddress, (uint32_t *) &m, sizeof(MicroBitLogMetaData)/4);
         flash.write(logEnd, (uint32_t *) &m, 1);
+        cache.update(startAddress, &m, sizeof(MicroBitLogMetaData));
+        cache.update(logEnd, &m, 4);
     }
 
-    status &= ~MICROBIT_LOG_STATUS_INITIALIZED; 
+    // Discard any data that has not yet been written.
+    flushedEnd = dataEnd;
+    packLength = 0;
+    packRows = 0;
+    status &= ~(MICROBIT_LOG_STATUS_INITIALIZED | MICROBIT_LOG_STATUS_INDEXED | MICROBIT_LOG_STATUS_LINE_OPEN);
 }
 
 /**
@@ -773,11 +2124,1065 @@ bool MicroBitLog::isFull()
 }
 
 /**
- * Destructor.
+ * Determines the number of rows logged since the log was last cleared, including any that have since been
+ * overwritten in circular mode.
+ *
+ * @return the number of rows logged.
  */
-MicroBitLog::~MicroBitLog()
+uint32_t MicroBitLog::getRowCount()
+{
+    init();
+    mutex.wait();
+
+    if (!(status & MICROBIT_LOG_STATUS_INDEXED))
+        restoreIndex();
+
+    uint32_t rows = rowCount + packRows;
+
+    mutex.notify();
+
+    return rows;
+}
+
+/**
+ * Determines the number of rows already in the log, and whether the last line is complete.
+ * Must be called before any data is written after the log is mounted.
+ */
+void MicroBitLog::restoreIndex()
+{
+    // Locate the last index record, and count the rows that follow it.
+    MicroBitLogIterator it(*this);
+    it.skipTo(0xFFFFFFFF);
+
+    rowCount = it.getRow();
+    indexPage = 0xFFFFFFFF;
+    status |= MICROBIT_LOG_STATUS_INDEXED;
+    status &= ~MICROBIT_LOG_STATUS_LINE_OPEN;
+
+    if (dataEnd > dataStart)
+    {
+        char c;
+        cache.read(dataEnd - 1, &c, 1);
+
+        if (c != '\n')
+            status |= MICROBIT_LOG_STATUS_LINE_OPEN;
+    }
+}
+
+/**
+ * Commits any buffered data to flash storage before deep sleep or power off.
+ */
+int MicroBitLog::deepSleepCallback(deepSleepCallbackReason reason, deepSleepCallbackData *data)
+{
+    if (reason == deepSleepCallbackPrepare || reason == deepSleepCallbackBegin || reason == deepSleepCallbackBeginWithWakeUps)
+        flush();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Periodically commits buffered data to flash storage, while write behind buffering is enabled.
+ */
+void MicroBitLog::flushFiber(void *param)
 {
+    MicroBitLog *log = (MicroBitLog *)param;
+
+    while (log->flushInterval)
+    {
+        fiber_sleep(log->flushInterval);
+        log->flush();
+    }
+
+    log->status &= ~MICROBIT_LOG_STATUS_FLUSH_FIBER;
+}
+
+/**
+ * Destructor.
+ */
+MicroBitLog::~MicroBitLog()
+{
+    flush();
+    free(writeBuffer);
+    free(valueBuffer);
+    free(rowBuffer);
+    free(packBuffer);
+    free(columnMap);
+    free(headingIndex);
+}
+
+/**
+ * Constructor.
+ * The iterator is initially positioned at the oldest row held in the log.
+ *
+ * @param log The log to read from.
+ */
+MicroBitLogIterator::MicroBitLogIterator(MicroBitLog &log) : log(log)
+{
+    this->address = 0;
+    this->row = 0;
+    this->time = 0;
+    this->headings = false;
+    this->types = NULL;
+    this->previous = NULL;
+    this->columns = 0;
+    this->packed = true;
+    this->recordLength = 0;
+    this->recordOffset = 0;
+    this->chunkAddress = 0;
+    this->chunkLength = 0;
+
+    log.init();
+    locate(0, 0, false);
+}
+
+/**
+ * Determines the number of pages that hold data.
+ * @return the number of pages.
+ */
+int MicroBitLogIterator::pageCount()
+{
+    uint32_t pageSize = log.flash.getPageSize();
+    char indicator[4];
+
+    // Once a circular log has wrapped around, every page holds data.
+    log.cache.read(log.logEnd + 1, indicator, 3);
+
+    if (memcmp(indicator, "WRP", 3) == 0)
+        return (log.logEnd - log.dataStart + pageSize - 1) / pageSize;
+
+    return (log.flushedEnd - log.dataStart) / pageSize + 1;
+}
+
+/**
+ * Determines the address of the given page of data, counting from the page holding the oldest data.
+ *
+ * @param page The index of the page.
+ * @return the logical address of the start of the page.
+ */
+uint32_t MicroBitLogIterator::pageAddress(int page)
+{
+    uint32_t pageSize = log.flash.getPageSize();
+    char indicator[4];
+
+    // Once a circular log has wrapped around, the oldest data is on the page after the newest.
+    log.cache.read(log.logEnd + 1, indicator, 3);
+
+    if (memcmp(indicator, "WRP", 3) == 0)
+        page = (page + (log.flushedEnd - log.dataStart) / pageSize + 1) % pageCount();
+
+    return log.dataStart + page * pageSize;
+}
+
+/**
+ * Finds the first index record to start on the given page, and positions the iterator at it.
+ *
+ * @param page The logical address of the page.
+ * @param row Set to the row number held in the index record.
+ * @param time Set to the time held in the index record.
+ * @return true if an index record was found.
+ */
+bool MicroBitLogIterator::findIndex(uint32_t page, uint32_t &row, CODAL_TIMESTAMP &time)
+{
+    uint32_t end = page + log.flash.getPageSize();
+
+    if (end > log.logEnd)
+        end = log.logEnd;
+
+    if (log.flushedEnd >= page && log.flushedEnd < end)
+        end = log.flushedEnd;
+
+    for (uint32_t a = page; a < end; )
+    {
+        a = log.scan(a, end, MICROBIT_LOG_BINARY_RECORD_MARKER, true);
+
+        if (a >= end)
+            break;
+
+        address = a + 1;
+
+        if (readByte() == MICROBIT_LOG_RECORD_INDEX && readRecord() == DEVICE_OK && recordLength == MICROBIT_LOG_INDEX_SIZE)
+        {
+            row = 0;
+            time = 0;
+
+            for (int i = 0; i < 4; i++)
+                row |= (uint32_t) record[1 + i] << (8 * i);
+            for (int i = 0; i < 6; i++)
+                time |= (CODAL_TIMESTAMP) record[5 + i] << (8 * i);
+
+            address = a;
+            recordLength = 0;
+            return true;
+        }
+
+        a++;
+    }
+
+    recordLength = 0;
+    return false;
+}
+
+/**
+ * Positions the iterator at the last index record preceding the given row or time, or at the oldest data if there is none.
+ *
+ * @param target The row to locate.
+ * @param t The time to locate, in milliseconds.
+ * @param byTime true to locate the given time, false to locate the given row.
+ */
+void MicroBitLogIterator::locate(uint32_t target, CODAL_TIMESTAMP t, bool byTime)
+{
+    int pages = pageCount();
+    int lo = 0;
+    int hi = pages - 1;
+    uint32_t first = pageAddress(0);
+    uint32_t bestAddress = first;
+    uint32_t bestRow = 0;
+    uint32_t r;
+    CODAL_TIMESTAMP mt;
+
+    // Binary search for the last page whose first index record precedes the target.
+    // Pages without one (those holding no data, or lines that span whole pages) are treated as part of the page before.
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        int p = mid;
+
+        while (p <= hi && !findIndex(pageAddress(p), r, mt))
+            p++;
+
+        if (p > hi)
+        {
+            hi = mid - 1;
+        }
+        else if (byTime ? mt < t : r <= target)
+        {
+            bestAddress = address;
+            bestRow = r;
+            lo = p + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+
+    // If the target precedes every index record, start from the oldest data. In a circular log that has wrapped
+    // around, that is the first index record, as the oldest page may begin part way through a line.
+    if (bestAddress == first && first != log.dataStart)
+    {
+        for (int p = 0; p < pages; p++)
+        {
+            if (findIndex(pageAddress(p), r, mt))
+            {
+                bestAddress = address;
+                bestRow = r;
+                break;
+            }
+        }
+    }
+
+    address = bestAddress;
+    row = bestRow;
+    headings = false;
+    recordLength = 0;
+    recordOffset = 0;
+}
+
+/**
+ * Positions the iterator at the given row, without first committing any buffered data.
+ *
+ * @param target The number of the row to read next.
+ * @return DEVICE_OK on success, or DEVICE_NO_DATA if the row is not held in the log.
+ */
+int MicroBitLogIterator::skipTo(uint32_t target)
+{
+    locate(target, 0, false);
+
+    while (row < target && next() >= 0);
+
+    return row == target ? DEVICE_OK : DEVICE_NO_DATA;
+}
+
+/**
+ * Positions the iterator at the given row.
+ *
+ * @param row The number of the row to read next.
+ * @return DEVICE_OK on success, or DEVICE_NO_DATA if the row is not held in the log (in which case the iterator
+ * is positioned at the nearest row that is).
+ */
+int MicroBitLogIterator::seekRow(uint32_t row)
+{
+    // Make sure any rows logged so far can be read.
+    log.flush();
+
+    return skipTo(row);
+}
+
+/**
+ * Positions the iterator at the first row with a timestamp at or after the given time.
+ * Rows are assumed to be logged in time order, as they are within each power cycle.
+ *
+ * @param time The time to seek to, in milliseconds.
+ * @return DEVICE_OK on success, DEVICE_NO_DATA if there is no such row, or DEVICE_NOT_SUPPORTED if the log is not timestamped.
+ */
+int MicroBitLogIterator::seekTime(CODAL_TIMESTAMP time)
+{
+    if (log.timeStampFormat == TimeStampFormat::None)
+        return DEVICE_NOT_SUPPORTED;
+
+    log.flush();
+    locate(0, time, true);
+
+    // Read forward to the first row at or after the given time, then return to it.
+    while (next() >= 0)
+        if (this->time >= time)
+            return skipTo(row - 1);
+
+    return DEVICE_NO_DATA;
+}
+
+/**
+ * Reads the next byte of data, wrapping around the end of the log in circular mode.
+ * @return the byte read, or -1 if the end of the data has been reached.
+ */
+int MicroBitLogIterator::readByte()
+{
+    if (address >= log.logEnd && address != log.flushedEnd)
+        address = log.dataStart;
+
+    if (address == log.flushedEnd)
+        return -1;
+
+    if (address < chunkAddress || address >= chunkAddress + chunkLength)
+    {
+        uint32_t end = address < log.flushedEnd ? log.flushedEnd : log.logEnd;
+
+        chunkAddress = address;
+        chunkLength = min(sizeof(chunk), end - address);
+        log.cache.read(chunkAddress, chunk, chunkLength);
+    }
+
+    return chunk[address++ - chunkAddress];
+}
+
+/**
+ * Reads the remainder of a binary record, decoding its payload into record.
+ * @return DEVICE_OK on success, or DEVICE_NO_DATA if the record is incomplete.
+ */
+int MicroBitLogIterator::readRecord()
+{
+    uint32_t v = 0;
+    int bits = 0;
+    int c;
+
+    recordLength = 0;
+
+    while ((c = readByte()) != '\n')
+    {
+        if (c < 0)
+            return DEVICE_NO_DATA;
+
+        int d = base64Value(c);
+
+        if (d < 0)
+            continue;
+
+        v = (v << 6) | d;
+        bits += 6;
+
+        if (bits >= 8)
+        {
+            bits -= 8;
+
+            if (recordLength < CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD)
+                record[recordLength++] = (v >> bits) & 0xFF;
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Parses the given value of the timestamp column, and records it as the time of the current row.
+ *
+ * @param s The value, as logged.
+ * @param length The length of the value.
+ */
+void MicroBitLogIterator::setTime(const char *s, int length)
+{
+    // Timestamps are logged in whole units, with two decimal places for anything other than milliseconds.
+    CODAL_TIMESTAMP t = 0;
+    int decimals = -1;
+
+    for (int i = 0; i < length; i++)
+    {
+        if (s[i] == '.')
+            decimals = 0;
+        else if (isdigit(s[i]) && decimals < 2)
+        {
+            t = t * 10 + (s[i] - '0');
+            if (decimals >= 0)
+                decimals++;
+        }
+    }
+
+    if ((int)log.timeStampFormat > 1)
+        for (decimals = max(decimals, 0); decimals < 2; decimals++)
+            t = t * 10;
+
+    time = t * (CODAL_TIMESTAMP) log.timeStampFormat;
+}
+
+/**
+ * Converts the next row held in record into CSV text.
+ *
+ * @param buffer The buffer to write into, or NULL.
+ * @param length The length of the buffer, in bytes.
+ * @return the length of the text placed in the buffer.
+ */
+int MicroBitLogIterator::decodeRow(char *buffer, int length)
+{
+    int timeColumn = log.timeStampColumn.id >= 0 ? log.columnMap[log.timeStampColumn.id] : -1;
+    int offset = recordOffset;
+    int bitmap = offset;
+    int out = 0;
+
+    offset += (columns + 7) / 8;
+    time = 0;
+
+    for (uint32_t i = 0; i < columns && offset <= recordLength; i++)
+    {
+        char value[24];
+        const char *text = value;
+        int l = 0;
+
+        if (record[bitmap + i / 8] & (1 << (i % 8)))
+        {
+            if (types[i] == MICROBIT_LOG_COLUMN_TEXT)
+            {
+                l = offset < recordLength ? record[offset] : 0;
+                text = (const char *) &record[offset + 1];
+                offset += 1 + l;
+            }
+            else if (packed && integerWidth(types[i]))
+            {
+                uint32_t z = 0;
+                int shift = 0;
+
+                while (offset < recordLength && (record[offset] & 0x80))
+                {
+                    z |= (record[offset++] & 0x7F) << shift;
+                    shift += 7;
+                }
+
+                if (offset < recordLength)
+                    z |= record[offset] << shift;
+
+                offset++;
+                previous[i] += (z >> 1) ^ (0 - (z & 1));
+                l = writeInteger(value, (int) previous[i]);
+            }
+            else
+            {
+                int width = integerWidth(types[i]);
+                uint32_t v = 0;
+
+                for (int b = 0; b < (width ? width : 4) && offset + b < recordLength; b++)
+                    v |= (uint32_t) record[offset + b] << (8 * b);
+
+                offset += width ? width : 4;
+
+                if (width == 1)
+                {
+                    l = writeInteger(value, (int8_t) v);
+                }
+                else if (width == 2)
+                {
+                    l = writeInteger(value, (int16_t) v);
+                }
+                else if (width)
+                {
+                    l = writeInteger(value, (int) v);
+                }
+                else
+                {
+                    float f;
+                    memcpy(&f, &v, sizeof(f));
+                    l = writeFloat(value, f);
+                }
+            }
+        }
+
+        if (offset > recordLength)
+            break;
+
+        if ((int) i == timeColumn)
+            setTime(text, l);
+
+        if (buffer)
+        {
+            if (i > 0 && out < length - 1)
+                buffer[out++] = ',';
+
+            for (int c = 0; c < l && out < length - 1; c++)
+                buffer[out++] = text[c];
+        }
+    }
+
+    recordOffset = offset;
+
+    // Abandon the rest of a malformed record.
+    if (recordOffset > recordLength)
+        recordOffset = recordLength;
+
+    if (buffer && length > 0)
+        buffer[out] = 0;
+
+    row++;
+    return out;
+}
+
+/**
+ * Reads the next row, as a line of CSV text without the trailing newline.
+ * Rows held in compressed or binary format are converted to CSV text, with one value for each column of their schema.
+ *
+ * @param buffer The buffer to read into, or NULL to skip the row. The text is NULL terminated, and truncated if necessary.
+ * @param length The length of the buffer, in bytes.
+ * @return the length of the text placed in the buffer, or DEVICE_NO_DATA if there are no more rows.
+ */
+int MicroBitLogIterator::next(char *buffer, int length)
+{
+    int timeColumn = log.timeStampColumn.id >= 0 ? log.columnMap[log.timeStampColumn.id] : -1;
+
+    while (true)
+    {
+        if (recordOffset < recordLength)
+            return decodeRow(buffer, length);
+
+        uint32_t start = address;
+        int c = readByte();
+
+        if (c < 0)
+            return DEVICE_NO_DATA;
+
+        if (c == MICROBIT_LOG_BINARY_RECORD_MARKER)
+        {
+            int type = readByte();
+
+            // Leave any record that has not been completely written to be read later.
+            if (type < 0 || readRecord() != DEVICE_OK)
+            {
+                address = start;
+                recordLength = 0;
+                return DEVICE_NO_DATA;
+            }
+
+            if (type == MICROBIT_LOG_RECORD_INDEX && recordLength == MICROBIT_LOG_INDEX_SIZE)
+            {
+                row = 0;
+                for (int i = 0; i < 4; i++)
+                    row |= (uint32_t) record[1 + i] << (8 * i);
+
+                if (record[0] & MICROBIT_LOG_INDEX_HEADINGS)
+                    headings = true;
+            }
+
+            if (type == MICROBIT_LOG_RECORD_SCHEMA && recordLength > 0)
+            {
+                uint32_t column = record[0];
+                uint32_t count = column;
+
+                for (int i = 1; i < recordLength; i++)
+                    if (record[i] == 0)
+                        count++;
+
+                if (count > columns || column == 0)
+                {
+                    uint8_t *t = (uint8_t *) malloc(count + 1);
+                    uint32_t *p = (uint32_t *) malloc(sizeof(uint32_t) * (count + 1));
+
+                    if (types)
+                        memcpy(t, types, min(columns, count));
+
+                    free(types);
+                    free(previous);
+                    types = t;
+                    previous = p;
+                    columns = count;
+                }
+
+                for (int i = 1; i < recordLength && column < columns; column++)
+                {
+                    types[column] = record[i];
+                    while (i < recordLength && record[i] != 0)
+                        i++;
+                    i++;
+                }
+            }
+
+            if ((type == MICROBIT_LOG_RECORD_ROWS || type == MICROBIT_LOG_RECORD_BINARY_ROWS) && recordLength > 0)
+            {
+                packed = type == MICROBIT_LOG_RECORD_ROWS;
+                recordOffset = 0;
+                memset(previous, 0, sizeof(uint32_t) * columns);
+
+                // Rows logged before their schema has been seen cannot be decoded.
+                if (columns == 0)
+                    recordLength = 0;
+
+                continue;
+            }
+
+            recordLength = 0;
+            continue;
+        }
+
+        // A line of text. Copy it out, noting the value of the timestamp column as we go.
+        char timeStamp[24];
+        int timeLength = 0;
+        int field = 0;
+        int out = 0;
+
+        while (c != '\n')
+        {
+            if (c < 0)
+            {
+                address = start;
+                return DEVICE_NO_DATA;
+            }
+
+            if (c == ',')
+                field++;
+            else if (field == timeColumn && timeLength < (int) sizeof(timeStamp))
+                timeStamp[timeLength++] = c;
+
+            if (buffer && out < length - 1)
+                buffer[out++] = c;
+
+            c = readByte();
+        }
+
+        if (buffer && length > 0)
+            buffer[out] = 0;
+
+        // Lines of CSV headings are not rows.
+        if (headings)
+        {
+            headings = false;
+            continue;
+        }
+
+        time = 0;
+        if (timeLength)
+            setTime(timeStamp, timeLength);
+
+        row++;
+        return out;
+    }
+}
+
+/**
+ * Determines the number of the row that will be read next.
+ * @return the row number.
+ */
+uint32_t MicroBitLogIterator::getRow()
+{
+    return row;
+}
+
+/**
+ * Determines the time held in the timestamp column of the last row read.
+ * @return the time of the row in milliseconds, or zero if it has none.
+ */
+CODAL_TIMESTAMP MicroBitLogIterator::getTime()
+{
+    return time;
+}
+
+/**
+ * Destructor.
+ */
+MicroBitLogIterator::~MicroBitLogIterator()
+{
+    free(types);
+    free(previous);
+}
+
+/**
+ * Constructor.
+ *
+ * @param log The log to write to.
+ * @param name The name of the table. Invalid LogFS symbols are replaced, and the name is truncated to
+ * CONFIG_MICROBIT_LOG_TABLE_NAME_LENGTH characters.
+ *
+ * @note Each table in use is given a distinct tag, and the tag of a table is reused once it is destroyed. At most
+ * 255 tables may be in use with the same log at once. The rows of any more are refused by endRow().
+ */
+MicroBitLogTable::MicroBitLogTable(MicroBitLog &log, const char *name) : log(log)
+{
+    int length = min(strlen(name), CONFIG_MICROBIT_LOG_TABLE_NAME_LENGTH);
+
+    ManagedString n = log.cleanBuffer(name, length);
+
+    this->name = n.length() ? n : ManagedString(name, length);
+
+    // Take the lowest tag not held by another table in use. Zero is never used, and marks a table with no tag.
+    this->tag = 0;
+    for (int t = 1; t < 256 && tag == 0; t++)
+    {
+        MicroBitLogTable *table = log.tables;
+
+        while (table && table->tag != t)
+            table = table->next;
+
+        if (table == NULL)
+            tag = t;
+    }
+
+    this->next = log.tables;
+    log.tables = this;
+
+    this->columns = NULL;
+    this->columnCount = 0;
+    this->valueBuffer = NULL;
+    this->valueLength = 0;
+    this->schemaAddress = 0xFFFFFFFF;
+    this->schemaChanged = true;
+    this->rowStarted = false;
+}
+
+/**
+ * Creates a new row in this table, ready to be populated by logData().
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLogTable::beginRow()
+{
+    // If beginRow is called during an open transaction, implicity perform an endRow before proceeding.
+    if (rowStarted)
+        endRow();
+
+    if (valueBuffer == NULL)
+        valueBuffer = (char *) malloc(CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE);
+
+    // Reset all values, ready to populate with a new row.
+    for (uint32_t i=0; i<columnCount; i++)
+        columns[i].length = 0;
+
+    valueLength = 0;
+    rowStarted = true;
+
+    // Place the timestamp in the first column, if it is enabled before the first row is logged.
+    log.init();
+
+    if (log.timeStampFormat != TimeStampFormat::None)
+        addColumn(log.timeStampHeading.toCharArray());
+
+    return DEVICE_OK;
+}
+
+/**
+ * Adds a column to this table, if it is not already present.
+ *
+ * @param key the name of the column.
+ * @return a handle to the column, valid only for this table.
+ */
+LogColumn MicroBitLogTable::addColumn(const char *key)
+{
+    LogColumn column;
+    int len = strlen(key);
+    uint32_t hash = hashHeading(key, len);
+
+    for (uint32_t i=0; i<columnCount; i++)
+    {
+        const char *k = columns[i].key.toCharArray();
+        int j = 0;
+
+        if (columns[i].hash != hash || columns[i].key.length() != len)
+            continue;
+
+        while (j < len && k[j] == cleanChar(key, j, len, true))
+            j++;
+
+        if (j == len)
+        {
+            column.id = i;
+            return column;
+        }
+    }
+
+    ManagedString k = log.cleanBuffer(key, len);
+
+    ColumnEntry *newColumns = (ColumnEntry *) malloc(sizeof(ColumnEntry) * (columnCount+1));
+
+    for (uint32_t i=0; i<columnCount; i++)
+    {
+        new (&newColumns[i]) ColumnEntry;
+        newColumns[i].key = columns[i].key;
+        newColumns[i].hash = columns[i].hash;
+        newColumns[i].value = columns[i].value;
+        newColumns[i].length = columns[i].length;
+        newColumns[i].type = columns[i].type;
+        newColumns[i].previous = columns[i].previous;
+        columns[i].~ColumnEntry();
+    }
+
+    new (&newColumns[columnCount]) ColumnEntry;
+    newColumns[columnCount].key = k.length() ? k : ManagedString(key);
+    newColumns[columnCount].hash = hash;
+
+    free(columns);
+    columns = newColumns;
+    column.id = columnCount++;
+    schemaChanged = true;
+
+    return column;
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::logData(const char *key, const char *value)
+{
+    return logData(addColumn(key), value);
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::logData(ManagedString key, ManagedString value)
+{
+    return logData(addColumn(key.toCharArray()), value.toCharArray());
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::logData(const char *key, int value)
+{
+    return logData(addColumn(key), value);
+}
+
+/**
+ * Populates the current row with the given key/value pair.
+ * The value is recorded to 7 significant figures.
+ * @param key the name of the key column) to set.
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::logData(const char *key, float value)
+{
+    return logData(addColumn(key), value);
+}
+
+/**
+ * Populates the given column of the current row.
+ * @param column the column to set, as returned by addColumn().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::logData(LogColumn column, const char *value)
+{
+    if (column.id < 0 || (uint32_t)column.id >= columnCount)
+        return DEVICE_INVALID_PARAMETER;
+
+    // If logData is called before explicitly beginning a row, do so implicitly.
+    if (!rowStarted)
+        beginRow();
+
+    return setValue(column.id, value, strlen(value));
+}
+
+/**
+ * Populates the given column of the current row.
+ * @param column the column to set, as returned by addColumn().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::logData(LogColumn column, int value)
+{
+    char s[12];
+    writeInteger(s, value);
+
+    return logData(column, s);
+}
+
+/**
+ * Populates the given column of the current row.
+ * The value is recorded to 7 significant figures.
+ * @param column the column to set, as returned by addColumn().
+ * @param value the value to insert
+ *
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the column is not valid, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::logData(LogColumn column, float value)
+{
+    char s[20];
+    writeFloat(s, value);
+
+    return logData(column, s);
+}
+
+/**
+ * Stores the given value in the current row, removing any invalid LogFS symbols.
+ *
+ * @param column the index of the column to set.
+ * @param value the value to store.
+ * @param length the length of the value, in bytes.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the row is full.
+ */
+int MicroBitLogTable::setValue(int column, const char *value, int length)
+{
+    ColumnEntry &c = columns[column];
+
+    // Reuse the space held by any previous value in this column if we can. Otherwise, add the value to the end of the row.
+    if (length > c.length)
+    {
+        if (valueLength + length + 1 > CONFIG_MICROBIT_LOG_ROW_BUFFER_SIZE)
+            return DEVICE_NO_RESOURCES;
+
+        c.value = valueLength;
+        valueLength += length + 1;
+    }
+
+    for (int i=0; i<length; i++)
+        valueBuffer[c.value + i] = cleanChar(value, i, length, true);
+
+    valueBuffer[c.value + length] = 0;
+    c.length = length;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Writes the definition of this table: its tag, name and schema.
+ *
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the log is full.
+ */
+int MicroBitLogTable::writeSchema()
+{
+    uint8_t definition[CONFIG_MICROBIT_LOG_TABLE_NAME_LENGTH + 2];
+    int length = name.length();
+
+    definition[0] = tag;
+    memcpy(&definition[1], name.toCharArray(), length);
+    definition[length + 1] = 0;
+
+    schemaAddress = log.dataEnd;
+
+    return log.writeSchema(columns, columnCount, definition, length + 2);
+}
+
+/**
+ * Completes the current row, and writes it to the log.
+ * @return DEVICE_OK on success, DEVICE_INVALID_STATE if no row has been started, DEVICE_NO_RESOURCES if the log is full
+ * or too many tables are in use, or DEVICE_INVALID_PARAMETER if the row is too large to be stored as a single record.
+ */
+int MicroBitLogTable::endRow()
+{
+    return endRow(system_timer_current_time());
+}
+
+/**
+ * Completes the current row, and writes it to the log.
+ * @param time The time to record in the timestamp column (if enabled), in milliseconds.
+ * @return DEVICE_OK on success, DEVICE_INVALID_STATE if no row has been started, DEVICE_NO_RESOURCES if the log is full
+ * or too many tables are in use, or DEVICE_INVALID_PARAMETER if the row is too large to be stored as a single record.
+ */
+int MicroBitLogTable::endRow(CODAL_TIMESTAMP time)
+{
+    uint8_t record[CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD];
+    uint32_t pageSize = log.flash.getPageSize();
+    bool validData = false;
+    int length;
+    int result;
+
+    if (!rowStarted)
+        return DEVICE_INVALID_STATE;
+
+    rowStarted = false;
+
+    if (tag == 0)
+        return DEVICE_NO_RESOURCES;
+
+    for (uint32_t i=0; i<columnCount; i++)
+        if (columns[i].length)
+            validData = true;
+
+    // As with the log itself, we suppress a pointless timestamp on an empty row.
+    if (!validData)
+        return DEVICE_OK;
+
+    if (log.timeStampFormat != TimeStampFormat::None)
+    {
+        char s[24];
+        int l = writeTimeStamp(s, time, log.timeStampFormat);
+
+        setValue(addColumn(log.timeStampHeading.toCharArray()).id, s, l);
+    }
+
+    if (columnCount > 255 || (int)(columnCount + 7) / 8 + 1 > CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD)
+        return DEVICE_INVALID_PARAMETER;
+
+    if (log.widenTypes(columns, columnCount, valueBuffer, false))
+        schemaChanged = true;
+
+    // Repeat the definition on each page (and after the log is cleared), so that the table can be decoded from any page.
+    if (log.dataEnd < schemaAddress || log.dataEnd / pageSize != schemaAddress / pageSize)
+        schemaChanged = true;
+
+    if (schemaChanged)
+    {
+        result = writeSchema();
+
+        if (result != DEVICE_OK)
+            return result;
+
+        schemaChanged = false;
+    }
+
+    length = log.encodeRow(record + 1, CONFIG_MICROBIT_LOG_MAX_BINARY_RECORD - 1, columns, columnCount, valueBuffer, false, false);
+
+    if (length < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    record[0] = tag;
+
+    return log.writeRecord(MICROBIT_LOG_RECORD_TABLE_ROW, record, length + 1);
+}
+
+/**
+ * Destructor.
+ */
+MicroBitLogTable::~MicroBitLogTable()
+{
+    MicroBitLogTable **table = &log.tables;
+
+    // Release our tag, for use by the next table created.
+    while (*table != this)
+        table = &(*table)->next;
+
+    *table = next;
+
+    for (uint32_t i=0; i<columnCount; i++)
+        columns[i].~ColumnEntry();
 
+    free(columns);
+    free(valueBuffer);
 }
 
-const uint8_t MicroBitLog::header[2048] = {0x3c,0x6d,0x65,0x74,0x61,0x20,0x63,0x68,0x61,0x72,0x73,0x65,0x74,0x3d,0x75,0x74,0x66,0x2d,0x38,0x3e,0x3c,0x73,0x74,0x79,0x6c,0x65,0x3e,0x2e,0x62,0x62,0x7b,0x64,0x69,0x73,0x70,0x6c,0x61,0x79,0x3a,0x66,0x6c,0x65,0x78,0x7d,0x2e,0x62,0x62,0x3e,0x2a,0x2b,0x2a,0x7b,0x6d,0x61,0x72,0x67,0x69,0x6e,0x2d,0x6c,0x65,0x66,0x74,0x3a,0x31,0x30,0x70,0x78,0x7d,0x62,0x75,0x74,0x74,0x6f,0x6e,0x7b,0x64,0x69,0x73,0x70,0x6c,0x61,0x79,0x3a,0x62,0x6c,0x6f,0x63,0x6b,0x7d,0x62,0x6f,0x64,0x79,0x7b,0x66,0x6f,0x6e,0x74,0x2d,0x66,0x61,0x6d,0x69,0x6c,0x79,0x3a,0x73,0x61,0x6e,0x73,0x2d,0x73,0x65,0x72,0x69,0x66,0x3b,0x6d,0x61,0x72,0x67,0x69,0x6e,0x3a,0x31,0x65,0x6d,0x7d,0x74,0x61,0x62,0x6c,0x65,0x7b,0x62,0x6f,0x72,0x64,0x65,0x72,0x2d,0x63,0x6f,0x6c,0x6c,0x61,0x70,0x73,0x65,0x3a,0x63,0x6f,0x6c,0x6c,0x61,0x70,0x73,0x65,0x3b,0x77,0x69,0x64,0x74,0x68,0x3a,0x35,0x30,0x25,0x3b,0x6d,0x61,0x72,0x67,0x69,0x6e,0x2d,0x74,0x6f,0x70,0x3a,0x31,0x65,0x6d,0x3b,0x74,0x65,0x78,0x74,0x2d,0x61,0x6c,0x69,0x67,0x6e,0x3a,0x72,0x69,0x67,0x68,0x74,0x7d,0x74,0x72,0x3a,0x66,0x69,0x72,0x73,0x74,0x2d,0x63,0x68,0x69,0x6c,0x64,0x7b,0x66,0x6f,0x6e,0x74,0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x37,0x30,0x30,0x7d,0x74,0x64,0x7b,0x62,0x6f,0x72,0x64,0x65,0x72,0x3a,0x31,0x70,0x78,0x20,0x73,0x6f,0x6c,0x69,0x64,0x20,0x23,0x64,0x64,0x64,0x3b,0x70,0x61,0x64,0x64,0x69,0x6e,0x67,0x3a,0x38,0x70,0x78,0x3b,0x6d,0x69,0x6e,0x2d,0x77,0x69,0x64,0x74,0x68,0x3a,0x38,0x63,0x68,0x7d,0x69,0x66,0x72,0x61,0x6d,0x65,0x7b,0x64,0x69,0x73,0x70,0x6c,0x61,0x79,0x3a,0x6e,0x6f,0x6e,0x65,0x7d,0x3c,0x2f,0x73,0x74,0x79,0x6c,0x65,0x3e,0x3c,0x6c,0x69,0x6e,0x6b,0x20,0x72,0x65,0x6c,0x3d,0x73,0x74,0x79,0x6c,0x65,0x73,0x68,0x65,0x65,0x74,0x20,0x68,0x72,0x65,0x66,0x3d,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x6d,0x69,0x63,0x72,0x6f,0x62,0x69,0x74,0x2e,0x6f,0x72,0x67,0x2f,0x64,0x6c,0x2f,0x31,0x2f,0x64,0x6c,0x2e,0x63,0x73,0x73,0x3e,0x3c,0x73,0x63,0x72,0x69,0x70,0x74,0x3e,0x6c,0x65,0x74,0x20,0x77,0x3d,0x77,0x69,0x6e,0x64,0x6f,0x77,0x2c,0x64,0x3d,0x64,0x6f,0x63,0x75,0x6d,0x65,0x6e,0x74,0x2c,0x6c,0x3d,0x77,0x2e,0x6c,0x6f,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2c,0x6e,0x3d,0x6e,0x75,0x6c,0x6c,0x2c,0x63,0x73,0x76,0x3d,0x22,0x22,0x2c,0x74,0x61,0x67,0x3d,0x64,0x6f,0x63,0x75,0x6d,0x65,0x6e,0x74,0x2e,0x63,0x72,0x65,0x61,0x74,0x65,0x45,0x6c,0x65,0x6d,0x65,0x6e,0x74,0x2e,0x62,0x69,0x6e,0x64,0x28,0x64,0x6f,0x63,0x75,0x6d,0x65,0x6e,0x74,0x29,0x3b,0x77,0x2e,0x64,0x6c,0x3d,0x7b,0x64,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x3a,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x6c,0x65,0x74,0x20,0x65,0x3d,0x74,0x61,0x67,0x28,0x22,0x61,0x22,0x29,0x3b,0x65,0x2e,0x64,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x3d,0x22,0x6d,0x69,0x63,0x72,0x6f,0x62,0x69,0x74,0x2e,0x63,0x73,0x76,0x22,0x2c,0x65,0x2e,0x68,0x72,0x65,0x66,0x3d,0x55,0x52,0x4c,0x2e,0x63,0x72,0x65,0x61,0x74,0x65,0x4f,0x62,0x6a,0x65,0x63,0x74,0x55,0x52,0x4c,0x28,0x6e,0x65,0x77,0x20,0x42,0x6c,0x6f,0x62,0x28,0x5b,0x63,0x73,0x76,0x5d,0x2c,0x7b,0x74,0x79,0x70,0x65,0x3a,0x22,0x74,0x65,0x78,0x74,0x2f,0x70,0x6c,0x61,0x69,0x6e,0x22,0x7d,0x29,0x29,0x2c,0x65,0x2e,0x63,0x6c,0x69,0x63,0x6b,0x28,0x29,0x2c,0x65,0x2e,0x72,0x65,0x6d,0x6f,0x76,0x65,0x28,0x29,0x7d,0x2c,0x63,0x6f,0x70,0x79,0x3a,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x6e,0x61,0x76,0x69,0x67,0x61,0x74,0x6f,0x72,0x2e,0x63,0x6c,0x69,0x70,0x62,0x6f,0x61,0x72,0x64,0x2e,0x77,0x72,0x69,0x74,0x65,0x54,0x65,0x78,0x74,0x28,0x63,0x73,0x76,0x2e,0x72,0x65,0x70,0x6c,0x61,0x63,0x65,0x28,0x2f,0x5c,0x2c,0x2f,0x67,0x2c,0x22,0x5c,0x74,0x22,0x29,0x29,0x7d,0x2c,0x75,0x70,0x64,0x61,0x74,0x65,0x3a,0x61,0x6c,0x65,0x72,0x74,0x2e,0x62,0x69,0x6e,0x64,0x28,0x6e,0x2c,0x22,0x55,0x6e,0x70,0x6c,0x75,0x67,0x20,0x79,0x6f,0x75,0x72,0x20,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x2c,0x20,0x74,0x68,0x65,0x6e,0x20,0x70,0x6c,0x75,0x67,0x20,0x69,0x74,0x20,0x62,0x61,0x63,0x6b,0x20,0x69,0x6e,0x20,0x61,0x6e,0x64,0x20,0x77,0x61,0x69,0x74,0x22,0x29,0x2c,0x63,0x6c,0x65,0x61,0x72,0x3a,0x61,0x6c,0x65,0x72,0x74,0x2e,0x62,0x69,0x6e,0x64,0x28,0x6e,0x2c,0x22,0x54,0x68,0x65,0x20,0x6c,0x6f,0x67,0x20,0x69,0x73,0x20,0x63,0x6c,0x65,0x61,0x72,0x65,0x64,0x20,0x77,0x68,0x65,0x6e,0x20,0x79,0x6f,0x75,0x20,0x72,0x65,0x66,0x6c,0x61,0x73,0x68,0x20,0x79,0x6f,0x75,0x72,0x20,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x22,0x29,0x2c,0x6c,0x6f,0x61,0x64,0x3a,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x6c,0x65,0x74,0x20,0x72,0x3d,0x64,0x2e,0x71,0x75,0x65,0x72,0x79,0x53,0x65,0x6c,0x65,0x63,0x74,0x6f,0x72,0x28,0x22,0x23,0x77,0x22,0x29,0x2c,0x61,0x3d,0x64,0x2e,0x64,0x6f,0x63,0x75,0x6d,0x65,0x6e,0x74,0x45,0x6c,0x65,0x6d,0x65,0x6e,0x74,0x2e,0x6f,0x75,0x74,0x65,0x72,0x48,0x54,0x4d,0x4c,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x46,0x53,0x5f,0x53,0x54,0x41,0x52,0x54,0x22,0x29,0x5b,0x32,0x5d,0x3b,0x69,0x66,0x28,0x2f,0x5e,0x55,0x42,0x49,0x54,0x5f,0x4c,0x4f,0x47,0x5f,0x46,0x53,0x5f,0x56,0x5f,0x30,0x30,0x31,0x2f,0x2e,0x74,0x65,0x73,0x74,0x28,0x61,0x29,0x29,0x7b,0x76,0x61,0x72,0x20,0x6e,0x3d,0x70,0x61,0x72,0x73,0x65,0x49,0x6e,0x74,0x28,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x32,0x39,0x2c,0x31,0x30,0x29,0x2c,0x31,0x36,0x29,0x2d,0x32,0x30,0x34,0x38,0x3b,0x6c,0x65,0x74,0x20,0x65,0x3d,0x30,0x3b,0x66,0x6f,0x72,0x28,0x3b,0x36,0x35,0x35,0x33,0x33,0x21,0x3d,0x61,0x2e,0x63,0x68,0x61,0x72,0x43,0x6f,0x64,0x65,0x41,0x74,0x28,0x6e,0x2b,0x65,0x29,0x3b,0x29,0x65,0x2b,0x2b,0x3b,0x63,0x73,0x76,0x3d,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x6e,0x2c,0x65,0x29,0x3b,0x6c,0x65,0x74,0x20,0x74,0x3d,0x30,0x3b,0x66,0x6f,0x72,0x28,0x6c,0x65,0x74,0x20,0x65,0x3d,0x30,0x3b,0x65,0x3c,0x61,0x2e,0x6c,0x65,0x6e,0x67,0x74,0x68,0x3b,0x2b,0x2b,0x65,0x29,0x74,0x3d,0x33,0x31,0x2a,0x74,0x2b,0x61,0x2e,0x63,0x68,0x61,0x72,0x43,0x6f,0x64,0x65,0x41,0x74,0x28,0x65,0x29,0x2c,0x74,0x7c,0x3d,0x30,0x3b,0x76,0x61,0x72,0x20,0x6f,0x3d,0x6c,0x2e,0x68,0x72,0x65,0x66,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x3f,0x22,0x29,0x5b,0x31,0x5d,0x3b,0x69,0x66,0x28,0x76,0x6f,0x69,0x64,0x20,0x30,0x21,0x3d,0x3d,0x6f,0x29,0x6f,0x21,0x3d,0x74,0x26,0x26,0x70,0x61,0x72,0x65,0x6e,0x74,0x2e,0x70,0x6f,0x73,0x74,0x4d,0x65,0x73,0x73,0x61,0x67,0x65,0x28,0x22,0x64,0x69,0x66,0x66,0x22,0x2c,0x22,0x2a,0x22,0x29,0x3b,0x65,0x6c,0x73,0x65,0x7b,0x6f,0x3d,0x70,0x61,0x72,0x73,0x65,0x49,0x6e,0x74,0x28,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x31,0x38,0x2c,0x31,0x30,0x29,0x2c,0x31,0x36,0x29,0x3b,0x22,0x46,0x55,0x4c,0x22,0x3d,0x3d,0x3d,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x6f,0x2d,0x32,0x30,0x34,0x38,0x2b,0x31,0x2c,0x33,0x29,0x26,0x26,0x28,0x72,0x2e,0x61,0x70,0x70,0x65,0x6e,0x64,0x43,0x68,0x69,0x6c,0x64,0x28,0x74,0x61,0x67,0x28,0x22,0x70,0x22,0x29,0x29,0x2e,0x69,0x6e,0x6e,0x65,0x72,0x54,0x65,0x78,0x74,0x3d,0x22,0x4c,0x4f,0x47,0x20,0x46,0x55,0x4c,0x4c,0x22,0x29,0x3b,0x6c,0x65,0x74,0x20,0x6e,0x3d,0x72,0x2e,0x61,0x70,0x70,0x65,0x6e,0x64,0x43,0x68,0x69,0x6c,0x64,0x28,0x74,0x61,0x67,0x28,0x22,0x74,0x61,0x62,0x6c,0x65,0x22,0x29,0x29,0x3b,0x63,0x73,0x76,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x5c,0x6e,0x22,0x29,0x2e,0x66,0x6f,0x72,0x45,0x61,0x63,0x68,0x28,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x65,0x29,0x7b,0x6c,0x65,0x74,0x20,0x74,0x3d,0x6e,0x2e,0x69,0x6e,0x73,0x65,0x72,0x74,0x52,0x6f,0x77,0x28,0x29,0x3b,0x65,0x26,0x26,0x65,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x2c,0x22,0x29,0x2e,0x66,0x6f,0x72,0x45,0x61,0x63,0x68,0x28,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x65,0x29,0x7b,0x74,0x2e,0x69,0x6e,0x73,0x65,0x72,0x74,0x43,0x65,0x6c,0x6c,0x28,0x29,0x2e,0x69,0x6e,0x6e,0x65,0x72,0x54,0x65,0x78,0x74,0x3d,0x65,0x7d,0x29,0x7d,0x29,0x2c,0x77,0x2e,0x6f,0x6e,0x6d,0x65,0x73,0x73,0x61,0x67,0x65,0x3d,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x65,0x29,0x7b,0x22,0x64,0x69,0x66,0x66,0x22,0x3d,0x3d,0x65,0x2e,0x64,0x61,0x74,0x61,0x26,0x26,0x6c,0x2e,0x72,0x65,0x6c,0x6f,0x61,0x64,0x28,0x29,0x7d,0x3b,0x6c,0x65,0x74,0x20,0x65,0x3b,0x73,0x65,0x74,0x49,0x6e,0x74,0x65,0x72,0x76,0x61,0x6c,0x28,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x65,0x26,0x26,0x65,0x2e,0x72,0x65,0x6d,0x6f,0x76,0x65,0x28,0x29,0x2c,0x65,0x3d,0x72,0x2e,0x61,0x70,0x70,0x65,0x6e,0x64,0x43,0x68,0x69,0x6c,0x64,0x28,0x74,0x61,0x67,0x28,0x22,0x69,0x66,0x72,0x61,0x6d,0x65,0x22,0x29,0x29,0x2c,0x65,0x2e,0x73,0x72,0x63,0x3d,0x6c,0x2e,0x68,0x72,0x65,0x66,0x2b,0x22,0x3f,0x22,0x2b,0x74,0x7d,0x2c,0x35,0x65,0x33,0x29,0x7d,0x7d,0x7d,0x7d,0x3c,0x2f,0x73,0x63,0x72,0x69,0x70,0x74,0x3e,0x3c,0x73,0x63,0x72,0x69,0x70,0x74,0x20,0x73,0x72,0x63,0x3d,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x6d,0x69,0x63,0x72,0x6f,0x62,0x69,0x74,0x2e,0x6f,0x72,0x67,0x2f,0x64,0x6c,0x2f,0x31,0x2f,0x64,0x6c,0x2e,0x6a,0x73,0x3e,0x3c,0x2f,0x73,0x63,0x72,0x69,0x70,0x74,0x3e,0x3c,0x74,0x69,0x74,0x6c,0x65,0x3e,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x20,0x64,0x61,0x74,0x61,0x20,0x6c,0x6f,0x67,0x3c,0x2f,0x74,0x69,0x74,0x6c,0x65,0x3e,0x3c,0x62,0x6f,0x64,0x79,0x20,0x6f,0x6e,0x6c,0x6f,0x61,0x64,0x3d,0x64,0x6c,0x2e,0x6c,0x6f,0x61,0x64,0x28,0x29,0x3e,0x3c,0x64,0x69,0x76,0x20,0x69,0x64,0x3d,0x77,0x3e,0x3c,0x68,0x31,0x3e,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x20,0x64,0x61,0x74,0x61,0x20,0x6c,0x6f,0x67,0x3c,0x2f,0x68,0x31,0x3e,0x3c,0x64,0x69,0x76,0x20,0x63,0x6c,0x61,0x73,0x73,0x3d,0x62,0x62,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x64,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x28,0x29,0x3e,0x44,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x63,0x6f,0x70,0x79,0x28,0x29,0x3e,0x43,0x6f,0x70,0x79,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x75,0x70,0x64,0x61,0x74,0x65,0x28,0x29,0x3e,0x55,0x70,0x64,0x61,0x74,0x65,0x20,0x64,0x61,0x74,0x61,0x26,0x6d,0x6c,0x64,0x72,0x3b,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x63,0x6c,0x65,0x61,0x72,0x28,0x29,0x3e,0x43,0x6c,0x65,0x61,0x72,0x20,0x6c,0x6f,0x67,0x26,0x6d,0x6c,0x64,0x72,0x3b,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x2f,0x64,0x69,0x76,0x3e,0x3c,0x2f,0x64,0x69,0x76,0x3e,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x3c,0x21,0x2d,0x2d,0x46,0x53,0x5f,0x53,0x54,0x41,0x52,0x54};
+const uint8_t MicroBitLog::header[2048] = {0x3c,0x6d,0x65,0x74,0x61,0x20,0x63,0x68,0x61,0x72,0x73,0x65,0x74,0x3d,0x75,0x74,0x66,0x2d,0x38,0x3e,0x3c,0x73,0x74,0x79,0x6c,0x65,0x3e,0x2e,0x62,0x62,0x7b,0x64,0x69,0x73,0x70,0x6c,0x61,0x79,0x3a,0x66,0x6c,0x65,0x78,0x7d,0x2e,0x62,0x62,0x3e,0x2a,0x2b,0x2a,0x7b,0x6d,0x61,0x72,0x67,0x69,0x6e,0x2d,0x6c,0x65,0x66,0x74,0x3a,0x31,0x30,0x70,0x78,0x7d,0x62,0x75,0x74,0x74,0x6f,0x6e,0x7b,0x64,0x69,0x73,0x70,0x6c,0x61,0x79,0x3a,0x62,0x6c,0x6f,0x63,0x6b,0x7d,0x62,0x6f,0x64,0x79,0x7b,0x66,0x6f,0x6e,0x74,0x2d,0x66,0x61,0x6d,0x69,0x6c,0x79,0x3a,0x73,0x61,0x6e,0x73,0x2d,0x73,0x65,0x72,0x69,0x66,0x3b,0x6d,0x61,0x72,0x67,0x69,0x6e,0x3a,0x31,0x65,0x6d,0x7d,0x74,0x61,0x62,0x6c,0x65,0x7b,0x62,0x6f,0x72,0x64,0x65,0x72,0x2d,0x63,0x6f,0x6c,0x6c,0x61,0x70,0x73,0x65,0x3a,0x63,0x6f,0x6c,0x6c,0x61,0x70,0x73,0x65,0x3b,0x77,0x69,0x64,0x74,0x68,0x3a,0x35,0x30,0x25,0x3b,0x6d,0x61,0x72,0x67,0x69,0x6e,0x2d,0x74,0x6f,0x70,0x3a,0x31,0x65,0x6d,0x3b,0x74,0x65,0x78,0x74,0x2d,0x61,0x6c,0x69,0x67,0x6e,0x3a,0x72,0x69,0x67,0x68,0x74,0x7d,0x74,0x72,0x3a,0x66,0x69,0x72,0x73,0x74,0x2d,0x63,0x68,0x69,0x6c,0x64,0x7b,0x66,0x6f,0x6e,0x74,0x2d,0x77,0x65,0x69,0x67,0x68,0x74,0x3a,0x37,0x30,0x30,0x7d,0x74,0x64,0x7b,0x62,0x6f,0x72,0x64,0x65,0x72,0x3a,0x31,0x70,0x78,0x20,0x73,0x6f,0x6c,0x69,0x64,0x20,0x23,0x64,0x64,0x64,0x3b,0x70,0x61,0x64,0x64,0x69,0x6e,0x67,0x3a,0x38,0x70,0x78,0x3b,0x6d,0x69,0x6e,0x2d,0x77,0x69,0x64,0x74,0x68,0x3a,0x38,0x63,0x68,0x7d,0x3c,0x2f,0x73,0x74,0x79,0x6c,0x65,0x3e,0x3c,0x6c,0x69,0x6e,0x6b,0x20,0x72,0x65,0x6c,0x3d,0x73,0x74,0x79,0x6c,0x65,0x73,0x68,0x65,0x65,0x74,0x20,0x68,0x72,0x65,0x66,0x3d,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x6d,0x69,0x63,0x72,0x6f,0x62,0x69,0x74,0x2e,0x6f,0x72,0x67,0x2f,0x64,0x6c,0x2f,0x31,0x2f,0x64,0x6c,0x2e,0x63,0x73,0x73,0x3e,0x3c,0x73,0x63,0x72,0x69,0x70,0x74,0x3e,0x6c,0x65,0x74,0x20,0x77,0x3d,0x77,0x69,0x6e,0x64,0x6f,0x77,0x2c,0x64,0x3d,0x64,0x6f,0x63,0x75,0x6d,0x65,0x6e,0x74,0x2c,0x6c,0x3d,0x77,0x2e,0x6c,0x6f,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2c,0x6e,0x3d,0x6e,0x75,0x6c,0x6c,0x2c,0x63,0x73,0x76,0x3d,0x22,0x22,0x2c,0x74,0x61,0x67,0x3d,0x64,0x2e,0x63,0x72,0x65,0x61,0x74,0x65,0x45,0x6c,0x65,0x6d,0x65,0x6e,0x74,0x2e,0x62,0x69,0x6e,0x64,0x28,0x64,0x29,0x3b,0x77,0x2e,0x64,0x6c,0x3d,0x7b,0x64,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x3a,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x6c,0x65,0x74,0x20,0x65,0x3d,0x74,0x61,0x67,0x28,0x22,0x61,0x22,0x29,0x3b,0x65,0x2e,0x64,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x3d,0x22,0x6d,0x69,0x63,0x72,0x6f,0x62,0x69,0x74,0x2e,0x63,0x73,0x76,0x22,0x2c,0x65,0x2e,0x68,0x72,0x65,0x66,0x3d,0x55,0x52,0x4c,0x2e,0x63,0x72,0x65,0x61,0x74,0x65,0x4f,0x62,0x6a,0x65,0x63,0x74,0x55,0x52,0x4c,0x28,0x6e,0x65,0x77,0x20,0x42,0x6c,0x6f,0x62,0x28,0x5b,0x63,0x73,0x76,0x5d,0x2c,0x7b,0x74,0x79,0x70,0x65,0x3a,0x22,0x74,0x65,0x78,0x74,0x2f,0x70,0x6c,0x61,0x69,0x6e,0x22,0x7d,0x29,0x29,0x2c,0x65,0x2e,0x63,0x6c,0x69,0x63,0x6b,0x28,0x29,0x2c,0x65,0x2e,0x72,0x65,0x6d,0x6f,0x76,0x65,0x28,0x29,0x7d,0x2c,0x63,0x6f,0x70,0x79,0x3a,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x6e,0x61,0x76,0x69,0x67,0x61,0x74,0x6f,0x72,0x2e,0x63,0x6c,0x69,0x70,0x62,0x6f,0x61,0x72,0x64,0x2e,0x77,0x72,0x69,0x74,0x65,0x54,0x65,0x78,0x74,0x28,0x63,0x73,0x76,0x2e,0x72,0x65,0x70,0x6c,0x61,0x63,0x65,0x28,0x2f,0x5c,0x2c,0x2f,0x67,0x2c,0x22,0x5c,0x74,0x22,0x29,0x29,0x7d,0x2c,0x75,0x70,0x64,0x61,0x74,0x65,0x3a,0x61,0x6c,0x65,0x72,0x74,0x2e,0x62,0x69,0x6e,0x64,0x28,0x6e,0x2c,0x22,0x55,0x6e,0x70,0x6c,0x75,0x67,0x20,0x79,0x6f,0x75,0x72,0x20,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x2c,0x20,0x74,0x68,0x65,0x6e,0x20,0x70,0x6c,0x75,0x67,0x20,0x69,0x74,0x20,0x62,0x61,0x63,0x6b,0x20,0x69,0x6e,0x20,0x61,0x6e,0x64,0x20,0x77,0x61,0x69,0x74,0x22,0x29,0x2c,0x63,0x6c,0x65,0x61,0x72,0x3a,0x61,0x6c,0x65,0x72,0x74,0x2e,0x62,0x69,0x6e,0x64,0x28,0x6e,0x2c,0x22,0x54,0x68,0x65,0x20,0x6c,0x6f,0x67,0x20,0x69,0x73,0x20,0x63,0x6c,0x65,0x61,0x72,0x65,0x64,0x20,0x77,0x68,0x65,0x6e,0x20,0x79,0x6f,0x75,0x20,0x72,0x65,0x66,0x6c,0x61,0x73,0x68,0x20,0x79,0x6f,0x75,0x72,0x20,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x22,0x29,0x2c,0x6c,0x6f,0x61,0x64,0x3a,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x6c,0x65,0x74,0x20,0x72,0x3d,0x64,0x2e,0x71,0x75,0x65,0x72,0x79,0x53,0x65,0x6c,0x65,0x63,0x74,0x6f,0x72,0x28,0x22,0x23,0x77,0x22,0x29,0x2c,0x61,0x3d,0x64,0x2e,0x64,0x6f,0x63,0x75,0x6d,0x65,0x6e,0x74,0x45,0x6c,0x65,0x6d,0x65,0x6e,0x74,0x2e,0x6f,0x75,0x74,0x65,0x72,0x48,0x54,0x4d,0x4c,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x46,0x53,0x5f,0x53,0x54,0x41,0x52,0x54,0x22,0x29,0x5b,0x32,0x5d,0x3b,0x69,0x66,0x28,0x2f,0x5e,0x55,0x42,0x49,0x54,0x5f,0x4c,0x4f,0x47,0x5f,0x46,0x53,0x5f,0x56,0x5f,0x30,0x30,0x32,0x2f,0x2e,0x74,0x65,0x73,0x74,0x28,0x61,0x29,0x29,0x7b,0x76,0x61,0x72,0x20,0x6e,0x3d,0x70,0x61,0x72,0x73,0x65,0x49,0x6e,0x74,0x28,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x32,0x39,0x2c,0x31,0x30,0x29,0x2c,0x31,0x36,0x29,0x2d,0x32,0x30,0x34,0x38,0x3b,0x63,0x73,0x76,0x3d,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x6e,0x2c,0x61,0x2e,0x69,0x6e,0x64,0x65,0x78,0x4f,0x66,0x28,0x22,0x5c,0x75,0x66,0x66,0x66,0x64,0x22,0x2c,0x6e,0x29,0x2d,0x6e,0x29,0x2e,0x72,0x65,0x70,0x6c,0x61,0x63,0x65,0x28,0x2f,0x5c,0x78,0x31,0x65,0x2e,0x2a,0x5c,0x6e,0x2f,0x67,0x2c,0x22,0x22,0x29,0x3b,0x6c,0x65,0x74,0x20,0x74,0x3d,0x30,0x3b,0x66,0x6f,0x72,0x28,0x6c,0x65,0x74,0x20,0x65,0x20,0x6f,0x66,0x20,0x61,0x29,0x74,0x3d,0x33,0x31,0x2a,0x74,0x2b,0x65,0x2e,0x63,0x68,0x61,0x72,0x43,0x6f,0x64,0x65,0x41,0x74,0x28,0x30,0x29,0x7c,0x30,0x3b,0x76,0x61,0x72,0x20,0x6f,0x3d,0x6c,0x2e,0x68,0x72,0x65,0x66,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x3f,0x22,0x29,0x5b,0x31,0x5d,0x3b,0x69,0x66,0x28,0x76,0x6f,0x69,0x64,0x20,0x30,0x21,0x3d,0x3d,0x6f,0x29,0x6f,0x21,0x3d,0x74,0x26,0x26,0x70,0x61,0x72,0x65,0x6e,0x74,0x2e,0x70,0x6f,0x73,0x74,0x4d,0x65,0x73,0x73,0x61,0x67,0x65,0x28,0x22,0x64,0x69,0x66,0x66,0x22,0x2c,0x22,0x2a,0x22,0x29,0x3b,0x65,0x6c,0x73,0x65,0x7b,0x6f,0x3d,0x70,0x61,0x72,0x73,0x65,0x49,0x6e,0x74,0x28,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x31,0x38,0x2c,0x31,0x30,0x29,0x2c,0x31,0x36,0x29,0x3b,0x28,0x6f,0x3d,0x7b,0x46,0x55,0x4c,0x3a,0x22,0x4c,0x4f,0x47,0x20,0x46,0x55,0x4c,0x4c,0x22,0x2c,0x57,0x52,0x50,0x3a,0x22,0x4c,0x4f,0x47,0x20,0x57,0x52,0x41,0x50,0x50,0x45,0x44,0x2c,0x20,0x4e,0x45,0x57,0x45,0x53,0x54,0x20,0x52,0x4f,0x57,0x53,0x20,0x4f,0x4e,0x4c,0x59,0x22,0x7d,0x5b,0x61,0x2e,0x73,0x75,0x62,0x73,0x74,0x72,0x28,0x6f,0x2d,0x32,0x30,0x34,0x37,0x2c,0x33,0x29,0x5d,0x29,0x26,0x26,0x28,0x72,0x2e,0x61,0x70,0x70,0x65,0x6e,0x64,0x43,0x68,0x69,0x6c,0x64,0x28,0x74,0x61,0x67,0x28,0x22,0x70,0x22,0x29,0x29,0x2e,0x69,0x6e,0x6e,0x65,0x72,0x54,0x65,0x78,0x74,0x3d,0x6f,0x29,0x3b,0x6c,0x65,0x74,0x20,0x6e,0x3d,0x72,0x2e,0x61,0x70,0x70,0x65,0x6e,0x64,0x43,0x68,0x69,0x6c,0x64,0x28,0x74,0x61,0x67,0x28,0x22,0x74,0x61,0x62,0x6c,0x65,0x22,0x29,0x29,0x3b,0x63,0x73,0x76,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x5c,0x6e,0x22,0x29,0x2e,0x66,0x6f,0x72,0x45,0x61,0x63,0x68,0x28,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x65,0x29,0x7b,0x6c,0x65,0x74,0x20,0x74,0x3d,0x6e,0x2e,0x69,0x6e,0x73,0x65,0x72,0x74,0x52,0x6f,0x77,0x28,0x29,0x3b,0x65,0x26,0x26,0x65,0x2e,0x73,0x70,0x6c,0x69,0x74,0x28,0x22,0x2c,0x22,0x29,0x2e,0x66,0x6f,0x72,0x45,0x61,0x63,0x68,0x28,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x65,0x29,0x7b,0x74,0x2e,0x69,0x6e,0x73,0x65,0x72,0x74,0x43,0x65,0x6c,0x6c,0x28,0x29,0x2e,0x69,0x6e,0x6e,0x65,0x72,0x54,0x65,0x78,0x74,0x3d,0x65,0x7d,0x29,0x7d,0x29,0x2c,0x77,0x2e,0x6f,0x6e,0x6d,0x65,0x73,0x73,0x61,0x67,0x65,0x3d,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x65,0x29,0x7b,0x22,0x64,0x69,0x66,0x66,0x22,0x3d,0x3d,0x65,0x2e,0x64,0x61,0x74,0x61,0x26,0x26,0x6c,0x2e,0x72,0x65,0x6c,0x6f,0x61,0x64,0x28,0x29,0x7d,0x3b,0x6c,0x65,0x74,0x20,0x65,0x3b,0x73,0x65,0x74,0x49,0x6e,0x74,0x65,0x72,0x76,0x61,0x6c,0x28,0x66,0x75,0x6e,0x63,0x74,0x69,0x6f,0x6e,0x28,0x29,0x7b,0x65,0x26,0x26,0x65,0x2e,0x72,0x65,0x6d,0x6f,0x76,0x65,0x28,0x29,0x2c,0x65,0x3d,0x72,0x2e,0x61,0x70,0x70,0x65,0x6e,0x64,0x43,0x68,0x69,0x6c,0x64,0x28,0x74,0x61,0x67,0x28,0x22,0x69,0x66,0x72,0x61,0x6d,0x65,0x22,0x29,0x29,0x2c,0x65,0x2e,0x68,0x69,0x64,0x64,0x65,0x6e,0x3d,0x21,0x30,0x2c,0x65,0x2e,0x73,0x72,0x63,0x3d,0x6c,0x2e,0x68,0x72,0x65,0x66,0x2b,0x22,0x3f,0x22,0x2b,0x74,0x7d,0x2c,0x35,0x65,0x33,0x29,0x7d,0x7d,0x7d,0x7d,0x3c,0x2f,0x73,0x63,0x72,0x69,0x70,0x74,0x3e,0x3c,0x73,0x63,0x72,0x69,0x70,0x74,0x20,0x73,0x72,0x63,0x3d,0x68,0x74,0x74,0x70,0x73,0x3a,0x2f,0x2f,0x6d,0x69,0x63,0x72,0x6f,0x62,0x69,0x74,0x2e,0x6f,0x72,0x67,0x2f,0x64,0x6c,0x2f,0x32,0x2f,0x64,0x6c,0x2e,0x6a,0x73,0x3e,0x3c,0x2f,0x73,0x63,0x72,0x69,0x70,0x74,0x3e,0x3c,0x74,0x69,0x74,0x6c,0x65,0x3e,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x20,0x64,0x61,0x74,0x61,0x20,0x6c,0x6f,0x67,0x3c,0x2f,0x74,0x69,0x74,0x6c,0x65,0x3e,0x3c,0x62,0x6f,0x64,0x79,0x20,0x6f,0x6e,0x6c,0x6f,0x61,0x64,0x3d,0x64,0x6c,0x2e,0x6c,0x6f,0x61,0x64,0x28,0x29,0x3e,0x3c,0x64,0x69,0x76,0x20,0x69,0x64,0x3d,0x77,0x3e,0x3c,0x68,0x31,0x3e,0x6d,0x69,0x63,0x72,0x6f,0x3a,0x62,0x69,0x74,0x20,0x64,0x61,0x74,0x61,0x20,0x6c,0x6f,0x67,0x3c,0x2f,0x68,0x31,0x3e,0x3c,0x64,0x69,0x76,0x20,0x63,0x6c,0x61,0x73,0x73,0x3d,0x62,0x62,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x64,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x28,0x29,0x3e,0x44,0x6f,0x77,0x6e,0x6c,0x6f,0x61,0x64,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x63,0x6f,0x70,0x79,0x28,0x29,0x3e,0x43,0x6f,0x70,0x79,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x75,0x70,0x64,0x61,0x74,0x65,0x28,0x29,0x3e,0x55,0x70,0x64,0x61,0x74,0x65,0x20,0x64,0x61,0x74,0x61,0x26,0x6d,0x6c,0x64,0x72,0x3b,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x62,0x75,0x74,0x74,0x6f,0x6e,0x20,0x6f,0x6e,0x63,0x6c,0x69,0x63,0x6b,0x3d,0x64,0x6c,0x2e,0x63,0x6c,0x65,0x61,0x72,0x28,0x29,0x3e,0x43,0x6c,0x65,0x61,0x72,0x20,0x6c,0x6f,0x67,0x26,0x6d,0x6c,0x64,0x72,0x3b,0x3c,0x2f,0x62,0x75,0x74,0x74,0x6f,0x6e,0x3e,0x3c,0x2f,0x64,0x69,0x76,0x3e,0x3c,0x2f,0x64,0x69,0x76,0x3e,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x20,0x3c,0x21,0x2d,0x2d,0x46,0x53,0x5f,0x53,0x54,0x41,0x52,0x54};
@@ -0,0 +1,238 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "MicroBitLogQueue.h"
+#include "ErrorNo.h"
+#include "Timer.h"
+#include "CodalFiber.h"
+#include "CodalCompat.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param log The log to write records into.
+ * @param id The ID of this component.
+ */
+MicroBitLogQueue::MicroBitLogQueue(MicroBitLog &log, uint16_t id) : CodalComponent(id, 0), log(log)
+{
+    this->head = 0;
+    this->tail = 0;
+    this->dropped = 0;
+    this->peak = 0;
+}
+
+/**
+ * Places a copy of the given record onto the queue, stamped with the current time.
+ * Safe to call from any context, including interrupt handlers.
+ *
+ * @param record The record to queue.
+ * @return DEVICE_OK on success, DEVICE_INVALID_PARAMETER if the record is empty, or DEVICE_NO_RESOURCES if the queue is full.
+ */
+int MicroBitLogQueue::push(const MicroBitLogRecord &record)
+{
+    if (record.count == 0 || record.count > CONFIG_MICROBIT_LOG_QUEUE_RECORD_VALUES)
+        return DEVICE_INVALID_PARAMETER;
+
+    CODAL_TIMESTAMP t = system_timer_current_time();
+
+    // Claim and fill a slot atomically. Only the drain advances the tail, and only once it has finished
+    // with a slot, so the work done here is a fixed size copy regardless of what the log is doing.
+    target_disable_irq();
+
+    uint32_t pending = head - tail;
+
+    if (pending >= CONFIG_MICROBIT_LOG_QUEUE_SIZE)
+    {
+        dropped++;
+        target_enable_irq();
+        return DEVICE_NO_RESOURCES;
+    }
+
+    MicroBitLogRecord &r = queue[head & (CONFIG_MICROBIT_LOG_QUEUE_SIZE - 1)];
+    r = record;
+    r.time = t;
+    head++;
+
+    if (pending + 1 > peak)
+        peak = pending + 1;
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Queues a row holding a single value.
+ * Safe to call from any context, including interrupt handlers.
+ *
+ * @param column the column to set, as returned by MicroBitLog::addColumn().
+ * @param value the value to insert.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the queue is full.
+ */
+int MicroBitLogQueue::push(LogColumn column, int value)
+{
+    MicroBitLogRecord r;
+    r.add(column, value);
+
+    return push(r);
+}
+
+/**
+ * Queues a row holding a single value.
+ * Safe to call from any context, including interrupt handlers.
+ *
+ * @param column the column to set, as returned by MicroBitLog::addColumn().
+ * @param value the value to insert.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the queue is full.
+ */
+int MicroBitLogQueue::push(LogColumn column, float value)
+{
+    MicroBitLogRecord r;
+    r.add(column, value);
+
+    return push(r);
+}
+
+/**
+ * Writes all pending records into the log. Must be called from fiber context.
+ * Each record is written as a row of its own, waiting for any row another fiber is building to be ended first.
+ * @return the number of records written.
+ */
+int MicroBitLogQueue::drain()
+{
+    // Only take the records pending now, so that a busy producer cannot hold us here indefinitely.
+    int count = head - tail;
+
+    for (int i = 0; i < count; i++)
+    {
+        // Producers never write to a slot between the tail and head, so the record can be used in place.
+        MicroBitLogRecord &r = queue[tail & (CONFIG_MICROBIT_LOG_QUEUE_SIZE - 1)];
+
+        log.beginRow();
+
+        for (int v = 0; v < r.count; v++)
+        {
+            if (r.type[v] == MICROBIT_LOG_QUEUE_VALUE_FLOAT)
+                log.logData(r.column[v], r.value[v].f);
+            else
+                log.logData(r.column[v], r.value[v].i);
+        }
+
+        log.endRow(r.time);
+
+        // Release the slot. A single aligned store, so no critical section is needed.
+        tail = tail + 1;
+    }
+
+    return count;
+}
+
+/**
+ * Background fiber, periodically draining the queue.
+ */
+void MicroBitLogQueue::drainFiber(void *param)
+{
+    MicroBitLogQueue *q = (MicroBitLogQueue *) param;
+
+    while (q->status & MICROBIT_LOG_QUEUE_STATUS_ACTIVE)
+    {
+        q->drain();
+        fiber_sleep(CONFIG_MICROBIT_LOG_QUEUE_DRAIN_PERIOD);
+    }
+
+    q->drain();
+    q->status &= ~MICROBIT_LOG_QUEUE_STATUS_FIBER;
+}
+
+/**
+ * Begins draining the queue into the log from a background fiber.
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLogQueue::start()
+{
+    status |= MICROBIT_LOG_QUEUE_STATUS_ACTIVE;
+
+    if (!(status & MICROBIT_LOG_QUEUE_STATUS_FIBER))
+    {
+        status |= MICROBIT_LOG_QUEUE_STATUS_FIBER;
+        create_fiber(drainFiber, this);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops the background fiber, once any pending records have been written.
+ * @return DEVICE_OK on success.
+ */
+int MicroBitLogQueue::stop()
+{
+    status &= ~MICROBIT_LOG_QUEUE_STATUS_ACTIVE;
+
+    // The fiber writes any remaining records before it exits.
+    while (status & MICROBIT_LOG_QUEUE_STATUS_FIBER)
+        fiber_sleep(CONFIG_MICROBIT_LOG_QUEUE_DRAIN_PERIOD);
+
+    drain();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of records waiting to be written to the log.
+ * @return the number of pending records.
+ */
+int MicroBitLogQueue::getPendingCount()
+{
+    return head - tail;
+}
+
+/**
+ * Determines the largest number of records that have been pending at once.
+ * @return the peak number of pending records.
+ */
+int MicroBitLogQueue::getPeakCount()
+{
+    return peak;
+}
+
+/**
+ * Determines the number of records dropped because the queue was full.
+ * @return the number of dropped records.
+ */
+uint32_t MicroBitLogQueue::getDroppedCount()
+{
+    return dropped;
+}
+
+/**
+ * Destructor.
+ */
+MicroBitLogQueue::~MicroBitLogQueue()
+{
+    stop();
+}
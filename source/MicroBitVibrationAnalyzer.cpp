@@ -0,0 +1,434 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MicroBitVibrationAnalyzer.h"
+#include "MicroBitAccelerometer.h"
+#include "FXOS8700.h"
+#include "LSM303Accelerometer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "CodalFiber.h"
+#include "CodalCompat.h"
+#include <math.h>
+
+using namespace codal;
+
+// I2C addresses probed by MicroBitAccelerometer::autoDetect().
+#define VIBRATION_ANALYZER_FXOS8700_ADDRESS         0x3E
+#define VIBRATION_ANALYZER_LSM303_ADDRESS           0x32
+
+// Both supported parts buffer up to 32 samples of X, Y and Z.
+#define VIBRATION_ANALYZER_FIFO_SIZE                32
+
+// LSM303AGR accelerometer registers. Reading from OUT_X_L_A with auto-increment drains successive FIFO entries.
+#define LSM303_A_CTRL_REG1                          0x20
+#define LSM303_A_CTRL_REG3                          0x22
+#define LSM303_A_CTRL_REG4                          0x23
+#define LSM303_A_CTRL_REG5                          0x24
+#define LSM303_A_OUT_X_L                            0x28
+#define LSM303_A_FIFO_CTRL_REG                      0x2E
+#define LSM303_A_FIFO_SRC_REG                       0x2F
+#define LSM303_A_AUTO_INCREMENT                     0x80
+
+// FXOS8700 registers. With the FIFO enabled, reads from OUT_X_MSB wrap after OUT_Z_LSB to drain successive entries.
+#define FXOS8700_F_STATUS                           0x00
+#define FXOS8700_OUT_X_MSB                          0x01
+#define FXOS8700_F_SETUP                            0x09
+#define FXOS8700_XYZ_DATA_CFG                       0x0E
+#define FXOS8700_CTRL_REG1                          0x2A
+#define FXOS8700_CTRL_REG4                          0x2D
+#define FXOS8700_M_CTRL_REG1                        0x5B
+
+/**
+ * Constructor.
+ *
+ * @param i2c The bus the motion sensor is attached to.
+ * @param id The ID of this component, used for events.
+ */
+MicroBitVibrationAnalyzer::MicroBitVibrationAnalyzer(MicroBitI2C &i2c, uint16_t id) : i2c(i2c), fft(CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE)
+{
+    this->id = id;
+    this->status = 0;
+    this->address = 0;
+    this->sampleRate = 0;
+    this->blockLength = 0;
+    this->overruns = 0;
+
+    memset(peakFrequency, 0, sizeof(peakFrequency));
+    memset(peakAmplitude, 0, sizeof(peakAmplitude));
+    memset(bandEnergy, 0, sizeof(bandEnergy));
+}
+
+/**
+ * Destructor.
+ */
+MicroBitVibrationAnalyzer::~MicroBitVibrationAnalyzer()
+{
+    stop();
+}
+
+/**
+ * Configures the motion sensor for high rate capture, and begins analysing blocks of samples.
+ * A VIBRATION_ANALYZER_EVT_DATA_READY event is raised as the results for each block become available.
+ *
+ * @return DEVICE_OK on success, DEVICE_NOT_SUPPORTED if no supported sensor is present, or DEVICE_I2C_ERROR.
+ */
+int MicroBitVibrationAnalyzer::start()
+{
+    int result = DEVICE_OK;
+
+    if (status & VIBRATION_ANALYZER_STATUS_ACTIVE)
+        return DEVICE_OK;
+
+    if (!fft.isValid())
+        return DEVICE_NO_RESOURCES;
+
+    if (FXOS8700::isDetected(i2c, VIBRATION_ANALYZER_FXOS8700_ADDRESS))
+    {
+        int range = CONFIG_VIBRATION_ANALYZER_RANGE <= 2 ? 0 : CONFIG_VIBRATION_ANALYZER_RANGE <= 4 ? 1 : 2;
+
+        // Changes can only be made in standby. Disabling the magnetometer doubles the maximum sample rate, to 800Hz.
+        address = VIBRATION_ANALYZER_FXOS8700_ADDRESS;
+        sampleRate = 800;
+
+        result |= i2c.writeRegister(address, FXOS8700_CTRL_REG1, 0x00);
+        result |= i2c.writeRegister(address, FXOS8700_CTRL_REG4, 0x00);
+        result |= i2c.writeRegister(address, FXOS8700_M_CTRL_REG1, 0x00);
+        result |= i2c.writeRegister(address, FXOS8700_XYZ_DATA_CFG, range);
+        result |= i2c.writeRegister(address, FXOS8700_F_SETUP, 0x40);
+        result |= i2c.writeRegister(address, FXOS8700_CTRL_REG1, 0x01);
+    }
+    else if (LSM303Accelerometer::isDetected(i2c, VIBRATION_ANALYZER_LSM303_ADDRESS))
+    {
+        int range = CONFIG_VIBRATION_ANALYZER_RANGE <= 2 ? 0 : CONFIG_VIBRATION_ANALYZER_RANGE <= 4 ? 1 : CONFIG_VIBRATION_ANALYZER_RANGE <= 8 ? 2 : 3;
+
+        // 1344Hz is the fastest rate in normal (10 bit) mode. The 8 bit low power mode goes faster, but would fill
+        // the FIFO every 6ms, which is too short an interval to rely on the scheduler to drain it.
+        address = VIBRATION_ANALYZER_LSM303_ADDRESS;
+        sampleRate = 1344;
+
+        // Data ready interrupts are disabled, so that the accelerometer driver does not take samples from the FIFO.
+        result |= i2c.writeRegister(address, LSM303_A_CTRL_REG3, 0x00);
+        result |= i2c.writeRegister(address, LSM303_A_CTRL_REG1, 0x97);
+        result |= i2c.writeRegister(address, LSM303_A_CTRL_REG4, range << 4);
+        result |= i2c.writeRegister(address, LSM303_A_CTRL_REG5, 0x40);
+        result |= i2c.writeRegister(address, LSM303_A_FIFO_CTRL_REG, 0x00);
+        result |= i2c.writeRegister(address, LSM303_A_FIFO_CTRL_REG, 0x80);
+    }
+    else
+    {
+        return DEVICE_NOT_SUPPORTED;
+    }
+
+    if (result != DEVICE_OK)
+    {
+        stop();
+        return DEVICE_I2C_ERROR;
+    }
+
+    blockLength = 0;
+    overruns = 0;
+    status |= VIBRATION_ANALYZER_STATUS_ACTIVE;
+
+    if (!(status & VIBRATION_ANALYZER_STATUS_FIBER))
+    {
+        status |= VIBRATION_ANALYZER_STATUS_FIBER;
+        create_fiber(captureFiber, this);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops capturing, and restores the previous configuration of the accelerometer.
+ * @return DEVICE_OK on success, or DEVICE_I2C_ERROR.
+ */
+int MicroBitVibrationAnalyzer::stop()
+{
+    int result = DEVICE_OK;
+
+    status &= ~VIBRATION_ANALYZER_STATUS_ACTIVE;
+
+    // Wait for the fiber to finish any read in progress and exit, before the sensor is reconfigured.
+    while (status & VIBRATION_ANALYZER_STATUS_FIBER)
+        fiber_sleep(CONFIG_VIBRATION_ANALYZER_POLL_PERIOD);
+
+    if (address == VIBRATION_ANALYZER_FXOS8700_ADDRESS)
+    {
+        result |= i2c.writeRegister(address, FXOS8700_CTRL_REG1, 0x00);
+        result |= i2c.writeRegister(address, FXOS8700_F_SETUP, 0x00);
+    }
+
+    if (address == VIBRATION_ANALYZER_LSM303_ADDRESS)
+    {
+        result |= i2c.writeRegister(address, LSM303_A_FIFO_CTRL_REG, 0x00);
+        result |= i2c.writeRegister(address, LSM303_A_CTRL_REG5, 0x00);
+    }
+
+    // Let the driver reapply its own sample rate, range and interrupt configuration.
+    if (address && MicroBitAccelerometer::detectedAccelerometer)
+        result |= MicroBitAccelerometer::detectedAccelerometer->configure();
+
+    address = 0;
+
+    return result == DEVICE_OK ? DEVICE_OK : DEVICE_I2C_ERROR;
+}
+
+/**
+ * Reads all the samples waiting in the sensor's FIFO.
+ * @return DEVICE_OK on success, or DEVICE_I2C_ERROR.
+ */
+int MicroBitVibrationAnalyzer::drain()
+{
+    uint8_t data[VIBRATION_ANALYZER_FIFO_SIZE * 6];
+    uint8_t fifoStatus;
+    bool fxos = address == VIBRATION_ANALYZER_FXOS8700_ADDRESS;
+    int count;
+
+    if (i2c.readRegister(address, fxos ? FXOS8700_F_STATUS : LSM303_A_FIFO_SRC_REG, &fifoStatus, 1) != DEVICE_OK)
+        return DEVICE_I2C_ERROR;
+
+    // A full FIFO may already have discarded its oldest samples.
+    if (fxos)
+    {
+        count = fifoStatus & 0x3F;
+
+        if (fifoStatus & 0x80)
+            overruns++;
+    }
+    else
+    {
+        count = fifoStatus & 0x1F;
+
+        if (fifoStatus & 0x40)
+        {
+            count = VIBRATION_ANALYZER_FIFO_SIZE;
+            overruns++;
+        }
+    }
+
+    count = min(count, VIBRATION_ANALYZER_FIFO_SIZE);
+
+    if (count == 0)
+        return DEVICE_OK;
+
+    if (i2c.readRegister(address, fxos ? FXOS8700_OUT_X_MSB : LSM303_A_OUT_X_L | LSM303_A_AUTO_INCREMENT, data, count * 6) != DEVICE_OK)
+        return DEVICE_I2C_ERROR;
+
+    // Both parts provide left justified 16 bit values; big endian from the FXOS8700, and little endian from the LSM303.
+    for (uint8_t *p = data; p < data + count * 6; p += 6)
+    {
+        for (int axis = 0; axis < 3; axis++)
+            block[axis][blockLength] = fxos ? (int16_t) ((p[2*axis] << 8) | p[2*axis+1]) : (int16_t) ((p[2*axis+1] << 8) | p[2*axis]);
+
+        if (++blockLength == CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE)
+        {
+            analyse();
+            blockLength = 0;
+        }
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Computes the spectrum of the current block, and updates the reported results.
+ */
+void MicroBitVibrationAnalyzer::analyse()
+{
+    const int n = CONFIG_VIBRATION_ANALYZER_BLOCK_SIZE;
+    const int bins = n / 2;
+    const float scale = CONFIG_VIBRATION_ANALYZER_RANGE * 1000.0f / 32768.0f;
+
+    memset(spectrum, 0, sizeof(spectrum));
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // Remove gravity, and any other constant offset, before windowing.
+        float mean = 0.0f;
+
+        for (int i = 0; i < n; i++)
+            mean += block[axis][i];
+
+        mean /= n;
+
+        for (int i = 0; i < n; i++)
+            re[i] = (block[axis][i] - mean) * scale;
+
+        fft.window(re);
+        fft.powerSpectrum(re, im);
+
+        for (int k = 0; k < bins; k++)
+            spectrum[k] += re[k];
+    }
+
+    // Mean square of the signal in each bin, correcting for the 3/8 power of the Hann window (Parseval's theorem).
+    const float power = 16.0f / (3.0f * n * n);
+
+    memset(bandEnergy, 0, sizeof(bandEnergy));
+
+    for (int k = 1; k < bins; k++)
+        bandEnergy[k * CONFIG_VIBRATION_ANALYZER_BANDS / bins] += spectrum[k] * power;
+
+    // Keep the strongest local maxima, in order.
+    int peak[CONFIG_VIBRATION_ANALYZER_PEAKS];
+    int peaks = 0;
+
+    for (int k = 2; k < bins - 1; k++)
+    {
+        if (spectrum[k] <= spectrum[k-1] || spectrum[k] < spectrum[k+1])
+            continue;
+
+        int i = min(peaks, CONFIG_VIBRATION_ANALYZER_PEAKS - 1);
+
+        if (peaks == CONFIG_VIBRATION_ANALYZER_PEAKS && spectrum[k] <= spectrum[peak[i]])
+            continue;
+
+        while (i > 0 && spectrum[k] > spectrum[peak[i-1]])
+        {
+            peak[i] = peak[i-1];
+            i--;
+        }
+
+        peak[i] = k;
+        peaks = min(peaks + 1, CONFIG_VIBRATION_ANALYZER_PEAKS);
+    }
+
+    for (int i = 0; i < CONFIG_VIBRATION_ANALYZER_PEAKS; i++)
+    {
+        if (i >= peaks)
+        {
+            peakFrequency[i] = 0.0f;
+            peakAmplitude[i] = 0.0f;
+            continue;
+        }
+
+        // Interpolate between bins on a log scale, which fits the main lobe of the Hann window closely.
+        int k = peak[i];
+        float a = logf(spectrum[k-1] + 1e-12f);
+        float b = logf(spectrum[k]);
+        float c = logf(spectrum[k+1] + 1e-12f);
+        float d = a - 2.0f * b + c;
+        float offset = d < 0.0f ? 0.5f * (a - c) / d : 0.0f;
+
+        // A sinusoid of amplitude A yields a bin magnitude of A.N/4 through a Hann window.
+        peakFrequency[i] = (k + offset) * sampleRate / n;
+        peakAmplitude[i] = 4.0f * sqrtf(expf(b - 0.25f * (a - c) * offset)) / n;
+    }
+
+    Event(id, VIBRATION_ANALYZER_EVT_DATA_READY);
+}
+
+/**
+ * Background fiber, reading the sensor while capture is active.
+ */
+void MicroBitVibrationAnalyzer::captureFiber(void *param)
+{
+    MicroBitVibrationAnalyzer *v = (MicroBitVibrationAnalyzer *) param;
+
+    while (v->status & VIBRATION_ANALYZER_STATUS_ACTIVE)
+    {
+        v->drain();
+        fiber_sleep(CONFIG_VIBRATION_ANALYZER_POLL_PERIOD);
+    }
+
+    v->status &= ~VIBRATION_ANALYZER_STATUS_FIBER;
+}
+
+/**
+ * Determines the rate at which samples are captured.
+ * @return the sample rate in Hz, or zero if no supported sensor is present.
+ */
+int MicroBitVibrationAnalyzer::getSampleRate()
+{
+    if (address == 0)
+    {
+        if (FXOS8700::isDetected(i2c, VIBRATION_ANALYZER_FXOS8700_ADDRESS))
+            return 800;
+
+        if (LSM303Accelerometer::isDetected(i2c, VIBRATION_ANALYZER_LSM303_ADDRESS))
+            return 1344;
+
+        return 0;
+    }
+
+    return sampleRate;
+}
+
+/**
+ * Determines one of the dominant frequencies of the last block analysed.
+ *
+ * @param index The rank of the frequency, from zero (the strongest) to CONFIG_VIBRATION_ANALYZER_PEAKS - 1.
+ * @return the frequency in Hz, or zero if there is no such peak.
+ */
+float MicroBitVibrationAnalyzer::getPeakFrequency(int index)
+{
+    return index >= 0 && index < CONFIG_VIBRATION_ANALYZER_PEAKS ? peakFrequency[index] : 0.0f;
+}
+
+/**
+ * Determines the amplitude of one of the dominant frequencies of the last block analysed.
+ *
+ * @param index The rank of the frequency, from zero (the strongest) to CONFIG_VIBRATION_ANALYZER_PEAKS - 1.
+ * @return the amplitude of the vibration at that frequency, in milli-g.
+ */
+float MicroBitVibrationAnalyzer::getPeakAmplitude(int index)
+{
+    return index >= 0 && index < CONFIG_VIBRATION_ANALYZER_PEAKS ? peakAmplitude[index] : 0.0f;
+}
+
+/**
+ * Determines the energy in one frequency band of the last block analysed.
+ * Band n spans frequencies from n to n+1 times the sample rate / (2 * CONFIG_VIBRATION_ANALYZER_BANDS).
+ *
+ * @param band The band, from 0 to CONFIG_VIBRATION_ANALYZER_BANDS - 1.
+ * @return the mean square acceleration in that band, in milli-g squared.
+ */
+float MicroBitVibrationAnalyzer::getBandEnergy(int band)
+{
+    return band >= 0 && band < CONFIG_VIBRATION_ANALYZER_BANDS ? bandEnergy[band] : 0.0f;
+}
+
+/**
+ * Determines the overall level of vibration in the last block analysed, excluding gravity and other constant forces.
+ * @return the RMS acceleration, in milli-g.
+ */
+float MicroBitVibrationAnalyzer::getRMS()
+{
+    float total = 0.0f;
+
+    for (int i = 0; i < CONFIG_VIBRATION_ANALYZER_BANDS; i++)
+        total += bandEnergy[i];
+
+    return sqrtf(total);
+}
+
+/**
+ * Determines the number of times the sensor's FIFO overflowed before it could be read, each of which loses samples.
+ * @return the number of overruns since start() was called.
+ */
+uint32_t MicroBitVibrationAnalyzer::getOverrunCount()
+{
+    return overruns;
+}
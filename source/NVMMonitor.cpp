@@ -0,0 +1,199 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "NVMMonitor.h"
+#include "ErrorNo.h"
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param nvm The controller to pass operations through to.
+ */
+NVMMonitor::NVMMonitor(NVMController &nvm) : nvm(nvm)
+{
+    this->wear = NULL;
+    this->pageCount = 0;
+
+    reset();
+}
+
+/**
+ * Resets the operation and byte counters to zero. The wear held for each page is unaffected.
+ */
+void NVMMonitor::reset()
+{
+    reads = 0;
+    writes = 0;
+    erases = 0;
+    bytesRead = 0;
+    bytesWritten = 0;
+}
+
+/**
+ * Determines the number of times the given page has been erased through this monitor.
+ *
+ * @param page The index of the page, counting from the start of the flash.
+ * @return the number of erases.
+ */
+uint32_t NVMMonitor::getWear(uint32_t page)
+{
+    return page < pageCount ? wear[page] : 0;
+}
+
+/**
+ * Determines the lowest and highest number of times any page in the given range has been erased through this monitor.
+ *
+ * @param start The address of the start of the range.
+ * @param end The address of the end of the range.
+ * @param min Set to the lowest number of erases.
+ * @param max Set to the highest number of erases.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER if the range holds no pages.
+ */
+int NVMMonitor::getWearRange(uint32_t start, uint32_t end, uint32_t &min, uint32_t &max)
+{
+    uint32_t pageSize = nvm.getPageSize();
+    uint32_t first = (start - nvm.getFlashStart()) / pageSize;
+    uint32_t last = (end - nvm.getFlashStart()) / pageSize;
+
+    if (start < nvm.getFlashStart() || first >= last)
+        return DEVICE_INVALID_PARAMETER;
+
+    min = 0xFFFFFFFF;
+    max = 0;
+
+    for (uint32_t page = first; page < last; page++)
+    {
+        uint32_t w = getWear(page);
+
+        if (w < min)
+            min = w;
+
+        if (w > max)
+            max = w;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Reads a block of memory from non-volatile memory into RAM.
+ *
+ * @param dest The address in RAM in which to store the result of the read operation.
+ * @param source The logical address in non-voltile memory to read from.
+ * @param size The number 32-bit words to read.
+ */
+int NVMMonitor::read(uint32_t* dest, uint32_t source, uint32_t size)
+{
+    reads++;
+    bytesRead += size * sizeof(uint32_t);
+
+    return nvm.read(dest, source, size);
+}
+
+/**
+ * Writes data to non-volatile memory.
+ *
+ * @param dest The logical address in non-voltile memory to write to.
+ * @param source The address in RAM of the data to write.
+ * @param size The number 32-bit words to write.
+ */
+int NVMMonitor::write(uint32_t dest, uint32_t* source, uint32_t size)
+{
+    writes++;
+    bytesWritten += size * sizeof(uint32_t);
+
+    return nvm.write(dest, source, size);
+}
+
+/**
+ * Erases the given page in non-volatile memory.
+ *
+ * @param page The address of the page to erase.
+ */
+int NVMMonitor::erase(uint32_t page)
+{
+    // The geometry of some controllers is only known once the device is running, so size the wear table on first use.
+    if (wear == NULL)
+    {
+        pageCount = nvm.getFlashSize() / nvm.getPageSize();
+        wear = (uint32_t *) malloc(pageCount * sizeof(uint32_t));
+
+        if (wear)
+            memset(wear, 0, pageCount * sizeof(uint32_t));
+        else
+            pageCount = 0;
+    }
+
+    uint32_t index = (page - nvm.getFlashStart()) / nvm.getPageSize();
+
+    erases++;
+
+    if (index < pageCount)
+        wear[index]++;
+
+    return nvm.erase(page);
+}
+
+/**
+ * Returns the logical address of the start of non-volatile memory.
+ */
+uint32_t NVMMonitor::getFlashStart()
+{
+    return nvm.getFlashStart();
+}
+
+/**
+ * Returns the logical address of the end of non-volatile memory.
+ */
+uint32_t NVMMonitor::getFlashEnd()
+{
+    return nvm.getFlashEnd();
+}
+
+/**
+ * Returns the size of a page of non-volatile memory, in bytes.
+ */
+uint32_t NVMMonitor::getPageSize()
+{
+    return nvm.getPageSize();
+}
+
+/**
+ * Returns the size of non-volatile memory, in bytes.
+ */
+uint32_t NVMMonitor::getFlashSize()
+{
+    return nvm.getFlashSize();
+}
+
+/**
+ * Destructor.
+ */
+NVMMonitor::~NVMMonitor()
+{
+    free(wear);
+}
@@ -0,0 +1,378 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "OnsetDetector.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "Timer.h"
+#include "CodalCompat.h"
+#include "CodalFiber.h"
+#include "codal_target_hal.h"
+#include <math.h>
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param source The DataSource to receive audio from.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param id The ID of this component, used for events. Defaults to that of the microphone.
+ */
+OnsetDetector::OnsetDetector(DataSource &source, float sampleRate, uint16_t id) : upstream(source), fft(CONFIG_ONSET_DETECTOR_FFT_SIZE)
+{
+    this->id = id;
+    this->status = 0;
+    this->sampleRate = sampleRate;
+    this->written = 0;
+    this->countdown = CONFIG_ONSET_DETECTOR_HOP_SIZE;
+    this->pending = 0;
+    this->frameEnd = 0;
+    this->frameTime = 0;
+    this->dropped = 0;
+    this->fluxTime = 0;
+    this->meanFlux = 0.0f;
+    this->sensitivity = CONFIG_ONSET_DETECTOR_SENSITIVITY;
+    this->lastOnset = 0;
+    this->historyHead = 0;
+    this->frames = 0;
+    this->period = 0.0f;
+    this->nextBeat = 0;
+
+    memset(samples, 0, sizeof(samples));
+    memset(magnitude, 0, sizeof(magnitude));
+    memset(flux, 0, sizeof(flux));
+    memset(history, 0, sizeof(history));
+
+    if (fft.isValid())
+    {
+        status |= ONSET_DETECTOR_STATUS_ACTIVE | ONSET_DETECTOR_STATUS_FIBER;
+        create_fiber(frameFiber, this);
+    }
+
+    upstream.connect(*this);
+}
+
+/**
+ * Destructor.
+ */
+OnsetDetector::~OnsetDetector()
+{
+    status &= ~ONSET_DETECTOR_STATUS_ACTIVE;
+
+    // Wake the fiber, and wait for it to exit before our memory is released.
+    while (status & ONSET_DETECTOR_STATUS_FIBER)
+    {
+        Event(DEVICE_ID_ONSET_DETECTOR, ONSET_DETECTOR_EVT_FRAME);
+        fiber_sleep(10);
+    }
+
+    upstream.disconnect();
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int OnsetDetector::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    int format = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    if (!(status & ONSET_DETECTOR_STATUS_ACTIVE) || format == DATASTREAM_FORMAT_UNKNOWN)
+        return DEVICE_OK;
+
+    // Samples are timed relative to the end of the buffer, which has only just been delivered.
+    CODAL_TIMESTAMP now = system_timer_current_time_us();
+    float samplePeriod = 1000000.0f / sampleRate;
+    int remaining = b.length() / bytesPerSample;
+
+    uint8_t *data = &b[0];
+
+    while (remaining--)
+    {
+        samples[written & (CONFIG_ONSET_DETECTOR_BUFFER_SIZE - 1)] = max(min(StreamNormalizer::readSample[format](data), 32767), -32768);
+        written++;
+        data += bytesPerSample;
+
+        // Drop the oldest waiting frame once its first sample has been overwritten.
+        if (pending && written - (frameEnd - (pending - 1) * CONFIG_ONSET_DETECTOR_HOP_SIZE - CONFIG_ONSET_DETECTOR_FFT_SIZE) > CONFIG_ONSET_DETECTOR_BUFFER_SIZE)
+        {
+            pending--;
+            dropped++;
+        }
+
+        if (--countdown > 0)
+            continue;
+
+        countdown = CONFIG_ONSET_DETECTOR_HOP_SIZE;
+
+        // Hand the frame to the fiber. Frames are a fixed hop apart, so only the newest needs to be recorded.
+        frameEnd = written;
+        frameTime = now - (CODAL_TIMESTAMP) ((remaining + CONFIG_ONSET_DETECTOR_FFT_SIZE / 2) * samplePeriod);
+        pending++;
+
+        Event(DEVICE_ID_ONSET_DETECTOR, ONSET_DETECTOR_EVT_FRAME);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Analyses the oldest waiting frame of samples.
+ */
+void OnsetDetector::processFrame()
+{
+    const int bins = CONFIG_ONSET_DETECTOR_FFT_SIZE / 2;
+
+    // A sinusoid of amplitude A yields a bin magnitude of A.N/4 through a Hann window.
+    const float floor = CONFIG_ONSET_DETECTOR_NOISE_FLOOR * CONFIG_ONSET_DETECTOR_FFT_SIZE / 4;
+    const float compression = 1.0f / (floor * floor);
+
+    float hopTime = CONFIG_ONSET_DETECTOR_HOP_SIZE * 1000000.0f / sampleRate;
+
+    // Take a copy of the frame, so that capture can carry on over the buffer while we analyse it.
+    target_disable_irq();
+
+    uint32_t end = frameEnd - (pending - 1) * CONFIG_ONSET_DETECTOR_HOP_SIZE;
+    CODAL_TIMESTAMP time = frameTime - (CODAL_TIMESTAMP) ((pending - 1) * hopTime);
+
+    for (int i = 0; i < CONFIG_ONSET_DETECTOR_FFT_SIZE; i++)
+        re[i] = samples[(end - CONFIG_ONSET_DETECTOR_FFT_SIZE + i) & (CONFIG_ONSET_DETECTOR_BUFFER_SIZE - 1)];
+
+    pending--;
+
+    target_enable_irq();
+
+    fft.window(re);
+    fft.powerSpectrum(re, im);
+
+    // Sum the increases in log magnitude, ignoring the DC component.
+    float f = 0.0f;
+
+    for (int k = 1; k < bins; k++)
+    {
+        float m = 0.5f * logf(1.0f + re[k] * compression);
+
+        if (m > magnitude[k])
+            f += m - magnitude[k];
+
+        magnitude[k] = m;
+    }
+
+    flux[0] = flux[1];
+    flux[1] = flux[2];
+    flux[2] = f;
+
+    history[historyHead] = f;
+    historyHead = (historyHead + 1) % CONFIG_ONSET_DETECTOR_TEMPO_HISTORY;
+
+    CODAL_TIMESTAMP peakTime = fluxTime;
+    fluxTime = time;
+
+    // The previous frame is an onset if it is a local maximum that stands out from the recent average.
+    if (flux[1] > flux[0] && flux[1] >= flux[2] && flux[1] > meanFlux * sensitivity && flux[1] > 1.0f)
+    {
+        // Interpolate the position of the peak between frames.
+        float d = flux[0] - 2.0f * flux[1] + flux[2];
+        float offset = d < 0.0f ? 0.5f * (flux[0] - flux[2]) / d : 0.0f;
+        CODAL_TIMESTAMP onset = peakTime + (int64_t) (offset * hopTime);
+
+        if (lastOnset == 0 || onset > lastOnset + CONFIG_ONSET_DETECTOR_MIN_INTERVAL * 1000)
+        {
+            lastOnset = onset;
+            Event(id, ONSET_DETECTOR_EVT_ONSET, onset);
+
+            // Pull the beat phase towards onsets that fall close to a predicted beat.
+            if (period > 0.0f)
+            {
+                float error = (float) (int64_t) (onset - nextBeat);
+
+                if (error < -0.5f * period)
+                    error += period;
+
+                if (fabsf(error) < 0.2f * period)
+                    nextBeat += (int64_t) (0.25f * error);
+            }
+        }
+    }
+
+    // Track the average flux over roughly the last half second.
+    meanFlux += (f - meanFlux) * (hopTime / 500000.0f);
+
+    if (++frames >= CONFIG_ONSET_DETECTOR_TEMPO_HISTORY / 8)
+    {
+        frames = 0;
+        estimateTempo();
+    }
+
+    if (period > 0.0f && time > lastOnset + CONFIG_ONSET_DETECTOR_BEAT_TIMEOUT * 1000)
+        period = 0.0f;
+
+    // Raise any beats that fall before the end of this frame, timed where they were predicted.
+    if (period > 0.0f)
+    {
+        // Align a newly established beat with the last onset, without raising beats that are already stale.
+        if (nextBeat == 0)
+        {
+            nextBeat = lastOnset;
+
+            while (nextBeat + (CODAL_TIMESTAMP) hopTime <= time)
+                nextBeat += (CODAL_TIMESTAMP) period;
+        }
+
+        while (nextBeat <= time)
+        {
+            Event(id, ONSET_DETECTOR_EVT_BEAT, nextBeat);
+            nextBeat += (CODAL_TIMESTAMP) period;
+        }
+    }
+    else
+    {
+        nextBeat = 0;
+    }
+}
+
+/**
+ * Background fiber, processing frames as they become ready.
+ */
+void OnsetDetector::frameFiber(void *param)
+{
+    OnsetDetector *d = (OnsetDetector *) param;
+
+    while (d->status & ONSET_DETECTOR_STATUS_ACTIVE)
+    {
+        if (d->pending)
+            d->processFrame();
+        else
+            fiber_wait_for_event(DEVICE_ID_ONSET_DETECTOR, ONSET_DETECTOR_EVT_FRAME);
+    }
+
+    d->status &= ~ONSET_DETECTOR_STATUS_FIBER;
+}
+
+/**
+ * Updates the tempo estimate from the flux history.
+ */
+void OnsetDetector::estimateTempo()
+{
+    const int length = CONFIG_ONSET_DETECTOR_TEMPO_HISTORY;
+
+    float framesPerMinute = 60.0f * sampleRate / CONFIG_ONSET_DETECTOR_HOP_SIZE;
+    int minLag = max((int) (framesPerMinute / CONFIG_ONSET_DETECTOR_MAX_TEMPO), 2);
+    int maxLag = min((int) (framesPerMinute / CONFIG_ONSET_DETECTOR_MIN_TEMPO) + 1, length / 2);
+
+    if (minLag >= maxLag)
+        return;
+
+    // Remove the mean, so that the autocorrelation reflects the periodicity of the flux rather than its level.
+    float mean = 0.0f;
+    for (int i = 0; i < length; i++)
+        mean += history[i];
+    mean /= length;
+
+    float energy = 0.0f;
+    for (int i = 0; i < length; i++)
+        energy += (history[i] - mean) * (history[i] - mean);
+
+    if (energy <= 0.0f)
+    {
+        period = 0.0f;
+        return;
+    }
+
+    float score[3] = {0.0f, 0.0f, 0.0f};
+    float bestScore = 0.0f;
+    float bestLag = 0.0f;
+
+    for (int lag = minLag - 1; lag <= maxLag + 1; lag++)
+    {
+        float r = 0.0f;
+
+        for (int i = lag; i < length; i++)
+            r += (history[(historyHead + i) % length] - mean) * (history[(historyHead + i - lag) % length] - mean);
+
+        // Weight towards 120 BPM, to favour the most likely metrical level.
+        float octaves = log2f(framesPerMinute / (lag * 120.0f));
+
+        score[0] = score[1];
+        score[1] = score[2];
+        score[2] = r * expf(-octaves * octaves) / energy;
+
+        if (lag > minLag && lag <= maxLag && score[1] > bestScore && score[1] >= score[0] && score[1] >= score[2])
+        {
+            float d = score[0] - 2.0f * score[1] + score[2];
+
+            bestScore = score[1];
+            bestLag = (lag - 1) + (d < 0.0f ? 0.5f * (score[0] - score[2]) / d : 0.0f);
+        }
+    }
+
+    // Only report a tempo if the flux is clearly periodic.
+    period = bestScore > 0.1f ? bestLag * CONFIG_ONSET_DETECTOR_HOP_SIZE * 1000000.0f / sampleRate : 0.0f;
+}
+
+/**
+ * Defines how readily onsets are detected.
+ *
+ * @param sensitivity The onset threshold, as a multiple of the recent mean spectral flux. Lower values detect more onsets.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int OnsetDetector::setSensitivity(float sensitivity)
+{
+    if (sensitivity < 1.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    this->sensitivity = sensitivity;
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the current tempo estimate.
+ * @return the tempo in beats per minute, or zero if no steady beat has been detected.
+ */
+float OnsetDetector::getTempo()
+{
+    return period > 0.0f ? 60000000.0f / period : 0.0f;
+}
+
+/**
+ * Determines the time of the most recent onset.
+ * @return the time of the last onset, in microseconds, or zero if none has been detected.
+ */
+CODAL_TIMESTAMP OnsetDetector::getLastOnsetTime()
+{
+    return lastOnset;
+}
+
+/**
+ * Determines the number of frames dropped because the analysis could not keep up.
+ * @return the number of dropped frames.
+ */
+uint32_t OnsetDetector::getDroppedCount()
+{
+    return dropped;
+}
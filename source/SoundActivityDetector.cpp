@@ -0,0 +1,303 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SoundActivityDetector.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "codal_target_hal.h"
+
+using namespace codal;
+
+#define SOUND_ACTIVITY_QUEUE_SIZE   (CONFIG_SOUND_ACTIVITY_PREROLL_BUFFERS + 1)
+
+/**
+ * Constructor.
+ *
+ * @param source The DataSource to receive audio from. Samples are expected to be signed, with any DC offset removed.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param id The ID of this component, used for events.
+ */
+SoundActivityDetector::SoundActivityDetector(DataSource &source, float sampleRate, uint16_t id) : upstream(source)
+{
+    this->id = id;
+    this->downStream = NULL;
+    this->head = 0;
+    this->count = 0;
+    this->notified = 0;
+    this->dropped = 0;
+    this->sampleRate = sampleRate;
+    this->quietSamples = 0;
+
+    setThreshold(CONFIG_SOUND_ACTIVITY_THRESHOLD);
+    setMinimumLevel(CONFIG_SOUND_ACTIVITY_MINIMUM_LEVEL);
+    setHangover(CONFIG_SOUND_ACTIVITY_HANGOVER);
+
+    noiseFloor = minimumLevel;
+
+    upstream.connect(*this);
+    status |= SOUND_ACTIVITY_STATUS_CONNECTED;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int SoundActivityDetector::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(upstream.getFormat());
+
+    // A buffer of unknown format can be neither analysed nor timed against the hangover, so treat it as empty.
+    if (b.length() == 0 || bytesPerSample == 0)
+        return DEVICE_OK;
+
+    if (analyse(b))
+    {
+        quietSamples = 0;
+
+        if (!(status & SOUND_ACTIVITY_STATUS_ACTIVE))
+        {
+            status |= SOUND_ACTIVITY_STATUS_ACTIVE;
+            Event(id, SOUND_ACTIVITY_EVT_ACTIVE);
+        }
+    }
+    else if (status & SOUND_ACTIVITY_STATUS_ACTIVE)
+    {
+        quietSamples += b.length() / bytesPerSample;
+
+        if (quietSamples >= hangover)
+        {
+            status &= ~SOUND_ACTIVITY_STATUS_ACTIVE;
+            Event(id, SOUND_ACTIVITY_EVT_INACTIVE);
+        }
+    }
+
+    // Append to the queue, discarding the oldest buffer if necessary. While inactive, this simply ages out the pre-roll.
+    if (count == SOUND_ACTIVITY_QUEUE_SIZE)
+    {
+        queue[head] = ManagedBuffer();
+        head = (head + 1) % SOUND_ACTIVITY_QUEUE_SIZE;
+        count--;
+
+        if (notified)
+        {
+            notified--;
+            dropped++;
+        }
+    }
+
+    queue[(head + count) % SOUND_ACTIVITY_QUEUE_SIZE] = b;
+    count++;
+
+    if (status & SOUND_ACTIVITY_STATUS_ACTIVE)
+        release();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Analyses the given buffer, updating the activity state of this detector.
+ * @return true if the buffer contains activity, false otherwise.
+ */
+bool SoundActivityDetector::analyse(ManagedBuffer &b)
+{
+    int format = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    if (format == DATASTREAM_FORMAT_UNKNOWN)
+        return false;
+
+    uint8_t *data = &b[0];
+    int len = b.length() / bytesPerSample;
+    uint64_t sum = 0;
+    int crossings = 0;
+    int last = 0;
+
+    for (int i = 0; i < len; i++)
+    {
+        int v = StreamNormalizer::readSample[format](data);
+        data += bytesPerSample;
+
+        sum += (int64_t) v * v;
+        if ((v ^ last) < 0)
+            crossings++;
+
+        last = v;
+    }
+
+    if (len == 0)
+        return false;
+
+    uint32_t energy = (uint32_t) (sum / len);
+    uint32_t zcr = (uint32_t) (crossings * sampleRate / len);
+
+    // Voiced sound has a characteristic zero crossing rate, so can be detected at a lower energy.
+    uint64_t limit = (uint64_t) noiseFloor * threshold;
+    if (zcr >= CONFIG_SOUND_ACTIVITY_ZCR_LOW && zcr <= CONFIG_SOUND_ACTIVITY_ZCR_HIGH)
+        limit = limit / 2;
+
+    bool active = energy >= minimumLevel && ((uint64_t) energy << 8) > limit;
+
+    // Track the background level: follow decreases immediately, and increases slowly (very slowly whilst active).
+    if (energy < noiseFloor)
+        noiseFloor = max(energy, (uint32_t) 1);
+    else
+        noiseFloor += max((energy - noiseFloor) >> (active ? 8 : 4), (uint32_t) 1);
+
+    return active;
+}
+
+/**
+ * Announces any unannounced buffers to our downstream component.
+ */
+void SoundActivityDetector::release()
+{
+    // n.b. our downstream component may pull() synchronously, so re-evaluate the queue on each iteration.
+    while (downStream && notified < count)
+    {
+        notified++;
+        downStream->pullRequest();
+    }
+}
+
+/**
+ * Provide the next available ManagedBuffer to our downstream caller, if available.
+ */
+ManagedBuffer SoundActivityDetector::pull()
+{
+    ManagedBuffer b;
+
+    target_disable_irq();
+
+    if (notified > 0)
+    {
+        b = queue[head];
+        queue[head] = ManagedBuffer();
+        head = (head + 1) % SOUND_ACTIVITY_QUEUE_SIZE;
+        count--;
+        notified--;
+    }
+
+    target_enable_irq();
+
+    return b;
+}
+
+/**
+ * Define a downstream component for data stream.
+ *
+ * @sink The component that data will be delivered to, when it is availiable
+ */
+void SoundActivityDetector::connect(DataSink &sink)
+{
+    downStream = &sink;
+}
+
+/**
+ * Disconnect our downstream component.
+ */
+void SoundActivityDetector::disconnect()
+{
+    downStream = NULL;
+}
+
+/**
+ * Determine the data format of the buffers streamed out of this component.
+ */
+int SoundActivityDetector::getFormat()
+{
+    return upstream.getFormat();
+}
+
+/**
+ * Determines if activity is currently detected.
+ * @return true if buffers are currently being delivered downstream, false otherwise.
+ */
+bool SoundActivityDetector::isActive()
+{
+    return status & SOUND_ACTIVITY_STATUS_ACTIVE;
+}
+
+/**
+ * Defines the sensitivity of the detector.
+ *
+ * @param ratio The ratio of signal energy to background noise energy that indicates activity (e.g. 4.0 = 6dB).
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SoundActivityDetector::setThreshold(float ratio)
+{
+    if (ratio < 1.0f || ratio > 65536.0f)
+        return DEVICE_INVALID_PARAMETER;
+
+    threshold = (uint32_t) (ratio * 256.0f);
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the minimum level of sound considered as activity, regardless of the background noise level.
+ *
+ * @param level The minimum RMS level, in sample units.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SoundActivityDetector::setMinimumLevel(int level)
+{
+    if (level < 1 || level > 32767)
+        return DEVICE_INVALID_PARAMETER;
+
+    minimumLevel = (uint32_t) (level * level);
+    return DEVICE_OK;
+}
+
+/**
+ * Defines how long the detector remains active after activity was last detected.
+ *
+ * @param milliseconds The hangover period.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SoundActivityDetector::setHangover(int milliseconds)
+{
+    if (milliseconds < 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    hangover = (uint32_t) (sampleRate * milliseconds / 1000.0f);
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of buffers discarded while active because our downstream component did not keep up.
+ * @return the number of buffers dropped.
+ */
+uint32_t SoundActivityDetector::getDroppedCount()
+{
+    return dropped;
+}
+
+/**
+ * Destructor.
+ */
+SoundActivityDetector::~SoundActivityDetector()
+{
+    if (status & SOUND_ACTIVITY_STATUS_CONNECTED)
+        upstream.disconnect();
+}
@@ -0,0 +1,541 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SoundLevelMeter.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "CodalDmesg.h"
+#include "codal_target_hal.h"
+#include "DSPMath.h"
+#include <new>
+
+using namespace codal;
+
+// Base ten octave ratio, as defined in IEC 61260.
+#define SOUND_LEVEL_METER_OCTAVE_RATIO          1.99526231f
+
+// Highest band edge permitted at each decimation level, as a fraction of the sample rate of that level.
+#define SOUND_LEVEL_METER_DECIMATION_MARGIN     0.15f
+
+// Highest band edge permitted for the filter bank, as a fraction of the input sample rate.
+#define SOUND_LEVEL_METER_NYQUIST_MARGIN        0.45f
+
+// Pole frequencies of the A-weighting curve, as defined in IEC 61672.
+#define A_WEIGHTING_F1                          20.598997f
+#define A_WEIGHTING_F2                          107.65265f
+#define A_WEIGHTING_F3                          737.86223f
+#define A_WEIGHTING_F4                          12194.217f
+
+// Gain of the A-weighting curve at 1kHz before normalisation, in dB, as defined in IEC 61672.
+#define A_WEIGHTING_A1000                       -2.000f
+
+// Largest number of third octave frequencies the A-weighting filter is fitted to (10Hz to 20kHz).
+#define A_WEIGHTING_FIT_POINTS                  34
+
+// Number of steps taken by the search for the best fitting high frequency pole.
+#define A_WEIGHTING_FIT_STEPS                   40
+
+/**
+ * Determines the relative response of the A-weighting curve defined in IEC 61672 at the given frequency.
+ *
+ * @param f The frequency, in Hz.
+ * @return The response, in dB. Zero at 1kHz.
+ */
+static float aWeightingCurve(float f)
+{
+    float f2 = f * f;
+    float r = (A_WEIGHTING_F4 * A_WEIGHTING_F4 * f2 / (f2 + A_WEIGHTING_F4 * A_WEIGHTING_F4)) * (f2 / (f2 + A_WEIGHTING_F1 * A_WEIGHTING_F1))
+            / sqrtf((f2 + A_WEIGHTING_F2 * A_WEIGHTING_F2) * (f2 + A_WEIGHTING_F3 * A_WEIGHTING_F3));
+
+    return 20.0f * log10f(r) - A_WEIGHTING_A1000;
+}
+
+/**
+ * Determines the response of a double real pole at z = p, with unity gain at DC.
+ *
+ * @param p The position of the pole.
+ * @param w The normalised angular frequency, in radians per sample.
+ * @return The response, in dB.
+ */
+static float poleResponse(float p, float w)
+{
+    return 20.0f * log10f((1.0f - p) * (1.0f - p) / (1.0f - 2.0f * p * cosf(w) + p * p));
+}
+
+/**
+ * Determines the analog frequency that the bilinear transform maps onto the given frequency.
+ *
+ * @param sampleRate The sample rate of the digital filter, in Hz.
+ * @param f The frequency, in Hz.
+ * @return The prewarped angular frequency, in radians per second.
+ */
+static float prewarp(float sampleRate, float f)
+{
+    return 2.0f * sampleRate * tanf((float)M_PI * f / sampleRate);
+}
+
+/**
+ * Constructor.
+ *
+ * @param source The DataSource to receive audio from. Samples are expected to be signed, with any DC offset removed.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param bands The resolution of the filter bank to use.
+ * @param id The ID of this component, used for events.
+ * @param connectImmediately If true, this component will begin receiving data immediately.
+ */
+SoundLevelMeter::SoundLevelMeter(DataSource &source, float sampleRate, SoundLevelMeterBands bands, uint16_t id, bool connectImmediately) : upstream(source)
+{
+    this->id = id;
+    this->sampleRate = sampleRate;
+    this->bands = NULL;
+    this->bandCount = 0;
+    this->levels = 0;
+    this->calibration = CONFIG_SOUND_LEVEL_METER_CALIBRATION;
+    this->leqA = 0.0f;
+    this->leqZ = 0.0f;
+
+    // Build the low frequency sections of the A-weighting filter from its analog prototype, prewarped so that
+    // the bilinear transform places their poles at the frequencies defined in IEC 61672.
+    float w1 = prewarp(sampleRate, A_WEIGHTING_F1);
+    float w2 = prewarp(sampleRate, A_WEIGHTING_F2);
+    float w3 = prewarp(sampleRate, A_WEIGHTING_F3);
+
+    aWeighting[0].setAnalogCoefficients(sampleRate, 1.0f, 0.0f, 0.0f, 1.0f, 2.0f * w1, w1 * w1);
+    aWeighting[1].setAnalogCoefficients(sampleRate, 1.0f, 0.0f, 0.0f, 1.0f, w2 + w3, w2 * w3);
+
+    // The double pole at F4 lies above, or close to, the Nyquist frequency at the sample rates of a microphone, where
+    // the bilinear transform cannot place it. Use a double real pole in the z-plane instead, positioned to fit the curve.
+    float p = fitAWeighting();
+    aWeighting[2].setCoefficients((1.0f - p) * (1.0f - p), 0.0f, 0.0f, 1.0f, -2.0f * p, p * p);
+
+    // Normalise to unity gain at 1kHz.
+    float gain = 1.0f;
+    for (int i = 0; i < 3; i++)
+        gain *= aWeighting[i].getGain(sampleRate, 1000.0f);
+
+    aWeighting[2].scale(1.0f / gain);
+
+    setWindow(CONFIG_SOUND_LEVEL_METER_DEFAULT_WINDOW);
+    setBands(bands);
+
+    if (connectImmediately)
+    {
+        upstream.connect(*this);
+        status |= SOUND_LEVEL_METER_STATUS_ACTIVE;
+    }
+}
+
+/**
+ * Positions the high frequency pole of the A-weighting filter to best fit the curve defined in IEC 61672.
+ * The error at the worst fitting third octave frequency up to SOUND_LEVEL_METER_NYQUIST_MARGIN of the sample rate
+ * is minimised, with the low frequency sections already in place.
+ *
+ * @return The position of the double real pole in the z-plane.
+ */
+float SoundLevelMeter::fitAWeighting()
+{
+    float w[A_WEIGHTING_FIT_POINTS];
+    float target[A_WEIGHTING_FIT_POINTS];
+    int points = 0;
+
+    // The response of the low frequency sections, relative to 1kHz, is subtracted from the curve up front.
+    float reference = 20.0f * log10f(aWeighting[0].getGain(sampleRate, 1000.0f) * aWeighting[1].getGain(sampleRate, 1000.0f));
+
+    for (int k = -20; points < A_WEIGHTING_FIT_POINTS; k++)
+    {
+        float f = 1000.0f * powf(SOUND_LEVEL_METER_OCTAVE_RATIO, k / 3.0f);
+
+        if (f > SOUND_LEVEL_METER_NYQUIST_MARGIN * sampleRate)
+            break;
+
+        w[points] = 2.0f * (float)M_PI * f / sampleRate;
+        target[points] = aWeightingCurve(f) - 20.0f * log10f(aWeighting[0].getGain(sampleRate, f) * aWeighting[1].getGain(sampleRate, f)) + reference;
+        points++;
+    }
+
+    // The worst case error is unimodal in the position of the pole, so narrow in on its minimum.
+    float w1000 = 2.0f * (float)M_PI * 1000.0f / sampleRate;
+    float lo = -0.9f;
+    float hi = 0.9f;
+
+    for (int step = 0; step < A_WEIGHTING_FIT_STEPS; step++)
+    {
+        float p[2] = {lo + (hi - lo) / 3.0f, hi - (hi - lo) / 3.0f};
+        float error[2] = {0.0f, 0.0f};
+
+        for (int j = 0; j < 2; j++)
+        {
+            float g = poleResponse(p[j], w1000);
+
+            for (int i = 0; i < points; i++)
+            {
+                float e = fabsf(poleResponse(p[j], w[i]) - g - target[i]);
+                if (e > error[j])
+                    error[j] = e;
+            }
+        }
+
+        if (error[0] < error[1])
+            hi = p[1];
+        else
+            lo = p[0];
+    }
+
+    return (lo + hi) / 2.0f;
+}
+
+/**
+ * Defines the resolution of the filter bank. Any partially integrated data is discarded.
+ *
+ * @param bands SoundLevelMeterBands::None, SoundLevelMeterBands::Octave or SoundLevelMeterBands::ThirdOctave.
+ * @return DEVICE_OK on success, or DEVICE_NO_RESOURCES if the filter bank could not be allocated.
+ */
+int SoundLevelMeter::setBands(SoundLevelMeterBands bands)
+{
+    int fraction = (int) bands;
+    int count = 0;
+    int first = 0;
+    SoundLevelMeterBand *b = NULL;
+
+    if (fraction)
+    {
+        // Determine the range of nominal band indexes (relative to 1kHz) that fit within the sample rate of the input.
+        // Bands are numbered such that the centre frequency of band x is 1000 * G^(x/fraction).
+        float g = logf(SOUND_LEVEL_METER_OCTAVE_RATIO);
+        int lowest = (int) ceilf(fraction * logf(CONFIG_SOUND_LEVEL_METER_MIN_FREQUENCY / 1000.0f) / g);
+
+        first = (int) floorf(fraction * logf(SOUND_LEVEL_METER_NYQUIST_MARGIN * sampleRate / 1000.0f) / g - 0.5f);
+        count = max(first - lowest + 1, 0);
+
+        if (count)
+        {
+            b = (SoundLevelMeterBand *) malloc(sizeof(SoundLevelMeterBand) * count);
+            if (b == NULL)
+                return DEVICE_NO_RESOURCES;
+        }
+    }
+
+    int newLevels = 1;
+    float sectionQ = sqrtf(powf(2.0f, 1.0f / CONFIG_SOUND_LEVEL_METER_BAND_SECTIONS) - 1.0f);
+
+    for (int i = 0; i < count; i++)
+    {
+        float x = (float)(first - i) / fraction;
+        float fm = 1000.0f * powf(SOUND_LEVEL_METER_OCTAVE_RATIO, x);
+        float f1 = fm * powf(SOUND_LEVEL_METER_OCTAVE_RATIO, -0.5f / fraction);
+        float f2 = fm * powf(SOUND_LEVEL_METER_OCTAVE_RATIO, 0.5f / fraction);
+
+        // Process each band at the lowest sample rate that safely contains it.
+        int level = 0;
+        while (level + 1 < CONFIG_SOUND_LEVEL_METER_DECIMATION_LEVELS && f2 < SOUND_LEVEL_METER_DECIMATION_MARGIN * sampleRate / (1 << (level + 1)))
+            level++;
+
+        new (&b[i]) SoundLevelMeterBand;
+        b[i].frequency = fm;
+        b[i].level = level;
+        b[i].energy = 0;
+        b[i].samples = 0;
+        b[i].leq = 0.0f;
+
+        // n identical sections narrow the bandwidth of the cascade, so widen each to compensate.
+        for (int s = 0; s < CONFIG_SOUND_LEVEL_METER_BAND_SECTIONS; s++)
+            b[i].filter[s].setBandPass(sampleRate / (1 << level), fm, sectionQ * fm / (f2 - f1));
+
+        newLevels = max(newLevels, level + 1);
+    }
+
+    // Configure the anti-alias filters used by each decimation stage (4th order Butterworth). These are built aside,
+    // as process() may be using the current ones until the new filter bank is swapped in.
+    BiquadFilter d[CONFIG_SOUND_LEVEL_METER_DECIMATION_LEVELS][2];
+
+    for (int l = 1; l < newLevels; l++)
+    {
+        float rate = sampleRate / (1 << (l - 1));
+        d[l][0].setLowPass(rate, rate / 8.0f, 0.5412f);
+        d[l][1].setLowPass(rate, rate / 8.0f, 1.3066f);
+    }
+
+    // Swap in the new filter bank, and restart the broadband window so that it stays aligned with the bands.
+    target_disable_irq();
+    SoundLevelMeterBand *old = this->bands;
+    this->bands = b;
+    this->bandCount = count;
+    this->levels = newLevels;
+    this->samples = 0;
+    this->energyA = 0;
+    this->energyZ = 0;
+
+    for (int l = 1; l < newLevels; l++)
+    {
+        decimator[l][0] = d[l][0];
+        decimator[l][1] = d[l][1];
+        phase[l] = false;
+    }
+
+    target_enable_irq();
+
+    if (old)
+        free(old);
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the integration period over which Leq values are calculated. Any partially integrated data is discarded.
+ *
+ * @param milliseconds The length of the window, in milliseconds.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SoundLevelMeter::setWindow(int milliseconds)
+{
+    if (milliseconds <= 0)
+        return DEVICE_INVALID_PARAMETER;
+
+    uint32_t length = max((uint32_t)(sampleRate * milliseconds / 1000.0f), (uint32_t) 1);
+
+    // process() updates the integrators from interrupt context.
+    target_disable_irq();
+    windowSamples = length;
+    samples = 0;
+    energyA = 0;
+    energyZ = 0;
+
+    for (int i = 0; i < bandCount; i++)
+    {
+        bands[i].energy = 0;
+        bands[i].samples = 0;
+    }
+
+    target_enable_irq();
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the sound pressure level that corresponds to a full scale RMS input signal.
+ *
+ * @param spl The calibration level, in dB SPL.
+ */
+void SoundLevelMeter::setCalibration(float spl)
+{
+    calibration = spl;
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int SoundLevelMeter::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+    int format = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    if (format == DATASTREAM_FORMAT_UNKNOWN || b.length() == 0)
+        return DEVICE_OK;
+
+    uint8_t *data = &b[0];
+    int len = b.length() / bytesPerSample;
+
+    while (len)
+    {
+        int l = min(len, CONFIG_SOUND_LEVEL_METER_CHUNK_SIZE);
+
+        // Normalise into the working buffer, leaving 8 bits of headroom for filtering.
+        for (int i = 0; i < l; i++)
+        {
+            chunk[i] = StreamNormalizer::readSample[format](data) * 256;
+            data += bytesPerSample;
+        }
+
+        process(l);
+        len -= l;
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Passes a block of samples through the weighting filters and filter bank.
+ *
+ * @param len the number of samples held in the working buffer.
+ */
+void SoundLevelMeter::process(int len)
+{
+    // Broadband measurements are taken at the full sample rate.
+    for (int i = 0; i < len; i++)
+    {
+        int32_t z = chunk[i] >> 8;
+        int32_t a = aWeighting[2].process(aWeighting[1].process(aWeighting[0].process(chunk[i]))) >> 8;
+
+        energyZ += (int64_t) z * z;
+        energyA += (int64_t) a * a;
+    }
+
+    samples += len;
+
+    // Bands are ordered by frequency, and hence by decimation level.
+    int band = 0;
+    for (int level = 0; level < levels && len > 0; level++)
+    {
+        if (level > 0)
+        {
+            // Low pass filter, and then drop alternate samples.
+            int out = 0;
+            for (int i = 0; i < len; i++)
+            {
+                int32_t v = decimator[level][1].process(decimator[level][0].process(chunk[i]));
+
+                if (phase[level])
+                    chunk[out++] = v;
+
+                phase[level] = !phase[level];
+            }
+            len = out;
+        }
+
+        while (band < bandCount && bands[band].level == level)
+        {
+            SoundLevelMeterBand &b = bands[band];
+
+            for (int i = 0; i < len; i++)
+            {
+                int32_t v = chunk[i];
+
+                for (int s = 0; s < CONFIG_SOUND_LEVEL_METER_BAND_SECTIONS; s++)
+                    v = b.filter[s].process(v);
+
+                v >>= 8;
+                b.energy += (int64_t) v * v;
+            }
+
+            b.samples += len;
+            band++;
+        }
+    }
+
+    if (samples >= windowSamples)
+        publish();
+}
+
+/**
+ * Converts a mean square value into a calibrated sound level.
+ */
+float SoundLevelMeter::toDecibels(uint64_t energy, uint32_t samples)
+{
+    if (energy == 0 || samples == 0)
+        return 0.0f;
+
+    // Full scale for a normalised 16 bit stream is 32768, i.e. 90.3dB relative to a unit sample.
+    return 10.0f * log10f((float) energy / (float) samples) - 90.309f + calibration;
+}
+
+/**
+ * Calculates and publishes the Leq values for the current window, and resets the integrators.
+ */
+void SoundLevelMeter::publish()
+{
+    leqA = toDecibels(energyA, samples);
+    leqZ = toDecibels(energyZ, samples);
+
+    for (int i = 0; i < bandCount; i++)
+    {
+        bands[i].leq = toDecibels(bands[i].energy, bands[i].samples);
+        bands[i].energy = 0;
+        bands[i].samples = 0;
+    }
+
+    energyA = 0;
+    energyZ = 0;
+    samples = 0;
+
+    Event(id, SOUND_LEVEL_METER_EVT_UPDATE);
+}
+
+/**
+ * Determines the most recent A-weighted equivalent continuous sound level.
+ * @return The LAeq over the last complete window, in dB.
+ */
+float SoundLevelMeter::getLeqA()
+{
+    return leqA;
+}
+
+/**
+ * Determines the most recent unweighted equivalent continuous sound level.
+ * @return The LZeq over the last complete window, in dB.
+ */
+float SoundLevelMeter::getLeqZ()
+{
+    return leqZ;
+}
+
+/**
+ * Determines the number of bands in the filter bank.
+ * @return the number of bands available.
+ */
+int SoundLevelMeter::getBandCount()
+{
+    return bandCount;
+}
+
+/**
+ * Determines the nominal centre frequency of the given band.
+ *
+ * @param band The index of the band, where band 0 is the highest frequency band.
+ * @return the centre frequency of the band in Hz, or zero if the band does not exist.
+ */
+float SoundLevelMeter::getBandFrequency(int band)
+{
+    if (band < 0 || band >= bandCount)
+        return 0.0f;
+
+    return bands[band].frequency;
+}
+
+/**
+ * Determines the most recent equivalent continuous sound level of the given band.
+ *
+ * @param band The index of the band, where band 0 is the highest frequency band.
+ * @return The Leq of the band over the last complete window, in dB, or zero if the band does not exist.
+ */
+float SoundLevelMeter::getBandLeq(int band)
+{
+    if (band < 0 || band >= bandCount)
+        return 0.0f;
+
+    return bands[band].leq;
+}
+
+/**
+ * Destructor.
+ */
+SoundLevelMeter::~SoundLevelMeter()
+{
+    if (status & SOUND_LEVEL_METER_STATUS_ACTIVE)
+        upstream.disconnect();
+
+    if (bands)
+        free(bands);
+}
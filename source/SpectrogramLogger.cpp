@@ -0,0 +1,232 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SpectrogramLogger.h"
+#include "StreamNormalizer.h"
+#include "ErrorNo.h"
+#include "Event.h"
+#include "Timer.h"
+#include "CodalFiber.h"
+#include "CodalCompat.h"
+#include <math.h>
+
+using namespace codal;
+
+/**
+ * Constructor.
+ *
+ * @param source The DataSource to receive audio from.
+ * @param log The log to write spectra into.
+ * @param sampleRate The sample rate of the given source, in Hz.
+ * @param id The ID of this component, used for events.
+ */
+SpectrogramLogger::SpectrogramLogger(DataSource &source, MicroBitLog &log, int sampleRate, uint16_t id) : upstream(source), log(log), fft(CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE)
+{
+    this->id = id;
+    this->status = 0;
+    this->sampleRate = sampleRate;
+    this->historyHead = 0;
+    this->frameTime = 0;
+    this->dropped = 0;
+
+    memset(history, 0, sizeof(history));
+    setFrameRate(CONFIG_SPECTROGRAM_LOGGER_FRAME_RATE);
+
+    upstream.connect(*this);
+}
+
+/**
+ * Callback provided when data is ready.
+ */
+int SpectrogramLogger::pullRequest()
+{
+    ManagedBuffer b = upstream.pull();
+
+    int format = upstream.getFormat();
+    int bytesPerSample = DATASTREAM_FORMAT_BYTES_PER_SAMPLE(format);
+
+    if (!(status & SPECTROGRAM_LOGGER_STATUS_ACTIVE) || format == DATASTREAM_FORMAT_UNKNOWN)
+        return DEVICE_OK;
+
+    uint8_t *data = &b[0];
+    uint8_t *end = data + b.length();
+
+    while (data < end)
+    {
+        history[historyHead] = max(min(StreamNormalizer::readSample[format](data), 32767), -32768);
+        historyHead = (historyHead + 1) & (CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE - 1);
+        data += bytesPerSample;
+
+        if (--countdown > 0)
+            continue;
+
+        countdown = hop;
+
+        // Hand the most recent samples to the fiber, unless it is still busy with the previous frame.
+        if (status & SPECTROGRAM_LOGGER_STATUS_FRAME_READY)
+        {
+            dropped++;
+            continue;
+        }
+
+        for (int i = 0; i < CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE; i++)
+            re[i] = history[(historyHead + i) & (CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE - 1)];
+
+        frameTime = (uint32_t) system_timer_current_time();
+        status |= SPECTROGRAM_LOGGER_STATUS_FRAME_READY;
+        Event(id, SPECTROGRAM_LOGGER_EVT_FRAME);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Computes the spectrum of the pending frame, and writes it to the log.
+ */
+void SpectrogramLogger::processFrame()
+{
+    const int bins = CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE / 2;
+
+    // A sinusoid of amplitude A yields a bin magnitude of A.N/4 through a Hann window.
+    const float offset = 20.0f * log10f(4.0f / CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE);
+
+    record[0] = frameTime & 0xFF;
+    record[1] = (frameTime >> 8) & 0xFF;
+    record[2] = (frameTime >> 16) & 0xFF;
+    record[3] = (frameTime >> 24) & 0xFF;
+    record[4] = sampleRate & 0xFF;
+    record[5] = (sampleRate >> 8) & 0xFF;
+    record[6] = CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE & 0xFF;
+    record[7] = (CONFIG_SPECTROGRAM_LOGGER_FFT_SIZE >> 8) & 0xFF;
+
+    fft.window(re);
+    fft.powerSpectrum(re, im);
+
+    for (int k = 0; k < bins; k++)
+    {
+        int level = re[k] > 0.0f ? (int) (2.0f * (10.0f * log10f(re[k]) + offset) + 0.5f) : 0;
+        record[SPECTROGRAM_LOGGER_RECORD_HEADER_SIZE + k] = max(min(level, 255), 0);
+    }
+
+    // The sample buffer is free once the spectrum is computed, so capture can continue while we write to storage.
+    status &= ~SPECTROGRAM_LOGGER_STATUS_FRAME_READY;
+
+    log.logBinary(SPECTROGRAM_LOGGER_RECORD_TYPE, record, sizeof(record));
+}
+
+/**
+ * Background fiber, processing frames as they become ready.
+ */
+void SpectrogramLogger::frameFiber(void *param)
+{
+    SpectrogramLogger *s = (SpectrogramLogger *) param;
+
+    while (s->status & SPECTROGRAM_LOGGER_STATUS_ACTIVE)
+    {
+        if (s->status & SPECTROGRAM_LOGGER_STATUS_FRAME_READY)
+            s->processFrame();
+        else
+            fiber_wait_for_event(s->id, SPECTROGRAM_LOGGER_EVT_FRAME);
+    }
+
+    s->status &= ~(SPECTROGRAM_LOGGER_STATUS_FIBER | SPECTROGRAM_LOGGER_STATUS_FRAME_READY);
+}
+
+/**
+ * Begins logging spectral frames.
+ * @return DEVICE_OK on success.
+ */
+int SpectrogramLogger::start()
+{
+    if (!fft.isValid())
+        return DEVICE_NO_RESOURCES;
+
+    if (status & SPECTROGRAM_LOGGER_STATUS_ACTIVE)
+        return DEVICE_OK;
+
+    countdown = hop;
+    status |= SPECTROGRAM_LOGGER_STATUS_ACTIVE;
+
+    if (!(status & SPECTROGRAM_LOGGER_STATUS_FIBER))
+    {
+        status |= SPECTROGRAM_LOGGER_STATUS_FIBER;
+        create_fiber(frameFiber, this);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Stops logging spectral frames.
+ * Waits for any frame being written to complete.
+ * @return DEVICE_OK on success.
+ */
+int SpectrogramLogger::stop()
+{
+    status &= ~SPECTROGRAM_LOGGER_STATUS_ACTIVE;
+
+    // Wake the fiber, and wait for it to exit, as it may still be writing a frame.
+    while (status & SPECTROGRAM_LOGGER_STATUS_FIBER)
+    {
+        Event(id, SPECTROGRAM_LOGGER_EVT_FRAME);
+        fiber_sleep(10);
+    }
+
+    return DEVICE_OK;
+}
+
+/**
+ * Defines the number of frames logged per second.
+ *
+ * @param framesPerSecond The frame rate, between 1 and the sample rate.
+ * @return DEVICE_OK on success, or DEVICE_INVALID_PARAMETER.
+ */
+int SpectrogramLogger::setFrameRate(int framesPerSecond)
+{
+    if (framesPerSecond < 1 || framesPerSecond > sampleRate)
+        return DEVICE_INVALID_PARAMETER;
+
+    hop = sampleRate / framesPerSecond;
+    countdown = hop;
+
+    return DEVICE_OK;
+}
+
+/**
+ * Determines the number of frames dropped because the log could not keep up.
+ * @return the number of dropped frames.
+ */
+uint32_t SpectrogramLogger::getDroppedCount()
+{
+    return dropped;
+}
+
+/**
+ * Destructor.
+ */
+SpectrogramLogger::~SpectrogramLogger()
+{
+    stop();
+    upstream.disconnect();
+}
@@ -0,0 +1,188 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Loops AcousticModemTransmitter back into AcousticModemReceiver through a simulated acoustic channel, at several
+ * signal to noise ratios. The transmitter's 44.1kHz output is resampled to the sample rate of the micro:bit microphone,
+ * attenuated, offset, and has white Gaussian noise added at the given ratio to the power of the transmission, before
+ * being delivered in microphone sized buffers after a random delay. Checks that frames are received intact down to
+ * 0dB, that most are received at -3dB, and that no corrupted frame is ever delivered.
+ */
+
+#include "AcousticModem.h"
+#include "HostTest.h"
+#include <random>
+#include <vector>
+
+#define TEST_FRAMES                 20
+#define TEST_PAYLOAD                40
+#define TEST_BUFFER_SAMPLES         256
+#define TEST_MAX_DELAY              4000
+#define TEST_TAIL                   8000
+#define TEST_SEED                   1
+
+class Microphone : public DataSource
+{
+    public:
+    ManagedBuffer next;
+
+    virtual ManagedBuffer pull() override
+    {
+        return next;
+    }
+
+    virtual int getFormat() override
+    {
+        return DATASTREAM_FORMAT_16BIT_SIGNED;
+    }
+};
+
+// Gaussian noise of unit variance (Box-Muller), drawn from the given generator so that runs are repeatable.
+static double gaussian(std::mt19937 &rng)
+{
+    double u1 = (rng() + 0.5) / 4294967296.0;
+    double u2 = (rng() + 0.5) / 4294967296.0;
+
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// Transmits the given payload, and returns the signal as captured by the microphone before noise is added.
+static std::vector<double> transmit(ManagedBuffer payload, std::mt19937 &rng)
+{
+    AcousticModemTransmitter tx;
+    std::vector<double> output(rng() % TEST_MAX_DELAY, 0.0);
+    std::vector<double> captured;
+
+    tx.send(payload);
+
+    // The output is centred on 512, as the micro:bit speaker expects.
+    while (tx.isTransmitting())
+    {
+        ManagedBuffer b = tx.pull();
+        uint16_t *data = (uint16_t *) &b[0];
+
+        for (int i = 0; i < b.length() / 2; i++)
+            output.push_back(data[i] - 512.0);
+    }
+
+    output.resize(output.size() + TEST_TAIL, 0.0);
+
+    // Resample with a four sample boxcar and linear interpolation, as a slower ADC would. The ratio is not a whole
+    // number, so symbol timing drifts against the receiver's sample clock.
+    double step = (double) CONFIG_ACOUSTIC_MODEM_TX_SAMPLE_RATE / CONFIG_ACOUSTIC_MODEM_RX_SAMPLE_RATE;
+
+    for (double position = 0.0; position + 5 < output.size(); position += step)
+    {
+        int i = (int) position;
+        double f = position - i;
+        double v = 0.0;
+
+        for (int k = 0; k < 4; k++)
+            v += output[i + k] * (1.0 - f) + output[i + k + 1] * f;
+
+        captured.push_back(v / 4.0 * 0.2);
+    }
+
+    return captured;
+}
+
+static void run(double snr)
+{
+    char label[32];
+    std::mt19937 rng(TEST_SEED);
+    int received = 0;
+    int corrupted = 0;
+    uint32_t errors = 0;
+
+    snprintf(label, sizeof(label), "SNR %+.0fdB", snr);
+
+    for (int t = 0; t < TEST_FRAMES; t++)
+    {
+        uint8_t payload[TEST_PAYLOAD];
+        for (int i = 0; i < TEST_PAYLOAD; i++)
+            payload[i] = rng();
+
+        std::vector<double> signal = transmit(ManagedBuffer(payload, TEST_PAYLOAD), rng);
+
+        // Noise is scaled to the power of the transmission itself, rather than of the silence around it.
+        double power = 0.0;
+        int active = 0;
+        for (double v : signal)
+        {
+            if (v != 0.0)
+            {
+                power += v * v;
+                active++;
+            }
+        }
+
+        double sigma = sqrt(power / active / pow(10.0, snr / 10.0));
+
+        Microphone mic;
+        AcousticModemReceiver rx(mic);
+
+        for (size_t i = 0; i < signal.size(); i += TEST_BUFFER_SAMPLES)
+        {
+            ManagedBuffer b(TEST_BUFFER_SAMPLES * 2);
+            int16_t *data = (int16_t *) &b[0];
+
+            for (int k = 0; k < TEST_BUFFER_SAMPLES; k++)
+            {
+                double v = (i + k < signal.size() ? signal[i + k] : 0.0) + sigma * gaussian(rng) + 100.0;
+                data[k] = (int16_t) std::max(-32768.0, std::min(32767.0, v * 64.0));
+            }
+
+            mic.next = b;
+            rx.pullRequest();
+        }
+
+        errors += rx.getErrorCount();
+
+        while (rx.available())
+        {
+            ManagedBuffer frame = rx.recv();
+
+            if (frame.length() == TEST_PAYLOAD && memcmp(&frame[0], payload, TEST_PAYLOAD) == 0)
+                received++;
+            else
+                corrupted++;
+        }
+    }
+
+    printf("%-10s %2d/%d frames received, %u rejected, %d corrupted\n", label, received, TEST_FRAMES, (unsigned) errors, corrupted);
+
+    check(corrupted == 0, label, "a corrupted frame was delivered");
+    check(snr < 0.0 || received == TEST_FRAMES, label, "frames were lost above 0dB");
+    check(snr < -3.0 || received * 5 >= TEST_FRAMES * 4, label, "fewer than 80% of frames were received at -3dB");
+}
+
+int main()
+{
+    run(3.0);
+    run(0.0);
+    run(-3.0);
+    run(-6.0);
+
+    return failures ? 1 : 0;
+}
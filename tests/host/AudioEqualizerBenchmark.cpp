@@ -0,0 +1,241 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Measures the per sample cost of AudioEqualizer on the host, in time and (on x86) timestamp counter cycles, with
+ * each number of active filter sections, on 10 bit NRF52PWM style buffers at 44.1kHz. Before that, checks that a
+ * fully bypassed equalizer passes buffers through untouched, and that the response of a typical speaker chain
+ * measured with pure tones matches the response of its filter sections as designed, with the polarity bit kept.
+ * The cost with no active sections is that of copying each buffer from the source, which the others also include.
+ * Exits with a non-zero status if any check fails.
+ */
+
+#include "AudioEqualizer.h"
+#include "HostTest.h"
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TEST_HAS_CYCLE_COUNTER      1
+#endif
+
+#define TEST_SAMPLE_RATE            44100
+#define TEST_RANGE                  1023
+#define TEST_BUFFER_SAMPLES         256
+#define TEST_AMPLITUDE              200
+#define TEST_POLARITY               0x8000
+#define TEST_SETTLE_BUFFERS         100
+#define TEST_MEASURE_BUFFERS        100
+#define TEST_BENCHMARK_BUFFERS      20000
+
+// Largest difference permitted between the measured and designed response, in dB.
+#define TEST_RESPONSE_TOLERANCE     0.2
+
+class Tone : public DataSource
+{
+    public:
+    double frequency;
+    long n;
+
+    Tone() : frequency(1000.0), n(0) {}
+
+    virtual ManagedBuffer pull() override
+    {
+        ManagedBuffer b(TEST_BUFFER_SAMPLES * 2);
+        uint16_t *data = (uint16_t *) &b[0];
+
+        for (int i = 0; i < TEST_BUFFER_SAMPLES; i++, n++)
+            data[i] = (uint16_t) lround(TEST_RANGE / 2 + TEST_AMPLITUDE * sin(2.0 * M_PI * frequency * n / TEST_SAMPLE_RATE)) | TEST_POLARITY;
+
+        return b;
+    }
+
+    virtual int getFormat() override
+    {
+        return DATASTREAM_FORMAT_16BIT_UNSIGNED;
+    }
+};
+
+// Replays a copy of the same buffer, so that the cost of generating audio is not measured.
+class Loop : public DataSource
+{
+    public:
+    ManagedBuffer buffer;
+
+    virtual ManagedBuffer pull() override
+    {
+        return ManagedBuffer(&buffer[0], buffer.length());
+    }
+
+    virtual int getFormat() override
+    {
+        return DATASTREAM_FORMAT_16BIT_UNSIGNED;
+    }
+};
+
+// The speaker chain measured: a low cut, a presence peak, a treble cut and an anti-alias filter.
+static void configure(AudioEqualizer &eq, BiquadFilter *design, int sections)
+{
+    eq.clear();
+
+    if (sections > 0)
+    {
+        eq.setFilter(0, AudioFilterType::HighPass, 300.0f);
+        design[0].setHighPass(TEST_SAMPLE_RATE, 300.0f, 0.7071f);
+    }
+
+    if (sections > 1)
+    {
+        eq.setFilter(1, AudioFilterType::Peaking, 2000.0f, 1.0f, 6.0f);
+        design[1].setPeaking(TEST_SAMPLE_RATE, 2000.0f, 1.0f, 6.0f);
+    }
+
+    if (sections > 2)
+    {
+        eq.setFilter(2, AudioFilterType::HighShelf, 8000.0f, 0.7071f, -6.0f);
+        design[2].setHighShelf(TEST_SAMPLE_RATE, 8000.0f, 0.7071f, -6.0f);
+    }
+
+    if (sections > 3)
+    {
+        eq.setFilter(3, AudioFilterType::LowPass, 15000.0f);
+        design[3].setLowPass(TEST_SAMPLE_RATE, 15000.0f, 0.7071f);
+    }
+}
+
+// Measures the gain of the equalizer at the given frequency, in dB. Returns false if the polarity bit was lost.
+static bool measure(AudioEqualizer &eq, Tone &tone, double frequency, double &gain)
+{
+    double energy = 0.0;
+    bool polarity = true;
+
+    tone.frequency = frequency;
+    tone.n = 0;
+
+    for (int k = 0; k < TEST_SETTLE_BUFFERS + TEST_MEASURE_BUFFERS; k++)
+    {
+        ManagedBuffer b = eq.pull();
+        uint16_t *data = (uint16_t *) &b[0];
+
+        for (int i = 0; k >= TEST_SETTLE_BUFFERS && i < TEST_BUFFER_SAMPLES; i++)
+        {
+            double v = (data[i] & ~TEST_POLARITY) - TEST_RANGE / 2;
+            energy += v * v;
+            polarity = polarity && (data[i] & TEST_POLARITY);
+        }
+    }
+
+    gain = 10.0 * log10(energy / (TEST_MEASURE_BUFFERS * TEST_BUFFER_SAMPLES) / (TEST_AMPLITUDE * TEST_AMPLITUDE / 2.0));
+    return polarity;
+}
+
+static void testBypass()
+{
+    const char *label = "bypass";
+    Tone tone;
+    AudioEqualizer eq(tone, TEST_SAMPLE_RATE, TEST_RANGE);
+    eq.setOrMask(TEST_POLARITY);
+
+    ManagedBuffer in = tone.pull();
+    tone.n = 0;
+    ManagedBuffer out = eq.pull();
+
+    check(out.length() == in.length() && memcmp(&out[0], &in[0], in.length()) == 0, label, "buffers were modified with every section bypassed");
+}
+
+static void testResponse()
+{
+    const char *label = "response";
+    static const double frequencies[] = {100.0, 300.0, 1000.0, 2000.0, 8000.0, 14000.0, 18000.0};
+    Tone tone;
+    AudioEqualizer eq(tone, TEST_SAMPLE_RATE, TEST_RANGE);
+    BiquadFilter design[CONFIG_AUDIO_EQUALIZER_SECTIONS];
+
+    eq.setOrMask(TEST_POLARITY);
+    configure(eq, design, CONFIG_AUDIO_EQUALIZER_SECTIONS);
+
+    for (double f : frequencies)
+    {
+        double gain;
+        double expected = 0.0;
+
+        for (int i = 0; i < CONFIG_AUDIO_EQUALIZER_SECTIONS; i++)
+            expected += 20.0 * log10(design[i].getGain(TEST_SAMPLE_RATE, f));
+
+        bool polarity = measure(eq, tone, f, gain);
+        printf("%-10s %6.0fHz %+7.2fdB (designed %+7.2fdB)\n", label, f, gain, expected);
+
+        check(polarity, label, "the polarity bit was not kept");
+        check(fabs(gain - expected) <= TEST_RESPONSE_TOLERANCE, label, "the measured response differs from the design");
+    }
+}
+
+static void benchmark()
+{
+    Tone tone;
+    Loop loop;
+    loop.buffer = tone.pull();
+
+    AudioEqualizer eq(loop, TEST_SAMPLE_RATE, TEST_RANGE);
+    BiquadFilter design[CONFIG_AUDIO_EQUALIZER_SECTIONS];
+
+    eq.setOrMask(TEST_POLARITY);
+
+    for (int sections = 0; sections <= CONFIG_AUDIO_EQUALIZER_SECTIONS; sections++)
+    {
+        configure(eq, design, sections);
+
+        double elapsed = 0;
+        uint64_t cycles = 0;
+
+        for (int b = 0; b < TEST_BENCHMARK_BUFFERS; b++)
+        {
+            auto start = std::chrono::steady_clock::now();
+#if TEST_HAS_CYCLE_COUNTER
+            uint64_t c = __rdtsc();
+#endif
+            eq.pull();
+#if TEST_HAS_CYCLE_COUNTER
+            cycles += __rdtsc() - c;
+#endif
+            elapsed += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        double samples = (double) TEST_BENCHMARK_BUFFERS * TEST_BUFFER_SAMPLES;
+        printf("sections=%d %6.2f ns/sample", sections, elapsed / samples);
+#if TEST_HAS_CYCLE_COUNTER
+        printf(", %6.1f TSC cycles/sample", cycles / samples);
+#endif
+        printf("\n");
+    }
+}
+
+int main()
+{
+    testBypass();
+    testResponse();
+    benchmark();
+
+    return failures ? 1 : 0;
+}
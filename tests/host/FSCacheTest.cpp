@@ -0,0 +1,135 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Checks the replacement policy of FSCache: that a block holding data not yet written to flash is never discarded,
+ * even when writing it back fails, and that read ahead only replaces the least recently used block of each set, and
+ * only if that is no more recent than the block replaced by the miss itself. Exits with a non-zero status if any check fails.
+ */
+
+#include "FSCache.h"
+#include "MockNVMController.h"
+#include "HostTest.h"
+
+#define TEST_BLOCK_SIZE             1024
+
+static uint32_t block(int n)
+{
+    return n * TEST_BLOCK_SIZE;
+}
+
+// A dirty block whose write back fails is kept, and a clean block in its set is replaced instead.
+static void testEvictionFailure()
+{
+    const char *label = "eviction failure";
+    MockNVMController mock(16 * 1024, TEST_BLOCK_SIZE);
+    FSCache cache(mock, TEST_BLOCK_SIZE, 2);
+    uint8_t data = 0x5A;
+    uint8_t b = 0;
+
+    cache.setWriteBack(true);
+    cache.write(block(1), &data, 1);
+    cache.read(block(2), &b, 1);
+
+    // Block 1 is now the least recently used, but cannot be written back.
+    mock.failWrites = 1;
+    check(cache.read(block(3), &b, 1) == DEVICE_OK, label, "a clean block was not replaced instead");
+    check(cache.getCacheEntry(block(1)) != NULL, label, "the dirty block was replaced");
+
+    // With nothing left that can be replaced, the error is reported rather than the data discarded.
+    cache.write(block(3), &data, 1);
+    check(cache.read(block(4), &b, 1) == DEVICE_I2C_ERROR, label, "a failed write back was not reported");
+    check(cache.write(block(4), &data, 1) == DEVICE_I2C_ERROR, label, "a failed write back was not reported");
+
+    mock.failWrites = 0;
+    check(cache.flush() == DEVICE_OK, label, "the kept blocks could not be written later");
+    check(mock.memory[block(1)] == data && mock.memory[block(3)] == data, label, "modified data was lost");
+    check(cache.read(block(4), &b, 1) == DEVICE_OK, label, "the cache did not recover");
+    check(mock.violations == 0, label, "programmed a bit that was not erased");
+}
+
+// Fills a two set, two way cache such that block 7 is the most recent block in set 1, and block 0 is the least recent
+// in set 0, then misses on block 8 (set 0) as the next block after 7.
+static void readAheadAfter(MockNVMController &mock, FSCache &cache, bool touch)
+{
+    uint8_t b = 0;
+
+    for (int n = 0; n < 16; n++)
+        memset(mock.memory + block(n), n, TEST_BLOCK_SIZE);
+
+    cache.read(block(3), &b, 1);
+    cache.read(block(5), &b, 1);
+    cache.read(block(0), &b, 1);
+    cache.read(block(2), &b, 1);
+    cache.read(block(7), &b, 1);
+
+    // Optionally use the other block of set 1, so that both are more recent than block 0.
+    if (touch)
+        cache.read(block(5), &b, 1);
+
+    cache.resetStatistics();
+    cache.read(block(8), &b, 1);
+}
+
+// Read ahead replaces the least recently used block of the following set, whichever way it is in.
+static void testReadAheadVictim()
+{
+    const char *label = "read ahead victim";
+    MockNVMController mock(16 * 1024, TEST_BLOCK_SIZE);
+    FSCache cache(mock, TEST_BLOCK_SIZE, 4);
+    uint8_t b[2];
+
+    readAheadAfter(mock, cache, false);
+
+    check(cache.prefetches == CODAL_FS_CACHE_READ_AHEAD, label, "the following block was not read ahead");
+    check(cache.getCacheEntry(block(7)) != NULL, label, "the block just read was replaced");
+    check(cache.getCacheEntry(block(5)) == NULL, label, "the least recently used block was kept");
+
+    cache.read(block(8), &b[0], 1);
+    cache.read(block(9), &b[1], 1);
+    check(b[0] == 8 && b[1] == 9 && cache.misses == 1, label, "blocks held in different ways were not read correctly");
+}
+
+// Read ahead stops rather than replace a block used more recently than the one the miss replaced.
+static void testReadAheadRecency()
+{
+    const char *label = "read ahead recency";
+    MockNVMController mock(16 * 1024, TEST_BLOCK_SIZE);
+    FSCache cache(mock, TEST_BLOCK_SIZE, 4);
+
+    readAheadAfter(mock, cache, true);
+
+    check(cache.prefetches == 0, label, "read ahead replaced a more recently used block");
+    check(cache.getCacheEntry(block(7)) != NULL && cache.getCacheEntry(block(5)) != NULL, label, "a recently used block was replaced");
+}
+
+int main()
+{
+    testEvictionFailure();
+    testReadAheadVictim();
+    testReadAheadRecency();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Compares the windowed power spectrum from FastFourierTransform, at every supported size, with a double precision
+ * direct DFT of the same data. Transforms of every size share one table of twiddle factors.
+ */
+
+#include "FastFourierTransform.h"
+
+// The largest error allowed, relative to the largest bin of the spectrum.
+#define TEST_TOLERANCE              1e-5
+
+int main()
+{
+    static float re[CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE];
+    static float im[CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE];
+    static double x[CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE];
+    int failures = 0;
+
+    srand(1);
+
+    for (int size = 4; size <= CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE; size <<= 1)
+    {
+        FastFourierTransform fft(size);
+
+        for (int i = 0; i < size; i++)
+        {
+            x[i] = sin(2 * M_PI * 3.3 * i / size) + 0.25 * cos(2 * M_PI * 0.4 * i) + (rand() % 2001 - 1000) / 4000.0;
+            re[i] = (float) x[i];
+        }
+
+        fft.window(re);
+        fft.powerSpectrum(re, im);
+
+        double peak = 0, worst = 0;
+        double power[CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE / 2 + 1];
+
+        for (int k = 0; k <= size / 2; k++)
+        {
+            double r = 0, i = 0;
+
+            for (int n = 0; n < size; n++)
+            {
+                double w = 0.5 - 0.5 * cos(2 * M_PI * n / size);
+                r += x[n] * w * cos(2 * M_PI * k * n / size);
+                i -= x[n] * w * sin(2 * M_PI * k * n / size);
+            }
+
+            power[k] = r * r + i * i;
+            peak = fmax(peak, power[k]);
+        }
+
+        for (int k = 0; k <= size / 2; k++)
+            worst = fmax(worst, fabs(power[k] - re[k]) / peak);
+
+        printf("size %4d: max relative error %.2e\n", size, worst);
+
+        if (!fft.isValid() || worst > TEST_TOLERANCE)
+        {
+            printf("FAIL size %d\n", size);
+            failures++;
+        }
+    }
+
+    if (FastFourierTransform(CONFIG_FAST_FOURIER_TRANSFORM_MAX_SIZE * 2).isValid() || FastFourierTransform(24).isValid())
+    {
+        printf("FAIL unsupported sizes accepted\n");
+        failures++;
+    }
+
+    return failures ? 1 : 0;
+}
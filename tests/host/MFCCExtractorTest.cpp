@@ -0,0 +1,230 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Compares the feature vectors from MFCCExtractor with a double precision reference: a direct DFT, explicit
+ * triangular mel filters and an orthonormal DCT-II. Then measures the cost of each frame, as processed by the
+ * extractor's fiber, in host time and (on x86) host timestamp counter cycles.
+ */
+
+#include "MFCCExtractor.h"
+#include <vector>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TEST_HAS_CYCLE_COUNTER      1
+#endif
+
+#define TEST_SAMPLE_RATE            10989
+#define TEST_BUFFER_SAMPLES         256
+#define TEST_BUFFERS                150
+#define TEST_BENCHMARK_BUFFERS      5000
+
+// The largest difference allowed between a coefficient and the reference.
+#define TEST_TOLERANCE              1e-3
+
+static const int N = CONFIG_MFCC_FFT_SIZE;
+static const int M = CONFIG_MFCC_MEL_FILTERS;
+static const int C = CONFIG_MFCC_COEFFICIENTS;
+
+static std::vector<int16_t> signal;
+
+class Signal : public DataSource
+{
+    public:
+    size_t position = 0;
+
+    virtual ManagedBuffer pull() override
+    {
+        ManagedBuffer b(TEST_BUFFER_SAMPLES * 2);
+        int16_t *data = (int16_t *) &b[0];
+
+        for (int i = 0; i < TEST_BUFFER_SAMPLES; i++)
+            data[i] = signal[position++ % signal.size()];
+
+        return b;
+    }
+
+    virtual int getFormat() override
+    {
+        return DATASTREAM_FORMAT_16BIT_SIGNED;
+    }
+};
+
+static double mel(double hz)
+{
+    return 2595 * log10(1 + hz / 700);
+}
+
+static double hz(double m)
+{
+    return 700 * (pow(10, m / 2595) - 1);
+}
+
+static void reference(const int16_t *x, double *mfcc)
+{
+    double frame[N], power[N / 2 + 1], energy[M], edges[M + 2];
+    double previous = x[0] / 32768.0;
+
+    for (int i = 0; i < N; i++)
+    {
+        double s = x[i] / 32768.0;
+        frame[i] = (s - CONFIG_MFCC_PRE_EMPHASIS * previous) * (0.5 - 0.5 * cos(2 * M_PI * i / N));
+        previous = s;
+    }
+
+    for (int k = 0; k <= N / 2; k++)
+    {
+        double r = 0, i = 0;
+
+        for (int n = 0; n < N; n++)
+        {
+            r += frame[n] * cos(2 * M_PI * k * n / N);
+            i -= frame[n] * sin(2 * M_PI * k * n / N);
+        }
+
+        power[k] = (r * r + i * i) / ((double) N * N);
+    }
+
+    double low = mel(CONFIG_MFCC_MIN_FREQUENCY);
+    double high = mel(fmin(CONFIG_MFCC_MAX_FREQUENCY, TEST_SAMPLE_RATE / 2));
+
+    for (int j = 0; j < M + 2; j++)
+        edges[j] = hz(low + j * (high - low) / (M + 1));
+
+    for (int m = 0; m < M; m++)
+    {
+        energy[m] = 0;
+
+        for (int k = 0; k <= N / 2; k++)
+        {
+            double f = (double) k * TEST_SAMPLE_RATE / N;
+
+            if (f >= edges[m] && f < edges[m + 1])
+                energy[m] += power[k] * (f - edges[m]) / (edges[m + 1] - edges[m]);
+            else if (f >= edges[m + 1] && f < edges[m + 2])
+                energy[m] += power[k] * (edges[m + 2] - f) / (edges[m + 2] - edges[m + 1]);
+        }
+
+        energy[m] = log(fmax(energy[m], CONFIG_MFCC_LOG_FLOOR));
+    }
+
+    for (int i = 0; i < C; i++)
+    {
+        mfcc[i] = 0;
+
+        for (int m = 0; m < M; m++)
+            mfcc[i] += sqrt((i ? 2.0 : 1.0) / M) * cos(M_PI * i * (m + 0.5) / M) * energy[m];
+    }
+}
+
+int main()
+{
+    int failures = 0;
+
+    // A warbling tone, a gated higher tone, and noise.
+    srand(1);
+
+    for (int n = 0; n < TEST_BUFFER_SAMPLES * TEST_BUFFERS; n++)
+    {
+        double t = (double) n / TEST_SAMPLE_RATE;
+        double v = 3000 * sin(2 * M_PI * (300 + 200 * sin(2 * M_PI * 0.7 * t)) * t);
+
+        if (fmod(t, 0.5) < 0.2)
+            v += 1500 * sin(2 * M_PI * 1800 * t);
+
+        signal.push_back((int16_t) (v + rand() % 401 - 200));
+    }
+
+    Signal source;
+    MFCCExtractor extractor(source, TEST_SAMPLE_RATE);
+    extractor.start();
+
+    double worst = 0, largest = 0;
+
+    for (int b = 0; b < TEST_BUFFERS; b++)
+    {
+        extractor.pullRequest();
+        host_run_fibers();
+
+        // The hop divides the buffer, so the newest frame ends with it.
+        if (source.position < (size_t) N)
+            continue;
+
+        float mfcc[C];
+        double expected[C];
+
+        extractor.getFrame(mfcc);
+        reference(&signal[source.position - N], expected);
+
+        for (int i = 0; i < C; i++)
+        {
+            worst = fmax(worst, fabs(expected[i] - mfcc[i]));
+            largest = fmax(largest, fabs(expected[i]));
+        }
+    }
+
+    printf("frames=%u dropped=%u max abs error=%.2e (largest coefficient %.1f)\n", (unsigned) extractor.getFrameCount(),
+        (unsigned) extractor.getDroppedCount(), worst, largest);
+
+    if (worst > TEST_TOLERANCE || extractor.getFrameCount() != TEST_BUFFERS * TEST_BUFFER_SAMPLES / CONFIG_MFCC_HOP_SIZE)
+    {
+        printf("FAIL feature vectors differ from the reference\n");
+        failures++;
+    }
+
+    // Only the fiber's share is timed: capture in pullRequest is a copy per sample.
+    uint32_t frames = extractor.getFrameCount();
+    double elapsed = 0;
+    uint64_t cycles = 0;
+
+    for (int b = 0; b < TEST_BENCHMARK_BUFFERS; b++)
+    {
+        extractor.pullRequest();
+
+        auto start = std::chrono::steady_clock::now();
+#if TEST_HAS_CYCLE_COUNTER
+        uint64_t c = __rdtsc();
+#endif
+        host_run_fibers();
+#if TEST_HAS_CYCLE_COUNTER
+        cycles += __rdtsc() - c;
+#endif
+        elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    frames = extractor.getFrameCount() - frames;
+
+    printf("host: %.2f us/frame", elapsed / frames);
+#if TEST_HAS_CYCLE_COUNTER
+    printf(", %.0f TSC cycles/frame", (double) cycles / frames);
+#endif
+    printf(" over %u frames\n", (unsigned) frames);
+
+    extractor.stop();
+    host_run_fibers();
+
+    return failures ? 1 : 0;
+}
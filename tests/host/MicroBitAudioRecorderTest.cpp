@@ -0,0 +1,145 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Records microphone sized buffers into a raw region of flash with MicroBitAudioRecorder, armed for more pre-trigger
+ * audio than its ring can hold. The ring holds several blocks of audio, all of which must be recorded ahead of the
+ * buffers that follow the trigger, with none dropped, in both PCM16 and ADPCM format. PCM16 recordings are read back
+ * and compared sample by sample, and the header of each must be completed with its length and dropped count.
+ * Exits with a non-zero status if any check fails.
+ */
+
+#include "MicroBitAudioRecorder.h"
+#include "MockNVMController.h"
+#include "HostTest.h"
+
+#define TEST_FLASH_SIZE         (64 * 1024)
+#define TEST_SAMPLE_RATE        11000
+#define TEST_BUFFER_SAMPLES     256
+#define TEST_BUFFER_PERIOD      23000
+#define TEST_ARMED_BUFFERS      12
+#define TEST_RECORDED_BUFFERS   28
+
+// Delivers buffers of 16 bit samples to its sink on demand, as the microphone would.
+class TestSource : public DataSource
+{
+    public:
+    DataSink *sink;
+    ManagedBuffer next;
+
+    TestSource() : sink(NULL) {}
+    virtual ManagedBuffer pull() { return next; }
+    virtual void connect(DataSink &s) { sink = &s; }
+    virtual int getFormat() { return DATASTREAM_FORMAT_16BIT_SIGNED; }
+};
+
+static int16_t sample(int buffer, int i)
+{
+    return (int16_t) ((i * 37 + buffer * 101) % 2000 - 1000);
+}
+
+static void deliver(TestSource &source, int buffer)
+{
+    ManagedBuffer b(TEST_BUFFER_SAMPLES * 2);
+
+    for (int i = 0; i < TEST_BUFFER_SAMPLES; i++)
+    {
+        int16_t v = sample(buffer, i);
+        memcpy(&b[i * 2], &v, 2);
+    }
+
+    source.next = b;
+    source.sink->pullRequest();
+    host_advance_time(TEST_BUFFER_PERIOD);
+}
+
+static void run(AudioRecorderFormat format)
+{
+    const char *label = format == AudioRecorderFormat::PCM16 ? "PCM16" : "ADPCM";
+    MockNVMController mock(TEST_FLASH_SIZE);
+    TestSource source;
+    int buffers = 0;
+
+    host_set_time(0);
+
+    MicroBitAudioRecorder *recorder = new MicroBitAudioRecorder(source, mock, 0, TEST_FLASH_SIZE, TEST_SAMPLE_RATE);
+    recorder->setFormat(format);
+
+    // Ask for more than the ring can hold, so that it holds as much as it can.
+    recorder->arm(1000);
+    for (; buffers < TEST_ARMED_BUFFERS; buffers++)
+        deliver(source, buffers);
+
+    check(recorder->record() == DEVICE_OK, label, "could not start recording");
+
+    // The first buffer after the trigger arrives before the writer has run.
+    for (; buffers < TEST_ARMED_BUFFERS + TEST_RECORDED_BUFFERS; buffers++)
+        deliver(source, buffers);
+
+    check(recorder->stop() == DEVICE_OK, label, "could not stop recording");
+
+    int first = TEST_ARMED_BUFFERS - CONFIG_AUDIO_RECORDER_MAX_PRETRIGGER_BUFFERS;
+    int samples = (buffers - first) * TEST_BUFFER_SAMPLES;
+    uint32_t expected;
+
+    if (format == AudioRecorderFormat::PCM16)
+        expected = samples * 2;
+    else
+        expected = samples / 2 + 4 * ((samples / 2 + CONFIG_AUDIO_RECORDER_BLOCK_SIZE - 5) / (CONFIG_AUDIO_RECORDER_BLOCK_SIZE - 4));
+
+    printf("%s: %u bytes, %u buffers dropped\n", label, (unsigned) recorder->getLength(), (unsigned) recorder->getDroppedCount());
+
+    check(recorder->getDroppedCount() == 0, label, "buffers were dropped");
+    check(recorder->getLength() == expected, label, "the recording is not the length of the audio retained and delivered");
+
+    AudioRecordingHeader *h = (AudioRecordingHeader *) mock.memory;
+    check(h->length == recorder->getLength() && h->dropped == 0, label, "the header was not completed");
+
+    // The oldest buffers retained come first, then every buffer delivered after the trigger.
+    if (format == AudioRecorderFormat::PCM16)
+    {
+        int16_t *data = (int16_t *) (mock.memory + sizeof(AudioRecordingHeader));
+        int mismatches = 0;
+
+        for (int b = first; b < buffers; b++)
+            for (int i = 0; i < TEST_BUFFER_SAMPLES; i++)
+                if (*data++ != sample(b, i))
+                    mismatches++;
+
+        check(mismatches == 0, label, "the audio was not recorded in order");
+    }
+
+    check(mock.violations == 0, label, "a write needed bits to be set");
+
+    delete recorder;
+    host_reset_fibers();
+}
+
+int main()
+{
+    run(AudioRecorderFormat::PCM16);
+    run(AudioRecorderFormat::ADPCM);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,323 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Measures the flash transactions MicroBitLog performs for each row logged, the cost of mounting the log again, and
+ * the wear it causes, for each storage format and flush interval. Every row is then read back through
+ * MicroBitLogIterator to check that nothing was lost or corrupted.
+ *
+ * Rows are logged every 20ms of host time, with two small integer columns and a millisecond timestamp. Evolving logs
+ * also add columns as they grow, and widen each from integer to floating point values a little later. A buffered log is
+ * also run against flash that fails some of its writes, to check that every row accepted survives, and no other. A log
+ * of another format version is checked to be reformatted when mounted. Buffered binary rows must take fewer bytes than
+ * buffered CSV rows.
+ * Exits with a non-zero status if any check fails.
+ */
+
+#include "MicroBitLog.h"
+#include "NVMMonitor.h"
+#include "MockNVMController.h"
+#include "HostTest.h"
+
+#define BENCHMARK_FLASH_SIZE        (128 * 1024)
+#define BENCHMARK_ROW_PERIOD        20000
+#define BENCHMARK_ROWS              3000
+#define BENCHMARK_CIRCULAR_ROWS     24000
+#define BENCHMARK_EVOLVING_ROWS     1500
+#define BENCHMARK_EVOLVING_COLUMNS  10
+#define BENCHMARK_FAILED_WRITES     3
+
+// Layout of the log on 1KB pages: the 2KB header, a page of metadata, then the journal pages and the data pages.
+#define BENCHMARK_METADATA_START    (2 * 1024)
+#define BENCHMARK_JOURNAL_START     (3 * 1024)
+#define BENCHMARK_DATA_START        (BENCHMARK_JOURNAL_START + CONFIG_MICROBIT_LOG_JOURNAL_PAGES * 1024)
+
+static const char *formatNames[] = {"CSV", "Compressed", "Binary"};
+
+static int field(const char *s, int n)
+{
+    while (n-- && s)
+    {
+        s = strchr(s, ',');
+        if (s)
+            s++;
+    }
+
+    return s ? atoi(s) : -1;
+}
+
+static MicroBitLog *mount(NVMController &flash, NRF52Serial &serial, LogFormat format, uint32_t interval, bool circular)
+{
+    MicroBitLog *log = new MicroBitLog(flash, serial);
+
+    log->setCircular(circular);
+    log->setFormat(format);
+    log->setFlushInterval(interval);
+    log->setTimeStamp(TimeStampFormat::Milliseconds);
+
+    return log;
+}
+
+static int logRow(MicroBitLog *log, int i, bool evolving)
+{
+    log->beginRow();
+    log->logData("x", i);
+    log->logData("y", (i * 3) % 17);
+
+    // Add columns as the log grows, each of which later widens from integer to floating point values.
+    if (evolving)
+    {
+        for (int c = 0; c < BENCHMARK_EVOLVING_COLUMNS && i >= c * 131; c++)
+        {
+            char key[8];
+            snprintf(key, sizeof(key), "c%d", c);
+
+            if (i >= c * 131 + 67)
+                log->logData(key, 0.5f);
+            else
+                log->logData(key, c);
+        }
+    }
+
+    return log->endRow();
+}
+
+// Returns the number of bytes written to flash for each row logged.
+static double run(LogFormat format, uint32_t interval, bool circular, bool evolving = false)
+{
+    MockNVMController mock(BENCHMARK_FLASH_SIZE);
+    NVMMonitor nvm(mock);
+    NRF52Serial serial;
+    char label[64];
+    char buffer[128];
+    int rows = circular ? BENCHMARK_CIRCULAR_ROWS : evolving ? BENCHMARK_EVOLVING_ROWS : BENCHMARK_ROWS;
+
+    snprintf(label, sizeof(label), "%s interval=%u%s%s", formatNames[(int)format], (unsigned)interval, circular ? " circular" : "", evolving ? " evolving" : "");
+    host_set_time(0);
+
+    // The first row writes the header and schema, so leave it out of the steady state.
+    MicroBitLog *log = mount(nvm, serial, format, interval, circular);
+    logRow(log, 0, evolving);
+    log->flush();
+    nvm.reset();
+
+    for (int i = 1; i < rows; i++)
+    {
+        host_advance_time(BENCHMARK_ROW_PERIOD);
+        logRow(log, i, evolving);
+    }
+
+    log->flush();
+
+    uint32_t reads = nvm.reads;
+    uint32_t writes = nvm.writes;
+    uint32_t erases = nvm.erases;
+    uint32_t bytesWritten = nvm.bytesWritten;
+
+    delete log;
+    host_reset_fibers();
+
+    // Mount the log again, as after a power cycle.
+    nvm.reset();
+    log = mount(nvm, serial, format, interval, circular);
+    uint32_t rowCount = log->getRowCount();
+    uint32_t mountReads = nvm.reads;
+    uint32_t mountBytes = nvm.bytesRead;
+
+    uint32_t wearMin, wearMax, journalMin, journalMax;
+    nvm.getWearRange(BENCHMARK_DATA_START, BENCHMARK_FLASH_SIZE, wearMin, wearMax);
+    nvm.getWearRange(BENCHMARK_JOURNAL_START, BENCHMARK_DATA_START, journalMin, journalMax);
+
+    printf("%-34s %8.3f %8.3f %8.1f %7u %8u %9u %5u..%-5u %5u..%-5u %4u\n", label, (double)reads / rows, (double)writes / rows,
+        (double)bytesWritten / rows, (unsigned)erases, (unsigned)mountReads, (unsigned)mountBytes, (unsigned)wearMin, (unsigned)wearMax,
+        (unsigned)journalMin, (unsigned)journalMax, (unsigned)mock.violations);
+
+    check(mock.violations == 0, label, "programmed a bit that was not erased");
+    check(journalMax <= wearMax, label, "a journal page wore faster than the data pages");
+    check(rowCount == (uint32_t)rows, label, "row count was not restored on mount");
+
+    // Read every row held back, checking that they are consecutive and end with the last row logged.
+    MicroBitLogIterator it(*log);
+    int expected = it.getRow();
+
+    check(circular || expected == 0, label, "the oldest row was lost");
+
+    while (it.next(buffer, sizeof(buffer)) >= 0)
+    {
+        if (field(buffer, 1) != expected || field(buffer, 2) != (expected * 3) % 17 || it.getTime() != (CODAL_TIMESTAMP)expected * BENCHMARK_ROW_PERIOD / 1000)
+        {
+            check(false, label, "a row read back differs from the row logged");
+            break;
+        }
+
+        expected++;
+    }
+
+    check(expected == rows, label, "the newest rows were lost");
+
+    delete log;
+    host_reset_fibers();
+
+    return (double)bytesWritten / rows;
+}
+
+// By default every row is written through, so a row survives power being removed straight after it is logged.
+static void runDefault()
+{
+    MockNVMController mock(BENCHMARK_FLASH_SIZE);
+    NRF52Serial serial;
+
+    host_set_time(0);
+
+    MicroBitLog *log = new MicroBitLog(mock, serial);
+    logRow(log, 0, false);
+
+    // Mount the same flash again, without the first log committing anything more.
+    MicroBitLog *after = new MicroBitLog(mock, serial);
+    check(after->getRowCount() == 1, "default", "a row was held in RAM rather than written through");
+
+    delete after;
+    delete log;
+    host_reset_fibers();
+}
+
+// A log written in any other version of the format must be reformatted when mounted, rather than misread.
+static void runVersion()
+{
+    MockNVMController mock(BENCHMARK_FLASH_SIZE);
+    NRF52Serial serial;
+
+    host_set_time(0);
+
+    MicroBitLog *log = new MicroBitLog(mock, serial);
+    for (int i = 0; i < 10; i++)
+        logRow(log, i, false);
+
+    delete log;
+    host_reset_fibers();
+
+    // Mark the log as written by the previous version, whose journal entries were ASCII hex.
+    check(memcmp(mock.memory + BENCHMARK_METADATA_START, MICROBIT_LOG_VERSION, 18) == 0, "version", "the version was not written");
+    mock.memory[BENCHMARK_METADATA_START + 16] = '1';
+
+    log = new MicroBitLog(mock, serial);
+    check(log->getRowCount() == 0, "version", "a log of another version was mounted");
+    check(memcmp(mock.memory + BENCHMARK_METADATA_START, MICROBIT_LOG_VERSION, 18) == 0, "version", "the log was not reformatted");
+    check(logRow(log, 0, false) == DEVICE_OK && mock.violations == 0, "version", "could not log to the reformatted log");
+
+    delete log;
+    host_reset_fibers();
+}
+
+// Every third write to the data pages fails, as if the interface chip were busy. Rows that cannot be committed must be
+// refused, leaving the log as it was, rather than discarding data that has been buffered already.
+static void runFailures()
+{
+    MockNVMController mock(BENCHMARK_FLASH_SIZE);
+    NRF52Serial serial;
+    const char *label = "CSV interval=1000 failing writes";
+    char buffer[128];
+    int *accepted = (int *) malloc(sizeof(int) * BENCHMARK_ROWS);
+    int count = 0;
+    int refused = 0;
+
+    host_set_time(0);
+
+    MicroBitLog *log = mount(mock, serial, LogFormat::CSV, 1000, false);
+    mock.failFrom = BENCHMARK_DATA_START;
+    mock.failWrites = BENCHMARK_FAILED_WRITES;
+
+    for (int i = 0; i < BENCHMARK_ROWS; i++)
+    {
+        host_advance_time(BENCHMARK_ROW_PERIOD);
+
+        int result = logRow(log, i, false);
+
+        if (result == DEVICE_OK)
+            accepted[count++] = i;
+        else if (result == DEVICE_I2C_ERROR)
+            refused++;
+        else
+            check(false, label, "a row failed for a reason other than the flash");
+    }
+
+    mock.failWrites = 0;
+    log->flush();
+
+    delete log;
+    host_reset_fibers();
+
+    check(refused > 0, label, "no row was refused");
+    check(mock.violations == 0, label, "programmed a bit that was not erased");
+
+    log = mount(mock, serial, LogFormat::CSV, 1000, false);
+    check(log->getRowCount() == (uint32_t)count, label, "row count was not restored on mount");
+
+    // Every row accepted must read back in order, and no refused row may appear between them.
+    MicroBitLogIterator it(*log);
+    int n = 0;
+
+    while (it.next(buffer, sizeof(buffer)) >= 0)
+    {
+        if (n == count || field(buffer, 1) != accepted[n] || field(buffer, 2) != (accepted[n] * 3) % 17)
+        {
+            check(false, label, "a row read back differs from the rows accepted");
+            break;
+        }
+
+        n++;
+    }
+
+    check(n == count, label, "an accepted row was lost");
+    printf("%s: %d rows refused, %d accepted\n", label, refused, count);
+
+    free(accepted);
+    delete log;
+    host_reset_fibers();
+}
+
+int main()
+{
+    runDefault();
+    runVersion();
+    runFailures();
+
+    printf("%-34s %8s %8s %8s %7s %8s %9s %11s %12s %4s\n", "", "reads/", "writes/", "bytes/", "", "mount", "mount", "data page", "journal page", "");
+    printf("%-34s %8s %8s %8s %7s %8s %9s %11s %12s %4s\n", "configuration", "row", "row", "row", "erases", "reads", "bytes", "wear", "wear", "bad");
+
+    double buffered[3];
+
+    for (int f = 0; f < 3; f++)
+    {
+        run((LogFormat) f, 0, false);
+        buffered[f] = run((LogFormat) f, 1000, false);
+        run((LogFormat) f, 0, true);
+        run((LogFormat) f, 1000, true);
+        run((LogFormat) f, 1000, false, true);
+    }
+
+    check(buffered[(int)LogFormat::Binary] < buffered[(int)LogFormat::CSV], "Binary", "a buffered binary row is no smaller than a CSV row");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Checks that the HTML header MicroBitLog writes to the start of the log is the minified form of
+ * resources/logfs/header.html, so that the two cannot drift apart when either is changed by hand.
+ *
+ * Minifying renames local variables, but leaves string literals, regular expressions, URLs and the numbers passed to
+ * substr() as they are. Each of these in the scripts of header.html must appear in the header, in the same order. The
+ * header must also be padded to exactly 2KB, end with the delimiter of the file system, and accept the version of the
+ * format this build writes.
+ * Exits with a non-zero status if any check fails.
+ */
+
+#include "MicroBitLog.h"
+#include "MockNVMController.h"
+#include "HostTest.h"
+
+#include <string>
+
+#define TEST_FLASH_SIZE     (32 * 1024)
+#define TEST_HEADER_SIZE    2048
+
+static std::string readFile(const char *path)
+{
+    std::string s;
+    char buffer[256];
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL)
+        return s;
+
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+        s.append(buffer, n);
+
+    fclose(f);
+    return s;
+}
+
+// The scripts in the given HTML, without their comments.
+static std::string scripts(const std::string &html)
+{
+    std::string code;
+    size_t start = 0;
+
+    while ((start = html.find("<script>", start)) != std::string::npos)
+    {
+        start += 8;
+        size_t end = html.find("</script>", start);
+        if (end == std::string::npos)
+            break;
+
+        size_t line = start;
+        while (line < end)
+        {
+            size_t next = html.find('\n', line);
+            if (next == std::string::npos || next > end)
+                next = end;
+
+            size_t first = html.find_first_not_of(" \t", line);
+            if (first < next && html.compare(first, 2, "//") != 0 && html.compare(first, 2, "/*") != 0 && html[first] != '*')
+                code.append(html, line, next - line).append("\n");
+
+            line = next + 1;
+        }
+
+        start = end;
+    }
+
+    return code;
+}
+
+// Checks that the given token appears in the header after the last one found, advancing past it.
+static void expect(const std::string &header, size_t &from, const std::string &token, const char *kind)
+{
+    size_t at = header.find(token, from);
+    char message[256];
+
+    snprintf(message, sizeof(message), "%s %s is missing or out of order", kind, token.c_str());
+    check(at != std::string::npos, "header", message);
+
+    if (at != std::string::npos)
+        from = at + token.length();
+}
+
+// The arguments of a substr() call, without whitespace and with any expression reduced to the numbers it subtracts
+// from or adds to, so "(logEnd - 2047, 3)" and "(o-2047,3)" both give "-2047,3".
+static std::string substrArguments(const std::string &code, size_t open)
+{
+    std::string args;
+    size_t i = open + 1;
+
+    while (i < code.length() && code[i] != ')')
+    {
+        char c = code[i];
+
+        if (isalpha(c) || c == '_' || c == '$' || c == '.')
+        {
+            while (i < code.length() && (isalnum(code[i]) || code[i] == '_' || code[i] == '$' || code[i] == '.'))
+                i++;
+            continue;
+        }
+
+        if (c != ' ' && c != '\t' && c != '\n')
+            args += c;
+        i++;
+    }
+
+    return args;
+}
+
+int main()
+{
+    MockNVMController mock(TEST_FLASH_SIZE);
+    NRF52Serial serial;
+
+    host_set_time(0);
+
+    // Logging a row formats the log, writing the header.
+    MicroBitLog *log = new MicroBitLog(mock, serial);
+    log->beginRow();
+    log->logData("x", 1);
+    log->endRow();
+
+    std::string header((const char *) mock.memory, TEST_HEADER_SIZE);
+    std::string source = readFile(LOG_HEADER_SOURCE);
+
+    delete log;
+    host_reset_fibers();
+
+    check(!source.empty(), "header", "could not read " LOG_HEADER_SOURCE);
+    check(header.find('\0') == std::string::npos, "header", "the header is shorter than 2KB");
+    check(header.compare(TEST_HEADER_SIZE - 12, 12, "<!--FS_START") == 0, "header", "the header does not end with <!--FS_START");
+
+    std::string version = std::string("/^") + std::string(MICROBIT_LOG_VERSION, 17) + "/";
+    check(header.find(version) != std::string::npos, "header", "the header does not accept this version of the format");
+    check(source.find(version) != std::string::npos, "header", "header.html does not accept this version of the format");
+
+    std::string code = scripts(source);
+    size_t from;
+
+    // String literals.
+    from = 0;
+    for (size_t i = 0; (i = code.find('"', i)) != std::string::npos;)
+    {
+        size_t end = i + 1;
+        while (end < code.length() && code[end] != '"')
+            end += code[end] == '\\' ? 2 : 1;
+
+        expect(header, from, code.substr(i, end - i + 1), "string");
+        i = end + 1;
+    }
+
+    // Regular expression literals, which header.html only passes to replace() or tests with.
+    from = 0;
+    for (size_t i = 0; (i = code.find('/', i)) != std::string::npos; i++)
+    {
+        size_t end = code.find('/', i + 1);
+        bool regex = (code.compare(i, 2, "/^") == 0 && code.compare(end + 1, 5, ".test") == 0) ||
+                     (i > 8 && code.compare(i - 8, 8, "replace(") == 0);
+
+        if (regex && end != std::string::npos)
+        {
+            expect(header, from, code.substr(i, end - i + 1), "regular expression");
+            i = end;
+        }
+    }
+
+    // URLs of the scripts and stylesheets loaded online.
+    from = 0;
+    for (size_t i = 0; (i = source.find("https://", i)) != std::string::npos;)
+    {
+        size_t end = source.find_first_of("\"' >", i);
+        expect(header, from, source.substr(i, end - i), "URL");
+        i = end;
+    }
+
+    // Offsets into the file system.
+    std::string expected, actual;
+    for (size_t i = 0; (i = code.find("substr(", i)) != std::string::npos; i += 7)
+        expected += substrArguments(code, i + 6) + ";";
+    for (size_t i = 0; (i = header.find("substr(", i)) != std::string::npos; i += 7)
+        actual += substrArguments(header, i + 6) + ";";
+
+    check(expected == actual, "header", "the offsets passed to substr() differ");
+    if (expected != actual)
+        printf("  header.html: %s\n  header:      %s\n", expected.c_str(), actual.c_str());
+
+    return failures ? 1 : 0;
+}
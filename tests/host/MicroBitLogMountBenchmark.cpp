@@ -0,0 +1,120 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Measures the NVM transactions MicroBitLog performs to mount a log, and restore its row count, as the log grows.
+ * Locating the end of the log is bounded by the number of journal pages, and restoring the row count by a binary
+ * search of the seek index, so mount cost should grow no faster than the logarithm of the data held.
+ *
+ * Exits with a non-zero status if the row count is not restored, the next row cannot be appended, or mount cost
+ * grows with the depth of the log.
+ */
+
+#include "MicroBitLog.h"
+#include "NVMMonitor.h"
+#include "MockNVMController.h"
+
+#define BENCHMARK_FLASH_SIZE        (256 * 1024)
+#define BENCHMARK_DATA_START        (7 * 1024)
+
+// The most reads a mount may take beyond that of an empty log, for each doubling of the data pages held.
+// Restoring the row count binary searches the seek index, so some growth with depth is expected.
+#define BENCHMARK_READS_PER_DOUBLING 4
+
+static const int depths[] = {0, 1, 5, 37, 300, 1000, 2900, 4000, 6000, 9000};
+
+int main()
+{
+    int failures = 0;
+    uint32_t baseline = 0;
+
+    printf("%6s %8s %10s\n", "rows", "reads", "bytes");
+
+    for (unsigned d = 0; d < sizeof(depths) / sizeof(depths[0]); d++)
+    {
+        int rows = depths[d];
+        MockNVMController mock(BENCHMARK_FLASH_SIZE);
+        NVMMonitor nvm(mock);
+        NRF52Serial serial;
+
+        MicroBitLog *log = new MicroBitLog(nvm, serial);
+        log->setFlushInterval(0);
+        log->setTimeStamp(TimeStampFormat::Milliseconds);
+
+        for (int i = 0; i < rows; i++)
+        {
+            log->beginRow();
+            log->logData("value", i);
+            log->logData("other", "abc");
+
+            // A late column rewrites the headings part way through the log.
+            if (i == rows / 2)
+                log->logData("late", 1);
+
+            log->endRow();
+        }
+
+        delete log;
+        host_reset_fibers();
+
+        nvm.reset();
+        log = new MicroBitLog(nvm, serial);
+        uint32_t rowCount = log->getRowCount();
+        uint32_t reads = nvm.reads;
+        uint32_t bytes = nvm.bytesRead;
+        uint32_t pages = mock.getUsedPages(BENCHMARK_DATA_START, BENCHMARK_FLASH_SIZE);
+
+        printf("%6d %8u %10u\n", rows, (unsigned)reads, (unsigned)bytes);
+
+        if (d == 0)
+            baseline = reads;
+
+        if (rowCount != (uint32_t)rows)
+        {
+            printf("FAIL rows=%d: row count %u restored on mount\n", rows, (unsigned)rowCount);
+            failures++;
+        }
+
+        if (reads > baseline + BENCHMARK_READS_PER_DOUBLING * (uint32_t)ceil(log2(pages + 1)))
+        {
+            printf("FAIL rows=%d: mount cost grows with log depth\n", rows);
+            failures++;
+        }
+
+        log->setFlushInterval(0);
+        log->beginRow();
+        log->logData("value", -1);
+
+        if (log->endRow() != DEVICE_OK || log->getRowCount() != (uint32_t)rows + 1 || mock.violations)
+        {
+            printf("FAIL rows=%d: could not append to the mounted log\n", rows);
+            failures++;
+        }
+
+        delete log;
+        host_reset_fibers();
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Checks that rows a fiber logs directly through MicroBitLog are kept apart from the records MicroBitLogQueue drains
+ * into the same log, even when the fiber yields part way through building a row. Every row read back must hold either
+ * all of the fiber's columns or only the queue's. Exits with a non-zero status if any check fails.
+ */
+
+#include "MicroBitLog.h"
+#include "MicroBitLogQueue.h"
+#include "MockNVMController.h"
+#include "HostTest.h"
+
+#define TEST_FLASH_SIZE             (64 * 1024)
+#define TEST_ROWS                   40
+#define TEST_ROW_TIME               7
+#define TEST_PUSH_PERIOD            10
+
+static int written = 0;
+
+// Splits a row read back into its first three columns, returning whether each holds a value.
+static void fields(const char *s, bool *set)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        set[i] = s && *s && *s != ',' && *s != '\n';
+        s = s ? strchr(s, ',') : NULL;
+        if (s)
+            s++;
+    }
+}
+
+// Logs rows a column at a time, sleeping between columns as a fiber waiting on a sensor would.
+static void writer(void *param)
+{
+    MicroBitLog *log = (MicroBitLog *) param;
+
+    for (int i = 0; i < TEST_ROWS; i++)
+    {
+        log->beginRow();
+        log->logData("a", i);
+        fiber_sleep(TEST_ROW_TIME);
+        log->logData("b", i);
+        log->endRow();
+        written++;
+    }
+}
+
+static void testInterleaving()
+{
+    const char *label = "interleaving";
+    MockNVMController mock(TEST_FLASH_SIZE);
+    NRF52Serial serial;
+    char buffer[64];
+
+    host_set_time(0);
+
+    MicroBitLog *log = new MicroBitLog(mock, serial);
+    log->addColumn("a");
+    log->addColumn("b");
+    LogColumn q = log->addColumn("q");
+
+    MicroBitLogQueue *queue = new MicroBitLogQueue(*log);
+    queue->start();
+    create_fiber(writer, log);
+
+    int pushed = 0;
+    while (written < TEST_ROWS)
+    {
+        if (queue->push(q, pushed) == DEVICE_OK)
+            pushed++;
+
+        host_advance_time(TEST_PUSH_PERIOD * 1000);
+    }
+
+    queue->stop();
+
+    int own = 0;
+    int queued = 0;
+    MicroBitLogIterator it(*log);
+
+    while (it.next(buffer, sizeof(buffer)) >= 0)
+    {
+        bool set[3];
+        fields(buffer, set);
+
+        if (set[0] && set[1] && !set[2])
+            own++;
+        else if (!set[0] && !set[1] && set[2])
+            queued++;
+        else
+            check(false, label, "a queued record was merged into a row another fiber was building");
+    }
+
+    printf("%-16s %4d rows logged directly, %4d queued, %4u dropped\n", label, own, queued, (unsigned)queue->getDroppedCount());
+
+    check(own == TEST_ROWS, label, "rows logged directly were lost");
+    check(queued == pushed, label, "queued records were lost");
+    check(queue->getDroppedCount() == 0, label, "the queue overflowed");
+
+    delete queue;
+    delete log;
+    host_reset_fibers();
+}
+
+int main()
+{
+    testInterleaving();
+
+    return failures ? 1 : 0;
+}
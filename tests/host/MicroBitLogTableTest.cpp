@@ -0,0 +1,361 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Logs rows to two named tables through MicroBitLogTable, mounting the log again between runs so that the tags of the
+ * tables are assigned afresh, and in the other order. The '=' and '&' records are then decoded from the flash as a
+ * reader would, attributing each row to the table named by the most recent definition with its tag, and every row of
+ * each table must read back with the values logged.
+ *
+ * Tables are then created and destroyed many more times than there are tags, and as many are held at once as there
+ * are tags: tags must be reused, and the rows of a table with no tag refused.
+ * Exits with a non-zero status if any check fails.
+ */
+
+#include "MicroBitLog.h"
+#include "MockNVMController.h"
+#include "HostTest.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#define TEST_FLASH_SIZE         (128 * 1024)
+#define TEST_ROWS               40
+#define TEST_EVENT_PERIOD       4
+#define TEST_SCRATCH_TABLES     300
+#define TEST_TAGS               255
+
+// Layout of the log on 1KB pages: the 2KB header, a page of metadata, then the journal pages and the data pages.
+#define TEST_DATA_START         (3 * 1024 + CONFIG_MICROBIT_LOG_JOURNAL_PAGES * 1024)
+
+typedef std::map<std::string, std::vector<std::string>> Tables;
+
+struct TableSchema
+{
+    std::string name;
+    std::string types;
+};
+
+static int base64Value(int c)
+{
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+
+    return -1;
+}
+
+static std::vector<uint8_t> base64Decode(const uint8_t *s, int length)
+{
+    std::vector<uint8_t> out;
+    uint32_t v = 0;
+    int bits = 0;
+
+    for (int i = 0; i < length; i++)
+    {
+        int d = base64Value(s[i]);
+        if (d < 0)
+            break;
+
+        v = (v << 6) | d;
+        bits += 6;
+
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out.push_back((v >> bits) & 0xFF);
+        }
+    }
+
+    return out;
+}
+
+// Decodes one row of a '&' record into CSV text, with one value for each column of its schema.
+static std::string decodeRow(const uint8_t *data, int length, const std::string &types)
+{
+    int columns = types.length();
+    int offset = (columns + 7) / 8;
+    std::string row;
+
+    for (int i = 0; i < columns; i++)
+    {
+        char value[32] = "";
+
+        if (i)
+            row += ",";
+
+        if (!(data[i / 8] & (1 << (i % 8))))
+            continue;
+
+        if (types[i] == MICROBIT_LOG_COLUMN_TEXT)
+        {
+            row.append((const char *) &data[offset + 1], data[offset]);
+            offset += data[offset] + 1;
+            continue;
+        }
+
+        uint32_t v = data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | ((uint32_t) data[offset + 3] << 24);
+        offset += 4;
+
+        if (types[i] == MICROBIT_LOG_COLUMN_FLOAT)
+        {
+            float f;
+            memcpy(&f, &v, sizeof(f));
+            snprintf(value, sizeof(value), "%g", f);
+        }
+        else
+        {
+            snprintf(value, sizeof(value), "%d", (int32_t) v);
+        }
+
+        row += value;
+    }
+
+    check(offset == length, "decode", "a row did not fill its record");
+
+    return row;
+}
+
+// Reads the rows of every named table from the data pages, as a reader of the log would.
+static Tables decode(MockNVMController &mock)
+{
+    std::map<int, TableSchema> tags;
+    Tables tables;
+    uint32_t address = TEST_DATA_START;
+
+    while (address < mock.size && mock.memory[address] != 0xFF)
+    {
+        uint32_t end = address;
+        while (end < mock.size && mock.memory[end] != '\n')
+            end++;
+
+        if (mock.memory[address] == MICROBIT_LOG_BINARY_RECORD_MARKER && end - address > 2)
+        {
+            char type = mock.memory[address + 1];
+            std::vector<uint8_t> data = base64Decode(&mock.memory[address + 2], end - address - 2);
+
+            if (type == MICROBIT_LOG_RECORD_TABLE && data.size() > 2)
+            {
+                // Tag, name, a zero byte, then the index of the first column described and each column's type and name.
+                TableSchema &table = tags[data[0]];
+                std::string name((const char *) &data[1]);
+                uint32_t i = name.length() + 2;
+
+                if (data[i] == 0 || table.name != name)
+                    table.types.clear();
+
+                table.name = name;
+                for (i++; i < data.size(); i += strlen((const char *) &data[i]) + 1)
+                    table.types += data[i];
+            }
+
+            if (type == MICROBIT_LOG_RECORD_TABLE_ROW && data.size() > 1)
+            {
+                check(tags.count(data[0]) == 1, "decode", "a row was logged with no table definition before it");
+
+                if (tags.count(data[0]))
+                {
+                    TableSchema &table = tags[data[0]];
+                    tables[table.name].push_back(decodeRow(&data[1], data.size() - 1, table.types));
+                }
+            }
+        }
+
+        address = end + 1;
+    }
+
+    return tables;
+}
+
+static void accelRow(MicroBitLogTable *accel, Tables &expected, int i, bool z)
+{
+    char row[64];
+
+    accel->beginRow();
+    accel->logData("x", i);
+    accel->logData("y", -3 * i);
+    if (z)
+        accel->logData("z", i * i);
+
+    check(accel->endRow() == DEVICE_OK, "tables", "a row of accel was refused");
+
+    snprintf(row, sizeof(row), z ? "%d,%d,%d" : "%d,%d", i, -3 * i, i * i);
+    expected["accel"].push_back(row);
+}
+
+static void eventRow(MicroBitLogTable *events, Tables &expected, int i)
+{
+    char row[64];
+    float level = i * 0.25f;
+
+    events->beginRow();
+    events->logData("name", i % 2 ? "tap" : "shake");
+    events->logData("level", level);
+
+    check(events->endRow() == DEVICE_OK, "tables", "a row of events was refused");
+
+    snprintf(row, sizeof(row), "%s,%g", i % 2 ? "tap" : "shake", level);
+    expected["events"].push_back(row);
+}
+
+// Logs to two tables over three runs of the device, creating them in a different order each time.
+static void testTables(MockNVMController &mock, Tables &expected)
+{
+    NRF52Serial serial;
+
+    for (int run = 0; run < 3; run++)
+    {
+        MicroBitLog *log = new MicroBitLog(mock, serial);
+        MicroBitLogTable *events = NULL;
+        MicroBitLogTable *accel = NULL;
+
+        if (run == 1)
+            events = new MicroBitLogTable(*log, "events");
+
+        accel = new MicroBitLogTable(*log, "accel");
+
+        if (run != 1)
+            events = new MicroBitLogTable(*log, "events");
+
+        for (int i = 0; i < TEST_ROWS; i++)
+        {
+            int n = run * TEST_ROWS + i;
+
+            // The last run adds a column to accel.
+            accelRow(accel, expected, n, run == 2);
+
+            if (i % TEST_EVENT_PERIOD == 0)
+                eventRow(events, expected, n);
+        }
+
+        delete accel;
+        delete events;
+        delete log;
+        host_reset_fibers();
+    }
+}
+
+// Creates and destroys more tables than there are tags, then holds a table for every tag at once.
+static void testTags(MockNVMController &mock, Tables &expected)
+{
+    NRF52Serial serial;
+    MicroBitLog *log = new MicroBitLog(mock, serial);
+    MicroBitLogTable *accel = new MicroBitLogTable(*log, "accel");
+    MicroBitLogTable *held[TEST_TAGS];
+    char row[16];
+
+    for (int i = 0; i < TEST_SCRATCH_TABLES; i++)
+    {
+        MicroBitLogTable *scratch = new MicroBitLogTable(*log, "scratch");
+
+        scratch->logData("n", i);
+        check(scratch->endRow() == DEVICE_OK, "tags", "a row was refused after tables were destroyed");
+
+        snprintf(row, sizeof(row), "%d", i);
+        expected["scratch"].push_back(row);
+
+        delete scratch;
+    }
+
+    // accel holds one tag, so all but one of these have a tag.
+    for (int i = 0; i < TEST_TAGS; i++)
+        held[i] = new MicroBitLogTable(*log, "held");
+
+    for (int i = 0; i < TEST_TAGS; i++)
+    {
+        held[i]->logData("n", i);
+        int result = held[i]->endRow();
+
+        if (i < TEST_TAGS - 1)
+        {
+            check(result == DEVICE_OK, "tags", "a row of a table with a tag was refused");
+            snprintf(row, sizeof(row), "%d", i);
+            expected["held"].push_back(row);
+        }
+        else
+        {
+            check(result == DEVICE_NO_RESOURCES, "tags", "a row of a table with no tag was accepted");
+        }
+    }
+
+    // Rows of the table created first must still be attributed to it.
+    accelRow(accel, expected, 1000, false);
+
+    for (int i = 0; i < TEST_TAGS; i++)
+        delete held[i];
+
+    delete accel;
+    delete log;
+    host_reset_fibers();
+}
+
+static void compare(Tables &expected, Tables &actual)
+{
+    char message[128];
+
+    check(actual.size() == expected.size(), "decode", "the log holds a different number of tables");
+
+    for (Tables::iterator t = expected.begin(); t != expected.end(); t++)
+    {
+        std::vector<std::string> &rows = actual[t->first];
+
+        snprintf(message, sizeof(message), "%s holds %d rows, not %d", t->first.c_str(), (int) rows.size(), (int) t->second.size());
+        check(rows.size() == t->second.size(), "decode", message);
+
+        for (size_t i = 0; i < rows.size() && i < t->second.size(); i++)
+        {
+            snprintf(message, sizeof(message), "%s row %d reads %s, not %s", t->first.c_str(), (int) i, rows[i].c_str(), t->second[i].c_str());
+            check(rows[i] == t->second[i], "decode", message);
+        }
+    }
+}
+
+int main()
+{
+    MockNVMController mock(TEST_FLASH_SIZE);
+    Tables expected;
+
+    host_set_time(0);
+
+    testTables(mock, expected);
+    testTags(mock, expected);
+
+    Tables actual = decode(mock);
+    compare(expected, actual);
+
+    check(mock.violations == 0, "tables", "a write needed bits to be set");
+
+    printf("accel: %d rows, events: %d rows, scratch: %d rows, held: %d rows\n", (int) actual["accel"].size(),
+           (int) actual["events"].size(), (int) actual["scratch"].size(), (int) actual["held"].size());
+
+    return failures ? 1 : 0;
+}
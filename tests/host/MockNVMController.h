@@ -0,0 +1,151 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MOCK_NVM_CONTROLLER_H
+#define MOCK_NVM_CONTROLLER_H
+
+#include "NVMController.h"
+
+/**
+ * An in-memory NVMController with the semantics of NOR flash: erasing a page sets every byte to 0xFF, and writing
+ * can only clear bits. A write that would need to set a bit is counted as a violation, as it would silently corrupt
+ * data on a device. Wrap it in an NVMMonitor to count the transactions and wear caused by a component.
+ */
+class MockNVMController : public NVMController
+{
+    public:
+    uint8_t             *memory;            // The contents of the flash.
+    uint32_t            size;               // The size of the flash, in bytes.
+    uint32_t            pageSize;           // The size of a page, in bytes.
+    uint32_t            violations;         // The number of bytes written that needed a bit to be set.
+    int                 failWrites;         // If non-zero, the number of writes to accept before each fails.
+    uint32_t            failFrom;           // The lowest address of the writes that failWrites applies to.
+    uint32_t            writes;             // The number of write operations attempted.
+
+    /**
+     * Constructor.
+     *
+     * @param size The size of the flash, in bytes.
+     * @param pageSize The size of a page, in bytes.
+     */
+    MockNVMController(uint32_t size = 128 * 1024, uint32_t pageSize = 1024) : size(size), pageSize(pageSize), violations(0), failWrites(0), failFrom(0), writes(0)
+    {
+        memory = (uint8_t *) malloc(size);
+        memset(memory, 0xFF, size);
+    }
+
+    ~MockNVMController()
+    {
+        free(memory);
+    }
+
+    /**
+     * Determines the number of pages in the given range that hold any programmed byte.
+     *
+     * @param start The address of the first page.
+     * @param end The address of the end of the range.
+     */
+    uint32_t getUsedPages(uint32_t start, uint32_t end)
+    {
+        uint32_t count = 0;
+
+        for (uint32_t page = start; page < end; page += pageSize)
+        {
+            for (uint32_t i = 0; i < pageSize; i++)
+            {
+                if (memory[page + i] != 0xFF)
+                {
+                    count++;
+                    break;
+                }
+            }
+        }
+
+        return count;
+    }
+
+    virtual int read(uint32_t* dest, uint32_t source, uint32_t size) override
+    {
+        if (source + size * 4 > this->size)
+            return DEVICE_INVALID_PARAMETER;
+
+        memcpy(dest, memory + source, size * 4);
+        return DEVICE_OK;
+    }
+
+    virtual int write(uint32_t dest, uint32_t* source, uint32_t size) override
+    {
+        uint8_t *s = (uint8_t *) source;
+
+        if (dest + size * 4 > this->size)
+            return DEVICE_INVALID_PARAMETER;
+
+        writes++;
+        if (failWrites && dest >= failFrom && writes % failWrites == 0)
+            return DEVICE_I2C_ERROR;
+
+        for (uint32_t i = 0; i < size * 4; i++)
+        {
+            if ((memory[dest + i] & s[i]) != s[i])
+                violations++;
+
+            memory[dest + i] &= s[i];
+        }
+
+        return DEVICE_OK;
+    }
+
+    virtual int erase(uint32_t page) override
+    {
+        page -= page % pageSize;
+
+        if (page >= size)
+            return DEVICE_INVALID_PARAMETER;
+
+        memset(memory + page, 0xFF, pageSize);
+        return DEVICE_OK;
+    }
+
+    virtual uint32_t getFlashStart() override
+    {
+        return 0;
+    }
+
+    virtual uint32_t getFlashEnd() override
+    {
+        return size;
+    }
+
+    virtual uint32_t getPageSize() override
+    {
+        return pageSize;
+    }
+
+    virtual uint32_t getFlashSize() override
+    {
+        return size;
+    }
+};
+
+#endif
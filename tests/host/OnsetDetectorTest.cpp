@@ -0,0 +1,162 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Feeds OnsetDetector a noisy click track at several tempos, in microphone sized buffers, running its fiber between
+ * buffers as the scheduler would. Checks that onsets are raised close to each click, that the tempo is found, and
+ * that no frames are dropped.
+ */
+
+#include "OnsetDetector.h"
+#include <vector>
+
+#define TEST_SAMPLE_RATE            10989
+#define TEST_BUFFER_SAMPLES         256
+#define TEST_DURATION               12
+
+// The furthest an onset may be from the click it marks, in microseconds.
+#define TEST_ONSET_TOLERANCE        30000
+
+static std::vector<CODAL_TIMESTAMP> onsets;
+
+class ClickTrack : public DataSource
+{
+    public:
+    double bpm;
+    long n;
+    std::vector<CODAL_TIMESTAMP> clicks;
+
+    ClickTrack(double bpm) : bpm(bpm), n(0) {}
+
+    virtual ManagedBuffer pull() override
+    {
+        ManagedBuffer b(TEST_BUFFER_SAMPLES * 2);
+        int16_t *data = (int16_t *) &b[0];
+        double period = 60.0 / bpm * TEST_SAMPLE_RATE;
+
+        for (int i = 0; i < TEST_BUFFER_SAMPLES; i++, n++)
+        {
+            double phase = fmod(n + 37.3, period);
+            double v = rand() % 41 - 20;
+
+            if (phase < 1.0)
+                clicks.push_back((CODAL_TIMESTAMP) (n * 1000000.0 / TEST_SAMPLE_RATE));
+
+            // A decaying tone burst, of slightly varying pitch.
+            if (phase < 400)
+                v += 3000 * exp(-phase / 60.0) * sin(2 * M_PI * (700 + rand() % 100) * phase / TEST_SAMPLE_RATE);
+
+            data[i] = (int16_t) v;
+        }
+
+        host_set_time((CODAL_TIMESTAMP) (n * 1000000.0 / TEST_SAMPLE_RATE));
+        return b;
+    }
+
+    virtual int getFormat() override
+    {
+        return DATASTREAM_FORMAT_16BIT_SIGNED;
+    }
+};
+
+static void onEvent(Event e)
+{
+    if (e.value == ONSET_DETECTOR_EVT_ONSET)
+        onsets.push_back(e.timestamp);
+}
+
+static int run(double bpm)
+{
+    int failures = 0;
+    ClickTrack track(bpm);
+    OnsetDetector *detector = new OnsetDetector(track, TEST_SAMPLE_RATE);
+
+    srand(1);
+    onsets.clear();
+
+    for (int i = 0; i < TEST_DURATION * TEST_SAMPLE_RATE / TEST_BUFFER_SAMPLES; i++)
+    {
+        detector->pullRequest();
+        host_run_fibers();
+    }
+
+    int matched = 0;
+    double worst = 0;
+
+    for (CODAL_TIMESTAMP c : track.clicks)
+    {
+        double best = 1e9;
+
+        for (CODAL_TIMESTAMP o : onsets)
+            if (fabs((double) o - (double) c) < best)
+                best = fabs((double) o - (double) c);
+
+        if (best < TEST_ONSET_TOLERANCE)
+        {
+            matched++;
+            worst = fmax(worst, best);
+        }
+    }
+
+    float tempo = detector->getTempo();
+
+    printf("%5.1f BPM: clicks=%zu onsets=%zu matched=%d worst=%.0fus tempo=%.2f dropped=%u\n", bpm, track.clicks.size(),
+        onsets.size(), matched, worst, tempo, (unsigned) detector->getDroppedCount());
+
+    if (matched < (int) track.clicks.size() * 9 / 10 || onsets.size() > track.clicks.size() + 2)
+    {
+        printf("FAIL %.1f BPM: onsets do not match the clicks\n", bpm);
+        failures++;
+    }
+
+    if (fabs(tempo - bpm) > 2.0)
+    {
+        printf("FAIL %.1f BPM: tempo not found\n", bpm);
+        failures++;
+    }
+
+    if (detector->getDroppedCount())
+    {
+        printf("FAIL %.1f BPM: frames dropped\n", bpm);
+        failures++;
+    }
+
+    delete detector;
+    host_run_fibers();
+
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+
+    host_set_event_handler(onEvent);
+
+    failures += run(90.0);
+    failures += run(120.0);
+    failures += run(150.0);
+
+    return failures ? 1 : 0;
+}
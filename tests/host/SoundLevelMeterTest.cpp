@@ -0,0 +1,153 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * Feeds SoundLevelMeter pure tones at each third octave frequency within its range, and checks the difference between
+ * its A-weighted and unweighted levels against the A-weighting curve defined in IEC 61672, at the sample rate of the
+ * micro:bit microphone and at common audio sample rates. Then changes the resolution of the filter bank part way
+ * through a stream, and checks the band holding the tone. Exits with a non-zero status if any check fails.
+ */
+
+#include "SoundLevelMeter.h"
+#include "HostTest.h"
+
+#define TEST_BUFFER_SAMPLES         256
+#define TEST_AMPLITUDE              29490.0
+#define TEST_WINDOW                 2000
+#define TEST_WINDOWS                3
+
+// Largest error permitted in the A-weighting curve, in dB, at the sample rate of the microphone and at other rates.
+#define TEST_A_TOLERANCE            0.2
+#define TEST_A_TOLERANCE_WIDE       0.7
+
+class Tone : public DataSource
+{
+    public:
+    double frequency;
+    double sampleRate;
+    long n;
+
+    Tone(double frequency, double sampleRate) : frequency(frequency), sampleRate(sampleRate), n(0) {}
+
+    virtual ManagedBuffer pull() override
+    {
+        ManagedBuffer b(TEST_BUFFER_SAMPLES * 2);
+        int16_t *data = (int16_t *) &b[0];
+
+        for (int i = 0; i < TEST_BUFFER_SAMPLES; i++, n++)
+            data[i] = (int16_t) lround(TEST_AMPLITUDE * sin(2.0 * M_PI * frequency * n / sampleRate));
+
+        return b;
+    }
+
+    virtual int getFormat() override
+    {
+        return DATASTREAM_FORMAT_16BIT_SIGNED;
+    }
+};
+
+// The A-weighting curve of IEC 61672, relative to 1kHz.
+static double aWeighting(double f)
+{
+    double f2 = f * f;
+    double r = 12194.217 * 12194.217 * f2 * f2 / ((f2 + 20.598997 * 20.598997) * sqrt((f2 + 107.65265 * 107.65265) * (f2 + 737.86223 * 737.86223)) * (f2 + 12194.217 * 12194.217));
+
+    return 20.0 * log10(r) + 2.0;
+}
+
+// Runs the meter for long enough to settle, and to publish the levels of the final window.
+static void run(SoundLevelMeter &meter, Tone &tone)
+{
+    while (tone.n < (long) (tone.sampleRate * TEST_WINDOW / 1000 * TEST_WINDOWS))
+        meter.pullRequest();
+}
+
+static void testAWeighting(double sampleRate, double tolerance)
+{
+    char label[32];
+    double worst = 0.0;
+    double worstFrequency = 0.0;
+
+    snprintf(label, sizeof(label), "A-weighting %.0fHz", sampleRate);
+
+    for (int k = -20; k < 14; k++)
+    {
+        double f = 1000.0 * pow(10.0, k / 10.0);
+
+        if (f > 0.45 * sampleRate)
+            break;
+
+        Tone tone(f, sampleRate);
+        SoundLevelMeter meter(tone, sampleRate, SoundLevelMeterBands::None);
+        meter.setWindow(TEST_WINDOW);
+        run(meter, tone);
+
+        double error = meter.getLeqA() - meter.getLeqZ() - aWeighting(f);
+
+        if (fabs(error) > fabs(worst))
+        {
+            worst = error;
+            worstFrequency = f;
+        }
+    }
+
+    printf("%-24s worst error %+.3fdB at %.0fHz\n", label, worst, worstFrequency);
+    check(fabs(worst) <= tolerance, label, "the A-weighted level departs from the IEC 61672 curve");
+}
+
+static void testSetBands()
+{
+    const char *label = "setBands";
+    double sampleRate = 10989.0;
+    Tone tone(1000.0, sampleRate);
+    SoundLevelMeter meter(tone, sampleRate, SoundLevelMeterBands::Octave);
+
+    meter.setWindow(TEST_WINDOW);
+    run(meter, tone);
+
+    // Change resolution part way through the stream, and let the new filter bank settle.
+    meter.setBands(SoundLevelMeterBands::ThirdOctave);
+    tone.n = 0;
+    run(meter, tone);
+
+    int best = 0;
+    for (int b = 1; b < meter.getBandCount(); b++)
+        if (meter.getBandLeq(b) > meter.getBandLeq(best))
+            best = b;
+
+    printf("%-24s loudest band %.0fHz at %.2fdB, unweighted %.2fdB\n", label, meter.getBandFrequency(best), meter.getBandLeq(best), meter.getLeqZ());
+    check(fabs(meter.getBandFrequency(best) - 1000.0) < 1.0, label, "the tone is not in the 1kHz band");
+    check(fabs(meter.getBandLeq(best) - meter.getLeqZ()) < 0.5, label, "the 1kHz band does not hold the level of the tone");
+}
+
+int main()
+{
+    testAWeighting(10989.0, TEST_A_TOLERANCE);
+    testAWeighting(16000.0, TEST_A_TOLERANCE_WIDE);
+    testAWeighting(22050.0, TEST_A_TOLERANCE_WIDE);
+    testAWeighting(44100.0, TEST_A_TOLERANCE_WIDE);
+    testSetBands();
+
+    return failures ? 1 : 0;
+}
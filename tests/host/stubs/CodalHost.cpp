@@ -0,0 +1,440 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#include "CodalHost.h"
+#include <ucontext.h>
+#include <vector>
+
+#define HOST_FIBER_STACK_SIZE       (256 * 1024)
+#define HOST_FIBER_MAX_PASSES       100000
+
+#define HOST_FIBER_RUNNABLE         0
+#define HOST_FIBER_WAIT_EVENT       1
+#define HOST_FIBER_SLEEP            2
+#define HOST_FIBER_WAIT_LOCK        3
+#define HOST_FIBER_DONE             4
+
+struct HostFiber
+{
+    ucontext_t context;
+    void *stack;
+    void (*entry)(void *);
+    void (*entry0)(void);
+    void (*completion)(void *);
+    void (*completion0)(void);
+    void *param;
+    int state;
+    uint16_t id;
+    uint16_t value;
+    uint64_t wakeTime;
+    FiberLock *lock;
+    uint32_t lockOrder;
+};
+
+struct HostTimerEvent
+{
+    uint64_t time;
+    uint16_t id;
+    uint16_t value;
+};
+
+static std::vector<HostFiber *> fibers;
+static std::vector<HostTimerEvent> timerEvents;
+static HostFiber *runningFiber = NULL;
+static HostFiber mainFiber;
+
+Fiber *codal::currentFiber = (Fiber *) &mainFiber;
+static ucontext_t mainContext;
+static uint64_t hostTime = 0;
+static uint32_t eventCount = 0;
+static uint32_t lockOrder = 0;
+static void (*eventHandler)(Event) = NULL;
+
+ManagedString ManagedString::EmptyString;
+
+static int read8u(uint8_t *p) { return *p; }
+static int read8s(uint8_t *p) { return (int8_t) *p; }
+static int read16u(uint8_t *p) { return *(uint16_t *) p; }
+static int read16s(uint8_t *p) { return *(int16_t *) p; }
+static void write8(uint8_t *p, int v) { *p = v; }
+static void write16(uint8_t *p, int v) { *(int16_t *) p = v; }
+
+SampleReadFn StreamNormalizer::readSample[9] = {read8u, read8u, read8s, read16u, read16s, read16s, read16s, read16s, read16s};
+SampleWriteFn StreamNormalizer::writeSample[9] = {write8, write8, write8, write16, write16, write16, write16, write16, write16};
+
+/**
+ * Returns control from the running fiber to the host scheduler.
+ */
+static void yieldFiber()
+{
+    HostFiber *f = runningFiber;
+    swapcontext(&f->context, &mainContext);
+}
+
+static void fiberEntry()
+{
+    HostFiber *f = runningFiber;
+
+    if (f->entry)
+        f->entry(f->param);
+    else
+        f->entry0();
+
+    if (f->completion)
+        f->completion(f->param);
+    else if (f->completion0)
+        f->completion0();
+
+    f->state = HOST_FIBER_DONE;
+}
+
+static void *launchFiber(HostFiber *f)
+{
+    f->stack = malloc(HOST_FIBER_STACK_SIZE);
+    f->state = HOST_FIBER_RUNNABLE;
+    f->lock = NULL;
+
+    getcontext(&f->context);
+    f->context.uc_stack.ss_sp = f->stack;
+    f->context.uc_stack.ss_size = HOST_FIBER_STACK_SIZE;
+    f->context.uc_link = &mainContext;
+    makecontext(&f->context, fiberEntry, 0);
+
+    fibers.push_back(f);
+    return f;
+}
+
+void *codal::create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *))
+{
+    HostFiber *f = new HostFiber();
+    f->entry = entry_fn;
+    f->param = param;
+    f->completion = completion_fn;
+    return launchFiber(f);
+}
+
+void *codal::create_fiber(void (*entry_fn)(void), void (*completion_fn)(void))
+{
+    HostFiber *f = new HostFiber();
+    f->entry0 = entry_fn;
+    f->completion0 = completion_fn;
+    return launchFiber(f);
+}
+
+int codal::fiber_scheduler_running()
+{
+    return 1;
+}
+
+void codal::schedule()
+{
+    if (runningFiber)
+        yieldFiber();
+    else
+        host_run_fibers();
+}
+
+void codal::fiber_sleep(unsigned long t)
+{
+    // The main context has nothing to wait for but time itself.
+    if (runningFiber == NULL)
+    {
+        host_advance_time((uint64_t) t * 1000);
+        return;
+    }
+
+    runningFiber->wakeTime = hostTime + (uint64_t) t * 1000;
+    runningFiber->state = HOST_FIBER_SLEEP;
+    yieldFiber();
+}
+
+int codal::fiber_wait_for_event(uint16_t id, uint16_t value)
+{
+    if (runningFiber == NULL)
+    {
+        host_run_fibers();
+        return DEVICE_OK;
+    }
+
+    runningFiber->id = id;
+    runningFiber->value = value;
+    runningFiber->state = HOST_FIBER_WAIT_EVENT;
+    yieldFiber();
+
+    return DEVICE_OK;
+}
+
+int codal::fiber_wake_on_event(uint16_t id, uint16_t value)
+{
+    if (runningFiber == NULL)
+        return DEVICE_NOT_SUPPORTED;
+
+    runningFiber->id = id;
+    runningFiber->value = value;
+    runningFiber->state = HOST_FIBER_WAIT_EVENT;
+
+    return DEVICE_OK;
+}
+
+CODAL_TIMESTAMP codal::system_timer_current_time()
+{
+    return hostTime / 1000;
+}
+
+CODAL_TIMESTAMP codal::system_timer_current_time_us()
+{
+    return hostTime;
+}
+
+int codal::system_timer_event_after(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, uint32_t)
+{
+    HostTimerEvent e;
+    e.time = hostTime + period * 1000;
+    e.id = id;
+    e.value = value;
+    timerEvents.push_back(e);
+
+    return DEVICE_OK;
+}
+
+void FiberLock::wait()
+{
+    while (locked)
+    {
+        if (runningFiber == NULL)
+        {
+            // Only a fiber can release the lock, so give them the chance to.
+            host_run_fibers();
+
+            if (locked)
+            {
+                fprintf(stderr, "FiberLock: deadlock in main context\n");
+                abort();
+            }
+        }
+        else
+        {
+            runningFiber->lock = this;
+            runningFiber->lockOrder = lockOrder++;
+            runningFiber->state = HOST_FIBER_WAIT_LOCK;
+            yieldFiber();
+
+            // notify() hands the lock to the fiber that has waited longest, as codal-core does.
+            if (runningFiber->lock == NULL)
+                return;
+
+            runningFiber->lock = NULL;
+        }
+    }
+
+    locked = true;
+}
+
+void FiberLock::notify()
+{
+    HostFiber *next = NULL;
+
+    for (HostFiber *f : fibers)
+        if (f->state == HOST_FIBER_WAIT_LOCK && f->lock == this && (next == NULL || f->lockOrder < next->lockOrder))
+            next = f;
+
+    if (next == NULL)
+    {
+        locked = false;
+        return;
+    }
+
+    next->state = HOST_FIBER_RUNNABLE;
+    next->lock = NULL;
+}
+
+void FiberLock::notifyAll()
+{
+    // Every waiter is woken to contend for the lock again.
+    locked = false;
+
+    for (HostFiber *f : fibers)
+        if (f->state == HOST_FIBER_WAIT_LOCK && f->lock == this)
+            f->state = HOST_FIBER_RUNNABLE;
+}
+
+int FiberLock::getWaitCount()
+{
+    int count = 0;
+
+    for (HostFiber *f : fibers)
+        if (f->state == HOST_FIBER_WAIT_LOCK && f->lock == this)
+            count++;
+
+    return count;
+}
+
+Event::Event(uint16_t source, uint16_t value, EventLaunchMode mode) : Event(source, value, system_timer_current_time_us(), mode)
+{
+}
+
+Event::Event(uint16_t source, uint16_t value, CODAL_TIMESTAMP timestamp, EventLaunchMode mode)
+{
+    this->source = source;
+    this->value = value;
+    this->timestamp = timestamp;
+
+    if (mode == CREATE_AND_FIRE)
+        fire();
+}
+
+void Event::fire()
+{
+    eventCount++;
+
+    if (eventHandler)
+        eventHandler(*this);
+
+    for (HostFiber *f : fibers)
+    {
+        if (f->state == HOST_FIBER_WAIT_EVENT && (f->id == DEVICE_ID_ANY || f->id == source) && (f->value == DEVICE_EVT_ANY || f->value == value))
+            f->state = HOST_FIBER_RUNNABLE;
+    }
+}
+
+int host_run_fibers()
+{
+    for (int pass = 0; pass < HOST_FIBER_MAX_PASSES; pass++)
+    {
+        bool ran = false;
+
+        // Fibers may be created as we go, so index rather than iterate.
+        for (size_t i = 0; i < fibers.size(); i++)
+        {
+            HostFiber *f = fibers[i];
+
+            if (f->state == HOST_FIBER_SLEEP && f->wakeTime <= hostTime)
+                f->state = HOST_FIBER_RUNNABLE;
+
+            if (f->state != HOST_FIBER_RUNNABLE)
+                continue;
+
+            runningFiber = f;
+            currentFiber = (Fiber *) f;
+            swapcontext(&mainContext, &f->context);
+            runningFiber = NULL;
+            currentFiber = (Fiber *) &mainFiber;
+            ran = true;
+        }
+
+        for (size_t i = 0; i < fibers.size();)
+        {
+            if (fibers[i]->state == HOST_FIBER_DONE)
+            {
+                free(fibers[i]->stack);
+                delete fibers[i];
+                fibers.erase(fibers.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        if (!ran)
+            break;
+    }
+
+    return fibers.size();
+}
+
+static void fireTimerEvents()
+{
+    for (size_t i = 0; i < timerEvents.size();)
+    {
+        if (timerEvents[i].time <= hostTime)
+        {
+            HostTimerEvent e = timerEvents[i];
+            timerEvents.erase(timerEvents.begin() + i);
+            Event(e.id, e.value);
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void host_advance_time(uint64_t us)
+{
+    uint64_t target = hostTime + us;
+
+    host_run_fibers();
+
+    // Step through each deadline in turn, so that periodic fibers run as often as they would on a device.
+    while (true)
+    {
+        uint64_t next = target;
+
+        for (HostFiber *f : fibers)
+            if (f->state == HOST_FIBER_SLEEP && f->wakeTime < next)
+                next = f->wakeTime;
+
+        for (HostTimerEvent &e : timerEvents)
+            if (e.time < next)
+                next = e.time;
+
+        hostTime = next;
+        fireTimerEvents();
+        host_run_fibers();
+
+        if (next == target)
+            break;
+    }
+}
+
+void host_set_time(uint64_t us)
+{
+    if (us > hostTime)
+        host_advance_time(us - hostTime);
+    else
+        hostTime = us;
+}
+
+void host_reset_fibers()
+{
+    for (HostFiber *f : fibers)
+    {
+        free(f->stack);
+        delete f;
+    }
+
+    fibers.clear();
+    timerEvents.clear();
+}
+
+void host_set_event_handler(void (*handler)(Event))
+{
+    eventHandler = handler;
+}
+
+uint32_t host_event_count()
+{
+    return eventCount;
+}
@@ -0,0 +1,349 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 Lancaster University.
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+/**
+ * A minimal host implementation of the parts of codal-core used by the components under test.
+ *
+ * Time only advances when a test calls host_advance_time(). Fibers are cooperative coroutines, run by
+ * host_run_fibers() until each has blocked on an event, a sleep or a FiberLock.
+ */
+
+#ifndef CODAL_HOST_H
+#define CODAL_HOST_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <new>
+
+#define CODAL_TIMESTAMP                         uint64_t
+
+#define DEVICE_OK                               0
+#define DEVICE_INVALID_PARAMETER                -1001
+#define DEVICE_NOT_SUPPORTED                    -1002
+#define DEVICE_NO_RESOURCES                     -1005
+#define DEVICE_BUSY                             -1006
+#define DEVICE_CANCELLED                        -1007
+#define DEVICE_I2C_ERROR                        -1010
+#define DEVICE_NO_DATA                          -1012
+#define DEVICE_INVALID_STATE                    -1015
+
+#define DEVICE_ID_ANY                           0
+#define DEVICE_EVT_ANY                          0
+#define DEVICE_ID_ACCELEROMETER                 5
+#define MICROBIT_ID_LOG                         44
+
+#define DEVICE_COMPONENT_RUNNING                0x1000
+#define DEVICE_COMPONENT_STATUS_SYSTEM_TICK     0x2000
+#define DEVICE_COMPONENT_STATUS_IDLE_TICK       0x4000
+#define MESSAGE_BUS_LISTENER_IMMEDIATE          0x10
+#define CODAL_TIMER_EVENT_FLAGS_WAKEUP          0x01
+
+#define CONFIG_ENABLED(X)                       (X == 1)
+#define CONFIG_DISABLED(X)                      (X != 1)
+
+#define DMESG(...)                              do {} while (0)
+#define DMESGN(...)                             do {} while (0)
+#define DMESGF(...)                             do {} while (0)
+
+#define DATASTREAM_FORMAT_UNKNOWN               0
+#define DATASTREAM_FORMAT_8BIT_UNSIGNED         1
+#define DATASTREAM_FORMAT_8BIT_SIGNED           2
+#define DATASTREAM_FORMAT_16BIT_UNSIGNED        3
+#define DATASTREAM_FORMAT_16BIT_SIGNED          4
+#define DATASTREAM_FORMAT_24BIT_UNSIGNED        5
+#define DATASTREAM_FORMAT_24BIT_SIGNED          6
+#define DATASTREAM_FORMAT_32BIT_UNSIGNED        7
+#define DATASTREAM_FORMAT_32BIT_SIGNED          8
+#define DATASTREAM_FORMAT_BYTES_PER_SAMPLE(x)   ((x+1)/2)
+
+namespace codal
+{
+    inline int min(int a, int b) { return a < b ? a : b; }
+    inline int max(int a, int b) { return a > b ? a : b; }
+    inline void memclr(void *a, size_t l) { memset(a, 0, l); }
+
+    CODAL_TIMESTAMP system_timer_current_time();
+    CODAL_TIMESTAMP system_timer_current_time_us();
+    int system_timer_event_after(CODAL_TIMESTAMP period, uint16_t id, uint16_t value, uint32_t flags = 0);
+
+    inline void target_disable_irq() {}
+    inline void target_enable_irq() {}
+    inline void target_wait(unsigned long) {}
+
+    // Identifies the running fiber, as in codal-core. The main context has a fiber of its own.
+    struct Fiber;
+    extern Fiber *currentFiber;
+
+    void *create_fiber(void (*entry_fn)(void *), void *param, void (*completion_fn)(void *) = NULL);
+    void *create_fiber(void (*entry_fn)(void), void (*completion_fn)(void) = NULL);
+    void fiber_sleep(unsigned long t);
+    int fiber_wait_for_event(uint16_t id, uint16_t value);
+    int fiber_wake_on_event(uint16_t id, uint16_t value);
+    int fiber_scheduler_running();
+    void schedule();
+
+    /**
+     * A non re-entrant mutual exclusion lock, as codal-core's FiberLock.
+     * Waiting on a held lock blocks the calling fiber until it is released.
+     */
+    class FiberLock
+    {
+        public:
+        bool locked;
+
+        FiberLock() : locked(false) {}
+        void wait();
+        void notify();
+        void notifyAll();
+        int getWaitCount();
+    };
+
+    enum EventLaunchMode { CREATE_ONLY, CREATE_AND_FIRE };
+
+    class Event
+    {
+        public:
+        uint16_t source;
+        uint16_t value;
+        CODAL_TIMESTAMP timestamp;
+
+        Event() : source(0), value(0), timestamp(0) {}
+        Event(uint16_t source, uint16_t value, EventLaunchMode mode = CREATE_AND_FIRE);
+        Event(uint16_t source, uint16_t value, CODAL_TIMESTAMP timestamp, EventLaunchMode mode = CREATE_AND_FIRE);
+        void fire();
+    };
+
+    enum deepSleepCallbackReason
+    {
+        deepSleepCallbackPrepare,
+        deepSleepCallbackBegin,
+        deepSleepCallbackBeginWithWakeUps,
+        deepSleepCallbackEnd,
+        deepSleepCallbackEndWithWakeUps,
+        deepSleepCallbackCountWakeUps,
+        deepSleepCallbackClearWakeUps
+    };
+
+    struct deepSleepCallbackData { int count; };
+
+    class CodalComponent
+    {
+        public:
+        uint16_t id;
+        uint16_t status;
+
+        CodalComponent() : id(0), status(0) {}
+        CodalComponent(uint16_t id, uint16_t status) : id(id), status(status) {}
+        virtual int deepSleepCallback(deepSleepCallbackReason, deepSleepCallbackData *) { return DEVICE_OK; }
+        virtual void periodicCallback() {}
+        virtual void idleCallback() {}
+        virtual int setSleep(bool) { return DEVICE_OK; }
+        virtual ~CodalComponent() {}
+    };
+
+    class ManagedBuffer
+    {
+        uint8_t *p;
+        int l;
+        int *rc;
+
+        public:
+        ManagedBuffer() : p(NULL), l(0), rc(NULL) {}
+        ManagedBuffer(int length) : l(length) { p = (uint8_t *) calloc(length ? length : 1, 1); rc = new int(1); }
+        ManagedBuffer(const uint8_t *data, int length) : ManagedBuffer(length) { memcpy(p, data, length); }
+        ManagedBuffer(const ManagedBuffer &o) : p(o.p), l(o.l), rc(o.rc) { if (rc) (*rc)++; }
+        ManagedBuffer& operator=(const ManagedBuffer &o) { if (o.rc) (*o.rc)++; release(); p = o.p; l = o.l; rc = o.rc; return *this; }
+        ~ManagedBuffer() { release(); }
+
+        void release() { if (rc && --(*rc) == 0) { free(p); delete rc; } rc = NULL; p = NULL; l = 0; }
+        uint8_t& operator[](int i) { return p[i]; }
+        uint8_t operator[](int i) const { return p[i]; }
+        int length() const { return l; }
+        uint8_t *getBytes() { return p; }
+        bool operator==(const ManagedBuffer &o) const { return p == o.p; }
+        bool operator!=(const ManagedBuffer &o) const { return p != o.p; }
+        int truncate(int n) { if (n < l) l = n; return DEVICE_OK; }
+        void shift(int n) { memmove(p, p + n, l - n); l -= n; }
+        void fill(uint8_t v, int offset = 0, int length = -1) { if (length < 0) length = l - offset; memset(p + offset, v, length); }
+    };
+
+    class ManagedString
+    {
+        char *s;
+
+        public:
+        static ManagedString EmptyString;
+
+        ManagedString() : s(strdup("")) {}
+        ManagedString(const char *c) : s(strdup(c ? c : "")) {}
+        ManagedString(const char *c, int16_t length) { s = (char *) malloc(length + 1); memcpy(s, c, length); s[length] = 0; }
+        ManagedString(int v) { char b[16]; snprintf(b, sizeof(b), "%d", v); s = strdup(b); }
+        ManagedString(const ManagedString &o) : s(strdup(o.s)) {}
+        ManagedString& operator=(const ManagedString &o) { char *n = strdup(o.s); free(s); s = n; return *this; }
+        ~ManagedString() { free(s); }
+
+        const char *toCharArray() const { return s; }
+        int16_t length() const { return strlen(s); }
+        bool operator==(const ManagedString &o) const { return strcmp(s, o.s) == 0; }
+        bool operator!=(const ManagedString &o) const { return strcmp(s, o.s) != 0; }
+        char charAt(int16_t i) const { return s[i]; }
+        ManagedString substring(int16_t start, int16_t length) const { return ManagedString(s + start, length); }
+
+        friend ManagedString operator+(const ManagedString &a, const ManagedString &b)
+        {
+            char *n = (char *) malloc(strlen(a.s) + strlen(b.s) + 1);
+            strcpy(n, a.s);
+            strcat(n, b.s);
+            ManagedString r(n);
+            free(n);
+            return r;
+        }
+    };
+
+    class DataSink
+    {
+        public:
+        virtual int pullRequest() { return DEVICE_OK; }
+        virtual ~DataSink() {}
+    };
+
+    class DataSource
+    {
+        public:
+        virtual ManagedBuffer pull() { return ManagedBuffer(); }
+        virtual void connect(DataSink &) {}
+        virtual void disconnect() {}
+        virtual int getFormat() { return DATASTREAM_FORMAT_UNKNOWN; }
+        virtual int setFormat(int) { return DEVICE_OK; }
+        virtual ~DataSource() {}
+    };
+
+    class DataStream : public DataSource, public DataSink
+    {
+        public:
+        DataStream(DataSource &) {}
+    };
+
+    typedef int (*SampleReadFn)(uint8_t *);
+    typedef void (*SampleWriteFn)(uint8_t *, int);
+
+    class StreamNormalizer
+    {
+        public:
+        static SampleReadFn readSample[9];
+        static SampleWriteFn writeSample[9];
+    };
+
+    class NVMController
+    {
+        public:
+        virtual int read(uint32_t* dest, uint32_t source, uint32_t size) = 0;
+        virtual int write(uint32_t dest, uint32_t* source, uint32_t size) = 0;
+        virtual int erase(uint32_t page) = 0;
+        virtual uint32_t getFlashStart() = 0;
+        virtual uint32_t getFlashEnd() = 0;
+        virtual uint32_t getPageSize() = 0;
+        virtual uint32_t getFlashSize() = 0;
+        virtual ~NVMController() {}
+    };
+
+    class NRF52Serial
+    {
+        public:
+        int send(uint8_t *, int length) { return length; }
+    };
+
+    struct MicroBitUSBFlashConfig
+    {
+        ManagedString fileName;
+        int fileSize;
+        bool visible;
+    };
+
+    class MicroBitUSBFlashManager : public NVMController
+    {
+        public:
+        virtual int setConfiguration(MicroBitUSBFlashConfig, bool) { return DEVICE_OK; }
+        virtual int remount() { return DEVICE_OK; }
+    };
+
+    class MicroBitAudio
+    {
+        public:
+        static void requestActivation() {}
+    };
+
+    // The host has no file system, so files can never be opened. Components are tested against an NVMController instead.
+    class MicroBitFile
+    {
+        public:
+        MicroBitFile(ManagedString) {}
+        int setPosition(int) { return DEVICE_NOT_SUPPORTED; }
+        int write(const char *, int) { return DEVICE_NOT_SUPPORTED; }
+        int remove() { return DEVICE_NOT_SUPPORTED; }
+        bool isValid() { return false; }
+        int close() { return DEVICE_OK; }
+    };
+}
+
+/**
+ * Advances the host clock, waking any fibers whose sleep has expired.
+ * @param us The number of microseconds to advance by.
+ */
+void host_advance_time(uint64_t us);
+
+/**
+ * Sets the host clock. Time may not move backwards while fibers are sleeping.
+ * @param us The new time, in microseconds.
+ */
+void host_set_time(uint64_t us);
+
+/**
+ * Runs every fiber that is able to run, until all have blocked or completed.
+ * @return the number of fibers still in existence.
+ */
+int host_run_fibers();
+
+/**
+ * Discards every fiber and pending timer event, e.g. before the components they refer to are destroyed.
+ */
+void host_reset_fibers();
+
+/**
+ * Registers a function to be called with every event fired.
+ * @param handler The function to call, or NULL.
+ */
+void host_set_event_handler(void (*handler)(codal::Event));
+
+/**
+ * Determines the number of events fired since the program started.
+ */
+uint32_t host_event_count();
+
+using namespace codal;
+
+#endif
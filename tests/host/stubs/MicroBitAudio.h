@@ -0,0 +1 @@
+#include "CodalHost.h"